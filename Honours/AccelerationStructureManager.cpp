@@ -29,29 +29,47 @@ AccelerationStructureManager::AccelerationStructureManager(DX::DeviceResources*
 	instance_desc_buffer = std::make_unique<UploadBuffer<D3D12_RAYTRACING_INSTANCE_DESC>>(device, 1, false);
 }
 
+// Sets the number of AABBs the BLAS is built from. They must already be in the buffer, so it's only grown if they don't fit.
 void AccelerationStructureManager::AllocateAABBBuffer(int new_aabb_count)
 {
-	if (aabb_buffer_ == nullptr || new_aabb_count != aabb_count_) {
-		requires_rebuild_ = true;
+	if (aabb_capacity_.Grow(new_aabb_count)) {
+		AllocateAABBs();
 	}
-	else {
-		requires_rebuild_ = false;
-	}
-
-	// Release and reallocate buffer for AABBs if required number has increased
-	if (new_aabb_count > max_aabb_count_) {
-		max_aabb_count_ = new_aabb_count;
 
-		ID3D12Device5* device = device_resources_->GetD3DDevice();
-		ID3D12GraphicsCommandList4* command_list = device_resources_->GetCommandList();
+	requires_rebuild_ = new_aabb_count != aabb_count_ || aabb_buffer_reallocated_;
+	aabb_buffer_reallocated_ = false;
 
-		aabb_buffer_.Reset();
-		Utilities::AllocateDefaultBuffer(device, max_aabb_count_ * sizeof(D3D12_RAYTRACING_AABB), &aabb_buffer_, D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+	aabb_count_ = new_aabb_count;
+}
 
-		Profiler::UpdateCurrentAABBsSize(max_aabb_count_ * sizeof(D3D12_RAYTRACING_AABB));
+// Makes room for AABBs to be written before their final count is known, without changing the count. Called once a frame,
+// the buffer is grown or shrunk as the capacity policy decides.
+void AccelerationStructureManager::ReserveAABBBuffer(int aabb_capacity)
+{
+	if (aabb_capacity_.Update(aabb_capacity)) {
+		AllocateAABBs();
 	}
+}
 
-	aabb_count_ = new_aabb_count;
+// Release and reallocate buffer for AABBs at the policy's capacity
+void AccelerationStructureManager::AllocateAABBs()
+{
+	ID3D12Device5* device = device_resources_->GetD3DDevice();
+
+	aabb_buffer_.Reset();
+	Utilities::AllocateDefaultBuffer(device, aabb_capacity_.GetCapacityBytes(), &aabb_buffer_, D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+	aabb_buffer_reallocated_ = true;
+
+	Profiler::UpdateCurrentAABBsSize(aabb_capacity_.GetCapacityBytes());
+}
+
+// Reallocations and unused space of the AABB buffer, BLAS and scratch
+CapacityStats AccelerationStructureManager::GetCapacityStats()
+{
+	CapacityStats stats = aabb_capacity_.GetStats();
+	stats += blas_capacity_.GetStats();
+	stats += scratch_capacity_.GetStats();
+	return stats;
 }
 
 // Updates or rebuilds acceleration structure
@@ -62,9 +80,13 @@ void AccelerationStructureManager::UpdateStructure(Profiler* profiler)
 		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS blas_inputs;
 		CalculatePreBuildInfo(blas_inputs, blas_prebuild_info);
 
+		// Sized every frame, not just on rebuilds, so the capacity policies' shrink window counts frames
+		// A reallocated BLAS has nothing to update from, so must be rebuilt
+		const bool blas_reallocated = UpdateCapacities(blas_prebuild_info);
+
 		// Fully rebuild if needed, otherwise update with new geometry
-		if (requires_rebuild_) {
-			RebuildStructure(blas_inputs, blas_prebuild_info, profiler);
+		if (requires_rebuild_ || blas_reallocated) {
+			BuildStructures(blas_inputs, blas_prebuild_info, profiler);
 		}
 		else {
 			BuildStructures(blas_inputs, blas_prebuild_info, profiler, true);
@@ -91,20 +113,21 @@ void AccelerationStructureManager::CalculatePreBuildInfo(D3D12_BUILD_RAYTRACING_
 	device_resources_->GetD3DDevice()->GetRaytracingAccelerationStructurePrebuildInfo(&blas_inputs, &blas_prebuild_info);
 }
 
-void AccelerationStructureManager::RebuildStructure(D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& blas_inputs, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO& blas_prebuild_info, Profiler* profiler)
+// Reallocates the BLAS and scratch as their capacity policies decide. Returns whether the BLAS was reallocated.
+bool AccelerationStructureManager::UpdateCapacities(const D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO& blas_prebuild_info)
 {
 	ID3D12Device5* device = device_resources_->GetD3DDevice();
 
-	// If required BLAS size has increased, will need to reallocate
-	UINT64 current_blas_width = bottom_acceleration_structure_ ? bottom_acceleration_structure_->GetDesc().Width : 0;
-	if (blas_prebuild_info.ResultDataMaxSizeInBytes > current_blas_width) {
+	// If required BLAS size has outgrown the BLAS, or has stayed well below it, will need to reallocate
+	const bool blas_reallocated = blas_capacity_.Update(blas_prebuild_info.ResultDataMaxSizeInBytes);
+	if (blas_reallocated) {
 		// Release previous resource
 		bottom_acceleration_structure_.Reset();
 
 		// Allocate resource for BLAS
-		Utilities::AllocateDefaultBuffer(device, blas_prebuild_info.ResultDataMaxSizeInBytes, &bottom_acceleration_structure_, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+		Utilities::AllocateDefaultBuffer(device, blas_capacity_.GetCapacity(), &bottom_acceleration_structure_, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 
-		Profiler::UpdateCurrentBLASSize(blas_prebuild_info.ResultDataMaxSizeInBytes);
+		Profiler::UpdateCurrentBLASSize(blas_capacity_.GetCapacity());
 
 		// Update the instance desc for the bottom-level acceleration structure.
 		D3D12_RAYTRACING_INSTANCE_DESC instanceDesc = {};
@@ -113,17 +136,16 @@ void AccelerationStructureManager::RebuildStructure(D3D12_BUILD_RAYTRACING_ACCEL
 		instanceDesc.AccelerationStructure = bottom_acceleration_structure_->GetGPUVirtualAddress();
 		instance_desc_buffer->CopyData(0, instanceDesc);
 	}
-	// If required scratch size has increased, will need to reallocate
-	UINT64 current_scratch_width = scratch_resource_ ? scratch_resource_->GetDesc().Width : 0;
-	if (blas_prebuild_info.ScratchDataSizeInBytes > current_scratch_width) {
+	// Likewise for the scratch, which is shared by both builds
+	if (scratch_capacity_.Update(max(top_level_prebuild_info_.ScratchDataSizeInBytes, blas_prebuild_info.ScratchDataSizeInBytes))) {
 		// Release previous resource
 		scratch_resource_.Reset();
 
 		// Allocate resource for scratch
-		Utilities::AllocateDefaultBuffer(device, max(top_level_prebuild_info_.ScratchDataSizeInBytes, blas_prebuild_info.ScratchDataSizeInBytes), &scratch_resource_, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+		Utilities::AllocateDefaultBuffer(device, scratch_capacity_.GetCapacity(), &scratch_resource_, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 	}
 
-	BuildStructures(blas_inputs, blas_prebuild_info, profiler);
+	return blas_reallocated;
 }
 
 void AccelerationStructureManager::BuildStructures(D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& blas_inputs, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO& blas_prebuild_info, Profiler* profiler, bool update)
@@ -4,6 +4,7 @@
 #include "DeviceResources.h"
 #include "UploadBuffer.h"
 #include "Profiler.h"
+#include "CapacityPolicy.h"
 
 using Microsoft::WRL::ComPtr;
 
@@ -12,16 +13,19 @@ class AccelerationStructureManager
 public:
     AccelerationStructureManager(DX::DeviceResources* device_resources);
     void AllocateAABBBuffer(int new_aabb_count);
+    void ReserveAABBBuffer(int aabb_capacity);
     ID3D12Resource* GetAABBBuffer() { return aabb_buffer_.Get(); }
 
     void UpdateStructure(Profiler* profiler);
     ID3D12Resource* GetTLAS() { return top_acceleration_structure_.Get(); }
     ID3D12Resource* GetBLAS() { return bottom_acceleration_structure_.Get(); }
     bool IsStructureBuilt() { return structure_built; }
+    CapacityStats GetCapacityStats();
 
 private:
+    void AllocateAABBs();
     void CalculatePreBuildInfo(D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& blas_inputs, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO& blas_prebuild_info);
-    void RebuildStructure(D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& blas_inputs, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO& blas_prebuild_info, Profiler* profiler);
+    bool UpdateCapacities(const D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO& blas_prebuild_info);
     void BuildStructures(D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& blas_inputs, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO& blas_prebuild_info, Profiler* profiler, bool update = false);
 
     // Acceleration buffers
@@ -38,10 +42,15 @@ private:
     // Buffer for AABBs used for BLAS construction
     ComPtr<ID3D12Resource> aabb_buffer_;
 
+    // When the AABB buffer, BLAS and scratch are reallocated, see CapacityPolicy.h. The BLAS and scratch are sized in bytes.
+    CapacityPolicy aabb_capacity_ = CapacityPolicy(sizeof(D3D12_RAYTRACING_AABB));
+    CapacityPolicy blas_capacity_;
+    CapacityPolicy scratch_capacity_;
+
     // Misc
     unsigned int aabb_count_ = 0;
-    unsigned int max_aabb_count_ = 0;
     bool requires_rebuild_ = false;
+    bool aabb_buffer_reallocated_ = false; // The BLAS must be rebuilt, rather than updated, from the new buffer
     bool structure_built = false;
 
     DX::DeviceResources* device_resources_;
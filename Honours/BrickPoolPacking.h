@@ -0,0 +1,117 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Shared by the app and the CPU backend, so it only depends on the standard library
+// (std::min/max are parenthesised throughout to dodge the windows.h macros)
+
+// D3D12_REQ_TEXTURE3D_U_V_OR_W_DIMENSION
+#define BRICK_POOL_MAX_TEXTURE_DIMENSION 2048
+#define BRICK_POOL_TILE_BYTES 65536
+#define BRICK_POOL_MAX_TEXTURES 2
+
+struct BrickPoolPackingSettings {
+	uint32_t voxels_per_axis_per_brick_ = 10;
+	uint32_t max_texture_dimension_ = BRICK_POOL_MAX_TEXTURE_DIMENSION;	// Voxels along each axis of a page
+	uint32_t texel_bytes_[BRICK_POOL_MAX_TEXTURES] = { 2, 0 };				// Each texture sharing the dimensions, 0 for none
+};
+
+struct BrickPoolPacking {
+	uint32_t dimensions_[3] = { 0, 0, 0 };	// Bricks along each axis of a page
+	uint32_t pages_ = 0;					// Textures of those dimensions, when one can't hold every brick
+	uint64_t slots_ = 0;					// Bricks the pages hold, at least as many as were asked for
+	uint64_t bytes_ = 0;					// Of every texture, each padded to whole 64KB tiles
+
+	inline uint64_t SlotsPerPage() const { return (uint64_t)dimensions_[0] * dimensions_[1] * dimensions_[2]; }
+};
+
+// Voxels along each axis of the 64KB tile a 3D texture of the texel size is laid out in (D3D12's standard swizzle). A
+// texture takes whole tiles, so a brick pool whose voxels overhang a tile boundary pays for the rest of the tile.
+inline void GetBrickPoolTileShape(uint32_t texel_bytes, uint32_t shape[3])
+{
+	switch (texel_bytes) {
+	case 1: shape[0] = 64; shape[1] = 32; shape[2] = 32; break;
+	case 2: shape[0] = 32; shape[1] = 32; shape[2] = 32; break;
+	case 4: shape[0] = 32; shape[1] = 32; shape[2] = 16; break;
+	case 8: shape[0] = 32; shape[1] = 16; shape[2] = 16; break;
+	default: shape[0] = 16; shape[1] = 16; shape[2] = 16; break;
+	}
+}
+
+// Bytes of one page of the dimensions, over every texture, rounded up to whole tiles
+inline uint64_t GetBrickPoolPageBytes(const uint32_t dimensions[3], const BrickPoolPackingSettings& settings)
+{
+	uint64_t bytes = 0;
+	for (uint32_t texel_bytes : settings.texel_bytes_) {
+		if (texel_bytes == 0) {
+			continue;
+		}
+
+		uint32_t shape[3];
+		GetBrickPoolTileShape(texel_bytes, shape);
+		uint64_t tiles = 1;
+		for (int axis = 0; axis < 3; axis++) {
+			uint64_t voxels = (uint64_t)dimensions[axis] * settings.voxels_per_axis_per_brick_;
+			tiles *= (voxels + shape[axis] - 1) / shape[axis];
+		}
+		bytes += tiles * BRICK_POOL_TILE_BYTES;
+	}
+	return bytes;
+}
+
+// Picks the brick pool's dimensions for at least the given bricks. Every x and y within the per axis limit is tried, z
+// being the fewest that fit the bricks, keeping the dimensions that take the fewest tiles. Ties go to the fewest slots,
+// then the most cube-like, as those bricks' neighbours are closer in memory. A cube root guess can leave most of a row
+// unused for awkward counts, or run past the limit. Bricks that don't fit one texture are split evenly over pages.
+// This is O(limit^2) at worst, fine for a reallocation but not every frame.
+inline BrickPoolPacking PackBrickPool(uint64_t bricks, const BrickPoolPackingSettings& settings = BrickPoolPackingSettings())
+{
+	BrickPoolPacking packing;
+	const uint64_t max_axis = (std::max)(settings.max_texture_dimension_ / settings.voxels_per_axis_per_brick_, 1u);
+	const uint64_t max_slots_per_page = max_axis * max_axis * max_axis;
+
+	bricks = (std::max)(bricks, (uint64_t)1); // Always a texture to bind
+	packing.pages_ = (uint32_t)((bricks + max_slots_per_page - 1) / max_slots_per_page);
+	const uint64_t page_bricks = (bricks + packing.pages_ - 1) / packing.pages_;
+
+	uint64_t best_bytes = UINT64_MAX, best_slots = UINT64_MAX, best_spread = UINT64_MAX;
+	for (uint64_t x = 1; x <= (std::min)(max_axis, page_bricks); x++) {
+		// Fewest rows that fit the bricks with the most layers, up to the rows that fit them in a single layer
+		uint64_t min_y = (std::max)((page_bricks + x * max_axis - 1) / (x * max_axis), (uint64_t)1);
+		uint64_t max_y = (std::min)(max_axis, (page_bricks + x - 1) / x);
+		for (uint64_t y = min_y; y <= max_y; y++) {
+			uint64_t z = (page_bricks + x * y - 1) / (x * y);
+			if (z > max_axis) {
+				continue;
+			}
+
+			uint32_t dimensions[3] = { (uint32_t)x, (uint32_t)y, (uint32_t)z };
+			uint64_t bytes = GetBrickPoolPageBytes(dimensions, settings);
+			uint64_t slots = x * y * z;
+			uint64_t spread = (std::max)((std::max)(x, y), z) - (std::min)((std::min)(x, y), z);
+			if (bytes < best_bytes || (bytes == best_bytes && (slots < best_slots || (slots == best_slots && spread < best_spread)))) {
+				best_bytes = bytes;
+				best_slots = slots;
+				best_spread = spread;
+				std::copy(dimensions, dimensions + 3, packing.dimensions_);
+			}
+		}
+	}
+
+	packing.slots_ = best_slots * packing.pages_;
+	packing.bytes_ = best_bytes * packing.pages_;
+	return packing;
+}
+
+// Page and brick coordinates within it of a brick pool slot, as BrickIndexToVoxelPosition
+inline void GetBrickPoolSlotLocation(const BrickPoolPacking& packing, uint64_t slot, uint32_t& page, uint32_t brick[3])
+{
+	uint64_t slots_per_page = packing.SlotsPerPage();
+	uint64_t page_slot = slot % slots_per_page;
+	uint64_t bricks_per_z = (uint64_t)packing.dimensions_[0] * packing.dimensions_[1];
+	page = (uint32_t)(slot / slots_per_page);
+	brick[0] = (uint32_t)(page_slot % packing.dimensions_[0]);
+	brick[1] = (uint32_t)((page_slot % bricks_per_z) / packing.dimensions_[0]);
+	brick[2] = (uint32_t)(page_slot / bricks_per_z);
+}
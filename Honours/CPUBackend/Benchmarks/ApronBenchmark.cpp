@@ -0,0 +1,249 @@
+// Compares filling every voxel of each brick against calculating only the cores and copying the apron from neighbouring
+// bricks (see BrickApron.h), at texture resolutions 256 and 512 unless one is given. The voxels and culled bricks must match
+// the full fill with its aprons replaced by the core voxels at the same positions, found from the voxel coords rather than
+// the neighbouring brick lookups the apron copy makes. Where the full fill's own aprons differ from those, the voxel must be
+// over a cell's face, and searching the 27 cells around each side's cell must give each value (see FillBrickPoolApronFree).
+// Usage: ApronBenchmark (particle no.) (scene) (threads) (iterations) (texture resolution, 0 for 256 and 512)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include "../BrickApron.h"
+#include "../GridCommon.h"
+#include "../GridEngine.h"
+#include "../ParticleReorder.h"
+#include "../ParticleScenes.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+template<typename F>
+static double TimeMs(F&& func, int iterations)
+{
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        func();
+    }
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+}
+
+// The full fill with each apron voxel replaced by the full fill's core voxel centred on the same point, if a surface cell
+// holds one there. Returns the number of apron voxels that differ from the core voxel other than by which cells were
+// searched for particles.
+template<typename Grid, typename PositionSource>
+static uint64_t GetCoreVoxelPool(const Grid& grid, const PositionSource& particle_positions, const std::vector<uint32_t>& cell_offsets,
+    const BrickPool& full_pool, BrickPool& core_pool)
+{
+    const TestVariables& test_values = grid.GetTestValues();
+    const int bricks_per_axis = (int)BricksPerAxisPerCell(test_values);
+    const uint32_t bricks_per_cell = bricks_per_axis * bricks_per_axis * bricks_per_axis;
+    const int cell_voxels = bricks_per_axis * CORE_VOXELS_PER_AXIS_PER_BRICK;
+    const int world_voxels = test_values.cells_per_axis_ * cell_voxels;
+    const float voxel_size = 1.f / world_voxels;
+
+    std::vector<int64_t> cell_first_brick(grid.GetCellCounts().size(), -1);
+    for (uint32_t i = 0; i < grid.GetSurfaceCounts().surface_cells; i++) {
+        cell_first_brick[grid.GetSurfaceCellIndices()[i]] = (int64_t)i * bricks_per_cell;
+    }
+
+    core_pool = full_pool;
+    uint64_t unexplained = 0;
+    for (uint32_t brick_index = 0; brick_index < full_pool.bricks_count_; brick_index++) {
+        uint32_t cell_index = grid.GetSurfaceCellIndices()[brick_index / bricks_per_cell];
+        uint32_t intra_cell_brick_index = brick_index % bricks_per_cell;
+        Int3 cell_coords = grid.GetCellCoords(cell_index);
+        int brick_offset[3] = { (int)(intra_cell_brick_index % bricks_per_axis), (int)((intra_cell_brick_index / bricks_per_axis) % bricks_per_axis),
+            (int)(intra_cell_brick_index / (bricks_per_axis * bricks_per_axis)) };
+        int cell[3] = { cell_coords.x, cell_coords.y, cell_coords.z };
+        Float3 brick_min = GetBrickAABB(test_values, cell_coords, intra_cell_brick_index).min_;
+        int neighbouring_cells[27];
+        grid.GetNeighbourCells(cell_index, neighbouring_cells);
+
+        int voxel = 0;
+        for (int z = 0; z < VOXELS_PER_AXIS_PER_BRICK; z++) {
+            for (int y = 0; y < VOXELS_PER_AXIS_PER_BRICK; y++) {
+                for (int x = 0; x < VOXELS_PER_AXIS_PER_BRICK; x++, voxel++) {
+                    if ((GetApronDirection(x) | GetApronDirection(y) | GetApronDirection(z)) == 0) {
+                        continue;
+                    }
+
+                    // Voxel coords across the whole texture, the apron being voxel 0
+                    int offset[3] = { x, y, z };
+                    int world[3], core_cell[3], core_voxel[3], core_brick = 0;
+                    bool in_world = true;
+                    for (int axis = 2; axis >= 0; axis--) {
+                        world[axis] = cell[axis] * cell_voxels + brick_offset[axis] * CORE_VOXELS_PER_AXIS_PER_BRICK + offset[axis] - 1;
+                        in_world &= world[axis] >= 0 && world[axis] < world_voxels;
+                        core_cell[axis] = world[axis] / cell_voxels;
+                        core_brick = core_brick * bricks_per_axis + (world[axis] % cell_voxels) / CORE_VOXELS_PER_AXIS_PER_BRICK;
+                        core_voxel[axis] = world[axis] % CORE_VOXELS_PER_AXIS_PER_BRICK + 1;
+                    }
+                    if (!in_world) {
+                        continue;
+                    }
+                    int64_t first_brick = cell_first_brick[CellCoordsToIndex(test_values, core_cell[0], core_cell[1], core_cell[2])];
+                    if (first_brick < 0) {
+                        continue;
+                    }
+
+                    size_t index = (size_t)brick_index * VOXELS_PER_BRICK + voxel;
+                    int16_t& core_value = core_pool.voxels_[index];
+                    core_value = full_pool.voxels_[(size_t)(first_brick + core_brick) * VOXELS_PER_BRICK +
+                        (core_voxel[2] * VOXELS_PER_AXIS_PER_BRICK + core_voxel[1]) * VOXELS_PER_AXIS_PER_BRICK + core_voxel[0]];
+                    if (core_value == full_pool.voxels_[index]) {
+                        continue;
+                    }
+
+                    // Only over a cell's face, with each side's value coming from the cells around its own
+                    uint32_t core_cell_index = CellCoordsToIndex(test_values, core_cell[0], core_cell[1], core_cell[2]);
+                    if (core_cell_index == cell_index) {
+                        unexplained++;
+                        continue;
+                    }
+                    int core_neighbouring_cells[27];
+                    grid.GetNeighbourCells(core_cell_index, core_neighbouring_cells);
+                    Float3 position = GetBrickVoxelPosition(brick_min, voxel_size, x, y, z);
+                    auto search = [&](const int cells[27]) {
+                        return FloatToSnorm16(GetSignedDistanceNNS(position, cells, grid.GetCellCounts(), cell_offsets, particle_positions, test_values.particle_radius_));
+                    };
+                    unexplained += search(neighbouring_cells) != full_pool.voxels_[index] || search(core_neighbouring_cells) != core_value;
+                }
+            }
+        }
+    }
+    return unexplained;
+}
+
+static bool RunResolution(TestVariables test_values, unsigned int threads, int iterations)
+{
+    DeriveGridValues(test_values);
+
+    ThreadPool thread_pool(threads);
+    std::vector<ParticleData> particles;
+    GenerateParticles(test_values, particles, &thread_pool);
+    ComputePositions(test_values, 0.5f, particles, &thread_pool);
+
+    GridEngine grid(&thread_pool, test_values);
+    grid.ComputeGrid(particles);
+    std::vector<uint32_t> cell_offsets;
+    std::vector<ParticleData> particles_ordered;
+    ComputeCellOffsets(grid.GetCellCounts(), cell_offsets, &thread_pool);
+    ReorderParticles(particles, cell_offsets, particles_ordered, &thread_pool);
+    ParticleDataPositionSource positions{ particles_ordered };
+
+    BrickPool full_pool, apron_free_pool;
+    ApronFillStats stats;
+    double full_ms = TimeMs([&] { FillBrickPoolFrom(grid, positions, cell_offsets, full_pool, &thread_pool); }, iterations);
+    double apron_free_ms = TimeMs([&] { stats = FillBrickPoolApronFree(grid, positions, cell_offsets, apron_free_pool, &thread_pool); }, iterations);
+    CullEmptyBricks(full_pool, &thread_pool);
+    CullEmptyBricks(apron_free_pool, &thread_pool);
+
+    // Particle distances the full fill calculates, from each brick's candidate count
+    const uint32_t bricks_per_axis = BricksPerAxisPerCell(test_values);
+    const uint32_t bricks_per_cell = bricks_per_axis * bricks_per_axis * bricks_per_axis;
+    const float voxel_size = 1.f / (test_values.cells_per_axis_ * bricks_per_axis * CORE_VOXELS_PER_AXIS_PER_BRICK);
+    uint64_t full_evaluations = 0;
+    std::vector<Float3> candidates;
+    for (uint32_t brick_index = 0; brick_index < full_pool.bricks_count_; brick_index++) {
+        uint32_t cell_index = grid.GetSurfaceCellIndices()[brick_index / bricks_per_cell];
+        int neighbouring_cells[27];
+        grid.GetNeighbourCells(cell_index, neighbouring_cells);
+
+        AABB voxel_bounds = GetBrickVoxelBounds(GetBrickAABB(test_values, grid.GetCellCoords(cell_index), brick_index % bricks_per_cell).min_, voxel_size);
+        GatherBrickCandidates(voxel_bounds, neighbouring_cells, grid.GetCellCounts(), cell_offsets, positions, test_values.particle_radius_, candidates);
+        full_evaluations += (uint64_t)candidates.size() * VOXELS_PER_BRICK;
+    }
+
+    // The cores must match the full fill exactly, and the aprons the full fill's core voxels at the same positions
+    BrickPool core_pool;
+    uint64_t unexplained_voxels = GetCoreVoxelPool(grid, positions, cell_offsets, full_pool, core_pool);
+    CullEmptyBricks(core_pool, &thread_pool);
+
+    bool valid = true;
+    if (core_pool.voxels_ != apron_free_pool.voxels_) {
+        printf("Voxels differ from the full fill's cores!\n");
+        valid = false;
+    }
+    if (core_pool.surface_bricks_count_ != apron_free_pool.surface_bricks_count_ ||
+        !std::equal(core_pool.surface_brick_indices_.begin(), core_pool.surface_brick_indices_.begin() + core_pool.surface_bricks_count_, apron_free_pool.surface_brick_indices_.begin())) {
+        printf("Different bricks culled to the full fill's cores!\n");
+        valid = false;
+    }
+
+    // The full fill's own aprons over a cell's face search different cells from the core voxel there, each missing some
+    // particles in reach. Where one side found none, it's left at the empty value, a jump of up to the whole snorm range.
+    uint64_t seam_voxels = 0, empty_voxels = 0;
+    int max_seam_difference = 0;
+    for (size_t i = 0; i < full_pool.voxels_.size(); i++) {
+        int difference = std::abs(full_pool.voxels_[i] - core_pool.voxels_[i]);
+        if (difference > 0) {
+            seam_voxels++;
+            empty_voxels += full_pool.voxels_[i] == INT16_MAX || core_pool.voxels_[i] == INT16_MAX;
+            max_seam_difference = std::max(max_seam_difference, difference);
+        }
+    }
+    if (unexplained_voxels > 0) {
+        printf("%llu full fill apron voxels differ from the core voxel other than by the cells searched!\n", (unsigned long long)unexplained_voxels);
+        valid = false;
+    }
+
+    std::vector<uint8_t> full_culled(full_pool.bricks_count_, 1), core_culled(core_pool.bricks_count_, 1);
+    for (uint32_t i = 0; i < full_pool.surface_bricks_count_; i++) {
+        full_culled[full_pool.surface_brick_indices_[i]] = 0;
+    }
+    for (uint32_t i = 0; i < core_pool.surface_bricks_count_; i++) {
+        core_culled[core_pool.surface_brick_indices_[i]] = 0;
+    }
+    uint32_t culled_differently = 0;
+    for (uint32_t brick_index = 0; brick_index < full_pool.bricks_count_; brick_index++) {
+        culled_differently += full_culled[brick_index] != core_culled[brick_index];
+    }
+
+    const uint64_t bricks = full_pool.bricks_count_;
+    const uint64_t full_voxels = bricks * VOXELS_PER_BRICK;
+    const uint64_t core_voxels = bricks * CORE_VOXELS_PER_AXIS_PER_BRICK * CORE_VOXELS_PER_AXIS_PER_BRICK * CORE_VOXELS_PER_AXIS_PER_BRICK;
+    printf("Texture resolution %d: %llu bricks, %u after culling\n", test_values.texture_res_, (unsigned long long)bricks, full_pool.surface_bricks_count_);
+    printf("  %-22s %12s %16s %18s\n", "", "time (ms)", "voxels evaluated", "SDF evaluations");
+    printf("  %-22s %12.3f %16llu %18llu\n", "full fill", full_ms, (unsigned long long)full_voxels, (unsigned long long)full_evaluations);
+    printf("  %-22s %12.3f %16llu %18llu\n", "cores + apron copy", apron_free_ms, (unsigned long long)stats.evaluated_voxels_, (unsigned long long)stats.sdf_evaluations_);
+    printf("  voxels evaluated %.1f%% of the full fill, SDF evaluations %.1f%%, %.2fx faster\n",
+        full_voxels ? 100.0 * stats.evaluated_voxels_ / full_voxels : 0.0, full_evaluations ? 100.0 * stats.sdf_evaluations_ / full_evaluations : 0.0,
+        apron_free_ms > 0 ? full_ms / apron_free_ms : 0.0);
+    printf("  apron voxels copied %llu, calculated %llu (no neighbouring brick)\n",
+        (unsigned long long)stats.copied_voxels_, (unsigned long long)(stats.evaluated_voxels_ - core_voxels));
+    printf("  full fill apron voxels not matching the neighbouring core: %llu, by up to %d snorm steps, %llu empty on one side, %u bricks culled differently\n",
+        (unsigned long long)seam_voxels, max_seam_difference, (unsigned long long)empty_voxels, culled_differently);
+    printf("  storage %.2f MB with aprons, %.2f MB for cores alone (%.1f%% less, if the sampler fetched the apron from neighbours)\n",
+        full_voxels * sizeof(int16_t) / 1048576.0, core_voxels * sizeof(int16_t) / 1048576.0, full_voxels ? 100.0 * (full_voxels - core_voxels) / full_voxels : 0.0);
+
+    return valid;
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    test_values.num_particles_ = argc > 1 ? std::atoi(argv[1]) : 20000;
+    test_values.scene_ = argc > 2 ? (SceneType)std::atoi(argv[2]) : SceneWave;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    int iterations = argc > 4 ? std::atoi(argv[4]) : 3;
+    int texture_res = argc > 5 ? std::atoi(argv[5]) : 0;
+
+    printf("Apron benchmark: %d particles, scene %d, %u threads, %d iterations, kernel %s\n",
+        test_values.num_particles_, test_values.scene_, threads, iterations, GetBrickKernelName(GetBestBrickKernelIsa()));
+
+    bool valid = true;
+    for (int resolution : { 256, 512 }) {
+        if (texture_res == 0 || texture_res == resolution) {
+            test_values.texture_res_ = resolution;
+            valid &= RunResolution(test_values, threads, iterations);
+        }
+    }
+    if (texture_res != 0 && texture_res != 256 && texture_res != 512) {
+        test_values.texture_res_ = texture_res;
+        valid &= RunResolution(test_values, threads, iterations);
+    }
+
+    return valid ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+// Compares GridEngine's per-cell surface detection (CSDetectSurfaceBlocksMain + CSDetectSurfaceCellsMain) against the
+// bitmask engine, scalar and AVX2, in both cell indexing modes.
+// The bitmask engine's surface cells are checked against a serial evaluation of the same rule, and against GridEngine's:
+// they must match in every block GridEngine searched, and the rest must lie in the full blocks GridEngine culls.
+// Usage: BitmaskBenchmark (particle no.) (scene) (threads) (iterations) [particle radius]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "../BitmaskSurfaceEngine.h"
+#include "../GridCommon.h"
+#include "../GridEngine.h"
+#include "../ParticleScenes.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+template<typename F>
+static double TimeMs(F&& func)
+{
+    Clock::time_point start = Clock::now();
+    func();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Sorted copy of the valid part of a surface list, as the order depends on thread timing
+static std::vector<uint32_t> SortedList(const std::vector<uint32_t>& list, uint32_t count)
+{
+    std::vector<uint32_t> sorted(list.begin(), list.begin() + count);
+    std::sort(sorted.begin(), sorted.end());
+    return sorted;
+}
+
+// Serial per-cell version of the bitmask engine's rule: CSDetectSurfaceCellsMain's test on every block.
+// The cells of the blocks GridEngine searched are also copied to grid_blocks_cells, and the rest counted in
+// culled_blocks_cells, failing if any lie outside a full block away from the edge.
+static std::vector<uint32_t> ReferenceSurfaceCells(const GridEngine& grid, std::vector<uint32_t>& grid_blocks_cells, size_t& culled_blocks_cells, bool& valid)
+{
+    const TestVariables& test_values = grid.GetTestValues();
+    const std::vector<uint32_t>& cell_counts = grid.GetCellCounts();
+    std::vector<uint32_t> surface_cells;
+
+    std::vector<uint8_t> searched_blocks(test_values.num_blocks_, 0);
+    for (uint32_t i = 0; i < grid.GetSurfaceCounts().surface_blocks; i++) {
+        searched_blocks[grid.GetSurfaceBlockIndices()[i]] = 1;
+    }
+    grid_blocks_cells.clear();
+    culled_blocks_cells = 0;
+
+    for (uint32_t block_index = 0; block_index < (uint32_t)test_values.num_blocks_; block_index++) {
+        bool has_empty_cell = false;
+        for (uint32_t i = 0; i < NUM_CELLS_PER_BLOCK; i++) {
+            UInt3 offset = { i % 4, (i / 4) % 4, i / 16 };
+            has_empty_cell |= cell_counts[BlockIndexToCellIndex(test_values, block_index, offset)] == 0;
+        }
+        bool culled = !has_empty_cell && !IsBlockAtEdge(test_values, block_index);
+
+        for (uint32_t i = 0; i < NUM_CELLS_PER_BLOCK; i++) {
+            UInt3 offset = { i % 4, (i / 4) % 4, i / 16 };
+            uint32_t cell_index = BlockIndexToCellIndex(test_values, block_index, offset);
+            uint32_t particle_count = cell_counts[cell_index];
+            bool is_surface = particle_count > 0 && particle_count < CELL_MAX_PARTICLE_COUNT;
+
+            int neighbouring_cells[27];
+            grid.GetNeighbourCells(cell_index, neighbouring_cells);
+            for (int neighbour_index : neighbouring_cells) {
+                is_surface |= neighbour_index > -1 && ((particle_count == 0) != (cell_counts[neighbour_index] == 0));
+            }
+            if (!is_surface) {
+                continue;
+            }
+
+            surface_cells.push_back(cell_index);
+            if (searched_blocks[block_index]) {
+                grid_blocks_cells.push_back(cell_index);
+            }
+            else if (culled) {
+                culled_blocks_cells++;
+            }
+            else {
+                valid = false;
+            }
+        }
+    }
+
+    std::sort(surface_cells.begin(), surface_cells.end());
+    std::sort(grid_blocks_cells.begin(), grid_blocks_cells.end());
+    return surface_cells;
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables base_values = {};
+    base_values.num_particles_ = argc > 1 ? std::atoi(argv[1]) : 100000;
+    base_values.scene_ = argc > 2 ? (SceneType)std::atoi(argv[2]) : SceneWave;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    int iterations = argc > 4 ? std::atoi(argv[4]) : 20;
+    base_values.particle_radius_ = argc > 5 ? (float)std::atof(argv[5]) : 0;
+    base_values.texture_res_ = 256;
+
+    ThreadPool thread_pool(threads);
+    printf("Bitmask surface detection benchmark: %d particles, scene %d, %u threads, %d iterations, AVX2 %s\n",
+        base_values.num_particles_, base_values.scene_, threads, iterations, BitmaskSurfaceEngine::HasSimd() ? "on" : "off");
+
+    bool valid = true;
+    for (CellIndexing cell_indexing : { CellIndexingLinear, CellIndexingMorton }) {
+        TestVariables test_values = base_values;
+        test_values.cell_indexing_ = cell_indexing;
+        DeriveGridValues(test_values);
+
+        std::vector<ParticleData> particles;
+        GenerateParticles(test_values, particles, &thread_pool);
+        ComputePositions(test_values, 0.5f, particles, &thread_pool);
+
+        // Flagged, so GridEngine's block counts give the blocks' true occupancy and it culls exactly the full blocks
+        GridEngine grid(&thread_pool, test_values);
+        grid.SetBlockNeighbourRule(BlockNeighbourFlagged);
+        BitmaskSurfaceEngine bitmask(&thread_pool, test_values);
+
+        // Per-cell detection, as GridEngine::ComputeGrid runs it
+        double per_cell_ms = 0;
+        for (int i = 0; i < iterations; i++) {
+            grid.ClearGridCounts();
+            grid.BuildGrid(particles);
+            per_cell_ms += TimeMs([&] {
+                grid.DetectSurfaceBlocks();
+                grid.DetectSurfaceCells();
+            });
+        }
+
+        printf("\n%s indexing, %d^3 cells, %u surface cells (GridEngine)\n", cell_indexing == CellIndexingMorton ? "Morton" : "Linear",
+            test_values.cells_per_axis_, grid.GetSurfaceCounts().surface_cells);
+        printf("%-10s %12s %12s %12s %12s %10s\n", "path", "total (ms)", "masks (ms)", "dilate (ms)", "extract (ms)", "speedup");
+        printf("%-10s %12.3f %12s %12s %12s %10s\n", "per-cell", per_cell_ms / iterations, "", "", "", "1.00x");
+
+        std::vector<uint32_t> grid_blocks_cells;
+        size_t culled_blocks_cells = 0;
+        bool grid_valid = true;
+        std::vector<uint32_t> reference = ReferenceSurfaceCells(grid, grid_blocks_cells, culled_blocks_cells, grid_valid);
+        for (bool use_simd : { false, true }) {
+            if (use_simd && !BitmaskSurfaceEngine::HasSimd()) {
+                continue;
+            }
+            bitmask.SetUseSimd(use_simd);
+
+            double masks_ms = 0, dilate_ms = 0, extract_ms = 0;
+            for (int i = 0; i < iterations; i++) {
+                masks_ms += TimeMs([&] { bitmask.BuildMasks(grid.GetCellCounts()); });
+                dilate_ms += TimeMs([&] { bitmask.DilateMasks(); });
+                extract_ms += TimeMs([&] { bitmask.ExtractSurfaceCells(); });
+            }
+            double total_ms = masks_ms + dilate_ms + extract_ms;
+            printf("%-10s %12.3f %12.3f %12.3f %12.3f %9.2fx\n", use_simd ? "avx2" : "scalar", total_ms / iterations,
+                masks_ms / iterations, dilate_ms / iterations, extract_ms / iterations, per_cell_ms / total_ms);
+
+            std::vector<uint32_t> surface_cells = SortedList(bitmask.GetSurfaceCellIndices(), bitmask.GetSurfaceCellCount());
+            if (surface_cells != reference) {
+                printf("%s surface cells differ from the per-cell reference!\n", use_simd ? "AVX2" : "Scalar");
+                valid = false;
+            }
+        }
+
+        // The masks also search the full blocks GridEngine culls, see BitmaskSurfaceEngine.h
+        std::vector<uint32_t> grid_surface_cells = SortedList(grid.GetSurfaceCellIndices(), grid.GetSurfaceCounts().surface_cells);
+        if (!grid_valid || grid_surface_cells != grid_blocks_cells) {
+            printf("Surface cells differ from GridEngine's!\n");
+            valid = false;
+        }
+        printf("Surface cells in full blocks culled by GridEngine: %zu\n", culled_blocks_cells);
+        printf("Bitmask engine memory: %.2f MB\n", bitmask.GetMemoryFootprint() / (1024.0 * 1024.0));
+    }
+
+    return valid ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+// Compares filling the brick pool with every voxel walking the 27 neighbouring cells, against walking a per-brick list
+// of the particles that can reach the brick. Reports the particle distance evaluations per brick for each, and checks
+// the brick pools are identical.
+// Usage: BrickCandidatesBenchmark (particle no.) (scene) (threads) (iterations) (texture resolution)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../BrickPool.h"
+#include "../GridEngine.h"
+#include "../ParticleReorder.h"
+#include "../ParticleScenes.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+template<typename F>
+static double TimeMs(F&& func, int iterations)
+{
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        func();
+    }
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    test_values.num_particles_ = argc > 1 ? std::atoi(argv[1]) : 20000;
+    test_values.scene_ = argc > 2 ? (SceneType)std::atoi(argv[2]) : SceneWave;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    int iterations = argc > 4 ? std::atoi(argv[4]) : 3;
+    test_values.texture_res_ = argc > 5 ? std::atoi(argv[5]) : 256;
+    DeriveGridValues(test_values);
+
+    ThreadPool thread_pool(threads);
+    std::vector<ParticleData> particles;
+    GenerateParticles(test_values, particles, &thread_pool);
+    ComputePositions(test_values, 0.5f, particles, &thread_pool);
+
+    GridEngine grid(&thread_pool, test_values);
+    grid.ComputeGrid(particles);
+    std::vector<uint32_t> cell_offsets;
+    std::vector<ParticleData> particles_ordered;
+    ComputeCellOffsets(grid.GetCellCounts(), cell_offsets, &thread_pool);
+    ReorderParticles(particles, cell_offsets, particles_ordered, &thread_pool);
+
+    // Count the evaluations each way, gathering the candidates as the brick pool does
+    const uint32_t bricks_per_axis = BricksPerAxisPerCell(test_values);
+    const uint32_t bricks_per_cell = bricks_per_axis * bricks_per_axis * bricks_per_axis;
+    const float voxel_size = 1.f / (test_values.cells_per_axis_ * bricks_per_axis * CORE_VOXELS_PER_AXIS_PER_BRICK);
+    const uint32_t bricks_count = grid.GetSurfaceCounts().surface_cells * bricks_per_cell;
+    uint64_t neighbour_particles = 0, candidate_particles = 0;
+    uint32_t max_candidates = 0;
+    std::vector<Float3> candidates;
+    for (uint32_t brick_index = 0; brick_index < bricks_count; brick_index++) {
+        uint32_t cell_index = grid.GetSurfaceCellIndices()[brick_index / bricks_per_cell];
+        int neighbouring_cells[27];
+        grid.GetNeighbourCells(cell_index, neighbouring_cells);
+
+        AABB voxel_bounds = GetBrickVoxelBounds(GetBrickAABB(test_values, grid.GetCellCoords(cell_index), brick_index % bricks_per_cell).min_, voxel_size);
+        neighbour_particles += GatherBrickCandidates(voxel_bounds, neighbouring_cells, grid.GetCellCounts(), cell_offsets,
+            ParticleDataPositionSource{ particles_ordered }, test_values.particle_radius_, candidates);
+        candidate_particles += candidates.size();
+        max_candidates = std::max(max_candidates, (uint32_t)candidates.size());
+    }
+
+    printf("Brick candidates benchmark: %d particles, scene %d, %u threads, %d iterations, %u bricks of %u per cell\n",
+        test_values.num_particles_, test_values.scene_, threads, iterations, bricks_count, bricks_per_cell);
+    if (bricks_count == 0) {
+        return 0;
+    }
+
+    BrickPool neighbour_pool, candidate_pool;
+    double neighbour_ms = TimeMs([&] { FillBrickPool(grid, particles_ordered, cell_offsets, neighbour_pool, &thread_pool, BrickEvaluationNeighbourCells); }, iterations);
+    // Scalar kernel, to compare like with like (BrickKernelBenchmark compares the kernels)
+    double candidate_ms = TimeMs([&] { FillBrickPool(grid, particles_ordered, cell_offsets, candidate_pool, &thread_pool, BrickEvaluationCandidates, BrickKernelScalar); }, iterations);
+
+    printf("%-18s %12s %22s\n", "evaluation", "time (ms)", "evaluations per brick");
+    printf("%-18s %12.3f %22.1f\n", "neighbour cells", neighbour_ms, (double)neighbour_particles * VOXELS_PER_BRICK / bricks_count);
+    printf("%-18s %12.3f %22.1f\n", "candidate lists", candidate_ms, (double)candidate_particles * VOXELS_PER_BRICK / bricks_count);
+    printf("Candidates per brick: %.1f of %.1f neighbouring particles, up to %u\n",
+        (double)candidate_particles / bricks_count, (double)neighbour_particles / bricks_count, max_candidates);
+
+    // Candidates are visited in the same order and skip only particles out of range of every voxel, so the bricks must match
+    if (candidate_pool.voxels_.size() != neighbour_pool.voxels_.size() ||
+        std::memcmp(candidate_pool.voxels_.data(), neighbour_pool.voxels_.data(), neighbour_pool.voxels_.size() * sizeof(int16_t)) != 0) {
+        printf("Candidate list brick pool differs from the neighbour cell brick pool!\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+// Culls the bricks the ray tracer can't hit from a filled brick pool, as CSBrickPoolMain does before the BLAS is built.
+// Reports how many bricks are culled and how long classifying and compacting them takes, and checks every culled brick
+// lies wholly above the hit threshold while every kept brick has a voxel within it.
+// Usage: BrickCullBenchmark (particle no.) (scene) (threads) (iterations) (texture resolution)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "../BrickPool.h"
+#include "../GridEngine.h"
+#include "../ParticleReorder.h"
+#include "../ParticleScenes.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+template<typename F>
+static double TimeMs(F&& func, int iterations)
+{
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        func();
+    }
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    test_values.num_particles_ = argc > 1 ? std::atoi(argv[1]) : 20000;
+    test_values.scene_ = argc > 2 ? (SceneType)std::atoi(argv[2]) : SceneWave;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    int iterations = argc > 4 ? std::atoi(argv[4]) : 5;
+    test_values.texture_res_ = argc > 5 ? std::atoi(argv[5]) : 512;
+    DeriveGridValues(test_values);
+
+    ThreadPool thread_pool(threads);
+    std::vector<ParticleData> particles;
+    GenerateParticles(test_values, particles, &thread_pool);
+    ComputePositions(test_values, 0.5f, particles, &thread_pool);
+
+    GridEngine grid(&thread_pool, test_values);
+    grid.ComputeGrid(particles);
+    std::vector<uint32_t> cell_offsets;
+    std::vector<ParticleData> particles_ordered;
+    ComputeCellOffsets(grid.GetCellCounts(), cell_offsets, &thread_pool);
+    ReorderParticles(particles, cell_offsets, particles_ordered, &thread_pool);
+
+    BrickPool brick_pool;
+    double fill_ms = TimeMs([&] { FillBrickPool(grid, particles_ordered, cell_offsets, brick_pool, &thread_pool); }, 1);
+    double cull_ms = TimeMs([&] { CullEmptyBricks(brick_pool, &thread_pool); }, iterations);
+
+    const uint32_t bricks_count = brick_pool.bricks_count_;
+    const uint32_t culled_count = bricks_count - brick_pool.surface_bricks_count_;
+    printf("Brick cull benchmark: %d particles, scene %d, %u threads, %d iterations, %u bricks of %u per cell\n",
+        test_values.num_particles_, test_values.scene_, threads, iterations, bricks_count, BricksPerAxisPerCell(test_values) * BricksPerAxisPerCell(test_values) * BricksPerAxisPerCell(test_values));
+    printf("Brick pool %.3f ms, culling %.3f ms\n", fill_ms, cull_ms);
+    printf("Bricks traced: %u, culled: %u (%.1f%%)\n", brick_pool.surface_bricks_count_, culled_count, bricks_count ? 100.0 * culled_count / bricks_count : 0.0);
+
+    // Check each brick against its voxels, walking the compacted list alongside the brick indices
+    uint32_t surface_index = 0;
+    for (uint32_t brick_index = 0; brick_index < bricks_count; brick_index++) {
+        const int16_t* voxels = brick_pool.voxels_.data() + (size_t)brick_index * VOXELS_PER_BRICK;
+        bool kept = surface_index < brick_pool.surface_bricks_count_ && brick_pool.surface_brick_indices_[surface_index] == brick_index;
+        bool hittable = std::any_of(voxels, voxels + VOXELS_PER_BRICK, [](int16_t voxel) { return Snorm16ToFloat(voxel) <= SPHERE_TRACING_THRESHOLD; });
+        if (kept != hittable) {
+            printf("Brick %u was %s, but %s a voxel within the threshold!\n", brick_index, kept ? "kept" : "culled", hittable ? "has" : "doesn't have");
+            return 1;
+        }
+        surface_index += kept;
+    }
+    if (surface_index != brick_pool.surface_bricks_count_) {
+        printf("Compacted brick list is out of order!\n");
+        return 1;
+    }
+    return 0;
+}
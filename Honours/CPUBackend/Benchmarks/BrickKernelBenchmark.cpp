@@ -0,0 +1,110 @@
+// Compares the brick pool SDF kernels for each instruction set the CPU supports, filling the brick pool from candidate
+// lists. Every kernel must give the same voxels as the scalar kernel, and the scalar kernel the same voxels as the
+// neighbour cell walk of CSBrickPoolMain.
+// Usage: BrickKernelBenchmark (particle no.) (scene) (threads) (iterations) (texture resolution)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../BrickPool.h"
+#include "../GridEngine.h"
+#include "../ParticleReorder.h"
+#include "../ParticleScenes.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+template<typename F>
+static double TimeMs(F&& func, int iterations)
+{
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        func();
+    }
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+}
+
+static bool SamePool(const BrickPool& a, const BrickPool& b)
+{
+    return a.voxels_.size() == b.voxels_.size() && std::memcmp(a.voxels_.data(), b.voxels_.data(), a.voxels_.size() * sizeof(int16_t)) == 0;
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    test_values.num_particles_ = argc > 1 ? std::atoi(argv[1]) : 20000;
+    test_values.scene_ = argc > 2 ? (SceneType)std::atoi(argv[2]) : SceneWave;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    int iterations = argc > 4 ? std::atoi(argv[4]) : 3;
+    test_values.texture_res_ = argc > 5 ? std::atoi(argv[5]) : 512;
+    DeriveGridValues(test_values);
+
+    ThreadPool thread_pool(threads);
+    std::vector<ParticleData> particles;
+    GenerateParticles(test_values, particles, &thread_pool);
+    ComputePositions(test_values, 0.5f, particles, &thread_pool);
+
+    GridEngine grid(&thread_pool, test_values);
+    grid.ComputeGrid(particles);
+    std::vector<uint32_t> cell_offsets;
+    std::vector<ParticleData> particles_ordered;
+    ComputeCellOffsets(grid.GetCellCounts(), cell_offsets, &thread_pool);
+    ReorderParticles(particles, cell_offsets, particles_ordered, &thread_pool);
+
+    // Particle distance evaluations, from the brick's candidate counts
+    const uint32_t bricks_per_axis = BricksPerAxisPerCell(test_values);
+    const uint32_t bricks_per_cell = bricks_per_axis * bricks_per_axis * bricks_per_axis;
+    const float voxel_size = 1.f / (test_values.cells_per_axis_ * bricks_per_axis * CORE_VOXELS_PER_AXIS_PER_BRICK);
+    const uint32_t bricks_count = grid.GetSurfaceCounts().surface_cells * bricks_per_cell;
+    uint64_t evaluations = 0;
+    std::vector<Float3> candidates;
+    for (uint32_t brick_index = 0; brick_index < bricks_count; brick_index++) {
+        uint32_t cell_index = grid.GetSurfaceCellIndices()[brick_index / bricks_per_cell];
+        int neighbouring_cells[27];
+        grid.GetNeighbourCells(cell_index, neighbouring_cells);
+
+        AABB voxel_bounds = GetBrickVoxelBounds(GetBrickAABB(test_values, grid.GetCellCoords(cell_index), brick_index % bricks_per_cell).min_, voxel_size);
+        GatherBrickCandidates(voxel_bounds, neighbouring_cells, grid.GetCellCounts(), cell_offsets,
+            ParticleDataPositionSource{ particles_ordered }, test_values.particle_radius_, candidates);
+        evaluations += (uint64_t)candidates.size() * VOXELS_PER_BRICK;
+    }
+
+    printf("Brick kernel benchmark: %d particles, scene %d, %u threads, %d iterations, texture resolution %d, %u bricks, best kernel %s\n",
+        test_values.num_particles_, test_values.scene_, threads, iterations, test_values.texture_res_, bricks_count, GetBrickKernelName(GetBestBrickKernelIsa()));
+    printf("%-10s %12s %18s %10s\n", "kernel", "time (ms)", "evaluations (G/s)", "speedup");
+
+    bool valid = true;
+    BrickPool scalar_pool;
+    double scalar_ms = 0;
+    for (int isa = BrickKernelScalar; isa < BrickKernelIsaCount; isa++) {
+        const BrickKernelIsa kernel = (BrickKernelIsa)isa;
+        if (!IsBrickKernelSupported(kernel)) {
+            printf("%-10s %12s\n", GetBrickKernelName(kernel), "unsupported");
+            continue;
+        }
+
+        BrickPool brick_pool;
+        double ms = TimeMs([&] { FillBrickPool(grid, particles_ordered, cell_offsets, brick_pool, &thread_pool, BrickEvaluationCandidates, kernel); }, iterations);
+        if (kernel == BrickKernelScalar) {
+            scalar_pool = brick_pool;
+            scalar_ms = ms;
+        }
+        printf("%-10s %12.3f %18.3f %9.2fx\n", GetBrickKernelName(kernel), ms, evaluations / (ms * 1e6), scalar_ms / ms);
+
+        if (!SamePool(brick_pool, scalar_pool)) {
+            printf("%s brick pool differs from the scalar brick pool!\n", GetBrickKernelName(kernel));
+            valid = false;
+        }
+    }
+
+    BrickPool reference_pool;
+    FillBrickPool(grid, particles_ordered, cell_offsets, reference_pool, &thread_pool, BrickEvaluationNeighbourCells);
+    if (!SamePool(reference_pool, scalar_pool)) {
+        printf("Scalar brick pool differs from the neighbour cell brick pool!\n");
+        valid = false;
+    }
+
+    return valid ? 0 : 1;
+}
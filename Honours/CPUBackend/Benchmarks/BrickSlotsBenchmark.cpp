@@ -0,0 +1,134 @@
+// Compares refilling the whole brick pool each frame against keeping bricks in persistent slots, refilling only those
+// around moved particles, over an animated scene. Only particles whose start x is below the moving fraction are animated,
+// so 0 is a paused scene and 1 the whole scene. Every frame, each brick's slot and the culled brick list are checked
+// against the full refill.
+// Usage: BrickSlotsBenchmark (particle no.) (scene) (threads) (frames) (texture resolution) (moving fraction)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../BrickSlots.h"
+#include "../GridEngine.h"
+#include "../ParticleScenes.h"
+#include "../ParticleSort.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+template<typename F>
+static double TimeMs(F&& func)
+{
+    Clock::time_point start = Clock::now();
+    func();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Every brick's slot must hold the same voxels as the full refill, and the same bricks must be culled
+static bool MatchBrickPools(const GridEngine& grid, const BrickSlotAllocator& slots, const BrickPool& incremental, const BrickPool& full)
+{
+    const uint32_t bricks_per_axis = BricksPerAxisPerCell(grid.GetTestValues());
+    const uint32_t bricks_per_cell = bricks_per_axis * bricks_per_axis * bricks_per_axis;
+    const std::vector<uint32_t>& surface_cell_indices = grid.GetSurfaceCellIndices();
+    auto brick_slot = [&](uint32_t brick_index) { return slots.GetBrickSlot(surface_cell_indices[brick_index / bricks_per_cell], brick_index % bricks_per_cell); };
+
+    if (incremental.bricks_count_ != full.bricks_count_ || incremental.surface_bricks_count_ != full.surface_bricks_count_) {
+        return false;
+    }
+    for (uint32_t brick_index = 0; brick_index < full.bricks_count_; brick_index++) {
+        if (std::memcmp(incremental.voxels_.data() + (size_t)brick_slot(brick_index) * VOXELS_PER_BRICK,
+            full.voxels_.data() + (size_t)brick_index * VOXELS_PER_BRICK, VOXELS_PER_BRICK * sizeof(int16_t)) != 0) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < full.surface_bricks_count_; i++) {
+        if (incremental.surface_brick_indices_[i] != brick_slot(full.surface_brick_indices_[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    test_values.num_particles_ = argc > 1 ? std::atoi(argv[1]) : 20000;
+    test_values.scene_ = argc > 2 ? (SceneType)std::atoi(argv[2]) : SceneWave;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    int frames = argc > 4 ? std::atoi(argv[4]) : 30;
+    test_values.texture_res_ = argc > 5 ? std::atoi(argv[5]) : 256;
+    float moving_fraction = argc > 6 ? (float)std::atof(argv[6]) : 1.f;
+    DeriveGridValues(test_values);
+
+    ThreadPool thread_pool(threads);
+    GridEngine grid(&thread_pool, test_values);
+    grid.SetSurfaceListOrder(SurfaceListSorted);
+    grid.SetBlockNeighbourRule(BlockNeighbourFlagged);
+    ParticleSorter sorter(&thread_pool, test_values); // Stable, so unmoved particles are visited in the same order every frame
+    BrickSlotAllocator slots(test_values);
+    BrickPool incremental_pool, full_pool;
+
+    std::vector<ParticleData> particles, previous_particles, animated_particles, particles_ordered;
+    GenerateParticles(test_values, particles, &thread_pool);
+
+    printf("Brick slots benchmark: %d particles, scene %d, %u threads, %d frames, moving fraction %.2f\n",
+        test_values.num_particles_, test_values.scene_, threads, frames, moving_fraction);
+
+    bool valid = true;
+    double full_ms = 0, incremental_ms = 0;
+    uint64_t bricks = 0, recomputed = 0;
+
+    // Frame 0 fills every slot, and is reported separately
+    for (int frame = 0; frame <= frames; frame++) {
+        previous_particles = particles;
+        animated_particles = particles;
+        ComputePositions(test_values, frame / 60.f, animated_particles, &thread_pool);
+        for (size_t i = 0; i < particles.size(); i++) {
+            if (particles[i].start_pos_.x < moving_fraction) {
+                particles[i].position_ = animated_particles[i].position_;
+            }
+        }
+
+        slots.AdvanceFrame();
+        slots.MarkMovedParticles(previous_particles, particles, &thread_pool);
+        grid.ComputeGrid(particles);
+        sorter.Sort(particles, particles_ordered, SortCounting);
+        ParticleDataPositionSource positions{ particles_ordered };
+
+        uint32_t frame_recomputed = 0;
+        double frame_incremental_ms = TimeMs([&] {
+            frame_recomputed = FillBrickPoolIncremental(grid, positions, sorter.GetCellOffsets(), slots, incremental_pool, &thread_pool);
+        });
+        double frame_full_ms = TimeMs([&] {
+            FillBrickPoolFrom(grid, positions, sorter.GetCellOffsets(), full_pool, &thread_pool);
+            CullEmptyBricks(full_pool, &thread_pool);
+        });
+
+        if (!MatchBrickPools(grid, slots, incremental_pool, full_pool)) {
+            printf("Brick slots differ from a full refill on frame %d!\n", frame);
+            valid = false;
+        }
+
+        if (frame == 0) {
+            printf("First frame: full refill %.3f ms, slots %.3f ms (%u bricks)\n", frame_full_ms, frame_incremental_ms, full_pool.bricks_count_);
+            continue;
+        }
+
+        full_ms += frame_full_ms;
+        incremental_ms += frame_incremental_ms;
+        bricks += full_pool.bricks_count_;
+        recomputed += frame_recomputed;
+    }
+
+    if (frames > 0) {
+        printf("Per frame averages over %d frames:\n", frames);
+        printf("  full refill:        %10.3f ms\n", full_ms / frames);
+        printf("  persistent slots:   %10.3f ms\n", incremental_ms / frames);
+        printf("  bricks:             %10.1f\n", (double)bricks / frames);
+        printf("  recomputed bricks:  %10.1f (%.1f%%)\n", (double)recomputed / frames, bricks ? 100.0 * recomputed / bricks : 0.0);
+        printf("  slot capacity:      %10u cells, %u free\n", slots.GetCapacity(), slots.GetFreeSlotsCount());
+    }
+
+    return valid ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+// Replays a per-frame brick count trace through the brick pool's capacity policy (see CapacityPolicy.h), comparing
+// reallocating to exactly each new high-water mark against geometric growth with delayed shrinking.
+// The trace is read from a file of one brick count per line, or recorded from an animated scene with "-", and can be
+// written out for replaying later. Checks the capacity always covers the frame's bricks and keeps to the budget.
+// Usage: CapacityReplayBenchmark (trace file or -) (particle no.) (scene) (frames) (threads) (budget MB, 0 for none) (trace output file)
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include "../../CapacityPolicy.h"
+#include "../BrickKernel.h"
+#include "../GridEngine.h"
+#include "../ParticleScenes.h"
+
+using namespace CPUBackend;
+
+#define BYTES_PER_BRICK (VOXELS_PER_BRICK * sizeof(int16_t))
+
+// Bricks the brick pool would need each frame, from the surface cells of the animated scene
+static std::vector<uint64_t> RecordTrace(TestVariables test_values, int frames, unsigned int threads)
+{
+    DeriveGridValues(test_values);
+    const uint32_t bricks_per_axis = BricksPerAxisPerCell(test_values);
+
+    ThreadPool thread_pool(threads);
+    GridEngine grid(&thread_pool, test_values);
+    std::vector<ParticleData> particles;
+    GenerateParticles(test_values, particles, &thread_pool);
+
+    std::vector<uint64_t> trace;
+    for (int frame = 0; frame < frames; frame++) {
+        ComputePositions(test_values, frame / 60.f, particles, &thread_pool);
+        grid.ComputeGrid(particles);
+        trace.push_back((uint64_t)grid.GetSurfaceCounts().surface_cells * bricks_per_axis * bricks_per_axis * bricks_per_axis);
+    }
+    return trace;
+}
+
+// Replays the trace, returning false if the capacity ever misses the frame's bricks or breaks the budget
+static bool Replay(const char* name, const std::vector<uint64_t>& trace, const CapacityPolicySettings& settings)
+{
+    CapacityPolicy policy(BYTES_PER_BRICK, settings);
+    uint64_t wasted_bytes = 0, peak_bytes = 0;
+    bool valid = true;
+
+    for (size_t frame = 0; frame < trace.size(); frame++) {
+        uint64_t required = trace[frame];
+        policy.Update(required);
+
+        bool over_budget = required * BYTES_PER_BRICK > settings.budget_bytes_;
+        if (policy.GetCapacity() < required || (!over_budget && policy.GetCapacityBytes() > settings.budget_bytes_)) {
+            printf("%s: capacity of %llu bricks doesn't fit %llu bricks within the budget on frame %zu!\n", name,
+                (unsigned long long)policy.GetCapacity(), (unsigned long long)required, frame);
+            valid = false;
+        }
+
+        wasted_bytes += policy.GetStats().wasted_bytes_;
+        peak_bytes = std::max(peak_bytes, policy.GetCapacityBytes());
+    }
+
+    CapacityStats stats = policy.GetStats();
+    printf("  %-28s %6u reallocations, %5u frames over budget, %10.2f MB wasted on average, %10.2f MB peak\n", name,
+        stats.reallocations_, stats.over_budget_, trace.empty() ? 0.0 : wasted_bytes / 1048576.0 / trace.size(), peak_bytes / 1048576.0);
+    return valid;
+}
+
+int main(int argc, char** argv)
+{
+    std::string trace_file = argc > 1 ? argv[1] : "-";
+    TestVariables test_values = {};
+    test_values.num_particles_ = argc > 2 ? std::atoi(argv[2]) : 20000;
+    test_values.scene_ = argc > 3 ? (SceneType)std::atoi(argv[3]) : SceneWave;
+    int frames = argc > 4 ? std::atoi(argv[4]) : 600;
+    unsigned int threads = argc > 5 ? std::atoi(argv[5]) : std::max(std::thread::hardware_concurrency(), 1u);
+    double budget_mb = argc > 6 ? std::atof(argv[6]) : 0;
+    test_values.texture_res_ = 512;
+
+    std::vector<uint64_t> trace;
+    if (trace_file == "-") {
+        trace = RecordTrace(test_values, frames, threads);
+        printf("Capacity replay benchmark: recorded %zu frames of %d particles, scene %d\n", trace.size(), test_values.num_particles_, test_values.scene_);
+    }
+    else {
+        std::ifstream file(trace_file);
+        if (!file) {
+            printf("Can't open trace %s!\n", trace_file.c_str());
+            return 1;
+        }
+        uint64_t bricks;
+        while (file >> bricks) {
+            trace.push_back(bricks);
+        }
+        printf("Capacity replay benchmark: %zu frames from %s\n", trace.size(), trace_file.c_str());
+    }
+
+    if (argc > 7) {
+        std::ofstream file(argv[7]);
+        for (uint64_t bricks : trace) {
+            file << bricks << "\n";
+        }
+    }
+
+    if (!trace.empty()) {
+        printf("Bricks per frame: %llu to %llu\n", (unsigned long long)*std::min_element(trace.begin(), trace.end()),
+            (unsigned long long)*std::max_element(trace.begin(), trace.end()));
+    }
+
+    // What the app did before, reallocate to exactly the new high-water mark and never shrink
+    CapacityPolicySettings high_water;
+    high_water.growth_factor_ = 1;
+    high_water.shrink_usage_ = 0;
+
+    CapacityPolicySettings hysteresis;
+    CapacityPolicySettings budgeted = hysteresis;
+    if (budget_mb > 0) {
+        budgeted.budget_bytes_ = (uint64_t)(budget_mb * 1048576);
+    }
+
+    bool valid = Replay("exact high-water mark", trace, high_water);
+    valid &= Replay("growth with hysteresis", trace, hysteresis);
+    if (budget_mb > 0) {
+        valid &= Replay("growth with hysteresis, cap", trace, budgeted);
+    }
+
+    return valid ? 0 : 1;
+}
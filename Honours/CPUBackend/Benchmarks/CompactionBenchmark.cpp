@@ -0,0 +1,139 @@
+// Compares appending surface blocks/cells with an atomic counter against flag -> scan -> scatter compaction, both with
+// the deterministic block neighbour rule so they find the same surface cells, and checks the compacted lists (and a brick pool built from them with ParticleSorter) are the same for different thread counts.
+// Usage: CompactionBenchmark (particle no.) (scene) (threads) (iterations)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../BitmaskSurfaceEngine.h"
+#include "../BrickPool.h"
+#include "../GridCommon.h"
+#include "../GridEngine.h"
+#include "../ParticleScenes.h"
+#include "../ParticleSort.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+template<typename F>
+static double TimeMs(F&& func)
+{
+    Clock::time_point start = Clock::now();
+    func();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static std::vector<uint32_t> ValidPart(const std::vector<uint32_t>& list, uint32_t count)
+{
+    return std::vector<uint32_t>(list.begin(), list.begin() + count);
+}
+
+// Surface detection timings, leaving the grid computed
+static void TimeSurfaceDetection(GridEngine& grid, std::vector<ParticleData>& particles, int iterations, double& blocks_ms, double& cells_ms)
+{
+    blocks_ms = cells_ms = 0;
+    for (int i = 0; i < iterations; i++) {
+        grid.ClearGridCounts();
+        grid.BuildGrid(particles);
+        blocks_ms += TimeMs([&] { grid.DetectSurfaceBlocks(); }) / iterations;
+        cells_ms += TimeMs([&] { grid.DetectSurfaceCells(); }) / iterations;
+    }
+}
+
+// Sorted surface lists and a stable particle order, so the whole brick pool should be reproducible
+static void BuildBrickPool(const TestVariables& test_values, std::vector<ParticleData> particles, ThreadPool* thread_pool,
+    std::vector<uint32_t>& surface_cells, BrickPool& brick_pool)
+{
+    GridEngine grid(thread_pool, test_values);
+    grid.SetSurfaceListOrder(SurfaceListSorted);
+    grid.SetBlockNeighbourRule(BlockNeighbourFlagged);
+    grid.ComputeGrid(particles);
+
+    ParticleSorter sorter(thread_pool, test_values);
+    std::vector<ParticleData> particles_ordered;
+    sorter.Sort(particles, particles_ordered, SortCounting);
+
+    FillBrickPool(grid, particles_ordered, sorter.GetCellOffsets(), brick_pool, thread_pool);
+    surface_cells = ValidPart(grid.GetSurfaceCellIndices(), grid.GetSurfaceCounts().surface_cells);
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    test_values.num_particles_ = argc > 1 ? std::atoi(argv[1]) : 100000;
+    test_values.scene_ = argc > 2 ? (SceneType)std::atoi(argv[2]) : SceneWave;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 4u);
+    int iterations = argc > 4 ? std::atoi(argv[4]) : 20;
+    test_values.texture_res_ = 256;
+    DeriveGridValues(test_values);
+
+    ThreadPool single_thread_pool(1);
+    ThreadPool thread_pool(threads);
+    std::vector<ParticleData> particles;
+    GenerateParticles(test_values, particles, &thread_pool);
+    ComputePositions(test_values, 0.5f, particles, &thread_pool);
+
+    printf("Compaction benchmark: %d particles, scene %d, %u threads, %d iterations, %d^3 cells\n",
+        test_values.num_particles_, test_values.scene_, threads, iterations, test_values.cells_per_axis_);
+    printf("%-8s %14s %14s %14s\n", "order", "blocks (ms)", "cells (ms)", "total (ms)");
+
+    GridEngine append_grid(&thread_pool, test_values);
+    append_grid.SetBlockNeighbourRule(BlockNeighbourFlagged);
+    double blocks_ms, cells_ms;
+    TimeSurfaceDetection(append_grid, particles, iterations, blocks_ms, cells_ms);
+    printf("%-8s %14.3f %14.3f %14.3f\n", "append", blocks_ms, cells_ms, blocks_ms + cells_ms);
+
+    GridEngine sorted_grid(&thread_pool, test_values);
+    sorted_grid.SetSurfaceListOrder(SurfaceListSorted);
+    sorted_grid.SetBlockNeighbourRule(BlockNeighbourFlagged);
+    TimeSurfaceDetection(sorted_grid, particles, iterations, blocks_ms, cells_ms);
+    printf("%-8s %14.3f %14.3f %14.3f\n", "sorted", blocks_ms, cells_ms, blocks_ms + cells_ms);
+
+    bool valid = true;
+
+    // The compacted cells must be ascending, and match the bitmask engine's in the surface blocks. The bitmask engine also
+    // searches the full blocks GridEngine culls, see BitmaskSurfaceEngine.h.
+    const GridSurfaceCounts& counts = sorted_grid.GetSurfaceCounts();
+    std::vector<uint32_t> sorted_blocks = ValidPart(sorted_grid.GetSurfaceBlockIndices(), counts.surface_blocks);
+    std::vector<uint32_t> sorted_cells = ValidPart(sorted_grid.GetSurfaceCellIndices(), counts.surface_cells);
+    BitmaskSurfaceEngine bitmask(&thread_pool, test_values);
+    bitmask.DetectSurfaceCells(sorted_grid.GetCellCounts());
+    std::vector<uint32_t> bitmask_cells = ValidPart(bitmask.GetSurfaceCellIndices(), bitmask.GetSurfaceCellCount());
+    std::vector<uint8_t> in_surface_block(test_values.num_cells_, 0);
+    for (uint32_t block_index : sorted_blocks) {
+        for (uint32_t i = 0; i < NUM_CELLS_PER_BLOCK; i++) {
+            in_surface_block[BlockIndexToCellIndex(test_values, block_index, { i % 4, (i / 4) % 4, i / 16 })] = 1;
+        }
+    }
+    std::erase_if(bitmask_cells, [&](uint32_t cell_index) { return !in_surface_block[cell_index]; });
+    std::sort(bitmask_cells.begin(), bitmask_cells.end());
+    if (!std::is_sorted(sorted_blocks.begin(), sorted_blocks.end()) || sorted_cells != bitmask_cells) {
+        printf("Compacted surface lists are out of order, or differ from the bitmask engine!\n");
+        valid = false;
+    }
+
+    // Appending only changes the order
+    std::vector<uint32_t> appended_cells = ValidPart(append_grid.GetSurfaceCellIndices(), append_grid.GetSurfaceCounts().surface_cells);
+    std::sort(appended_cells.begin(), appended_cells.end());
+    if (appended_cells != sorted_cells) {
+        printf("Appended and compacted surface cells differ!\n");
+        valid = false;
+    }
+    printf("Surface cells: append %u, sorted %u\n", append_grid.GetSurfaceCounts().surface_cells, counts.surface_cells);
+
+    // The brick pools built with 1 and many threads must be identical
+    std::vector<uint32_t> single_thread_cells, multi_thread_cells;
+    BrickPool single_thread_pool_bricks, multi_thread_pool_bricks;
+    BuildBrickPool(test_values, particles, &single_thread_pool, single_thread_cells, single_thread_pool_bricks);
+    BuildBrickPool(test_values, particles, &thread_pool, multi_thread_cells, multi_thread_pool_bricks);
+    bool same_bricks = single_thread_pool_bricks.voxels_.size() == multi_thread_pool_bricks.voxels_.size() &&
+        std::memcmp(single_thread_pool_bricks.voxels_.data(), multi_thread_pool_bricks.voxels_.data(), single_thread_pool_bricks.voxels_.size() * sizeof(int16_t)) == 0;
+    printf("Brick pool identical for 1 and %u threads: %s\n", threads, same_bricks ? "yes" : "no");
+    if (single_thread_cells != multi_thread_cells || !same_bricks) {
+        valid = false;
+    }
+
+    return valid ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+// Compares sphere tracing the Simple method's dense SDF texture as the intersection shader does against stepping through
+// its distance pyramid (see DistancePyramid.h), for rays from the orbital camera over the test scenes and the particle
+// counts in Tests.bat. Reports the time to build the pyramid, the mean, 99th percentile and most steps rays take with each,
+// how many pyramid texels the hierarchical rays read, and how their hits differ from the plain rays'.
+// Checks that at random points in the texture, the sampled distance is never below the texels of the pyramid around them.
+// Usage: DistancePyramidBenchmark (particle no., 0 for Tests.bat's) (scene, -1 for random, grid and wave) (threads)
+//        (texture resolution) (image height)
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "../DistancePyramid.h"
+#include "../GridEngine.h"
+#include "../ParticleReorder.h"
+#include "../ParticleScenes.h"
+#include "../SimpleTexture.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+struct StepStats {
+    double mean_ = 0;
+    int p99_ = 0;
+    int max_ = 0;
+};
+
+template<typename F>
+static double TimeMs(F&& func)
+{
+    Clock::time_point start = Clock::now();
+    func();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static StepStats GetStepStats(const std::vector<SphereTraceResult>& results)
+{
+    std::vector<int> steps(results.size());
+    uint64_t sum = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        steps[i] = results[i].steps_;
+        sum += steps[i];
+    }
+    StepStats stats;
+    if (steps.empty()) {
+        return stats;
+    }
+    stats.mean_ = (double)sum / steps.size();
+    stats.max_ = *std::max_element(steps.begin(), steps.end());
+    std::nth_element(steps.begin(), steps.begin() + steps.size() * 99 / 100, steps.end());
+    stats.p99_ = steps[steps.size() * 99 / 100];
+    return stats;
+}
+
+static bool RunParticleCount(TestVariables test_values, unsigned int threads, int image_height)
+{
+    DeriveGridValues(test_values);
+    const int texture_res = test_values.texture_res_;
+
+    ThreadPool thread_pool(threads);
+    std::vector<ParticleData> particles;
+    GenerateParticles(test_values, particles, &thread_pool);
+    ComputePositions(test_values, 0.5f, particles, &thread_pool);
+
+    GridEngine grid(&thread_pool, test_values);
+    std::vector<uint32_t> cell_offsets;
+    std::vector<ParticleData> particles_ordered;
+    grid.ComputeGrid(particles);
+    ComputeCellOffsets(grid.GetCellCounts(), cell_offsets, &thread_pool);
+    ReorderParticles(particles, cell_offsets, particles_ordered, &thread_pool);
+
+    std::vector<int16_t> voxels((size_t)texture_res * texture_res * texture_res, 0);
+    FillSimpleTextureGrid(grid, ParticleDataPositionSource{ particles_ordered }, cell_offsets, voxels, &thread_pool, 0, texture_res);
+
+    DistancePyramid pyramid;
+    BuildDistancePyramid(voxels, texture_res, pyramid, &thread_pool); // Allocates, so page faults aren't timed
+    double pyramid_ms = TimeMs([&] { BuildDistancePyramid(voxels, texture_res, pyramid, &thread_pool); });
+
+    // Rays from the orbital camera at the default view distance, at 16:9
+    const int image_width = image_height * 16 / 9;
+    const float camera_height = test_values.scene_ == SceneWave ? 0.3f : 0.5f;
+    std::vector<SphereTraceResult> plain_results((size_t)image_width * image_height), pyramid_results(plain_results.size());
+    double plain_ms = 0, hierarchical_ms = 0;
+    for (bool hierarchical : { false, true }) {
+        std::vector<SphereTraceResult>& results = hierarchical ? pyramid_results : plain_results;
+        (hierarchical ? hierarchical_ms : plain_ms) = TimeMs([&] {
+            thread_pool.ParallelFor(0, results.size(), 256, [&](size_t begin, size_t end) {
+                for (size_t pixel = begin; pixel < end; pixel++) {
+                    Float3 origin, direction;
+                    GetOrbitalCameraRay(1.5f, camera_height, image_width, image_height, (int)(pixel % image_width), (int)(pixel / image_width),
+                        origin, direction);
+                    results[pixel] = hierarchical ? SphereTraceDistancePyramid(voxels, pyramid, origin, direction)
+                        : SphereTraceDenseTexture(voxels, texture_res, origin, direction);
+                }
+            });
+        });
+    }
+
+    uint64_t coarse_samples = 0, hits = 0, hits_differ = 0, both_hit = 0;
+    double hit_t_diff = 0;
+    for (size_t pixel = 0; pixel < plain_results.size(); pixel++) {
+        coarse_samples += pyramid_results[pixel].coarse_samples_;
+        hits += plain_results[pixel].hit_;
+        hits_differ += plain_results[pixel].hit_ != pyramid_results[pixel].hit_;
+        if (plain_results[pixel].hit_ && pyramid_results[pixel].hit_) {
+            both_hit++;
+            hit_t_diff += std::abs(plain_results[pixel].t_ - pyramid_results[pixel].t_);
+        }
+    }
+    StepStats plain = GetStepStats(plain_results), hierarchical = GetStepStats(pyramid_results);
+
+    // No point within a texel may sample below it
+    std::mt19937 random(test_values.num_particles_);
+    std::uniform_real_distribution<float> unit(0, 1);
+    uint64_t below = 0;
+    for (int sample = 0; sample < 100000; sample++) {
+        Float3 position = { unit(random), unit(random), unit(random) };
+        float distance = SampleDenseTexture(voxels, texture_res, position);
+        for (int level = 1; level <= DISTANCE_PYRAMID_LEVELS; level++) {
+            const int res = pyramid.LevelResolution(level);
+            const float texel_size = (float)(1 << level) / texture_res;
+            float texel = pyramid.LevelTexel(level, std::min((int)(position.x / texel_size), res - 1),
+                std::min((int)(position.y / texel_size), res - 1), std::min((int)(position.z / texel_size), res - 1));
+            below += distance < texel - 1e-6f;
+        }
+    }
+
+    printf("  %-6d %-9d %10.2f %8.2f %6d %6d %8.2f %6d %6d %8.1fx %10.2f %10.1f %10.1f %8llu %10llu %12.6f\n", test_values.scene_,
+        test_values.num_particles_, pyramid_ms, plain.mean_, plain.p99_, plain.max_, hierarchical.mean_, hierarchical.p99_, hierarchical.max_,
+        hierarchical.mean_ > 0 ? plain.mean_ / hierarchical.mean_ : 0.0, (double)coarse_samples / pyramid_results.size(), plain_ms,
+        hierarchical_ms, (unsigned long long)hits, (unsigned long long)hits_differ, both_hit ? hit_t_diff / both_hit : 0.0);
+    if (below > 0) {
+        printf("  %llu samples are below the pyramid texels around them!\n", (unsigned long long)below);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    int particle_count = argc > 1 ? std::atoi(argv[1]) : 0;
+    int scene = argc > 2 ? std::atoi(argv[2]) : -1;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    test_values.texture_res_ = argc > 4 ? std::atoi(argv[4]) : 256;
+    int image_height = argc > 5 ? std::atoi(argv[5]) : 270;
+
+    printf("Distance pyramid benchmark: %u threads, texture resolution %d, %d levels, %dp\n", threads, test_values.texture_res_,
+        DISTANCE_PYRAMID_LEVELS, image_height);
+    printf("  %-6s %-9s %10s %8s %6s %6s %8s %6s %6s %9s %10s %10s %10s %8s %10s %12s\n", "scene", "particles", "build ms", "steps", "p99",
+        "max", "h steps", "h p99", "h max", "fewer", "texels", "plain ms", "h ms", "hits", "hits diff", "hit t diff");
+
+    bool valid = true;
+    for (SceneType scene_type : { SceneRandom, SceneGrid, SceneWave }) {
+        if (scene >= 0 && scene_type != scene) {
+            continue;
+        }
+        for (int count : { 1, 27, 343, 1000, 10648 }) {
+            if (particle_count > 0 && count != particle_count) {
+                continue;
+            }
+            test_values.scene_ = scene_type;
+            test_values.num_particles_ = count;
+            test_values.particle_radius_ = 0; // Derived from the count
+            valid &= RunParticleCount(test_values, threads, image_height);
+        }
+    }
+    return valid ? 0 : 1;
+}
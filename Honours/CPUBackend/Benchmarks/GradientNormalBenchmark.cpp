@@ -0,0 +1,216 @@
+// Compares the normals CalculateNormal finds by six finite difference taps against the SDF's gradient, accumulated
+// alongside the distance: read from the brick pool's normal channel (see BrickNormals.h), or worked out in the same pass
+// over the particles for the Naive path. Hits are random points in the bricks' cores within half a voxel of the surface.
+// Reports the cost per hit and per frame at 1080p and 4K, for the given fraction of pixels hitting the surface, and the
+// angle between each normal and the exact gradient. Checks the gradient against finite differences of the exact SDF.
+// Usage: GradientNormalBenchmark (particle no.) (scene) (threads) (texture resolution) (hits) (screen coverage)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "../BrickNormals.h"
+#include "../BrickPool.h"
+#include "../GridEngine.h"
+#include "../ParticleReorder.h"
+#include "../ParticleScenes.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+#define RADIANS_TO_DEGREES 57.2957795f
+#define ANALYTICAL_HITS 256 // The Naive path is O(particles) per tap, so only a few hits are timed
+
+struct Hit {
+    uint32_t brick_index_;
+    Float3 voxel_position_; // Within the brick, see SampleBrick
+    Float3 position_;
+};
+
+template<typename F>
+static double TimeNsPerHit(F&& func, size_t hits)
+{
+    Clock::time_point start = Clock::now();
+    func();
+    return hits ? std::chrono::duration<double, std::nano>(Clock::now() - start).count() / hits : 0.0;
+}
+
+static float AngleDegrees(const Float3& a, const Float3& b)
+{
+    return std::acos(std::clamp(Dot(a, b), -1.f, 1.f)) * RADIANS_TO_DEGREES;
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    test_values.num_particles_ = argc > 1 ? std::atoi(argv[1]) : 20000;
+    test_values.scene_ = argc > 2 ? (SceneType)std::atoi(argv[2]) : SceneWave;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    test_values.texture_res_ = argc > 4 ? std::atoi(argv[4]) : 256;
+    size_t hit_count = argc > 5 ? std::atoi(argv[5]) : 200000;
+    double coverage = argc > 6 ? std::atof(argv[6]) : 1.0;
+    DeriveGridValues(test_values);
+
+    ThreadPool thread_pool(threads);
+    std::vector<ParticleData> particles;
+    GenerateParticles(test_values, particles, &thread_pool);
+    ComputePositions(test_values, 0.5f, particles, &thread_pool);
+
+    GridEngine grid(&thread_pool, test_values);
+    grid.ComputeGrid(particles);
+    std::vector<uint32_t> cell_offsets;
+    std::vector<ParticleData> particles_ordered;
+    ComputeCellOffsets(grid.GetCellCounts(), cell_offsets, &thread_pool);
+    ReorderParticles(particles, cell_offsets, particles_ordered, &thread_pool);
+    ParticleDataPositionSource positions{ particles_ordered };
+
+    const uint32_t bricks_per_axis = BricksPerAxisPerCell(test_values);
+    const uint32_t bricks_per_cell = bricks_per_axis * bricks_per_axis * bricks_per_axis;
+    const float voxel_size = 1.f / (test_values.cells_per_axis_ * bricks_per_axis * CORE_VOXELS_PER_AXIS_PER_BRICK);
+    const float particle_radius = test_values.particle_radius_;
+
+    printf("Gradient normal benchmark: %d particles, scene %d, %u threads, texture resolution %d\n",
+        test_values.num_particles_, test_values.scene_, threads, test_values.texture_res_);
+
+    // Fill the brick pool, and its normal channel
+    BrickPool brick_pool;
+    FillBrickPoolFrom(grid, positions, cell_offsets, brick_pool, &thread_pool);
+    std::vector<BrickNormal> normals((size_t)brick_pool.bricks_count_ * VOXELS_PER_BRICK);
+    std::vector<Float3> brick_mins(brick_pool.bricks_count_);
+    thread_pool.ParallelFor(0, brick_pool.bricks_count_, 16, [&](size_t begin, size_t end) {
+        std::vector<Float3> candidates;
+        for (size_t brick_index = begin; brick_index < end; brick_index++) {
+            uint32_t cell_index = grid.GetSurfaceCellIndices()[brick_index / bricks_per_cell];
+            int neighbouring_cells[27];
+            grid.GetNeighbourCells(cell_index, neighbouring_cells);
+
+            brick_mins[brick_index] = GetBrickAABB(test_values, grid.GetCellCoords(cell_index), brick_index % bricks_per_cell).min_;
+            GatherBrickCandidates(GetBrickVoxelBounds(brick_mins[brick_index], voxel_size), neighbouring_cells, grid.GetCellCounts(), cell_offsets,
+                positions, particle_radius, candidates);
+            FillBrickNormals(brick_mins[brick_index], voxel_size, candidates.data(), candidates.size(), particle_radius,
+                normals.data() + brick_index * VOXELS_PER_BRICK);
+        }
+    });
+    auto brick_voxels = [&](uint32_t brick_index) { return brick_pool.voxels_.data() + (size_t)brick_index * VOXELS_PER_BRICK; };
+    auto brick_normals = [&](uint32_t brick_index) { return normals.data() + (size_t)brick_index * VOXELS_PER_BRICK; };
+    auto decode = [](int16_t voxel) { return Snorm16ToFloat(voxel); };
+
+    // Random points in the cores near the surface, as the ray tracer reports hits within the threshold
+    std::vector<Hit> hits;
+    std::mt19937 random(1);
+    std::uniform_int_distribution<uint32_t> brick(0, brick_pool.bricks_count_ ? brick_pool.bricks_count_ - 1 : 0);
+    std::uniform_real_distribution<float> core(0.5f, VOXELS_PER_AXIS_PER_BRICK - 1.5f);
+    for (size_t attempt = 0; brick_pool.bricks_count_ > 0 && hits.size() < hit_count && attempt < hit_count * 1000; attempt++) {
+        Hit hit = { brick(random), { core(random), core(random), core(random) }, { 0, 0, 0 } };
+        if (std::abs(SampleBrick(brick_voxels(hit.brick_index_), hit.voxel_position_, decode)) < voxel_size * 0.5f) {
+            hit.position_ = brick_mins[hit.brick_index_] + (hit.voxel_position_ - 0.5f) * voxel_size; // Voxel 1 starts at brick_min
+            hits.push_back(hit);
+        }
+    }
+    if (hits.empty()) {
+        printf("No hits found!\n");
+        return 1;
+    }
+
+    // Exact gradient at each hit, over every particle as the Naive path does
+    std::vector<Float3> all_positions(particles.size());
+    for (size_t i = 0; i < particles.size(); i++) {
+        all_positions[i] = particles[i].position_;
+    }
+    auto exact_distance = [&](const Float3& position) {
+        return GetSignedDistanceCandidates(position, all_positions.data(), all_positions.size(), particle_radius);
+    };
+    auto exact_gradient = [&](const Float3& position) {
+        Float3 gradient;
+        GetSignedDistanceGradientCandidates(position, all_positions.data(), all_positions.size(), particle_radius, gradient);
+        return gradient;
+    };
+
+    const size_t analytical_hits = std::min(hits.size(), (size_t)ANALYTICAL_HITS);
+    std::vector<Float3> exact_normals(analytical_hits);
+    for (size_t i = 0; i < analytical_hits; i++) {
+        exact_normals[i] = Normalize(exact_gradient(hits[i].position_));
+    }
+
+    // Time each way of finding the normals, keeping them for the angle errors
+    std::vector<Float3> differenced(hits.size()), channel(hits.size());
+    std::vector<Float3> analytical_differenced(analytical_hits), analytical_gradient(analytical_hits);
+    double differenced_ns = TimeNsPerHit([&] {
+        for (size_t i = 0; i < hits.size(); i++) {
+            differenced[i] = SampleBrickNormal(brick_voxels(hits[i].brick_index_), hits[i].voxel_position_, decode);
+        }
+    }, hits.size());
+    double channel_ns = TimeNsPerHit([&] {
+        for (size_t i = 0; i < hits.size(); i++) {
+            channel[i] = SampleBrickNormalChannel(brick_normals(hits[i].brick_index_), hits[i].voxel_position_);
+        }
+    }, hits.size());
+    const float step = 0.001f; // As CalculateNormal's analytical path
+    double analytical_differenced_ns = TimeNsPerHit([&] {
+        for (size_t i = 0; i < analytical_hits; i++) {
+            const Float3& p = hits[i].position_;
+            analytical_differenced[i] = Normalize(Float3{
+                exact_distance(p + Float3{ step, 0, 0 }) - exact_distance(p - Float3{ step, 0, 0 }),
+                exact_distance(p + Float3{ 0, step, 0 }) - exact_distance(p - Float3{ 0, step, 0 }),
+                exact_distance(p + Float3{ 0, 0, step }) - exact_distance(p - Float3{ 0, 0, step }) });
+        }
+    }, analytical_hits);
+    double analytical_gradient_ns = TimeNsPerHit([&] {
+        for (size_t i = 0; i < analytical_hits; i++) {
+            analytical_gradient[i] = Normalize(exact_gradient(hits[i].position_));
+        }
+    }, analytical_hits);
+
+    // Angle of each to the exact gradient, over the hits the Naive path was timed for
+    auto angle_stats = [&](const std::vector<Float3>& normals_found, double& mean, float& p99) {
+        std::vector<float> angles(analytical_hits);
+        for (size_t i = 0; i < analytical_hits; i++) {
+            angles[i] = AngleDegrees(normals_found[i], exact_normals[i]);
+        }
+        std::sort(angles.begin(), angles.end());
+        mean = 0;
+        for (float angle : angles) {
+            mean += angle / angles.size();
+        }
+        p99 = angles[(size_t)(angles.size() * 0.99)];
+    };
+
+    // The gradient must match fine finite differences of the exact SDF, away from the influence cut-off's discontinuity
+    const float fine_step = voxel_size * 0.001f;
+    uint32_t mismatches = 0;
+    for (size_t i = 0; i < analytical_hits; i++) {
+        const Float3& p = hits[i].position_;
+        Float3 fine = {
+            exact_distance(p + Float3{ fine_step, 0, 0 }) - exact_distance(p - Float3{ fine_step, 0, 0 }),
+            exact_distance(p + Float3{ 0, fine_step, 0 }) - exact_distance(p - Float3{ 0, fine_step, 0 }),
+            exact_distance(p + Float3{ 0, 0, fine_step }) - exact_distance(p - Float3{ 0, 0, fine_step }) };
+        if (Length(fine) / (fine_step * 2) < 2 && AngleDegrees(Normalize(fine), exact_normals[i]) > 1.f) {
+            mismatches++;
+        }
+    }
+
+    printf("%u bricks, %zu hits (%zu for the Naive path)\n", brick_pool.bricks_count_, hits.size(), analytical_hits);
+    printf("  %-32s %12s %14s %14s %16s %10s\n", "", "ns per hit", "ms at 1080p", "ms at 4K", "mean error (deg)", "p99 (deg)");
+    auto report = [&](const char* name, double ns, const std::vector<Float3>& normals_found) {
+        double mean;
+        float p99;
+        angle_stats(normals_found, mean, p99);
+        printf("  %-32s %12.1f %14.3f %14.3f %16.3f %10.3f\n", name, ns, ns * 1920 * 1080 * coverage / 1e6, ns * 3840 * 2160 * coverage / 1e6,
+            mean, p99);
+    };
+    report("brick pool, 6 finite differences", differenced_ns, differenced);
+    report("brick pool, normal channel", channel_ns, channel);
+    report("Naive, 6 finite differences", analytical_differenced_ns, analytical_differenced);
+    report("Naive, gradient", analytical_gradient_ns, analytical_gradient);
+    printf("  brick pool normals %.2fx faster, Naive normals %.2fx faster (single thread, %.0f%% of pixels hitting)\n",
+        channel_ns > 0 ? differenced_ns / channel_ns : 0.0, analytical_gradient_ns > 0 ? analytical_differenced_ns / analytical_gradient_ns : 0.0, coverage * 100);
+    printf("  normal channel memory %.2f MB, the distances %.2f MB\n", normals.size() * sizeof(BrickNormal) / 1048576.0,
+        brick_pool.voxels_.size() * sizeof(int16_t) / 1048576.0);
+
+    if (mismatches > 0) {
+        printf("%u gradients differ from finite differences of the exact SDF!\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
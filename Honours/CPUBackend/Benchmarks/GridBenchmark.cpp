@@ -0,0 +1,109 @@
+// Benchmarks the headless grid construction and surface detection stages at 1..N threads.
+// Usage: GridBenchmark (particle no.) (scene) (max threads) (iterations) [particle radius] [surface list order]
+// The grid layout is derived from the particle radius as in the app, which is itself derived from the particle count if left out.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "../GridEngine.h"
+#include "../ParticleScenes.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+struct StageTimes {
+    double clear_ = 0;
+    double grid_ = 0;
+    double surface_blocks_ = 0;
+    double surface_cells_ = 0;
+};
+
+template<typename F>
+static double TimeMs(F&& func)
+{
+    Clock::time_point start = Clock::now();
+    func();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Sorted copy of the valid part of a surface list, as the order depends on thread timing
+static std::vector<uint32_t> SortedList(const std::vector<uint32_t>& list, uint32_t count)
+{
+    std::vector<uint32_t> sorted(list.begin(), list.begin() + count);
+    std::sort(sorted.begin(), sorted.end());
+    return sorted;
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    test_values.num_particles_ = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    test_values.scene_ = argc > 2 ? (SceneType)std::atoi(argv[2]) : SceneWave;
+    unsigned int max_threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    int iterations = argc > 4 ? std::atoi(argv[4]) : 10;
+    test_values.particle_radius_ = argc > 5 ? (float)std::atof(argv[5]) : 0;
+    SurfaceListOrder surface_list_order = argc > 6 ? (SurfaceListOrder)std::atoi(argv[6]) : SurfaceListAppend;
+    DeriveGridValues(test_values);
+
+    uint32_t particle_count = test_values.num_particles_;
+    printf("Grid benchmark: %u particles, scene %d, %d iterations\n", particle_count, test_values.scene_, iterations);
+    printf("Particle radius %.5f, %d^3 cells, %d^3 blocks, %s surface lists\n", test_values.particle_radius_, test_values.cells_per_axis_, test_values.blocks_per_axis_,
+        surface_list_order == SurfaceListSorted ? "sorted" : "appended");
+    printf("%8s %14s %14s %14s %14s %14s\n", "threads", "clear", "grid", "surf. blocks", "surf. cells", "total");
+    printf("%8s %14s %14s %14s %14s %14s\n", "", "(Mparticles/s)", "(Mparticles/s)", "(Mparticles/s)", "(Mparticles/s)", "(ms)");
+
+    std::vector<uint32_t> reference_cells;
+    std::vector<uint32_t> reference_surface_cells;
+    bool valid = true;
+
+    for (unsigned int threads = 1; threads <= max_threads; threads++) {
+        ThreadPool thread_pool(threads);
+        // The GPU's block neighbour rule depends on thread timing, so would fail the check below at random
+        GridEngine grid(&thread_pool, test_values);
+        grid.SetSurfaceListOrder(surface_list_order);
+        grid.SetBlockNeighbourRule(BlockNeighbourFlagged);
+
+        std::vector<ParticleData> particles;
+        GenerateParticles(test_values, particles, &thread_pool);
+        ComputePositions(test_values, 0.5f, particles, &thread_pool);
+
+        // Warm up caches and the pool's threads
+        grid.ComputeGrid(particles);
+
+        StageTimes times;
+        for (int i = 0; i < iterations; i++) {
+            times.clear_ += TimeMs([&] { grid.ClearGridCounts(); });
+            times.grid_ += TimeMs([&] { grid.BuildGrid(particles); });
+            times.surface_blocks_ += TimeMs([&] { grid.DetectSurfaceBlocks(); });
+            times.surface_cells_ += TimeMs([&] { grid.DetectSurfaceCells(); });
+        }
+
+        // Results must match the single threaded run. Sorted lists must already be in order.
+        std::vector<uint32_t> surface_cells = SortedList(grid.GetSurfaceCellIndices(), grid.GetSurfaceCounts().surface_cells);
+        if (surface_list_order == SurfaceListSorted && !std::equal(surface_cells.begin(), surface_cells.end(), grid.GetSurfaceCellIndices().begin())) {
+            printf("Sorted surface cells out of order at %u threads!\n", threads);
+            valid = false;
+        }
+        if (threads == 1) {
+            reference_cells = grid.GetCellCounts();
+            reference_surface_cells = surface_cells;
+        }
+        else if (grid.GetCellCounts() != reference_cells || surface_cells != reference_surface_cells) {
+            printf("Mismatch against single threaded results at %u threads!\n", threads);
+            valid = false;
+        }
+
+        auto throughput = [&](double total_ms) { return particle_count / (total_ms / iterations) / 1000.0; };
+        double total = (times.clear_ + times.grid_ + times.surface_blocks_ + times.surface_cells_) / iterations;
+        printf("%8u %14.2f %14.2f %14.2f %14.2f %14.3f\n", threads,
+            throughput(times.clear_), throughput(times.grid_), throughput(times.surface_blocks_), throughput(times.surface_cells_), total);
+    }
+
+    // Cells holding more than CELL_MAX_PARTICLE_COUNT break the full/empty surface test, so report them
+    size_t overfull_cells = std::count_if(reference_cells.begin(), reference_cells.end(), [](uint32_t count) { return count > CELL_MAX_PARTICLE_COUNT; });
+    printf("Grid: %zu cells, %zu surface cells, %zu overfull cells\n", reference_cells.size(), reference_surface_cells.size(), overfull_cells);
+
+    return valid ? 0 : 1;
+}
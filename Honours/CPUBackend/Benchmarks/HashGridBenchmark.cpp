@@ -0,0 +1,177 @@
+// Compares the dense GridEngine against the sparse HashGridEngine as the domain grows.
+// A domain scale of D keeps the particles and cell size the same but covers D^3 times the volume with cells,
+// which is what a dense grid would need for a world D times wider.
+// Usage: HashGridBenchmark (particle no.) (scene) (threads) (iterations)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unordered_map>
+#include "../BrickPool.h"
+#include "../GridCommon.h"
+#include "../GridEngine.h"
+#include "../HashGridEngine.h"
+#include "../ParticleReorder.h"
+#include "../ParticleScenes.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+// Dense grids beyond this many cells are skipped rather than allocated
+#define MAX_DENSE_CELLS (1 << 25)
+
+template<typename F>
+static double TimeMs(F&& func)
+{
+    Clock::time_point start = Clock::now();
+    func();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Grid build, surface detection and reorder, averaged over the iterations
+template<typename Grid>
+static double TimeGrid(Grid& grid, std::vector<ParticleData>& particles, std::vector<uint32_t>& cell_offsets,
+    std::vector<ParticleData>& particles_ordered, ThreadPool* thread_pool, int iterations)
+{
+    // Warm up, and let the hash grid settle on a capacity
+    grid.ComputeGrid(particles);
+
+    double total = 0;
+    for (int i = 0; i < iterations; i++) {
+        total += TimeMs([&] {
+            grid.ComputeGrid(particles);
+            ComputeCellOffsets(grid.GetCellCounts(), cell_offsets, thread_pool);
+            ReorderParticles(particles, cell_offsets, particles_ordered, thread_pool);
+        });
+    }
+    return total / iterations;
+}
+
+// Every occupied hashed cell must hold as many particles as the same dense cell
+static bool MatchCellCounts(const GridEngine& dense, const HashGridEngine& hashed)
+{
+    const std::vector<uint32_t>& dense_counts = dense.GetCellCounts();
+    uint32_t dense_occupied = (uint32_t)std::count_if(dense_counts.begin(), dense_counts.end(), [](uint32_t count) { return count > 0; });
+    if (dense_occupied != hashed.GetOccupiedCellCount()) {
+        return false;
+    }
+
+    const TestVariables& test_values = dense.GetTestValues();
+    for (uint32_t i = 0; i < hashed.GetOccupiedCellCount(); i++) {
+        uint32_t cell_index = hashed.GetOccupiedCellIndices()[i];
+        Int3 coords = hashed.GetCellCoords(cell_index);
+        uint32_t dense_index = CellCoordsToIndex(test_values, coords.x, coords.y, coords.z);
+        if (dense_counts[dense_index] != hashed.GetCellCounts()[cell_index]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Bricks of the same cell must match, within a couple of steps as the particle order within cells depends on thread timing
+static bool MatchBrickPools(const GridEngine& dense, const BrickPool& dense_pool, const HashGridEngine& hashed, const BrickPool& hashed_pool)
+{
+    if (dense_pool.bricks_count_ != hashed_pool.bricks_count_) {
+        return false;
+    }
+
+    // Surface cell coords to the position of its bricks in the hashed pool
+    std::unordered_map<uint64_t, uint32_t> hashed_surface_cells;
+    auto coords_key = [](const Int3& c) { return ((uint64_t)(uint32_t)c.x) | ((uint64_t)(uint32_t)c.y << 21) | ((uint64_t)(uint32_t)c.z << 42); };
+    for (uint32_t i = 0; i < hashed.GetSurfaceCounts().surface_cells; i++) {
+        hashed_surface_cells[coords_key(hashed.GetCellCoords(hashed.GetSurfaceCellIndices()[i]))] = i;
+    }
+
+    const uint32_t bricks_per_cell = dense_pool.bricks_count_ / std::max(dense.GetSurfaceCounts().surface_cells, 1u);
+    const size_t voxels_per_cell = (size_t)bricks_per_cell * VOXELS_PER_BRICK;
+    for (uint32_t i = 0; i < dense.GetSurfaceCounts().surface_cells; i++) {
+        auto match = hashed_surface_cells.find(coords_key(dense.GetCellCoords(dense.GetSurfaceCellIndices()[i])));
+        if (match == hashed_surface_cells.end()) {
+            return false;
+        }
+
+        const int16_t* dense_voxels = dense_pool.voxels_.data() + i * voxels_per_cell;
+        const int16_t* hashed_voxels = hashed_pool.voxels_.data() + match->second * voxels_per_cell;
+        for (size_t v = 0; v < voxels_per_cell; v++) {
+            if (std::abs(dense_voxels[v] - hashed_voxels[v]) > 2) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables base_values = {};
+    base_values.num_particles_ = argc > 1 ? std::atoi(argv[1]) : 20000;
+    base_values.scene_ = argc > 2 ? (SceneType)std::atoi(argv[2]) : SceneRandom;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    int iterations = argc > 4 ? std::atoi(argv[4]) : 10;
+    base_values.texture_res_ = 256;
+    DeriveGridValues(base_values);
+
+    ThreadPool thread_pool(threads);
+    std::vector<ParticleData> particles;
+    GenerateParticles(base_values, particles, &thread_pool);
+    ComputePositions(base_values, 0.5f, particles, &thread_pool);
+
+    printf("Hash grid benchmark: %d particles, scene %d, %u threads, %d iterations\n", base_values.num_particles_, base_values.scene_, threads, iterations);
+    printf("Grid build + surface detection + reorder, and grid memory including the cell offsets\n");
+    printf("%6s %14s %12s %12s %14s %14s %12s\n", "scale", "cells", "dense (ms)", "hashed (ms)", "dense (MB)", "hashed (MB)", "surf. cells");
+
+    bool valid = true;
+    std::vector<uint32_t> dense_offsets, hashed_offsets;
+    std::vector<ParticleData> dense_ordered, hashed_ordered;
+
+    for (int scale = 1; scale <= 16; scale *= 2) {
+        TestVariables test_values = base_values;
+        test_values.cells_per_axis_ = base_values.cells_per_axis_ * scale;
+        test_values.blocks_per_axis_ = test_values.cells_per_axis_ / NUM_CELLS_PER_AXIS_PER_BLOCK;
+        uint64_t cells = (uint64_t)test_values.cells_per_axis_ * test_values.cells_per_axis_ * test_values.cells_per_axis_;
+        test_values.num_cells_ = (int)std::min<uint64_t>(cells, INT32_MAX);
+        test_values.num_blocks_ = test_values.blocks_per_axis_ * test_values.blocks_per_axis_ * test_values.blocks_per_axis_;
+
+        HashGridEngine hashed(&thread_pool, test_values);
+        double hashed_ms = TimeGrid(hashed, particles, hashed_offsets, hashed_ordered, &thread_pool, iterations);
+        double hashed_mb = (hashed.GetMemoryFootprint() + hashed_offsets.size() * sizeof(uint32_t)) / (1024.0 * 1024.0);
+
+        if (cells > MAX_DENSE_CELLS) {
+            // Cell counts plus offsets and surface list, blocks are negligible
+            double dense_mb = cells * 3 * sizeof(uint32_t) / (1024.0 * 1024.0);
+            printf("%6d %14llu %12s %12.3f %13.1f* %14.2f %12u\n", scale, (unsigned long long)cells, "skipped", hashed_ms, dense_mb, hashed_mb, hashed.GetSurfaceCounts().surface_cells);
+            continue;
+        }
+
+        GridEngine dense(&thread_pool, test_values);
+        double dense_ms = TimeGrid(dense, particles, dense_offsets, dense_ordered, &thread_pool, iterations);
+        double dense_mb = (dense.GetMemoryFootprint() + dense_offsets.size() * sizeof(uint32_t)) / (1024.0 * 1024.0);
+
+        printf("%6d %14llu %12.3f %12.3f %14.2f %14.2f %12u\n", scale, (unsigned long long)cells, dense_ms, hashed_ms, dense_mb, hashed_mb, hashed.GetSurfaceCounts().surface_cells);
+
+        if (!MatchCellCounts(dense, hashed)) {
+            printf("Cell counts differ between the dense and hashed grids at scale %d!\n", scale);
+            valid = false;
+        }
+
+        // The brick pool is only compared at the smallest scale, as the number of surface cells grows with the cell count
+        if (scale == 1) {
+            BrickPool dense_pool, hashed_pool;
+            double dense_pool_ms = TimeMs([&] { FillBrickPool(dense, dense_ordered, dense_offsets, dense_pool, &thread_pool); });
+            double hashed_pool_ms = TimeMs([&] { FillBrickPool(hashed, hashed_ordered, hashed_offsets, hashed_pool, &thread_pool); });
+            printf("%6s brick pool: %u bricks, dense %.3f ms, hashed %.3f ms\n", "", dense_pool.bricks_count_, dense_pool_ms, hashed_pool_ms);
+
+            // Surface detection only matches away from the dense grid's edges and when there are no completely full blocks,
+            // which holds for the default scenes
+            if (dense.GetSurfaceCounts().surface_cells == hashed.GetSurfaceCounts().surface_cells &&
+                !MatchBrickPools(dense, dense_pool, hashed, hashed_pool)) {
+                printf("Brick pools differ between the dense and hashed grids!\n");
+                valid = false;
+            }
+        }
+    }
+    printf("* estimated\n");
+
+    return valid ? 0 : 1;
+}
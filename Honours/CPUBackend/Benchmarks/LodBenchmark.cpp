@@ -0,0 +1,192 @@
+// Compares a brick pool with every surface cell at full resolution against one with each cell's level picked from how
+// many pixels its voxels cover (see BrickLod.h), from the orbital camera at several view distances. Reports the bricks at
+// each level, the memory and fill time against the full pool, for a few pixels per voxel thresholds. Then measures how far
+// the field steps across faces between levels, at the face points the seams are stitched at and between them, before and
+// after stitching, for the views with more than one level. Checks the stitched seams match the coarse field at the face
+// points near the surface, and step no further than the unstitched ones between them.
+// Usage: LodBenchmark (particle no.) (scene) (threads) (texture resolution) (screen height)
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "../BrickLod.h"
+#include "../GridEngine.h"
+#include "../ParticleReorder.h"
+#include "../ParticleScenes.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+#define PI 3.14159265f
+
+struct SeamError {
+    uint64_t points_ = 0;
+    double sum_ = 0;
+    float max_ = 0;
+    uint64_t mismatches_ = 0;  // Points off by more than the tolerance
+
+    void Add(float error, bool mismatch)
+    {
+        points_++;
+        sum_ += error;
+        max_ = std::max(max_, error);
+        mismatches_ += mismatch;
+    }
+    double Mean() const { return points_ ? sum_ / points_ : 0.0; }
+};
+
+// Difference between each brick's field and the coarser cell's across the faces they share, in the brick's voxels. Face
+// points are where the stitching matches the fields, and mismatch past the tolerance there is counted. The points between
+// them are halfway to the next face points along the face. Only points where the coarse field is within band of the
+// surface are measured, at the face points around them too, as past the particles' influence cut-off the field jumps.
+static void MeasureSeams(const GridEngine& grid, const LodBrickPool& brick_pool, float band, float tolerance, SeamError& face_points,
+    SeamError& between_points)
+{
+    const TestVariables& test_values = grid.GetTestValues();
+    auto decode = [](int16_t stored) { return Snorm16ToFloat(stored); };
+
+    for (uint32_t i = 0; i < grid.GetSurfaceCounts().surface_cells; i++) {
+        uint32_t cell_index = grid.GetSurfaceCellIndices()[i];
+        int lod = brick_pool.cell_lods_[cell_index];
+        int neighbouring_cells[27];
+        grid.GetNeighbourCells(cell_index, neighbouring_cells);
+        Int3 cell_coords = grid.GetCellCoords(cell_index);
+        const int bricks_per_axis = BricksPerAxisAtLod(test_values, lod);
+        const float voxel_size = 1.f / (test_values.cells_per_axis_ * bricks_per_axis * CORE_VOXELS_PER_AXIS_PER_BRICK);
+
+        for (int brick = 0; brick < bricks_per_axis * bricks_per_axis * bricks_per_axis; brick++) {
+            const int16_t* voxels = brick_pool.Brick(brick_pool.cell_bricks_[cell_index] + brick);
+            Float3 brick_min = GetLodBrickAABB(test_values, cell_coords, lod, brick).min_;
+            for (int z = 0; z < VOXELS_PER_AXIS_PER_BRICK; z++) {
+                for (int y = 0; y < VOXELS_PER_AXIS_PER_BRICK; y++) {
+                    for (int x = 0; x < VOXELS_PER_AXIS_PER_BRICK; x++) {
+                        Int3 direction = { GetApronDirection(x), GetApronDirection(y), GetApronDirection(z) };
+                        if (std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z) != 1) {
+                            continue;
+                        }
+                        int seam_cell_index = GetLodSeamCell(grid, brick_pool, neighbouring_cells, lod, brick, direction);
+                        if (seam_cell_index < 0) {
+                            continue;
+                        }
+
+                        // In the brick's voxels, u and v being along the face
+                        Float3 face_voxel = Float3{ x - direction.x * 0.5f, y - direction.y * 0.5f, z - direction.z * 0.5f };
+                        Float3 u = direction.x ? Float3{ 0, 1, 0 } : Float3{ 1, 0, 0 };
+                        Float3 v = direction.z ? Float3{ 0, 1, 0 } : Float3{ 0, 0, 1 };
+                        auto coarse_at = [&](const Float3& voxel) {
+                            return SampleLodCell(test_values, brick_pool, seam_cell_index, grid.GetCellCoords(seam_cell_index),
+                                brick_min + (voxel - 0.5f) * voxel_size);
+                        };
+
+                        float coarse = coarse_at(face_voxel);
+                        if (std::abs(coarse) > band) {
+                            continue;
+                        }
+                        float error = std::abs(SampleBrick(voxels, face_voxel, decode) - coarse);
+                        face_points.Add(error / voxel_size, error > tolerance);
+
+                        bool in_band = std::abs(coarse_at(face_voxel + u)) <= band && std::abs(coarse_at(face_voxel + v)) <= band &&
+                            std::abs(coarse_at(face_voxel + u + v)) <= band;
+                        if (in_band) {
+                            Float3 between_voxel = face_voxel + (u + v) * 0.5f;
+                            between_points.Add(std::abs(SampleBrick(voxels, between_voxel, decode) - coarse_at(between_voxel)) / voxel_size, false);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+template<typename F>
+static double TimeMs(F&& func)
+{
+    Clock::time_point start = Clock::now();
+    func();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    test_values.num_particles_ = argc > 1 ? std::atoi(argv[1]) : 4000;
+    test_values.scene_ = argc > 2 ? (SceneType)std::atoi(argv[2]) : SceneWave;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    test_values.texture_res_ = argc > 4 ? std::atoi(argv[4]) : 512;
+    float screen_height = argc > 5 ? (float)std::atof(argv[5]) : 1080.f;
+    DeriveGridValues(test_values);
+
+    ThreadPool thread_pool(threads);
+    std::vector<ParticleData> particles;
+    GenerateParticles(test_values, particles, &thread_pool);
+    ComputePositions(test_values, 0.5f, particles, &thread_pool);
+
+    GridEngine grid(&thread_pool, test_values);
+    grid.ComputeGrid(particles);
+    std::vector<uint32_t> cell_offsets;
+    std::vector<ParticleData> particles_ordered;
+    ComputeCellOffsets(grid.GetCellCounts(), cell_offsets, &thread_pool);
+    ReorderParticles(particles, cell_offsets, particles_ordered, &thread_pool);
+    ParticleDataPositionSource positions{ particles_ordered };
+
+    // Pixels per unit length at unit distance, for the app's PI / 4 vertical field of view
+    const float pixel_scale = screen_height / (2 * std::tan(PI / 8));
+    const double brick_mb = VOXELS_PER_BRICK * sizeof(int16_t) / 1048576.0;
+
+    printf("LOD benchmark: %d particles, scene %d, %u threads, texture resolution %d, %d cells per axis, %d bricks per axis, %d levels, %.0fp\n",
+        test_values.num_particles_, test_values.scene_, threads, test_values.texture_res_, test_values.cells_per_axis_,
+        BricksPerAxisPerCell(test_values), MaxBrickLod(test_values) + 1, screen_height);
+
+    LodBrickPool full_pool;
+    SelectLodBricks(grid, Float3{ 0, 0, 0 }, pixel_scale, 0, full_pool);
+    double full_ms = TimeMs([&] { FillLodBrickPool(grid, positions, cell_offsets, full_pool, &thread_pool); });
+    printf("  full resolution: %u surface cells, %u bricks, %.1f MB, fill %.1f ms\n", grid.GetSurfaceCounts().surface_cells,
+        full_pool.bricks_count_, full_pool.bricks_count_ * brick_mb, full_ms);
+
+    printf("  %-10s %-12s %-20s %10s %10s %10s %10s\n", "view dist", "px per voxel", "cells per level", "bricks", "memory", "fill ms", "fill time");
+    const float band = test_values.particle_radius_;
+    const float tolerance = 1.f / 32767; // A step of the R16_SNORM voxels, the stitched aprons being rounded to them
+    uint64_t mismatched = 0;
+    int worse_views = 0;
+    for (float view_dist : { 1.5f, 2.f, 3.f, 4.f, 5.f }) {
+        // OrbitalCamera at its start
+        Float3 camera = { 0.5f + view_dist, test_values.scene_ == SceneWave ? 0.3f : 0.5f, 0.5f };
+
+        for (float pixels_per_voxel : { 1.f, 2.f, 4.f }) {
+            LodBrickPool brick_pool;
+            SelectLodBricks(grid, camera, pixel_scale, pixels_per_voxel, brick_pool);
+            double fill_ms = TimeMs([&] { FillLodBrickPool(grid, positions, cell_offsets, brick_pool, &thread_pool); });
+
+            char levels[32];
+            snprintf(levels, sizeof(levels), "%u / %u / %u", brick_pool.lod_cells_[0], brick_pool.lod_cells_[1], brick_pool.lod_cells_[2]);
+            printf("  %-10.1f %-12.0f %-20s %10u %9.1f%% %10.1f %9.1f%%\n", view_dist, pixels_per_voxel, levels, brick_pool.bricks_count_,
+                100.0 * brick_pool.bricks_count_ / full_pool.bricks_count_, fill_ms, 100.0 * fill_ms / full_ms);
+
+            // Seams, where there's more than one level
+            if (std::count(brick_pool.lod_cells_, brick_pool.lod_cells_ + MAX_BRICK_LODS, 0u) >= MAX_BRICK_LODS - 1) {
+                continue;
+            }
+            SeamError unstitched_faces, unstitched_between, stitched_faces, stitched_between;
+            MeasureSeams(grid, brick_pool, band, tolerance, unstitched_faces, unstitched_between);
+            uint64_t stitched_voxels = 0;
+            double stitch_ms = TimeMs([&] { stitched_voxels = StitchLodSeams(grid, brick_pool, &thread_pool); });
+            MeasureSeams(grid, brick_pool, band, tolerance, stitched_faces, stitched_between);
+            printf("    seams: %llu apron voxels stitched in %.2f ms, step at face points mean %.4f max %.4f voxels -> mean %.4f max %.4f, "
+                "between them mean %.4f max %.4f -> mean %.4f max %.4f\n", (unsigned long long)stitched_voxels, stitch_ms,
+                unstitched_faces.Mean(), unstitched_faces.max_, stitched_faces.Mean(), stitched_faces.max_,
+                unstitched_between.Mean(), unstitched_between.max_, stitched_between.Mean(), stitched_between.max_);
+            mismatched += stitched_faces.mismatches_;
+            if (stitched_between.max_ > unstitched_between.max_) {
+                printf("    stitching made the seams step further between the face points!\n");
+                worse_views++;
+            }
+        }
+    }
+
+    if (mismatched > 0) {
+        printf("%llu stitched face points don't match the coarse field!\n", (unsigned long long)mismatched);
+    }
+    return mismatched > 0 || worse_views > 0 ? 1 : 0;
+}
@@ -0,0 +1,168 @@
+// Compares the ways the intersection shader can step along rays through the Simple method's dense SDF texture (see
+// MarchingMode in SphereTracing.h), each with the fixed threshold and one growing with distance, for rays from the orbital
+// camera over the test scenes and the particle counts in Tests.bat. Reports the mean, 99th percentile and most steps rays
+// take, how often relaxed steps passed the surface, a histogram of the steps, and how the hits differ from plain sphere
+// tracing with the fixed threshold, including rays hitting more than a voxel further, having stepped through the surface.
+// Checks each hit is within its threshold of the surface when sampled again, and the histogram covers every ray traced.
+// Usage: MarchingBenchmark (particle no., 0 for Tests.bat's) (scene, -1 for random, grid and wave) (threads)
+//        (texture resolution) (image height)
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "../GridEngine.h"
+#include "../ParticleReorder.h"
+#include "../ParticleScenes.h"
+#include "../SimpleTexture.h"
+#include "../SphereTracing.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+template<typename F>
+static double TimeMs(F&& func)
+{
+    Clock::time_point start = Clock::now();
+    func();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static bool RunParticleCount(TestVariables test_values, unsigned int threads, int image_height)
+{
+    DeriveGridValues(test_values);
+    const int texture_res = test_values.texture_res_;
+
+    ThreadPool thread_pool(threads);
+    std::vector<ParticleData> particles;
+    GenerateParticles(test_values, particles, &thread_pool);
+    ComputePositions(test_values, 0.5f, particles, &thread_pool);
+
+    GridEngine grid(&thread_pool, test_values);
+    std::vector<uint32_t> cell_offsets;
+    std::vector<ParticleData> particles_ordered;
+    grid.ComputeGrid(particles);
+    ComputeCellOffsets(grid.GetCellCounts(), cell_offsets, &thread_pool);
+    ReorderParticles(particles, cell_offsets, particles_ordered, &thread_pool);
+
+    std::vector<int16_t> voxels((size_t)texture_res * texture_res * texture_res, 0);
+    FillSimpleTextureGrid(grid, ParticleDataPositionSource{ particles_ordered }, cell_offsets, voxels, &thread_pool, 0, texture_res);
+
+    // Rays from the orbital camera at the default view distance, at 16:9
+    const int image_width = image_height * 16 / 9;
+    const float camera_height = test_values.scene_ == SceneWave ? 0.3f : 0.5f;
+    const float pixel_radius = std::tan(3.14159265f / 8) / image_height;
+    auto trace = [&](const MarchingOptions& options, std::vector<SphereTraceResult>& results) {
+        results.resize((size_t)image_width * image_height);
+        return TimeMs([&] {
+            thread_pool.ParallelFor(0, results.size(), 256, [&](size_t begin, size_t end) {
+                for (size_t pixel = begin; pixel < end; pixel++) {
+                    Float3 origin, direction;
+                    GetOrbitalCameraRay(1.5f, camera_height, image_width, image_height, (int)(pixel % image_width), (int)(pixel / image_width),
+                        origin, direction);
+                    results[pixel] = SphereTraceDenseTexture(voxels, texture_res, origin, direction, options);
+                }
+            });
+        });
+    };
+
+    std::vector<SphereTraceResult> plain_results, results;
+    trace(MarchingOptions(), plain_results);
+    printf("  scene %d, %d particles\n", test_values.scene_, test_values.num_particles_);
+
+    const char* mode_names[] = { "sphere", "over-relaxed", "relaxed cone" };
+    const float voxel_size = 1.f / texture_res;
+    uint64_t invalid = 0;
+    for (MarchingMode mode : { MarchingSphere, MarchingOverRelaxed, MarchingRelaxedCone }) {
+        for (bool adaptive : { false, true }) {
+            MarchingOptions options;
+            options.mode_ = mode;
+            options.pixel_radius_ = adaptive ? pixel_radius : 0;
+            double ms = trace(options, results);
+
+            std::vector<int> steps(results.size());
+            uint64_t step_sum = 0, overshoots = 0, hits_lost = 0, hits_gained = 0, both_hit = 0, through = 0, traced = 0;
+            double hit_t_diff = 0;
+            for (size_t pixel = 0; pixel < results.size(); pixel++) {
+                const SphereTraceResult& result = results[pixel];
+                const SphereTraceResult& plain = plain_results[pixel];
+                steps[pixel] = result.steps_;
+                step_sum += result.steps_;
+                overshoots += result.overshoots_;
+                hits_lost += plain.hit_ && !result.hit_;
+                hits_gained += !plain.hit_ && result.hit_;
+                if (plain.hit_ && result.hit_) {
+                    both_hit++;
+                    hit_t_diff += std::abs(result.t_ - plain.t_);
+                }
+                through += plain.hit_ && result.hit_ && result.t_ > plain.t_ + voxel_size;
+                traced += result.steps_ > 0;
+
+                if (result.hit_) {
+                    Float3 origin, direction;
+                    GetOrbitalCameraRay(1.5f, camera_height, image_width, image_height, (int)(pixel % image_width), (int)(pixel / image_width),
+                        origin, direction);
+                    float distance = SampleDenseTexture(voxels, texture_res, Clamp(origin + direction * result.t_, 0, 1));
+                    invalid += distance > GetMarchingThreshold(options, result.t_);
+                }
+            }
+
+            uint64_t bins[STEP_HISTOGRAM_BINS], binned = 0;
+            GetStepHistogram(results, bins);
+            for (uint64_t bin : bins) {
+                binned += bin;
+            }
+            invalid += binned != traced;
+            const size_t p99 = steps.size() * 99 / 100;
+            std::nth_element(steps.begin(), steps.begin() + p99, steps.end());
+            int max_steps = *std::max_element(steps.begin(), steps.end());
+
+            printf("    %-13s %-9s %8.2f %6d %6d %8.3f %8.1f %8llu %8llu %8llu %12.6f  ", mode_names[mode], adaptive ? "adaptive" : "fixed",
+                (double)step_sum / results.size(), steps[p99], max_steps, (double)overshoots / results.size(), ms,
+                (unsigned long long)hits_lost, (unsigned long long)hits_gained, (unsigned long long)through, both_hit ? hit_t_diff / both_hit : 0.0);
+            for (uint64_t bin : bins) {
+                printf(" %5.1f", traced ? 100.0 * bin / traced : 0.0);
+            }
+            printf("\n");
+        }
+    }
+
+    if (invalid > 0) {
+        printf("    %llu hits aren't within the threshold of the surface, or histograms don't cover every ray!\n", (unsigned long long)invalid);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    int particle_count = argc > 1 ? std::atoi(argv[1]) : 0;
+    int scene = argc > 2 ? std::atoi(argv[2]) : -1;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    test_values.texture_res_ = argc > 4 ? std::atoi(argv[4]) : 256;
+    int image_height = argc > 5 ? std::atoi(argv[5]) : 270;
+
+    printf("Marching benchmark: %u threads, texture resolution %d, %dp, over-relaxation %.1f, relaxed cone at most %.1fx with %d search steps\n",
+        threads, test_values.texture_res_, image_height, OVER_RELAXATION, RELAXED_CONE_MAX_RELAXATION, RELAXED_CONE_SEARCH_STEPS);
+    printf("    %-13s %-9s %8s %6s %6s %8s %8s %8s %8s %8s %12s   %% of rays taking 1, 2-3, 4-7, ... steps\n", "mode", "threshold", "steps",
+        "p99", "max", "passed", "ms", "lost", "gained", "further", "hit t diff");
+
+    bool valid = true;
+    for (SceneType scene_type : { SceneRandom, SceneGrid, SceneWave }) {
+        if (scene >= 0 && scene_type != scene) {
+            continue;
+        }
+        for (int count : { 1, 27, 343, 1000, 10648 }) {
+            if (particle_count > 0 && count != particle_count) {
+                continue;
+            }
+            test_values.scene_ = scene_type;
+            test_values.num_particles_ = count;
+            test_values.particle_radius_ = 0; // Derived from the count
+            valid &= RunParticleCount(test_values, threads, image_height);
+        }
+    }
+    return valid ? 0 : 1;
+}
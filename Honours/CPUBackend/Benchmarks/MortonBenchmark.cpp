@@ -0,0 +1,369 @@
+// Compares linear and Morton cell indexing on the grid stages and the brick pool fill.
+// Cache misses during the fill come from the hardware counters where perf_event_open is available (Linux),
+// and from a simple LRU cache model of the fill's grid and particle reads everywhere.
+// Usage: MortonBenchmark (particle no.) (scene) (threads) (iterations)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include "../BrickPool.h"
+#include "../GridEngine.h"
+#include "../Morton.h"
+#include "../ParticleReorder.h"
+#include "../ParticleScenes.h"
+#include "../ParticleSort.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+template<typename F>
+static double TimeMs(F&& func)
+{
+    Clock::time_point start = Clock::now();
+    func();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Hardware cache reference/miss counters for this process, including threads created after Open
+class PerfCounters
+{
+public:
+    bool Open()
+    {
+#if defined(__linux__)
+        references_fd_ = OpenCounter(PERF_COUNT_HW_CACHE_REFERENCES);
+        misses_fd_ = OpenCounter(PERF_COUNT_HW_CACHE_MISSES);
+#endif
+        return IsOpen();
+    }
+
+    ~PerfCounters()
+    {
+#if defined(__linux__)
+        if (references_fd_ >= 0) close(references_fd_);
+        if (misses_fd_ >= 0) close(misses_fd_);
+#endif
+    }
+
+    inline bool IsOpen() const { return references_fd_ >= 0 && misses_fd_ >= 0; }
+
+    template<typename F>
+    void Measure(F&& func, uint64_t& references, uint64_t& misses)
+    {
+        references = misses = 0;
+        if (!IsOpen()) {
+            func();
+            return;
+        }
+#if defined(__linux__)
+        for (int fd : { references_fd_, misses_fd_ }) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        func();
+        for (int fd : { references_fd_, misses_fd_ }) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+        if (read(references_fd_, &references, sizeof(references)) != sizeof(references) || read(misses_fd_, &misses, sizeof(misses)) != sizeof(misses)) {
+            references = misses = 0;
+        }
+#endif
+    }
+
+private:
+#if defined(__linux__)
+    static int OpenCounter(uint64_t config)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif
+
+    int references_fd_ = -1;
+    int misses_fd_ = -1;
+};
+
+// Set-associative LRU cache with 64 byte lines, counting misses for a stream of addresses
+class CacheModel
+{
+public:
+    CacheModel(size_t size_bytes, uint32_t ways) :
+        ways_(ways),
+        sets_(size_bytes / 64 / ways),
+        lines_(sets_ * ways, ~0ull),
+        ages_(sets_ * ways, 0)
+    {
+    }
+
+    void Access(const void* address, size_t bytes)
+    {
+        uint64_t first = (uint64_t)(uintptr_t)address / 64;
+        uint64_t last = ((uint64_t)(uintptr_t)address + bytes - 1) / 64;
+        for (uint64_t line = first; line <= last; line++) {
+            AccessLine(line);
+        }
+    }
+
+    inline uint64_t GetMisses() const { return misses_; }
+    inline uint64_t GetAccesses() const { return accesses_; }
+
+private:
+    void AccessLine(uint64_t line)
+    {
+        accesses_++;
+        time_++;
+        size_t set = (line % sets_) * ways_;
+
+        size_t victim = set;
+        for (size_t way = set; way < set + ways_; way++) {
+            if (lines_[way] == line) {
+                ages_[way] = time_;
+                return;
+            }
+            if (ages_[way] < ages_[victim]) {
+                victim = way;
+            }
+        }
+
+        misses_++;
+        lines_[victim] = line;
+        ages_[victim] = time_;
+    }
+
+    size_t ways_;
+    size_t sets_;
+    std::vector<uint64_t> lines_;
+    std::vector<uint64_t> ages_;
+    uint64_t time_ = 0;
+    uint64_t accesses_ = 0;
+    uint64_t misses_ = 0;
+};
+
+// Replays the cell count, cell offset and particle reads of the brick pool fill, once per brick
+// (the voxels of a brick re-read the same data, which would hit in any level of cache).
+static void ModelBrickPoolReads(const GridEngine& grid, const std::vector<uint32_t>& cell_offsets, const std::vector<ParticleData>& particles_ordered,
+    CacheModel& l1, CacheModel& l2)
+{
+    const std::vector<uint32_t>& cell_counts = grid.GetCellCounts();
+
+    for (uint32_t i = 0; i < grid.GetSurfaceCounts().surface_cells; i++) {
+        int neighbouring_cells[27];
+        grid.GetNeighbourCells(grid.GetSurfaceCellIndices()[i], neighbouring_cells);
+
+        for (int cell_index : neighbouring_cells) {
+            if (cell_index < 0) {
+                continue;
+            }
+            for (CacheModel* cache : { &l1, &l2 }) {
+                cache->Access(&cell_counts[cell_index], sizeof(uint32_t));
+                cache->Access(&cell_offsets[cell_index], sizeof(uint32_t));
+                if (cell_counts[cell_index] > 0) {
+                    cache->Access(&particles_ordered[cell_offsets[cell_index]], cell_counts[cell_index] * sizeof(ParticleData));
+                }
+            }
+        }
+    }
+}
+
+struct ModeResults {
+    double grid_ms_ = 0;
+    double brick_pool_ms_ = 0;
+    uint64_t perf_references_ = 0;
+    uint64_t perf_misses_ = 0;
+    uint64_t model_accesses_ = 0;
+    uint64_t model_l1_misses_ = 0;
+    uint64_t model_l2_misses_ = 0;
+    uint32_t bricks_count_ = 0;
+    size_t footprint_ = 0;
+
+    // Brick voxels by cell coords, for comparing the two modes
+    std::map<uint64_t, std::vector<int16_t>> bricks_by_cell_;
+};
+
+static ModeResults RunMode(TestVariables test_values, CellIndexing cell_indexing, unsigned int threads, int iterations, bool keep_bricks)
+{
+    ModeResults results;
+    test_values.cell_indexing_ = cell_indexing;
+    DeriveGridValues(test_values);
+
+    // Counters must be opened before the pool's threads are created for them to be included
+    PerfCounters perf;
+    perf.Open();
+    ThreadPool thread_pool(threads);
+
+    std::vector<ParticleData> particles, particles_ordered;
+    std::vector<uint32_t> cell_offsets;
+    GenerateParticles(test_values, particles, &thread_pool);
+    ComputePositions(test_values, 0.5f, particles, &thread_pool);
+
+    // The GPU's block counts can hold different cells from run to run (see GridEngine.h), so the bricks of the two modes
+    // are only comparable with sorted lists and the deterministic rule
+    GridEngine grid(&thread_pool, test_values);
+    grid.SetSurfaceListOrder(SurfaceListSorted);
+    grid.SetBlockNeighbourRule(BlockNeighbourFlagged);
+    auto compute_grid = [&] {
+        grid.ComputeGrid(particles);
+        ComputeCellOffsets(grid.GetCellCounts(), cell_offsets, &thread_pool);
+        ReorderParticles(particles, cell_offsets, particles_ordered, &thread_pool);
+    };
+    compute_grid();
+    for (int i = 0; i < iterations; i++) {
+        results.grid_ms_ += TimeMs(compute_grid) / iterations;
+    }
+
+    // The fill's smooth min depends on the order of the particles within each cell, which the grid build's atomics change
+    // from run to run. Sorting them stably keeps the bricks of the two modes comparable.
+    ParticleSorter sorter(&thread_pool, test_values);
+    sorter.Sort(particles, particles_ordered, SortCounting);
+    cell_offsets = sorter.GetCellOffsets();
+
+    BrickPool brick_pool;
+    FillBrickPool(grid, particles_ordered, cell_offsets, brick_pool, &thread_pool);
+    for (int i = 0; i < iterations; i++) {
+        uint64_t references, misses;
+        perf.Measure([&] {
+            results.brick_pool_ms_ += TimeMs([&] { FillBrickPool(grid, particles_ordered, cell_offsets, brick_pool, &thread_pool); }) / iterations;
+        }, references, misses);
+        results.perf_references_ += references / iterations;
+        results.perf_misses_ += misses / iterations;
+    }
+
+    // Roughly a per-core L1D and L2
+    CacheModel l1(32 * 1024, 8), l2(1024 * 1024, 16);
+    ModelBrickPoolReads(grid, cell_offsets, particles_ordered, l1, l2);
+    results.model_accesses_ = l1.GetAccesses() / 2;
+    results.model_l1_misses_ = l1.GetMisses();
+    results.model_l2_misses_ = l2.GetMisses();
+
+    results.bricks_count_ = brick_pool.bricks_count_;
+    results.footprint_ = grid.GetMemoryFootprint() + cell_offsets.size() * sizeof(uint32_t);
+
+    if (keep_bricks) {
+        const uint32_t bricks_per_cell = brick_pool.bricks_count_ / std::max(grid.GetSurfaceCounts().surface_cells, 1u);
+        const size_t voxels_per_cell = (size_t)bricks_per_cell * VOXELS_PER_BRICK;
+        for (uint32_t i = 0; i < grid.GetSurfaceCounts().surface_cells; i++) {
+            Int3 coords = grid.GetCellCoords(grid.GetSurfaceCellIndices()[i]);
+            uint64_t key = (uint64_t)coords.x | ((uint64_t)coords.y << 21) | ((uint64_t)coords.z << 42);
+            auto first = brick_pool.voxels_.begin() + i * voxels_per_cell;
+            results.bricks_by_cell_[key].assign(first, first + voxels_per_cell);
+        }
+    }
+
+    return results;
+}
+
+// The LUT and BMI2 paths must agree, and decoding must invert encoding
+static bool ValidateMortonCodes()
+{
+    for (uint32_t z = 0; z < MAX_CELLS_PER_AXIS; z++) {
+        for (uint32_t y = 0; y < MAX_CELLS_PER_AXIS; y++) {
+            for (uint32_t x = 0; x < MAX_CELLS_PER_AXIS; x++) {
+                uint32_t code = MortonEncode(x, y, z);
+                UInt3 coords = MortonDecode(code);
+                UInt3 lut_coords = MortonDecodeLUT(code);
+                if (code != MortonEncodeLUT(x, y, z) || coords.x != x || coords.y != y || coords.z != z ||
+                    lut_coords.x != x || lut_coords.y != y || lut_coords.z != z) {
+                    printf("Morton code mismatch at (%u, %u, %u)!\n", x, y, z);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Encode + decode throughput over a 128^3 grid, in millions of cells per second
+template<typename Encode, typename Decode>
+static double CodeThroughput(Encode&& encode, Decode&& decode)
+{
+    volatile uint32_t sink = 0;
+    double ms = TimeMs([&] {
+        uint32_t checksum = 0;
+        for (uint32_t z = 0; z < MAX_CELLS_PER_AXIS; z++) {
+            for (uint32_t y = 0; y < MAX_CELLS_PER_AXIS; y++) {
+                for (uint32_t x = 0; x < MAX_CELLS_PER_AXIS; x++) {
+                    UInt3 coords = decode(encode(x, y, z));
+                    checksum += coords.x ^ coords.y ^ coords.z;
+                }
+            }
+        }
+        sink = checksum;
+    });
+    (void)sink;
+    return MAX_CELLS_PER_AXIS * MAX_CELLS_PER_AXIS * MAX_CELLS_PER_AXIS / ms / 1000.0;
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    test_values.num_particles_ = argc > 1 ? std::atoi(argv[1]) : 20000;
+    test_values.scene_ = argc > 2 ? (SceneType)std::atoi(argv[2]) : SceneWave;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    int iterations = argc > 4 ? std::atoi(argv[4]) : 3;
+    test_values.texture_res_ = 256;
+
+    bool valid = ValidateMortonCodes();
+#if defined(__BMI2__)
+    printf("Morton encode + decode: BMI2 %.1f Mcells/s, LUT %.1f Mcells/s\n",
+        CodeThroughput([](uint32_t x, uint32_t y, uint32_t z) { return MortonEncode(x, y, z); }, [](uint32_t c) { return MortonDecode(c); }),
+        CodeThroughput([](uint32_t x, uint32_t y, uint32_t z) { return MortonEncodeLUT(x, y, z); }, [](uint32_t c) { return MortonDecodeLUT(c); }));
+#else
+    printf("Morton encode + decode: LUT %.1f Mcells/s (built without BMI2)\n",
+        CodeThroughput([](uint32_t x, uint32_t y, uint32_t z) { return MortonEncodeLUT(x, y, z); }, [](uint32_t c) { return MortonDecodeLUT(c); }));
+#endif
+
+    DeriveGridValues(test_values);
+    printf("Morton benchmark: %d particles, scene %d, %d^3 cells, %u threads, %d iterations\n",
+        test_values.num_particles_, test_values.scene_, test_values.cells_per_axis_, threads, iterations);
+
+    ModeResults linear = RunMode(test_values, CellIndexingLinear, threads, iterations, true);
+    ModeResults morton = RunMode(test_values, CellIndexingMorton, threads, iterations, true);
+
+    printf("%8s %10s %12s %14s %14s %14s %14s %14s %12s\n", "indexing", "grid (ms)", "bricks (ms)", "Mvoxels/s",
+        "HW refs", "HW misses", "model L1 miss", "model L2 miss", "grid (KB)");
+    for (const auto& [name, results] : { std::pair<const char*, const ModeResults&>("linear", linear), std::pair<const char*, const ModeResults&>("Morton", morton) }) {
+        double voxels_per_second = (double)results.bricks_count_ * VOXELS_PER_BRICK / results.brick_pool_ms_ / 1000.0;
+        char perf_refs[32] = "n/a", perf_misses[32] = "n/a";
+        if (results.perf_references_ > 0) {
+            snprintf(perf_refs, sizeof(perf_refs), "%llu", (unsigned long long)results.perf_references_);
+            snprintf(perf_misses, sizeof(perf_misses), "%llu", (unsigned long long)results.perf_misses_);
+        }
+        printf("%8s %10.3f %12.3f %14.2f %14s %14s %13.2f%% %13.2f%% %12.1f\n", name, results.grid_ms_, results.brick_pool_ms_, voxels_per_second,
+            perf_refs, perf_misses, 100.0 * results.model_l1_misses_ / std::max<uint64_t>(results.model_accesses_, 1),
+            100.0 * results.model_l2_misses_ / std::max<uint64_t>(results.model_accesses_, 1), results.footprint_ / 1024.0);
+    }
+
+    // Both modes must produce the same surface cells, and the same bricks for them
+    bool bricks_match = linear.bricks_by_cell_.size() == morton.bricks_by_cell_.size();
+    for (auto linear_cell = linear.bricks_by_cell_.begin(); bricks_match && linear_cell != linear.bricks_by_cell_.end(); ++linear_cell) {
+        auto morton_cell = morton.bricks_by_cell_.find(linear_cell->first);
+        bricks_match = morton_cell != morton.bricks_by_cell_.end();
+        for (size_t v = 0; bricks_match && v < linear_cell->second.size(); v++) {
+            bricks_match = std::abs(linear_cell->second[v] - morton_cell->second[v]) <= 2;
+        }
+    }
+    if (!bricks_match) {
+        printf("Brick pools differ between linear and Morton indexing!\n");
+        valid = false;
+    }
+
+    return valid ? 0 : 1;
+}
@@ -0,0 +1,259 @@
+// Compares filling the Simple method's dense SDF texture from the grid everywhere (see SimpleTexture.h) against only within
+// a narrow band of voxels around the cells the surface can be in, flooding a cheaper distance out over the rest (see
+// NarrowBand.h), for a few band widths over the particle counts in Tests.bat. Reports the fraction of voxels in the band,
+// the build time of each, and the sphere tracing steps rays from the orbital camera take through each texture.
+// Checks the band's voxels match the full texture, and that outside the fluid the far field is never further than the full
+// texture's surface, from an exact distance transform of the voxels the surface passes near.
+// The voxels the band leaves out are the cheap ones, with no particles around them, so it only saves time where it covers
+// a small part of the texture. Where the particles fill the volume, as in the random scene, the band covers nearly every
+// voxel and the flood and far field passes make it slower than the full texture.
+// Usage: NarrowBandBenchmark (particle no., 0 for Tests.bat's) (scene) (threads) (iterations) (texture resolution) (image height)
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "../GridEngine.h"
+#include "../NarrowBand.h"
+#include "../ParticleReorder.h"
+#include "../ParticleScenes.h"
+#include "../SphereTracing.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+struct TraceStats {
+    uint64_t rays_ = 0;
+    uint64_t steps_ = 0;
+    int max_steps_ = 0;
+    uint64_t hits_ = 0;
+
+    void Add(const SphereTraceResult& result)
+    {
+        rays_++;
+        steps_ += result.steps_;
+        max_steps_ = std::max(max_steps_, result.steps_);
+        hits_ += result.hit_;
+    }
+    double Mean() const { return rays_ ? (double)steps_ / rays_ : 0.0; }
+};
+
+// Squared distance transform along one line of the texture, (Felzenszwalb & Huttenlocher, 2012) lower envelope of parabolas
+static void DistanceTransform1D(float* line, size_t stride, int count, std::vector<float>& f, std::vector<int>& v, std::vector<float>& z)
+{
+    for (int i = 0; i < count; i++) {
+        f[i] = line[i * stride];
+    }
+    int k = 0;
+    v[0] = 0;
+    z[0] = -1e30f;
+    z[1] = 1e30f;
+    for (int q = 1; q < count; q++) {
+        float s;
+        while (true) {
+            s = ((f[q] + (float)q * q) - (f[v[k]] + (float)v[k] * v[k])) / (2.f * q - 2.f * v[k]);
+            if (s > z[k] || k == 0) {
+                break;
+            }
+            k--;
+        }
+        if (s <= z[k]) {
+            v[0] = q; // Every earlier parabola is above this one
+            z[0] = -1e30f;
+            z[1] = 1e30f;
+            k = 0;
+            continue;
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = 1e30f;
+    }
+    k = 0;
+    for (int q = 0; q < count; q++) {
+        while (z[k + 1] < q) {
+            k++;
+        }
+        line[q * stride] = (float)(q - v[k]) * (q - v[k]) + f[v[k]];
+    }
+}
+
+// Squared distance in voxels from each voxel to the nearest seed voxel, seeds being 0 and the rest infinite to begin with
+static void DistanceTransform(std::vector<float>& squared, int texture_res, ThreadPool* thread_pool)
+{
+    const size_t strides[3] = { 1, (size_t)texture_res, (size_t)texture_res * texture_res };
+    for (int axis = 0; axis < 3; axis++) {
+        thread_pool->ParallelFor(0, (size_t)texture_res * texture_res, 64, [&](size_t begin, size_t end) {
+            std::vector<float> f(texture_res), z(texture_res + 1);
+            std::vector<int> v(texture_res);
+            for (size_t line = begin; line < end; line++) {
+                // The two axes other than the one transformed
+                size_t a = line % texture_res, b = line / texture_res;
+                size_t start = axis == 0 ? (b * texture_res + a) * texture_res : axis == 1 ? b * strides[2] + a : b * texture_res + a;
+                DistanceTransform1D(squared.data() + start, strides[axis], texture_res, f, v, z);
+            }
+        });
+    }
+}
+
+template<typename F>
+static double TimeMs(F&& func, int iterations)
+{
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        func();
+    }
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+}
+
+static bool RunParticleCount(TestVariables test_values, unsigned int threads, int iterations, int image_height)
+{
+    DeriveGridValues(test_values);
+    const int texture_res = test_values.texture_res_;
+    const size_t texture_voxels = (size_t)texture_res * texture_res * texture_res;
+
+    ThreadPool thread_pool(threads);
+    std::vector<ParticleData> particles;
+    GenerateParticles(test_values, particles, &thread_pool);
+    ComputePositions(test_values, 0.5f, particles, &thread_pool);
+
+    GridEngine grid(&thread_pool, test_values);
+    std::vector<uint32_t> cell_offsets;
+    std::vector<ParticleData> particles_ordered;
+    grid.ComputeGrid(particles);
+    ComputeCellOffsets(grid.GetCellCounts(), cell_offsets, &thread_pool);
+    ReorderParticles(particles, cell_offsets, particles_ordered, &thread_pool);
+    ParticleDataPositionSource positions{ particles_ordered };
+
+    // Allocated up front, so page faults aren't timed
+    std::vector<int16_t> full_voxels(texture_voxels, 0), band_voxels(texture_voxels, 0);
+    double full_ms = TimeMs([&] { FillSimpleTextureGrid(grid, positions, cell_offsets, full_voxels, &thread_pool, 0, texture_res); }, iterations);
+
+    // Rays from the orbital camera at the default view distance, at 16:9
+    const int image_width = image_height * 16 / 9;
+    const float camera_height = test_values.scene_ == SceneWave ? 0.3f : 0.5f;
+    auto trace = [&](const std::vector<int16_t>& voxels, std::vector<SphereTraceResult>& results) {
+        results.resize((size_t)image_width * image_height);
+        thread_pool.ParallelFor(0, results.size(), 256, [&](size_t begin, size_t end) {
+            for (size_t pixel = begin; pixel < end; pixel++) {
+                Float3 origin, direction;
+                GetOrbitalCameraRay(1.5f, camera_height, image_width, image_height, (int)(pixel % image_width), (int)(pixel / image_width), origin, direction);
+                results[pixel] = SphereTraceDenseTexture(voxels, texture_res, origin, direction);
+            }
+        });
+    };
+    // Exact distance to the voxels the full texture's surface passes within half a voxel diagonal of, which are within that
+    // of the surface too, so the surface is no nearer than that distance less the half diagonal
+    const float voxel_size = 1.f / texture_res;
+    const float half_diagonal = 0.5f * std::sqrt(3.f) * voxel_size;
+    std::vector<float> surface_distances(texture_voxels);
+    for (size_t voxel = 0; voxel < texture_voxels; voxel++) {
+        surface_distances[voxel] = std::abs(Snorm16ToFloat(full_voxels[voxel])) <= half_diagonal ? 0.f : 1e20f;
+    }
+    DistanceTransform(surface_distances, texture_res, &thread_pool);
+
+    std::vector<SphereTraceResult> full_results, band_results;
+    trace(full_voxels, full_results);
+    TraceStats full_stats;
+    for (const SphereTraceResult& result : full_results) {
+        full_stats.Add(result);
+    }
+
+    printf("  %d particles, %d cells per axis, radius %.4f: full texture %.1f ms, steps mean %.2f max %d, %llu of %llu rays hit\n",
+        test_values.num_particles_, test_values.cells_per_axis_, test_values.particle_radius_, full_ms, full_stats.Mean(),
+        full_stats.max_steps_, (unsigned long long)full_stats.hits_, (unsigned long long)full_stats.rays_);
+    printf("    %-6s %8s %10s %10s %10s %10s %8s %10s %10s %10s %12s\n", "band", "in band", "band ms", "flood ms", "far ms", "total ms",
+        "saving", "steps", "max steps", "hits diff", "hit t diff");
+
+    const float step = 1.f / 32767; // Of the R16_SNORM voxels
+    uint64_t mismatched = 0, over = 0;
+    for (int band_width : { 2, 4, 8 }) {
+        NarrowBand band;
+        band.band_voxels_ = band_width;
+        double band_ms = TimeMs([&] { FillNarrowBand(grid, positions, cell_offsets, band, band_voxels, &thread_pool); }, iterations);
+        double flood_ms = TimeMs([&] { FloodNarrowBand(test_values, band, &thread_pool); }, iterations);
+        double far_ms = TimeMs([&] { FillFarField(grid, band, band_voxels, &thread_pool); }, iterations);
+        if (band.band_voxels_ != band_width) {
+            continue; // Clamped to the cell size, so the same as a narrower band
+        }
+
+        // Band voxels must match, far voxels outside the fluid mustn't be further than the surface
+        uint64_t in_band = 0, band_mismatched = 0, far_over = 0;
+        for (int z = 0; z < texture_res; z++) {
+            for (int y = 0; y < texture_res; y++) {
+                for (int x = 0; x < texture_res; x++) {
+                    size_t voxel = ((size_t)z * texture_res + y) * texture_res + x;
+                    Float3 position = GetSimpleTextureVoxelPosition(texture_res, x, y, z);
+                    uint32_t cell_index = GetCellIndex(test_values, position);
+                    int neighbouring_cells[27];
+                    grid.GetNeighbourCells(cell_index, neighbouring_cells);
+                    if (IsNarrowBandVoxel(test_values, band, neighbouring_cells, grid.GetCellCoords(cell_index), position)) {
+                        in_band++;
+                        band_mismatched += band_voxels[voxel] != full_voxels[voxel];
+                    }
+                    else if (grid.GetCellCounts()[cell_index] == 0) {
+                        float surface_distance = std::sqrt(surface_distances[voxel]) * voxel_size - half_diagonal;
+                        far_over += Snorm16ToFloat(band_voxels[voxel]) > surface_distance + step;
+                    }
+                }
+            }
+        }
+        mismatched += band_mismatched;
+        over += far_over;
+
+        trace(band_voxels, band_results);
+        TraceStats band_stats;
+        uint64_t hits_differ = 0, both_hit = 0;
+        double hit_t_diff = 0;
+        for (size_t pixel = 0; pixel < band_results.size(); pixel++) {
+            band_stats.Add(band_results[pixel]);
+            hits_differ += band_results[pixel].hit_ != full_results[pixel].hit_;
+            if (band_results[pixel].hit_ && full_results[pixel].hit_) {
+                both_hit++;
+                hit_t_diff += std::abs(band_results[pixel].t_ - full_results[pixel].t_);
+            }
+        }
+
+        double total_ms = band_ms + flood_ms + far_ms;
+        printf("    %-6d %7.2f%% %10.1f %10.1f %10.1f %10.1f %7.1f%% %10.2f %10d %10llu %12.6f\n", band.band_voxels_, 100.0 * in_band / texture_voxels,
+            band_ms, flood_ms, far_ms, total_ms, 100.0 * (1 - total_ms / full_ms), band_stats.Mean(), band_stats.max_steps_,
+            (unsigned long long)hits_differ, both_hit ? hit_t_diff / both_hit : 0.0);
+        if (band_mismatched > 0 || far_over > 0) {
+            printf("    %llu band voxels don't match, %llu far voxels are further than the surface\n", (unsigned long long)band_mismatched,
+                (unsigned long long)far_over);
+        }
+    }
+
+    return mismatched == 0 && over == 0;
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    int particle_count = argc > 1 ? std::atoi(argv[1]) : 0;
+    test_values.scene_ = argc > 2 ? (SceneType)std::atoi(argv[2]) : SceneWave;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    int iterations = argc > 4 ? std::max(std::atoi(argv[4]), 1) : 3;
+    test_values.texture_res_ = argc > 5 ? std::atoi(argv[5]) : 256;
+    int image_height = argc > 6 ? std::atoi(argv[6]) : 270;
+
+    printf("Narrow band benchmark: scene %d, %u threads, %d iterations, texture resolution %d, flood grid %d, %dp\n", test_values.scene_,
+        threads, iterations, test_values.texture_res_, NarrowBand().FloodResolution(test_values), image_height);
+
+    bool valid = true;
+    for (int count : { 1, 27, 343, 1000, 10648 }) {
+        if (particle_count > 0 && count != particle_count) {
+            continue;
+        }
+        test_values.num_particles_ = count;
+        test_values.particle_radius_ = 0; // Derived from the count
+        valid &= RunParticleCount(test_values, threads, iterations, image_height);
+    }
+
+    if (!valid) {
+        printf("The narrow band texture doesn't match the full texture!\n");
+        return 1;
+    }
+    return 0;
+}
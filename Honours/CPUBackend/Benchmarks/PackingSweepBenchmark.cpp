@@ -0,0 +1,188 @@
+// Sweeps brick counts from 1 up to the given maximum through the brick pool's packing (see BrickPoolPacking.h), against
+// the cube root guess the brick pool used before. Every count is packed up to 10000 bricks, then counts 0.2% apart.
+// Reports the slots allocated but not needed and the memory wasted once each texture is padded to whole 64KB tiles,
+// by decade of brick count, then packs the same counts with a smaller texture limit to show bricks spread over pages.
+// Checks every packing holds the bricks within the limit, never takes more memory than the guess when that fits, and
+// that each page's slots map to distinct bricks.
+// Usage: PackingSweepBenchmark (max bricks) (texel bytes) (normal channel, 1 for RGBA8) (paged texture limit)
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "../../BrickPoolPacking.h"
+#include "../BrickKernel.h"
+
+using namespace CPUBackend;
+
+struct DecadeWaste {
+    uint64_t counts_ = 0;
+    double slot_waste_sum_ = 0; // Fraction of the slots not needed
+    double slot_waste_max_ = 0;
+    double byte_waste_sum_ = 0; // Fraction of the tile padded bytes not holding a needed brick
+    double byte_waste_max_ = 0;
+    uint64_t over_limit_ = 0;   // Packings past the per axis limit
+
+    void Add(double slot_waste, double byte_waste, bool over_limit)
+    {
+        counts_++;
+        slot_waste_sum_ += slot_waste;
+        slot_waste_max_ = std::max(slot_waste_max_, slot_waste);
+        byte_waste_sum_ += byte_waste;
+        byte_waste_max_ = std::max(byte_waste_max_, byte_waste);
+        over_limit_ += over_limit;
+    }
+};
+
+// The brick pool's previous packing, greedily taking x as the cube root then y as the square root of the rest
+static uint64_t CubeRootPacking(uint32_t bricks, uint32_t dimensions[3])
+{
+    int cube_root = (int)std::ceil(std::cbrt(bricks));
+    dimensions[0] = cube_root;
+
+    while (dimensions[0] > 0) {
+        int remaining = (int)std::ceil((double)bricks / dimensions[0]);
+        int y_approx = (int)std::sqrt(remaining);
+        int z_approx = (int)std::ceil((double)remaining / y_approx);
+
+        if ((uint64_t)dimensions[0] * y_approx * z_approx >= bricks) {
+            dimensions[1] = y_approx;
+            dimensions[2] = z_approx;
+            return (uint64_t)dimensions[0] * dimensions[1] * dimensions[2];
+        }
+
+        dimensions[0]--;
+    }
+
+    dimensions[0] = dimensions[1] = dimensions[2] = cube_root;
+    return (uint64_t)dimensions[0] * dimensions[1] * dimensions[2];
+}
+
+static std::vector<uint32_t> GetSweepCounts(uint32_t max_bricks)
+{
+    std::vector<uint32_t> counts;
+    for (uint32_t bricks = 1; bricks <= std::min(max_bricks, 10000u); bricks++) {
+        counts.push_back(bricks);
+    }
+    for (double bricks = 10000 * 1.002; bricks <= max_bricks; bricks *= 1.002) {
+        counts.push_back((uint32_t)bricks);
+    }
+    return counts;
+}
+
+static int GetDecade(uint32_t bricks)
+{
+    return (int)std::floor(std::log10((double)bricks));
+}
+
+static void PrintDecades(const char* name, const std::vector<DecadeWaste>& decades)
+{
+    printf("  %s\n", name);
+    printf("    %-18s %8s %18s %18s %18s %18s %12s\n", "bricks", "counts", "slot waste mean", "slot waste max", "tile waste mean",
+        "tile waste max", "over limit");
+    for (size_t decade = 0; decade < decades.size(); decade++) {
+        const DecadeWaste& waste = decades[decade];
+        if (waste.counts_ == 0) {
+            continue;
+        }
+        char range[32];
+        snprintf(range, sizeof(range), "%.0f-%.0f", std::pow(10.0, (double)decade), std::pow(10.0, (double)decade + 1) - 1);
+        printf("    %-18s %8llu %17.2f%% %17.2f%% %17.2f%% %17.2f%% %12llu\n", range, (unsigned long long)waste.counts_,
+            100 * waste.slot_waste_sum_ / waste.counts_, 100 * waste.slot_waste_max_, 100 * waste.byte_waste_sum_ / waste.counts_,
+            100 * waste.byte_waste_max_, (unsigned long long)waste.over_limit_);
+    }
+}
+
+// Every slot of the packing must map to a distinct brick of a page within its dimensions
+static bool CheckSlotLocations(const BrickPoolPacking& packing)
+{
+    std::vector<bool> used(packing.slots_, false);
+    for (uint64_t slot = 0; slot < packing.slots_; slot++) {
+        uint32_t page, brick[3];
+        GetBrickPoolSlotLocation(packing, slot, page, brick);
+        if (page >= packing.pages_ || brick[0] >= packing.dimensions_[0] || brick[1] >= packing.dimensions_[1] || brick[2] >= packing.dimensions_[2]) {
+            return false;
+        }
+
+        uint64_t location = page * packing.SlotsPerPage() + ((uint64_t)brick[2] * packing.dimensions_[1] + brick[1]) * packing.dimensions_[0] + brick[0];
+        if (used[location]) {
+            return false;
+        }
+        used[location] = true;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t max_bricks = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    uint32_t texel_bytes = argc > 2 ? std::atoi(argv[2]) : 2;
+    bool normal_channel = argc > 3 ? std::atoi(argv[3]) != 0 : false;
+    uint32_t paged_limit = argc > 4 ? std::atoi(argv[4]) : 256;
+
+    BrickPoolPackingSettings settings;
+    settings.voxels_per_axis_per_brick_ = VOXELS_PER_AXIS_PER_BRICK;
+    settings.texel_bytes_[0] = texel_bytes;
+    settings.texel_bytes_[1] = normal_channel ? 4 : 0;
+    const uint64_t needed_bytes_per_brick = (uint64_t)VOXELS_PER_BRICK * (texel_bytes + settings.texel_bytes_[1]);
+    const uint32_t max_axis = settings.max_texture_dimension_ / VOXELS_PER_AXIS_PER_BRICK;
+
+    std::vector<uint32_t> counts = GetSweepCounts(max_bricks);
+    printf("Packing sweep benchmark: %zu brick counts up to %u, %u byte texels%s, texture limit %u voxels\n",
+        counts.size(), max_bricks, texel_bytes, normal_channel ? " with an RGBA8 normal channel" : "", settings.max_texture_dimension_);
+
+    std::vector<DecadeWaste> cube_root_decades(GetDecade(max_bricks) + 1), packed_decades(GetDecade(max_bricks) + 1);
+    uint64_t cube_root_bytes_total = 0, packed_bytes_total = 0, needed_bytes_total = 0;
+    uint32_t invalid = 0, worse = 0;
+    for (uint32_t bricks : counts) {
+        const double needed_bytes = (double)bricks * needed_bytes_per_brick;
+
+        uint32_t cube_root_dimensions[3];
+        uint64_t cube_root_slots = CubeRootPacking(bricks, cube_root_dimensions);
+        uint64_t cube_root_bytes = GetBrickPoolPageBytes(cube_root_dimensions, settings);
+        bool cube_root_over_limit = *std::max_element(cube_root_dimensions, cube_root_dimensions + 3) > max_axis;
+        cube_root_decades[GetDecade(bricks)].Add(1 - (double)bricks / cube_root_slots, 1 - needed_bytes / cube_root_bytes, cube_root_over_limit);
+
+        BrickPoolPacking packing = PackBrickPool(bricks, settings);
+        bool over_limit = *std::max_element(packing.dimensions_, packing.dimensions_ + 3) > max_axis;
+        packed_decades[GetDecade(bricks)].Add(1 - (double)bricks / packing.slots_, 1 - needed_bytes / packing.bytes_, over_limit);
+
+        invalid += packing.slots_ < bricks || over_limit || packing.pages_ != 1;
+        worse += !cube_root_over_limit && packing.bytes_ > cube_root_bytes;
+        cube_root_bytes_total += cube_root_bytes;
+        packed_bytes_total += packing.bytes_;
+        needed_bytes_total += (uint64_t)needed_bytes;
+    }
+
+    PrintDecades("cube root guess", cube_root_decades);
+    PrintDecades("packed", packed_decades);
+    printf("  memory over the sweep: needed %.1f GB, cube root guess %.1f GB (%.2f%% wasted), packed %.1f GB (%.2f%% wasted)\n",
+        needed_bytes_total / 1e9, cube_root_bytes_total / 1e9, 100.0 * (cube_root_bytes_total - needed_bytes_total) / cube_root_bytes_total,
+        packed_bytes_total / 1e9, 100.0 * (packed_bytes_total - needed_bytes_total) / packed_bytes_total);
+
+    // The same counts with a smaller texture, so the larger ones spill onto more pages
+    BrickPoolPackingSettings paged_settings = settings;
+    paged_settings.max_texture_dimension_ = paged_limit;
+    const uint32_t paged_max_axis = paged_limit / VOXELS_PER_AXIS_PER_BRICK;
+    uint32_t max_pages = 0;
+    double paged_slot_waste_max = 0;
+    for (uint32_t bricks : counts) {
+        BrickPoolPacking packing = PackBrickPool(bricks, paged_settings);
+        invalid += packing.slots_ < bricks || *std::max_element(packing.dimensions_, packing.dimensions_ + 3) > paged_max_axis;
+        max_pages = std::max(max_pages, packing.pages_);
+        paged_slot_waste_max = std::max(paged_slot_waste_max, 1 - (double)bricks / packing.slots_);
+    }
+    printf("  texture limit %u voxels (%u bricks per axis): up to %u pages, slot waste max %.2f%%\n", paged_limit, paged_max_axis,
+        max_pages, 100 * paged_slot_waste_max);
+
+    for (uint32_t bricks : { 1u, 7u, 1000u, 4099u, 30011u }) {
+        invalid += !CheckSlotLocations(PackBrickPool(bricks, settings)) || !CheckSlotLocations(PackBrickPool(bricks, paged_settings));
+    }
+
+    if (invalid > 0 || worse > 0) {
+        printf("%u packings don't hold their bricks within the limit, %u take more memory than the cube root guess!\n", invalid, worse);
+        return 1;
+    }
+    return 0;
+}
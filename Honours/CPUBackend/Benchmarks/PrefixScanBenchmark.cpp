@@ -0,0 +1,61 @@
+// Throughput of the CPU prefix scan variants from 4K to 64M elements, each checked against the scalar reference.
+// Usage: PrefixScanBenchmark (max elements) (threads) (iterations)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "../PrefixScan.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+static const char* VARIANT_NAMES[] = { "scalar", "avx2", "lookback" };
+
+int main(int argc, char** argv)
+{
+    uint32_t max_size = argc > 1 ? (uint32_t)std::atoll(argv[1]) : (64u << 20);
+    unsigned int threads = argc > 2 ? std::atoi(argv[2]) : std::max(std::thread::hardware_concurrency(), 1u);
+    int iterations = argc > 3 ? std::atoi(argv[3]) : 5;
+
+    ThreadPool thread_pool(threads);
+    PrefixScan scans[] = { { &thread_pool, ScanScalar }, { &thread_pool, ScanAvx2 }, { &thread_pool, ScanDecoupledLookback } };
+
+    printf("Prefix scan benchmark: %u threads, %d iterations, AVX2 %s\n", threads, iterations, PrefixScan::HasAvx2() ? "on" : "off");
+    printf("%10s %16s %16s %16s\n", "elements", "scalar (Ge/s)", "avx2 (Ge/s)", "lookback (Ge/s)");
+
+    bool valid = true;
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<uint32_t> distribution(0, 16);
+
+    for (uint32_t size = 4096; size <= max_size && size != 0; size *= 4) {
+        std::vector<uint32_t> input(size);
+        for (uint32_t& value : input) {
+            value = distribution(rng);
+        }
+
+        printf("%10u", size);
+        for (PrefixScan& scan : scans) {
+            scan.UpdateSize(size);
+            std::copy(input.begin(), input.end(), scan.GetScanInBuffer().begin());
+
+            // Warm up, then time
+            scan.DispatchScan();
+            Clock::time_point start = Clock::now();
+            for (int i = 0; i < iterations; i++) {
+                scan.DispatchScan();
+            }
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count() / iterations;
+            printf(" %16.3f", size / seconds * 1e-9);
+
+            if (scan.GetScanOutBuffer() != scans[0].GetScanOutBuffer()) {
+                printf("\n%s scan differs from the scalar reference at %u elements!\n", VARIANT_NAMES[scan.GetVariant()], size);
+                valid = false;
+            }
+        }
+        printf("\n");
+    }
+
+    return valid ? 0 : 1;
+}
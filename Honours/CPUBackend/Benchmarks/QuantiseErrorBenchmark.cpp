@@ -0,0 +1,191 @@
+// Measures the error of storing bricks as 8-bit voxels relative to each brick's range (see BrickQuantise.h) rather than
+// R16_SNORM, over the test scenes. Random points in each brick's core are sampled trilinearly from both, comparing the
+// distances and the normals CalculateNormal would give. Checks every 8-bit voxel is within half a step of its distance.
+// Usage: QuantiseErrorBenchmark (particle no.) (threads) (texture resolution) (samples per brick) (scene, -1 for all)
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include "../BrickPool.h"
+#include "../BrickQuantise.h"
+#include "../GridEngine.h"
+#include "../ParticleReorder.h"
+#include "../ParticleScenes.h"
+
+using namespace CPUBackend;
+
+#define RADIANS_TO_DEGREES 57.2957795f
+
+struct QuantiseErrors {
+    uint64_t band_samples_ = 0;       // Samples within the band, against the 16-bit voxels clamped to it
+    double band_error_sum_ = 0;
+    float band_error_max_ = 0;
+    uint64_t surface_samples_ = 0;    // Samples within a voxel of the surface
+    double surface_error_sum_ = 0;
+    float surface_error_max_ = 0;
+    uint64_t hit_disagreements_ = 0;  // Samples one format would report as a hit and the other wouldn't
+    std::vector<float> normal_errors_; // Degrees, for samples within two voxels of the surface
+    uint64_t bad_voxels_ = 0;         // 8-bit voxels further than half a step from their distance
+
+    void Add(const QuantiseErrors& other)
+    {
+        band_samples_ += other.band_samples_;
+        band_error_sum_ += other.band_error_sum_;
+        band_error_max_ = std::max(band_error_max_, other.band_error_max_);
+        surface_samples_ += other.surface_samples_;
+        surface_error_sum_ += other.surface_error_sum_;
+        surface_error_max_ = std::max(surface_error_max_, other.surface_error_max_);
+        hit_disagreements_ += other.hit_disagreements_;
+        normal_errors_.insert(normal_errors_.end(), other.normal_errors_.begin(), other.normal_errors_.end());
+        bad_voxels_ += other.bad_voxels_;
+    }
+};
+
+static bool RunScene(TestVariables test_values, ThreadPool* thread_pool, int samples_per_brick)
+{
+    DeriveGridValues(test_values);
+
+    std::vector<ParticleData> particles;
+    GenerateParticles(test_values, particles, thread_pool);
+    ComputePositions(test_values, 0.5f, particles, thread_pool);
+
+    GridEngine grid(thread_pool, test_values);
+    grid.ComputeGrid(particles);
+    std::vector<uint32_t> cell_offsets;
+    std::vector<ParticleData> particles_ordered;
+    ComputeCellOffsets(grid.GetCellCounts(), cell_offsets, thread_pool);
+    ReorderParticles(particles, cell_offsets, particles_ordered, thread_pool);
+    ParticleDataPositionSource positions{ particles_ordered };
+
+    const uint32_t bricks_per_axis = BricksPerAxisPerCell(test_values);
+    const uint32_t bricks_per_cell = bricks_per_axis * bricks_per_axis * bricks_per_axis;
+    const uint32_t bricks = grid.GetSurfaceCounts().surface_cells * bricks_per_cell;
+    const float voxel_size = 1.f / (test_values.cells_per_axis_ * bricks_per_axis * CORE_VOXELS_PER_AXIS_PER_BRICK);
+    const float band = GetBrickQuantiseBand(voxel_size);
+
+    QuantiseErrors errors;
+    std::mutex errors_mutex;
+    thread_pool->ParallelFor(0, bricks, 16, [&](size_t begin, size_t end) {
+        QuantiseErrors chunk_errors;
+        std::vector<Float3> candidates;
+        alignas(64) float xs[PADDED_VOXELS_PER_BRICK], ys[PADDED_VOXELS_PER_BRICK], zs[PADDED_VOXELS_PER_BRICK];
+        alignas(64) float distances[PADDED_VOXELS_PER_BRICK];
+        int16_t voxels16[VOXELS_PER_BRICK];
+        int8_t voxels8[VOXELS_PER_BRICK];
+
+        for (size_t brick_index = begin; brick_index < end; brick_index++) {
+            uint32_t cell_index = grid.GetSurfaceCellIndices()[brick_index / bricks_per_cell];
+            int neighbouring_cells[27];
+            grid.GetNeighbourCells(cell_index, neighbouring_cells);
+
+            Float3 brick_min = GetBrickAABB(test_values, grid.GetCellCoords(cell_index), brick_index % bricks_per_cell).min_;
+            GatherBrickCandidates(GetBrickVoxelBounds(brick_min, voxel_size), neighbouring_cells, grid.GetCellCounts(), cell_offsets,
+                positions, test_values.particle_radius_, candidates);
+            GetBrickVoxelPositions(brick_min, voxel_size, xs, ys, zs);
+            EvaluateVoxelDistances(GetBestBrickKernelIsa(), xs, ys, zs, VOXELS_PER_BRICK, candidates.data(), candidates.size(),
+                test_values.particle_radius_, distances);
+
+            for (int i = 0; i < VOXELS_PER_BRICK; i++) {
+                voxels16[i] = FloatToSnorm16(distances[i]);
+            }
+            BrickRange range = QuantiseBrick(distances, band, voxels8);
+            for (int i = 0; i < VOXELS_PER_BRICK; i++) {
+                float error = std::abs(DequantiseDistance(Snorm8ToFloat(voxels8[i]), range) - std::clamp(distances[i], -band, band));
+                chunk_errors.bad_voxels_ += error > range.scale_ / 254.f + band * 1e-5f;
+            }
+
+            auto decode16 = [](int16_t voxel) { return Snorm16ToFloat(voxel); };
+            auto decode16_clamped = [&](int16_t voxel) { return std::clamp(Snorm16ToFloat(voxel), -band, band); };
+            auto decode8 = [&](int8_t voxel) { return DequantiseDistance(Snorm8ToFloat(voxel), range); };
+
+            // Points anywhere in the core, which is what the brick's AABB covers
+            std::mt19937 random((uint32_t)brick_index);
+            std::uniform_real_distribution<float> core(0.5f, VOXELS_PER_AXIS_PER_BRICK - 1.5f);
+            for (int sample = 0; sample < samples_per_brick; sample++) {
+                Float3 position = { core(random), core(random), core(random) };
+                float distance16 = SampleBrick(voxels16, position, decode16);
+                float distance8 = SampleBrick(voxels8, position, decode8);
+                float error = std::abs(distance8 - distance16) / voxel_size;
+
+                // Clamping to the band only shortens steps, so away from the surface just the rounding is measured
+                if (std::abs(distance16) < band) {
+                    float band_error = std::abs(distance8 - SampleBrick(voxels16, position, decode16_clamped)) / voxel_size;
+                    chunk_errors.band_samples_++;
+                    chunk_errors.band_error_sum_ += band_error;
+                    chunk_errors.band_error_max_ = std::max(chunk_errors.band_error_max_, band_error);
+                }
+                if (std::abs(distance16) < voxel_size) {
+                    chunk_errors.surface_samples_++;
+                    chunk_errors.surface_error_sum_ += error;
+                    chunk_errors.surface_error_max_ = std::max(chunk_errors.surface_error_max_, error);
+                }
+                chunk_errors.hit_disagreements_ += (distance16 <= SPHERE_TRACING_THRESHOLD) != (distance8 <= SPHERE_TRACING_THRESHOLD);
+
+                if (std::abs(distance16) < voxel_size * 2) {
+                    Float3 normal16 = SampleBrickNormal(voxels16, position, decode16);
+                    Float3 normal8 = SampleBrickNormal(voxels8, position, decode8);
+                    if (Dot(normal16, normal16) > 0 && Dot(normal8, normal8) > 0) {
+                        chunk_errors.normal_errors_.push_back(std::acos(std::clamp(Dot(normal16, normal8), -1.f, 1.f)) * RADIANS_TO_DEGREES);
+                    }
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(errors_mutex);
+        errors.Add(chunk_errors);
+    });
+
+    std::vector<float>& normal_errors = errors.normal_errors_;
+    std::sort(normal_errors.begin(), normal_errors.end());
+    double normal_error_sum = 0;
+    for (float normal_error : normal_errors) {
+        normal_error_sum += normal_error;
+    }
+
+    printf("Scene %d: %u bricks, band %.4f (%.1f voxels)\n", test_values.scene_, bricks, band, band / voxel_size);
+    printf("  distance error (voxels):  within band mean %.5f max %.5f, near surface mean %.5f max %.5f\n",
+        errors.band_samples_ ? errors.band_error_sum_ / errors.band_samples_ : 0.0, errors.band_error_max_,
+        errors.surface_samples_ ? errors.surface_error_sum_ / errors.surface_samples_ : 0.0, errors.surface_error_max_);
+    printf("  normal error (degrees):   mean %.4f p99 %.4f max %.4f over %zu samples\n",
+        normal_errors.empty() ? 0.0 : normal_error_sum / normal_errors.size(),
+        normal_errors.empty() ? 0.f : normal_errors[(size_t)(normal_errors.size() * 0.99)],
+        normal_errors.empty() ? 0.f : normal_errors.back(), normal_errors.size());
+    printf("  hit disagreements:        %llu of %llu samples\n", (unsigned long long)errors.hit_disagreements_, (unsigned long long)bricks * samples_per_brick);
+
+    const double bytes16 = (double)bricks * VOXELS_PER_BRICK * sizeof(int16_t);
+    const double bytes8 = (double)bricks * (VOXELS_PER_BRICK * sizeof(int8_t) + sizeof(BrickRange));
+    printf("  memory:                   16-bit %.2f MB, 8-bit %.2f MB with ranges (%.1f%%)\n",
+        bytes16 / 1048576.0, bytes8 / 1048576.0, bytes16 > 0 ? 100.0 * bytes8 / bytes16 : 0.0);
+
+    if (errors.bad_voxels_ > 0) {
+        printf("  %llu 8-bit voxels further than half a step from their distance!\n", (unsigned long long)errors.bad_voxels_);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    test_values.num_particles_ = argc > 1 ? std::atoi(argv[1]) : 20000;
+    unsigned int threads = argc > 2 ? std::atoi(argv[2]) : std::max(std::thread::hardware_concurrency(), 1u);
+    test_values.texture_res_ = argc > 3 ? std::atoi(argv[3]) : 256;
+    int samples_per_brick = argc > 4 ? std::atoi(argv[4]) : 64;
+    int scene = argc > 5 ? std::atoi(argv[5]) : -1;
+
+    printf("Quantise error benchmark: %d particles, %u threads, texture resolution %d, %d samples per brick\n",
+        test_values.num_particles_, threads, test_values.texture_res_, samples_per_brick);
+
+    ThreadPool thread_pool(threads);
+    bool valid = true;
+    for (int scene_type : { SceneRandom, SceneGrid, SceneWave, SceneNormals }) {
+        if (scene < 0 || scene == scene_type) {
+            test_values.scene_ = (SceneType)scene_type;
+            valid &= RunScene(test_values, &thread_pool, samples_per_brick);
+        }
+    }
+
+    return valid ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+// Renders the test scenes with the CPU reference renderer (see ReferenceRenderer.h) for each implementation, from the
+// orbital camera at the default view distance, and reports how long the scene took to build, the rays per second traced
+// across the threads, and the SDF samples and AABBs per ray. Optionally writes each image as PPM and PFM, to compare with
+// the app's output. Checks every image has some hits, and that the Simple and Complex images hit where the Naive one does
+// but for a few pixels along the silhouettes.
+// Usage: RenderBenchmark (particle no.) (scene, -1 for random, grid and wave) (implementation, -1 for all) (threads)
+//        (texture resolution) (image width) (image height) (output prefix, none to not write images)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "../ReferenceRenderer.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+#define MAX_SILHOUETTE_MISMATCH 0.02 // Of the pixels, where the textures' hits can differ from the analytical SDF's
+
+template<typename F>
+static double TimeMs(F&& func)
+{
+    Clock::time_point start = Clock::now();
+    func();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static bool RunScene(const TestVariables& test_values, int implementation, ThreadPool& thread_pool, int width, int height,
+    const std::string& output_prefix)
+{
+    const char* implementation_names[] = { "naive", "simple", "complex" };
+    const float time = 0.5f;
+    const RenderCamera camera = GetOrbitalRenderCamera(test_values, 1.5f, 0, width, height);
+    printf("  scene %d, %d particles\n", test_values.scene_, test_values.num_particles_);
+
+    bool valid = true;
+    std::vector<bool> naive_hits;
+    for (ImplementationType type : { Naive, Simple, Complex }) {
+        // The Naive image is needed to check the others against
+        if (implementation >= 0 && type != implementation && type != Naive) {
+            continue;
+        }
+
+        ReferenceScene scene;
+        double build_ms = TimeMs([&] { BuildReferenceScene(test_values, type, time, scene, &thread_pool); });
+
+        ReferenceRenderOptions options;
+        options.implementation_ = type;
+        options.width_ = width;
+        options.height_ = height;
+        std::vector<Float3> colours;
+        ReferenceRenderStats stats = RenderReference(scene, camera, options, colours, &thread_pool);
+
+        const double rays = (double)width * height;
+        printf("    %-8s %10.2f %10.2f %12.0f %8.2f %8.2f %8.2f%%\n", implementation_names[type], build_ms, stats.ms_, stats.rays_per_second_,
+            stats.steps_ / rays, stats.aabbs_tested_ / rays, 100.0 * stats.hits_ / rays);
+
+        // Misses are exactly the miss colour, so hits can be read back from the image
+        std::vector<bool> hits(colours.size());
+        for (size_t pixel = 0; pixel < colours.size(); pixel++) {
+            const Float3& colour = colours[pixel];
+            hits[pixel] = !(colour.x == 0.0f && colour.y == 0.2f && colour.z == 0.4f);
+        }
+        if (stats.hits_ == 0) {
+            printf("    %s image has no hits!\n", implementation_names[type]);
+            valid = false;
+        }
+        if (type == Naive) {
+            naive_hits = hits;
+        }
+        else {
+            size_t mismatched = 0;
+            for (size_t pixel = 0; pixel < hits.size(); pixel++) {
+                mismatched += hits[pixel] != naive_hits[pixel];
+            }
+            if (mismatched > MAX_SILHOUETTE_MISMATCH * hits.size()) {
+                printf("    %s image hits differ from the naive image's at %zu pixels!\n", implementation_names[type], mismatched);
+                valid = false;
+            }
+        }
+
+        if (!output_prefix.empty() && (implementation < 0 || type == implementation)) {
+            std::string path = output_prefix + "_" + std::to_string(test_values.scene_) + "_" + std::to_string(test_values.num_particles_) + "_" +
+                implementation_names[type];
+            if (!WritePPM(path + ".ppm", width, height, colours) || !WritePFM(path + ".pfm", width, height, colours)) {
+                printf("    couldn't write %s!\n", path.c_str());
+                valid = false;
+            }
+        }
+    }
+    return valid;
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    test_values.num_particles_ = argc > 1 ? std::atoi(argv[1]) : 343;
+    int scene = argc > 2 ? std::atoi(argv[2]) : -1;
+    int implementation = argc > 3 ? std::atoi(argv[3]) : -1;
+    unsigned int threads = argc > 4 ? std::atoi(argv[4]) : std::max(std::thread::hardware_concurrency(), 1u);
+    test_values.texture_res_ = argc > 5 ? std::atoi(argv[5]) : 256;
+    int width = argc > 6 ? std::atoi(argv[6]) : 480;
+    int height = argc > 7 ? std::atoi(argv[7]) : 270;
+    std::string output_prefix = argc > 8 ? argv[8] : "";
+
+    printf("Render benchmark: %u threads, texture resolution %d, %d x %d, %d pixel tiles\n", threads, test_values.texture_res_, width, height,
+        REFERENCE_TILE_SIZE);
+    printf("    %-8s %10s %10s %12s %8s %8s %9s\n", "method", "build ms", "render ms", "rays/s", "steps", "AABBs", "hits");
+
+    ThreadPool thread_pool(threads);
+    bool valid = true;
+    for (SceneType scene_type : { SceneRandom, SceneGrid, SceneWave }) {
+        if (scene >= 0 && scene_type != scene) {
+            continue;
+        }
+        test_values.scene_ = scene_type;
+        valid &= RunScene(test_values, implementation, thread_pool, width, height, output_prefix);
+    }
+    return valid ? 0 : 1;
+}
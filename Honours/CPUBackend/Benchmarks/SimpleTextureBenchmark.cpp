@@ -0,0 +1,153 @@
+// Compares filling the Simple method's dense SDF texture by visiting every particle for each voxel, as CSTexMain does,
+// against visiting only the particles around the voxel's cell once they're sorted by cell (see SimpleTexture.h), for the
+// particle counts in Tests.bat. The every-particle fill is only timed over a few z slices and scaled up to the texture.
+// On those slices, the grid's voxels must match the SDF of the particles in the 27 cells around them. Reports how many
+// voxels take the far distance, how many are above the SDF of every particle, and the error against it near the surface.
+// Usage: SimpleTextureBenchmark (texture resolution) (scene) (threads) (timed slices) (particle no., 0 for Tests.bat's)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "../GridEngine.h"
+#include "../ParticleReorder.h"
+#include "../ParticleScenes.h"
+#include "../SimpleTexture.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+template<typename F>
+static double TimeMs(F&& func)
+{
+    Clock::time_point start = Clock::now();
+    func();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static bool RunParticleCount(TestVariables test_values, unsigned int threads, int timed_slices)
+{
+    DeriveGridValues(test_values);
+    const int texture_res = test_values.texture_res_;
+
+    ThreadPool thread_pool(threads);
+    std::vector<ParticleData> particles;
+    GenerateParticles(test_values, particles, &thread_pool);
+    ComputePositions(test_values, 0.5f, particles, &thread_pool);
+
+    GridEngine grid(&thread_pool, test_values);
+    std::vector<uint32_t> cell_offsets;
+    std::vector<ParticleData> particles_ordered;
+    double sort_ms = TimeMs([&] {
+        grid.ComputeGrid(particles);
+        ComputeCellOffsets(grid.GetCellCounts(), cell_offsets, &thread_pool);
+        ReorderParticles(particles, cell_offsets, particles_ordered, &thread_pool);
+    });
+
+    std::vector<Float3> positions(particles.size());
+    for (size_t i = 0; i < particles.size(); i++) {
+        positions[i] = particles[i].position_;
+    }
+
+    // Every particle, over evenly spaced slices. Both textures are allocated up front, so page faults aren't timed.
+    std::vector<int16_t> naive_voxels((size_t)texture_res * texture_res * texture_res, 0), grid_voxels(naive_voxels.size(), 0);
+    std::vector<int> slices;
+    double naive_ms = 0;
+    for (int slice = 0; slice < timed_slices; slice++) {
+        int z = (int)((slice + 0.5f) * texture_res / timed_slices);
+        slices.push_back(z);
+        naive_ms += TimeMs([&] { FillSimpleTextureNaive(test_values, positions, naive_voxels, &thread_pool, z, z + 1); });
+    }
+    naive_ms *= (double)texture_res / timed_slices;
+
+    double grid_ms = TimeMs([&] {
+        FillSimpleTextureGrid(grid, ParticleDataPositionSource{ particles_ordered }, cell_offsets, grid_voxels, &thread_pool, 0, texture_res);
+    });
+
+    // Compare on the slices both filled. The grid's voxels must match the particles of the 27 cells around them, bucketed
+    // here by their cell index rather than through the offsets and sorted buffer, and are compared against every particle.
+    std::vector<std::vector<uint32_t>> cell_particles(grid.GetCellCounts().size());
+    for (uint32_t i = 0; i < particles.size(); i++) {
+        cell_particles[particles[i].cell_index_].push_back(i);
+    }
+    for (std::vector<uint32_t>& cell : cell_particles) {
+        std::sort(cell.begin(), cell.end(), [&](uint32_t a, uint32_t b) { return particles[a].intra_cell_index_ < particles[b].intra_cell_index_; });
+    }
+
+    const float particle_radius = test_values.particle_radius_;
+    uint64_t voxels = 0, far_voxels = 0, surface_voxels = 0, over = 0, mismatched = 0;
+    double surface_error_sum = 0;
+    float surface_error_max = 0;
+    std::vector<Float3> neighbour_particles;
+    for (int z : slices) {
+        for (int y = 0; y < texture_res; y++) {
+            for (int x = 0; x < texture_res; x++) {
+                size_t voxel = ((size_t)z * texture_res + y) * texture_res + x;
+                float exact = Snorm16ToFloat(naive_voxels[voxel]);
+                float distance = Snorm16ToFloat(grid_voxels[voxel]);
+                Float3 position = GetSimpleTextureVoxelPosition(texture_res, x, y, z);
+                uint32_t cell_index = GetCellIndex(test_values, position);
+                Int3 cell_coords = grid.GetCellCoords(cell_index);
+
+                int neighbouring_cells[27];
+                grid.GetNeighbourCells(cell_index, neighbouring_cells);
+                neighbour_particles.clear();
+                for (int neighbour : neighbouring_cells) {
+                    if (neighbour >= 0) {
+                        for (uint32_t i : cell_particles[neighbour]) {
+                            neighbour_particles.push_back(particles[i].position_);
+                        }
+                    }
+                }
+                float expected = GetSimpleTextureGridDistance(test_values, cell_coords, position, neighbour_particles);
+                mismatched += grid_voxels[voxel] != FloatToSnorm16(expected);
+
+                float far_distance = GetSimpleTextureFarDistance(test_values, cell_coords, position);
+                voxels++;
+                far_voxels += expected >= far_distance;
+                over += distance > exact;
+                if (std::abs(exact) < particle_radius) {
+                    surface_voxels++;
+                    surface_error_sum += std::abs(distance - exact);
+                    surface_error_max = std::max(surface_error_max, std::abs(distance - exact));
+                }
+            }
+        }
+    }
+
+    printf("  %-9d %6d %8.4f %12.1f %8.1f %10.1f %8.1fx %8.2f%% %8.2f%% %10.6f %10.6f\n", test_values.num_particles_, test_values.cells_per_axis_,
+        particle_radius, naive_ms, sort_ms, grid_ms, naive_ms / (sort_ms + grid_ms), 100.0 * far_voxels / voxels, 100.0 * over / voxels,
+        surface_voxels ? surface_error_sum / surface_voxels : 0.0, surface_error_max);
+
+    if (mismatched > 0) {
+        printf("%llu voxels don't match the particles of the cells around them!\n", (unsigned long long)mismatched);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    test_values.texture_res_ = argc > 1 ? std::atoi(argv[1]) : 256;
+    test_values.scene_ = argc > 2 ? (SceneType)std::atoi(argv[2]) : SceneWave;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    int timed_slices = argc > 4 ? std::max(std::atoi(argv[4]), 1) : 2;
+    int particle_count = argc > 5 ? std::atoi(argv[5]) : 0;
+
+    printf("Simple texture benchmark: texture resolution %d, scene %d, %u threads, every particle timed over %d slices\n",
+        test_values.texture_res_, test_values.scene_, threads, timed_slices);
+    printf("  %-9s %6s %8s %12s %8s %10s %9s %9s %9s %10s %10s\n", "particles", "cells", "radius", "every ms", "sort ms", "grid ms",
+        "speedup", "far", "above", "surf mean", "surf max");
+
+    bool valid = true;
+    for (int count : { 1, 27, 343, 1000, 10648 }) {
+        if (particle_count > 0 && count != particle_count) {
+            continue;
+        }
+        test_values.num_particles_ = count;
+        test_values.particle_radius_ = 0; // Derived from the count
+        valid &= RunParticleCount(test_values, threads, timed_slices);
+    }
+    return valid ? 0 : 1;
+}
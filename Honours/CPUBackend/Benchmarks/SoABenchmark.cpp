@@ -0,0 +1,151 @@
+// Compares the AoS ParticleData buffer against the SoA particle store, with float and quantised 16-bit positions,
+// for the reorder and the brick pool. Bandwidth is modelled from the cache lines each stage touches, as hardware
+// counters aren't always available.
+// Usage: SoABenchmark (particle no.) (scene) (threads) (iterations)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../BrickPool.h"
+#include "../GridEngine.h"
+#include "../ParticleReorder.h"
+#include "../ParticleScenes.h"
+#include "../ParticleStore.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+#define CACHE_LINE_SIZE 64
+
+// At most 1 in this many quantised voxels may differ by more than a step from the float positions
+#define MAX_CHANGED_VOXELS_RATIO 10000
+
+template<typename F>
+static double TimeMs(F&& func, int iterations)
+{
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        func();
+    }
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+}
+
+// Cache lines of particle data read per brick, each brick reading the particles of its 27 neighbouring cells,
+// for particle records of the given size
+static uint64_t BrickPoolParticleLines(const GridEngine& grid, const std::vector<uint32_t>& cell_offsets, size_t particle_size)
+{
+    const std::vector<uint32_t>& cell_counts = grid.GetCellCounts();
+    const uint32_t bricks_per_axis = BricksPerAxisPerCell(grid.GetTestValues());
+    const uint32_t bricks_per_cell = bricks_per_axis * bricks_per_axis * bricks_per_axis;
+
+    uint64_t lines = 0;
+    std::vector<uint64_t> brick_lines;
+    for (uint32_t i = 0; i < grid.GetSurfaceCounts().surface_cells; i++) {
+        int neighbouring_cells[27];
+        grid.GetNeighbourCells(grid.GetSurfaceCellIndices()[i], neighbouring_cells);
+
+        brick_lines.clear();
+        for (int cell_index : neighbouring_cells) {
+            if (cell_index < 0 || cell_counts[cell_index] == 0) {
+                continue;
+            }
+            uint64_t first_byte = (uint64_t)cell_offsets[cell_index] * particle_size;
+            uint64_t last_byte = first_byte + (uint64_t)cell_counts[cell_index] * particle_size - 1;
+            for (uint64_t line = first_byte / CACHE_LINE_SIZE; line <= last_byte / CACHE_LINE_SIZE; line++) {
+                brick_lines.push_back(line);
+            }
+        }
+        std::sort(brick_lines.begin(), brick_lines.end());
+        lines += (std::unique(brick_lines.begin(), brick_lines.end()) - brick_lines.begin()) * (uint64_t)bricks_per_cell;
+    }
+    return lines;
+}
+
+static double ToMB(uint64_t bytes)
+{
+    return bytes / (1024.0 * 1024.0);
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    test_values.num_particles_ = argc > 1 ? std::atoi(argv[1]) : 20000;
+    test_values.scene_ = argc > 2 ? (SceneType)std::atoi(argv[2]) : SceneWave;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    int iterations = argc > 4 ? std::atoi(argv[4]) : 3;
+    test_values.texture_res_ = 256;
+    DeriveGridValues(test_values);
+
+    ThreadPool thread_pool(threads);
+    std::vector<ParticleData> particles;
+    GenerateParticles(test_values, particles, &thread_pool);
+    ComputePositions(test_values, 0.5f, particles, &thread_pool);
+
+    GridEngine grid(&thread_pool, test_values);
+    grid.ComputeGrid(particles);
+    std::vector<uint32_t> cell_offsets;
+    ComputeCellOffsets(grid.GetCellCounts(), cell_offsets, &thread_pool);
+
+    const uint64_t count = particles.size();
+    printf("SoA benchmark: %d particles, scene %d, %u threads, %d iterations, %u surface cells\n",
+        test_values.num_particles_, test_values.scene_, threads, iterations, grid.GetSurfaceCounts().surface_cells);
+
+    // Reorder. Every layout reads the whole AoS record, and writes only its own streams.
+    printf("\n%-22s %12s %16s\n", "reorder", "time (ms)", "written (MB)");
+    std::vector<ParticleData> aos_ordered;
+    double aos_ms = TimeMs([&] { ReorderParticles(particles, cell_offsets, aos_ordered, &thread_pool); }, iterations);
+    printf("%-22s %12.3f %16.2f\n", "AoS ParticleData", aos_ms, ToMB(count * sizeof(ParticleData)));
+
+    struct StreamSet { const char* name_; uint32_t streams_; size_t bytes_; };
+    const StreamSet stream_sets[] = {
+        { "SoA all streams", ParticleStreamAll, sizeof(ParticleData) },
+        { "SoA positions", ParticleStreamPositions, sizeof(Float3) },
+        { "SoA quantised", ParticleStreamQuantisedPositions, sizeof(QuantisedPosition) },
+    };
+    ParticleStore soa_ordered, quantised_ordered;
+    for (const StreamSet& stream_set : stream_sets) {
+        ParticleStore& store = stream_set.streams_ == ParticleStreamQuantisedPositions ? quantised_ordered : soa_ordered;
+        double soa_ms = TimeMs([&] { ReorderParticlesSoA(test_values, particles, cell_offsets, stream_set.streams_, store, &thread_pool); }, iterations);
+        printf("%-22s %12.3f %16.2f\n", stream_set.name_, soa_ms, ToMB(count * stream_set.bytes_));
+    }
+
+    // Brick pool, from the AoS buffer, the position stream (left by the last float reorder) and the quantised stream
+    printf("\n%-22s %12s %16s\n", "brick pool", "time (ms)", "particles (MB)");
+    BrickPool aos_pool, soa_pool, quantised_pool;
+    double aos_pool_ms = TimeMs([&] { FillBrickPool(grid, aos_ordered, cell_offsets, aos_pool, &thread_pool); }, iterations);
+    printf("%-22s %12.3f %16.2f\n", "AoS ParticleData", aos_pool_ms, ToMB(BrickPoolParticleLines(grid, cell_offsets, sizeof(ParticleData)) * CACHE_LINE_SIZE));
+    double soa_pool_ms = TimeMs([&] { FillBrickPoolFrom(grid, SoAPositionSource{ soa_ordered.positions_ }, cell_offsets, soa_pool, &thread_pool); }, iterations);
+    printf("%-22s %12.3f %16.2f\n", "SoA positions", soa_pool_ms, ToMB(BrickPoolParticleLines(grid, cell_offsets, sizeof(Float3)) * CACHE_LINE_SIZE));
+    double quantised_pool_ms = TimeMs([&] { FillBrickPoolFrom(grid, QuantisedPositionSource{ quantised_ordered.quantised_positions_ }, cell_offsets, quantised_pool, &thread_pool); }, iterations);
+    printf("%-22s %12.3f %16.2f\n", "SoA quantised", quantised_pool_ms, ToMB(BrickPoolParticleLines(grid, cell_offsets, sizeof(QuantisedPosition)) * CACHE_LINE_SIZE));
+
+    bool valid = true;
+
+    // Float positions are the same values, so the bricks must be identical
+    if (soa_pool.voxels_.size() != aos_pool.voxels_.size() ||
+        std::memcmp(soa_pool.voxels_.data(), aos_pool.voxels_.data(), aos_pool.voxels_.size() * sizeof(int16_t)) != 0) {
+        printf("SoA brick pool differs from the AoS brick pool!\n");
+        valid = false;
+    }
+
+    // Quantised positions are within 1/131070th of a cell, well under one R16_SNORM step of the distance. The exception is
+    // voxels where a particle sits right at the 2x radius cut-off, as the SDF jumps when it drops in or out of range,
+    // so only a tiny fraction of voxels may differ by more than a step.
+    int max_difference = 0;
+    size_t changed_voxels = 0;
+    for (size_t i = 0; i < aos_pool.voxels_.size() && i < quantised_pool.voxels_.size(); i++) {
+        int difference = std::abs(aos_pool.voxels_[i] - quantised_pool.voxels_[i]);
+        max_difference = std::max(max_difference, difference);
+        changed_voxels += difference > 1;
+    }
+    printf("Quantised brick pool: %zu of %zu voxels differ by more than one snorm step, by up to %d steps\n",
+        changed_voxels, aos_pool.voxels_.size(), max_difference);
+    if (quantised_pool.voxels_.size() != aos_pool.voxels_.size() || changed_voxels > aos_pool.voxels_.size() / MAX_CHANGED_VOXELS_RATIO) {
+        printf("Quantised brick pool differs from the AoS brick pool in too many voxels!\n");
+        valid = false;
+    }
+
+    return valid ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+// Compares ways of sorting particles by cell: the GPU pipeline's atomic intra-cell indices + offset scan + scatter
+// (GridEngine::BuildGrid, ComputeCellOffsets, ReorderParticles), against the stable counting and radix sorts.
+// Particle counts go up by 10x from 1K to the maximum. Sorts are checked against std::stable_sort up to 1M particles.
+// Usage: SortBenchmark (max particle no.) (scene) (threads) (iterations)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include "../GridCommon.h"
+#include "../GridEngine.h"
+#include "../ParticleReorder.h"
+#include "../ParticleScenes.h"
+#include "../ParticleSort.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+// Largest particle count checked against std::stable_sort
+#define MAX_REFERENCE_PARTICLES 1000000
+
+template<typename F>
+static double TimeMs(F&& func, int iterations)
+{
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        func();
+    }
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+}
+
+static bool SameParticles(const std::vector<ParticleData>& a, const std::vector<ParticleData>& b)
+{
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(ParticleData)) == 0;
+}
+
+// Stable sort by cell, as the sorter should produce
+static bool MatchReference(const TestVariables& test_values, const std::vector<ParticleData>& particles, const std::vector<ParticleData>& particles_ordered)
+{
+    std::vector<uint32_t> order(particles.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return GetCellIndex(test_values, particles[a].position_) < GetCellIndex(test_values, particles[b].position_);
+    });
+
+    for (size_t i = 0; i < order.size(); i++) {
+        if (std::memcmp(&particles[order[i]].position_, &particles_ordered[i].position_, sizeof(Float3)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    int max_particles = argc > 1 ? std::atoi(argv[1]) : 10000000;
+    SceneType scene = argc > 2 ? (SceneType)std::atoi(argv[2]) : SceneRandom;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    int iterations = argc > 4 ? std::atoi(argv[4]) : 5;
+
+    ThreadPool thread_pool(threads);
+    printf("Sort benchmark: scene %d, %u threads, %d iterations\n", scene, threads, iterations);
+    printf("%10s %10s %14s %14s %14s %16s\n", "particles", "cells", "atomic (ms)", "counting (ms)", "radix (ms)", "counting (Mp/s)");
+
+    bool valid = true;
+    for (int num_particles = 1000; num_particles <= max_particles; num_particles *= 10) {
+        TestVariables test_values = {};
+        test_values.num_particles_ = num_particles;
+        test_values.scene_ = scene;
+        test_values.texture_res_ = 256;
+        DeriveGridValues(test_values);
+
+        std::vector<ParticleData> particles;
+        GenerateParticles(test_values, particles, &thread_pool);
+        ComputePositions(test_values, 0.5f, particles, &thread_pool);
+
+        // The GPU pipeline's order
+        GridEngine grid(&thread_pool, test_values);
+        std::vector<uint32_t> atomic_offsets;
+        std::vector<ParticleData> atomic_ordered;
+        double atomic_ms = TimeMs([&] {
+            grid.ClearGridCounts();
+            grid.BuildGrid(particles);
+            ComputeCellOffsets(grid.GetCellCounts(), atomic_offsets, &thread_pool);
+            ReorderParticles(particles, atomic_offsets, atomic_ordered, &thread_pool);
+        }, iterations);
+
+        ParticleSorter sorter(&thread_pool, test_values);
+        std::vector<ParticleData> radix_ordered, counting_ordered;
+        double radix_ms = TimeMs([&] { sorter.Sort(particles, radix_ordered, SortRadix); }, iterations);
+        std::vector<uint32_t> radix_offsets = sorter.GetCellOffsets();
+        double counting_ms = TimeMs([&] { sorter.Sort(particles, counting_ordered, SortCounting); }, iterations);
+
+        printf("%10d %10d %14.3f %14.3f %14.3f %16.1f\n", num_particles, test_values.num_cells_, atomic_ms, counting_ms, radix_ms, num_particles / (counting_ms * 1000));
+
+        // Both sorts are stable so must match exactly, and the cell offsets must match the GPU pipeline's
+        if (!SameParticles(counting_ordered, radix_ordered) || sorter.GetCellOffsets() != radix_offsets) {
+            printf("Counting and radix sorts differ at %d particles!\n", num_particles);
+            valid = false;
+        }
+        if (sorter.GetCellOffsets() != atomic_offsets || sorter.GetCellCounts() != grid.GetCellCounts()) {
+            printf("Cell offsets differ from the atomic pipeline at %d particles!\n", num_particles);
+            valid = false;
+        }
+        if (num_particles <= MAX_REFERENCE_PARTICLES && !MatchReference(test_values, particles, counting_ordered)) {
+            printf("Sorted order differs from std::stable_sort at %d particles!\n", num_particles);
+            valid = false;
+        }
+    }
+
+    return valid ? 0 : 1;
+}
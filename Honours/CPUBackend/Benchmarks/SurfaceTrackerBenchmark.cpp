@@ -0,0 +1,143 @@
+// Compares full surface detection each frame against the incremental SurfaceTracker, over an animated scene.
+// The tracker's surface set is checked against a serial full evaluation every frame.
+// Usage: SurfaceTrackerBenchmark (particle no.) (scene) (threads) (frames) (particle radius)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "../BrickPool.h"
+#include "../GridCommon.h"
+#include "../GridEngine.h"
+#include "../ParticleScenes.h"
+#include "../SurfaceTracker.h"
+
+using namespace CPUBackend;
+typedef std::chrono::high_resolution_clock Clock;
+
+template<typename F>
+static double TimeMs(F&& func)
+{
+    Clock::time_point start = Clock::now();
+    func();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Serial version of the tracker's per-cell surface test, over every cell in the grid
+static std::vector<uint8_t> ReferenceSurfaceCells(const GridEngine& grid)
+{
+    const TestVariables& test_values = grid.GetTestValues();
+    const std::vector<uint32_t>& cell_counts = grid.GetCellCounts();
+    std::vector<uint8_t> is_surface(test_values.num_cells_, 0);
+
+    for (int z = 0; z < test_values.cells_per_axis_; z++) {
+        for (int y = 0; y < test_values.cells_per_axis_; y++) {
+            for (int x = 0; x < test_values.cells_per_axis_; x++) {
+                uint32_t cell_index = CellCoordsToIndex(test_values, x, y, z);
+                uint32_t particle_count = cell_counts[cell_index];
+                bool surface = particle_count > 0 && particle_count < CELL_MAX_PARTICLE_COUNT;
+
+                int neighbouring_cells[27];
+                grid.GetNeighbourCells(cell_index, neighbouring_cells);
+                for (int neighbour_index : neighbouring_cells) {
+                    surface |= neighbour_index > -1 && ((particle_count == 0) != (cell_counts[neighbour_index] == 0));
+                }
+                is_surface[cell_index] = surface;
+            }
+        }
+    }
+    return is_surface;
+}
+
+// The tracker's slots must hold exactly the reference surface cells, and agree with its cell to slot mapping
+static bool MatchSurfaceCells(const SurfaceTracker& tracker, const std::vector<uint8_t>& reference)
+{
+    uint32_t reference_count = (uint32_t)std::count(reference.begin(), reference.end(), 1);
+    if (reference_count != tracker.GetSurfaceCellCount()) {
+        return false;
+    }
+
+    uint32_t slot_count = 0;
+    for (uint32_t cell_index : tracker.GetSurfaceSlots()) {
+        if (cell_index == SurfaceTracker::INVALID_SURFACE_SLOT) {
+            continue;
+        }
+        if (!reference[cell_index] || !tracker.IsSurfaceCell(cell_index)) {
+            return false;
+        }
+        slot_count++;
+    }
+    return slot_count == reference_count;
+}
+
+int main(int argc, char** argv)
+{
+    TestVariables test_values = {};
+    test_values.num_particles_ = argc > 1 ? std::atoi(argv[1]) : 100000;
+    test_values.scene_ = argc > 2 ? (SceneType)std::atoi(argv[2]) : SceneWave;
+    unsigned int threads = argc > 3 ? std::atoi(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    int frames = argc > 4 ? std::atoi(argv[4]) : 60;
+    test_values.particle_radius_ = argc > 5 ? (float)std::atof(argv[5]) : 0;
+    test_values.texture_res_ = 256;
+    DeriveGridValues(test_values);
+
+    ThreadPool thread_pool(threads);
+    GridEngine grid(&thread_pool, test_values);
+    SurfaceTracker tracker(&thread_pool, test_values);
+    std::vector<ParticleData> particles;
+    std::vector<AABB> aabbs;
+    GenerateParticles(test_values, particles, &thread_pool);
+
+    printf("Surface tracker benchmark: %d particles, scene %d, %u threads, %d frames\n", test_values.num_particles_, test_values.scene_, threads, frames);
+    printf("Grid: %d^3 cells, particle radius %f\n", test_values.cells_per_axis_, test_values.particle_radius_);
+
+    bool valid = true;
+    double full_ms = 0, tracker_ms = 0, aabb_ms = 0;
+    uint64_t dirty = 0, evaluated = 0, added = 0, removed = 0, surface = 0;
+
+    // Frame 0 is the tracker's full evaluation, and is reported separately
+    for (int frame = 0; frame <= frames; frame++) {
+        ComputePositions(test_values, frame / 60.f, particles, &thread_pool);
+        grid.ClearGridCounts();
+        grid.BuildGrid(particles);
+
+        double frame_full_ms = TimeMs([&] {
+            grid.DetectSurfaceBlocks();
+            grid.DetectSurfaceCells();
+        });
+        double frame_tracker_ms = TimeMs([&] { tracker.Update(grid, particles); });
+        double frame_aabb_ms = TimeMs([&] { tracker.UpdateAABBs(grid, aabbs); });
+
+        if (!MatchSurfaceCells(tracker, ReferenceSurfaceCells(grid))) {
+            printf("Tracked surface cells differ from a full evaluation on frame %d!\n", frame);
+            valid = false;
+        }
+
+        if (frame == 0) {
+            printf("First frame: full detection %.3f ms, tracker %.3f ms (%u surface cells)\n", frame_full_ms, frame_tracker_ms, tracker.GetSurfaceCellCount());
+            continue;
+        }
+
+        full_ms += frame_full_ms;
+        tracker_ms += frame_tracker_ms;
+        aabb_ms += frame_aabb_ms;
+        dirty += tracker.GetDirtyCellCount();
+        evaluated += tracker.GetEvaluatedCellCount();
+        added += tracker.GetAddedCells().size();
+        removed += tracker.GetRemovedCells().size();
+        surface += tracker.GetSurfaceCellCount();
+    }
+
+    if (frames > 0) {
+        printf("Per frame averages over %d frames:\n", frames);
+        printf("  full detection:     %10.3f ms\n", full_ms / frames);
+        printf("  tracker update:     %10.3f ms\n", tracker_ms / frames);
+        printf("  tracker AABBs:      %10.3f ms (%zu AABB slots)\n", aabb_ms / frames, aabbs.size());
+        printf("  dirty cells:        %10.1f\n", (double)dirty / frames);
+        printf("  evaluated cells:    %10.1f of %d\n", (double)evaluated / frames, test_values.num_cells_);
+        printf("  added / removed:    %10.1f / %.1f\n", (double)added / frames, (double)removed / frames);
+        printf("  surface cells:      %10.1f\n", (double)surface / frames);
+    }
+
+    return valid ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+#include "BitmaskSurfaceEngine.h"
+#include "GridCommon.h"
+#include <atomic>
+#include <bit>
+#include "CpuFeatures.h"
+
+namespace CPUBackend {
+
+// Rows of blocks per chunk
+#define MASK_ROW_GRAIN_SIZE 4
+
+// Bits of the cells at coord 0 and coord 3 of each axis, for bit = x + 4y + 16z
+static const uint64_t LOW_FACE_MASKS[3] = { 0x1111111111111111ull, 0x000F000F000F000Full, 0x000000000000FFFFull };
+static const uint64_t HIGH_FACE_MASKS[3] = { 0x8888888888888888ull, 0xF000F000F000F000ull, 0xFFFF000000000000ull };
+static const int AXIS_SHIFTS[3] = { 1, 4, 16 };
+
+BitmaskSurfaceEngine::BitmaskSurfaceEngine(ThreadPool* thread_pool, const TestVariables& test_values) :
+    use_simd_(HasSimd()),
+    test_values_(test_values),
+    thread_pool_(thread_pool)
+{
+    padded_blocks_per_axis_ = test_values_.blocks_per_axis_ + 2;
+    padded_blocks_per_z_ = (size_t)padded_blocks_per_axis_ * padded_blocks_per_axis_;
+    size_t padded_blocks = padded_blocks_per_z_ * padded_blocks_per_axis_;
+
+    // The border blocks are never written, so stay zero
+    cell_masks_.resize(padded_blocks * 2);
+    full_masks_.resize(padded_blocks);
+    dilated_masks_.resize(padded_blocks * 2);
+    scratch_masks_.resize(padded_blocks * 2);
+    surface_cell_indices_.resize(test_values_.num_cells_);
+
+    // Block cells are offset from the first cell by the same amount in every block, for either cell indexing mode
+    uint32_t first_cell = BlockIndexToCellIndex(test_values_, 0, { 0, 0, 0 });
+    for (uint32_t bit = 0; bit < NUM_CELLS_PER_BLOCK; bit++) {
+        UInt3 cell_offset = { bit % NUM_CELLS_PER_AXIS_PER_BLOCK, (bit / NUM_CELLS_PER_AXIS_PER_BLOCK) % NUM_CELLS_PER_AXIS_PER_BLOCK, bit / (NUM_CELLS_PER_AXIS_PER_BLOCK * NUM_CELLS_PER_AXIS_PER_BLOCK) };
+        cell_offsets_[bit] = BlockIndexToCellIndex(test_values_, 0, cell_offset) - first_cell;
+    }
+}
+
+bool BitmaskSurfaceEngine::HasSimd()
+{
+    static const bool has_simd = HasBitmaskAvx2() && CpuSupportsFeature(CpuFeatureAvx2);
+    return has_simd;
+}
+
+void BitmaskSurfaceEngine::DetectSurfaceCells(const std::vector<uint32_t>& cell_counts)
+{
+    BuildMasks(cell_counts);
+    DilateMasks();
+    ExtractSurfaceCells();
+}
+
+// Sets a bit per cell for the non-empty, empty and full cells of each block
+void BitmaskSurfaceEngine::BuildMasks(const std::vector<uint32_t>& cell_counts)
+{
+    const int blocks_per_axis = test_values_.blocks_per_axis_;
+
+    thread_pool_->ParallelFor(0, (size_t)blocks_per_axis * blocks_per_axis, MASK_ROW_GRAIN_SIZE, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++) {
+            int by = (int)(row % blocks_per_axis);
+            int bz = (int)(row / blocks_per_axis);
+
+            for (int bx = 0; bx < blocks_per_axis; bx++) {
+                uint32_t block_index = (uint32_t)(row * blocks_per_axis + bx);
+                const uint32_t* block_counts = cell_counts.data() + BlockIndexToCellIndex(test_values_, block_index, { 0, 0, 0 });
+
+                uint64_t empty = 0;
+                uint64_t full = 0;
+                if (use_simd_) {
+                    BuildBlockMasksAvx2(block_counts, cell_offsets_, empty, full);
+                }
+                else {
+                    for (int bit = 0; bit < NUM_CELLS_PER_BLOCK; bit++) {
+                        uint32_t particle_count = block_counts[cell_offsets_[bit]];
+                        empty |= (uint64_t)(particle_count == 0) << bit;
+                        full |= (uint64_t)(particle_count >= CELL_MAX_PARTICLE_COUNT) << bit;
+                    }
+                }
+
+                size_t mask_index = MaskIndex(bx, by, bz);
+                cell_masks_[mask_index * 2] = ~empty;
+                cell_masks_[mask_index * 2 + 1] = empty;
+                full_masks_[mask_index] = full;
+            }
+        }
+    });
+}
+
+// Dilates the non-empty and empty masks by one cell in every direction, including diagonals, as three one-axis passes
+void BitmaskSurfaceEngine::DilateMasks()
+{
+    DilateAxis(cell_masks_, dilated_masks_, 0);
+    DilateAxis(dilated_masks_, scratch_masks_, 1);
+    DilateAxis(scratch_masks_, dilated_masks_, 2);
+}
+
+// out = in | in shifted one cell up and down the axis, with the cells crossing block borders taken from the neighbouring blocks
+void BitmaskSurfaceEngine::DilateAxis(const std::vector<uint64_t>& in, std::vector<uint64_t>& out, int axis)
+{
+    const int blocks_per_axis = test_values_.blocks_per_axis_;
+    const uint64_t low_face = LOW_FACE_MASKS[axis];
+    const uint64_t high_face = HIGH_FACE_MASKS[axis];
+    const int shift = AXIS_SHIFTS[axis];
+    const int face_shift = shift * (NUM_CELLS_PER_AXIS_PER_BLOCK - 1);
+
+    // Distance to the neighbouring block's masks along the axis
+    const size_t stride = 2 * (axis == 0 ? 1 : (axis == 1 ? (size_t)padded_blocks_per_axis_ : padded_blocks_per_z_));
+
+    thread_pool_->ParallelFor(0, (size_t)blocks_per_axis * blocks_per_axis, MASK_ROW_GRAIN_SIZE, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++) {
+            int by = (int)(row % blocks_per_axis);
+            int bz = (int)(row / blocks_per_axis);
+
+            // A row's blocks are contiguous, two masks each
+            const uint64_t* src = in.data() + MaskIndex(0, by, bz) * 2;
+            uint64_t* dst = out.data() + MaskIndex(0, by, bz) * 2;
+            size_t count = (size_t)blocks_per_axis * 2;
+            size_t i = 0;
+
+            if (use_simd_) {
+                i = DilateMasksAvx2(src, dst, count, stride, low_face, high_face, shift, face_shift);
+            }
+            for (; i < count; i++) {
+                uint64_t m = src[i];
+                uint64_t below = src[i - stride];
+                uint64_t above = src[i + stride];
+                dst[i] = m | ((m << shift) & ~low_face) | ((m >> shift) & ~high_face) | ((below & high_face) >> face_shift) | ((above & low_face) << face_shift);
+            }
+        }
+    });
+}
+
+// Combines the masks into each block's surface cells, and appends their indices to the surface cell list
+void BitmaskSurfaceEngine::ExtractSurfaceCells()
+{
+    const int blocks_per_axis = test_values_.blocks_per_axis_;
+    surface_cells_count_ = 0;
+
+    thread_pool_->ParallelFor(0, (size_t)blocks_per_axis * blocks_per_axis, MASK_ROW_GRAIN_SIZE, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++) {
+            int by = (int)(row % blocks_per_axis);
+            int bz = (int)(row / blocks_per_axis);
+
+            for (int bx = 0; bx < blocks_per_axis; bx++) {
+                uint32_t block_index = (uint32_t)(row * blocks_per_axis + bx);
+                size_t mask_index = MaskIndex(bx, by, bz);
+                uint64_t non_empty = cell_masks_[mask_index * 2];
+                uint64_t empty = cell_masks_[mask_index * 2 + 1];
+
+                // Partly full cells, and empty / non-empty cells next to a non-empty / empty cell
+                uint64_t surface = (non_empty & ~full_masks_[mask_index]) |
+                    (empty & dilated_masks_[mask_index * 2]) |
+                    (non_empty & dilated_masks_[mask_index * 2 + 1]);
+                if (surface == 0) {
+                    continue;
+                }
+
+                // Reserve space for the whole block's surface cells at once
+                uint32_t surface_cells_array_index = std::atomic_ref<uint32_t>(surface_cells_count_).fetch_add(std::popcount(surface), std::memory_order_relaxed);
+                uint32_t first_cell = BlockIndexToCellIndex(test_values_, block_index, { 0, 0, 0 });
+                while (surface) {
+                    surface_cell_indices_[surface_cells_array_index++] = first_cell + cell_offsets_[std::countr_zero(surface)];
+                    surface &= surface - 1;
+                }
+            }
+        }
+    });
+}
+
+size_t BitmaskSurfaceEngine::GetMemoryFootprint() const
+{
+    return (cell_masks_.size() + full_masks_.size() + dilated_masks_.size() + scratch_masks_.size()) * sizeof(uint64_t) +
+        surface_cell_indices_.size() * sizeof(uint32_t);
+}
+
+}
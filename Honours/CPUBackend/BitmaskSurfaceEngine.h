@@ -0,0 +1,85 @@
+#pragma once
+#include <vector>
+#include "CPUStructs.h"
+#include "ThreadPool.h"
+
+namespace CPUBackend {
+
+// Surface cell detection using one bit per cell. A block is 4x4x4 = 64 cells, so each block's cells fit in a uint64,
+// with cell (x, y, z) of the block at bit x + 4y + 16z.
+//
+// Per block masks of non-empty and full cells are built from the grid's cell counts, then the non-empty and empty masks
+// are dilated by one cell in x, y and z in turn using shifts, taking the border cells from the neighbouring blocks.
+// A cell is a surface cell if it's partly full, or if it's empty / non-empty with a non-empty / empty neighbour.
+// This is the same test as CSDetectSurfaceCellsMain, without the 26 neighbour loads per cell, run on every block.
+//
+// Blocks are stored with a border of blocks on every side which are always zero, so out of bounds neighbours need no
+// checks and count as neither empty nor non-empty. Dilation runs two blocks (four masks) at a time with AVX2 when it's
+// built (HONOURS_CPU_AVX2 in CMakeLists.txt) and the CPU supports it.
+//
+// Unlike GridEngine, blocks with no empty cells are searched too. The dilated empty mask already holds the neighbouring
+// blocks' border cells, so a full block's cells next to an empty cell across the border are found, as are its partly full
+// cells. CSDetectSurfaceBlocksMain culls these blocks when they aren't at the edge of the grid, which is the only place the
+// two lists differ with BlockNeighbourFlagged.
+class BitmaskSurfaceEngine
+{
+public:
+    BitmaskSurfaceEngine(ThreadPool* thread_pool, const TestVariables& test_values);
+
+    // Runs all stages, given the cell counts from GridEngine::BuildGrid
+    void DetectSurfaceCells(const std::vector<uint32_t>& cell_counts);
+
+    // Individual stages, for profiling
+    void BuildMasks(const std::vector<uint32_t>& cell_counts);
+    void DilateMasks();
+    void ExtractSurfaceCells();
+
+    // Uses the scalar path even when AVX2 is available, for comparison
+    inline void SetUseSimd(bool use_simd) { use_simd_ = use_simd && HasSimd(); }
+    static bool HasSimd();
+
+    inline uint32_t GetSurfaceCellCount() const { return surface_cells_count_; }
+    // Only the first GetSurfaceCellCount() entries are valid
+    inline const std::vector<uint32_t>& GetSurfaceCellIndices() const { return surface_cell_indices_; }
+
+    // Bytes held by the engine's buffers
+    size_t GetMemoryFootprint() const;
+
+private:
+    // Index of block (bx, by, bz) of the grid in the mask arrays, which include the border
+    inline size_t MaskIndex(int bx, int by, int bz) const { return (size_t)(bx + 1) + (by + 1) * padded_blocks_per_axis_ + (bz + 1) * padded_blocks_per_z_; }
+
+    void DilateAxis(const std::vector<uint64_t>& in, std::vector<uint64_t>& out, int axis);
+
+    int padded_blocks_per_axis_;
+    size_t padded_blocks_per_z_;
+
+    // Offset of each of a block's 64 cells from its first cell, in bit order
+    uint32_t cell_offsets_[NUM_CELLS_PER_BLOCK];
+
+    // Per block, including the border. The cell and dilated masks hold the non-empty mask then the empty mask of each block,
+    // so both are dilated together.
+    std::vector<uint64_t> cell_masks_;
+    std::vector<uint64_t> full_masks_;
+    std::vector<uint64_t> dilated_masks_;
+    std::vector<uint64_t> scratch_masks_;
+
+    // Accessed atomically with std::atomic_ref
+    std::vector<uint32_t> surface_cell_indices_;
+    uint32_t surface_cells_count_ = 0;
+
+    bool use_simd_;
+
+    TestVariables test_values_;
+    ThreadPool* thread_pool_;
+};
+
+// AVX2 paths, in their own translation unit built with AVX2 enabled (see CMakeLists.txt), so the rest of the backend runs
+// on any x86-64 CPU. HasBitmaskAvx2 returns whether they were built, not whether the CPU supports them.
+bool HasBitmaskAvx2();
+// Empty and full masks of a block's 64 cells, gathering 8 cell counts at a time
+void BuildBlockMasksAvx2(const uint32_t* block_counts, const uint32_t* cell_offsets, uint64_t& empty, uint64_t& full);
+// Dilates four masks at a time along one axis, returning how many were done. The rest are left to the scalar loop.
+size_t DilateMasksAvx2(const uint64_t* src, uint64_t* dst, size_t count, size_t stride, uint64_t low_face, uint64_t high_face, int shift, int face_shift);
+
+}
@@ -0,0 +1,61 @@
+#include "BitmaskSurfaceEngine.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace CPUBackend {
+
+bool HasBitmaskAvx2()
+{
+#if defined(__AVX2__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void BuildBlockMasksAvx2(const uint32_t* block_counts, const uint32_t* cell_offsets, uint64_t& empty, uint64_t& full)
+{
+    empty = 0;
+    full = 0;
+#if defined(__AVX2__)
+    // Gather 8 cell counts at a time, and turn the comparisons into 8 mask bits
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max_count = _mm256_set1_epi32(CELL_MAX_PARTICLE_COUNT - 1);
+    for (int bit = 0; bit < NUM_CELLS_PER_BLOCK; bit += 8) {
+        __m256i offsets = _mm256_loadu_si256((const __m256i*)(cell_offsets + bit));
+        __m256i counts = _mm256_i32gather_epi32((const int*)block_counts, offsets, 4);
+        empty |= (uint64_t)(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(counts, zero))) << bit;
+        full |= (uint64_t)(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(counts, max_count))) << bit;
+    }
+#endif
+}
+
+size_t DilateMasksAvx2(const uint64_t* src, uint64_t* dst, size_t count, size_t stride, uint64_t low_face, uint64_t high_face, int shift, int face_shift)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i not_low = _mm256_set1_epi64x((long long)~low_face);
+    const __m256i not_high = _mm256_set1_epi64x((long long)~high_face);
+    const __m256i low = _mm256_set1_epi64x((long long)low_face);
+    const __m256i high = _mm256_set1_epi64x((long long)high_face);
+    const __m128i shift_count = _mm_cvtsi32_si128(shift);
+    const __m128i face_shift_count = _mm_cvtsi32_si128(face_shift);
+
+    for (; i + 4 <= count; i += 4) {
+        __m256i m = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i below = _mm256_loadu_si256((const __m256i*)(src + i - stride));
+        __m256i above = _mm256_loadu_si256((const __m256i*)(src + i + stride));
+
+        __m256i result = m;
+        result = _mm256_or_si256(result, _mm256_and_si256(_mm256_sll_epi64(m, shift_count), not_low));
+        result = _mm256_or_si256(result, _mm256_and_si256(_mm256_srl_epi64(m, shift_count), not_high));
+        result = _mm256_or_si256(result, _mm256_srl_epi64(_mm256_and_si256(below, high), face_shift_count));
+        result = _mm256_or_si256(result, _mm256_sll_epi64(_mm256_and_si256(above, low), face_shift_count));
+        _mm256_storeu_si256((__m256i*)(dst + i), result);
+    }
+#endif
+    return i;
+}
+
+}
@@ -0,0 +1,212 @@
+#pragma once
+#include <atomic>
+#include "BrickPool.h"
+
+namespace CPUBackend {
+
+// Which side of the brick's core a voxel offset along one axis is on, -1 or 1 for the apron and 0 for the core
+inline int GetApronDirection(int voxel_offset)
+{
+    if (voxel_offset == 0) {
+        return -1;
+    }
+    return voxel_offset == VOXELS_PER_AXIS_PER_BRICK - 1 ? 1 : 0;
+}
+
+// The bricks next to a brick, indexed by direction as the neighbouring cells are ((dz + 1) * 9 + (dy + 1) * 3 + (dx + 1)),
+// or INVALID_BRICK_SLOT where the cell there isn't a surface cell. cell_bricks holds the first brick of each surface cell,
+// INVALID_BRICK_SLOT for the rest.
+inline void GetNeighbourBricks(uint32_t bricks_per_axis, const int neighbouring_cells[27], uint32_t intra_cell_brick_index,
+    const std::vector<uint32_t>& cell_bricks, uint32_t neighbour_bricks[27])
+{
+    const int bricks = (int)bricks_per_axis;
+    const int brick_x = intra_cell_brick_index % bricks_per_axis;
+    const int brick_y = (intra_cell_brick_index / bricks_per_axis) % bricks_per_axis;
+    const int brick_z = intra_cell_brick_index / (bricks_per_axis * bricks_per_axis);
+
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                // Step into the neighbouring cell when the brick is on the edge of its own
+                int x = brick_x + dx, y = brick_y + dy, z = brick_z + dz;
+                int cell_x = (x >= bricks) - (x < 0), cell_y = (y >= bricks) - (y < 0), cell_z = (z >= bricks) - (z < 0);
+                int cell_index = neighbouring_cells[(cell_z + 1) * 9 + (cell_y + 1) * 3 + (cell_x + 1)];
+
+                uint32_t& neighbour_brick = neighbour_bricks[(dz + 1) * 9 + (dy + 1) * 3 + (dx + 1)];
+                neighbour_brick = INVALID_BRICK_SLOT;
+                if (cell_index > -1 && cell_bricks[cell_index] != INVALID_BRICK_SLOT) {
+                    x -= cell_x * bricks;
+                    y -= cell_y * bricks;
+                    z -= cell_z * bricks;
+                    neighbour_brick = cell_bricks[cell_index] + (z * bricks + y) * bricks + x;
+                }
+            }
+        }
+    }
+}
+
+// Where each surface cell's bricks are in the pool, as cell_brick_slots_ is on the GPU. INVALID_BRICK_SLOT for other cells.
+template<typename Grid>
+void GetCellBricks(const Grid& grid, std::vector<uint32_t>& cell_bricks, ThreadPool* thread_pool)
+{
+    const uint32_t bricks_per_axis = BricksPerAxisPerCell(grid.GetTestValues());
+    const uint32_t bricks_per_cell = bricks_per_axis * bricks_per_axis * bricks_per_axis;
+    const std::vector<uint32_t>& surface_cell_indices = grid.GetSurfaceCellIndices();
+
+    cell_bricks.assign(grid.GetCellCounts().size(), INVALID_BRICK_SLOT);
+    thread_pool->ParallelFor(0, grid.GetSurfaceCounts().surface_cells, 1024, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            cell_bricks[surface_cell_indices[i]] = (uint32_t)i * bricks_per_cell;
+        }
+    });
+}
+
+// CPU port of CSBrickApronMain. Sets every apron voxel with a neighbouring brick on that side to the neighbour's core voxel,
+// leaving the rest. Returns the number of voxels copied.
+template<typename Grid>
+uint64_t CopyBrickAprons(const Grid& grid, const std::vector<uint32_t>& cell_bricks, BrickPool& brick_pool, ThreadPool* thread_pool)
+{
+    const uint32_t bricks_per_axis = BricksPerAxisPerCell(grid.GetTestValues());
+    const uint32_t bricks_per_cell = bricks_per_axis * bricks_per_axis * bricks_per_axis;
+    const std::vector<uint32_t>& surface_cell_indices = grid.GetSurfaceCellIndices();
+    std::atomic<uint64_t> copied_voxels = 0;
+
+    thread_pool->ParallelFor(0, brick_pool.bricks_count_, 16, [&](size_t begin, size_t end) {
+        uint64_t copied = 0;
+        for (size_t brick_index = begin; brick_index < end; brick_index++) {
+            uint32_t cell_index = surface_cell_indices[brick_index / bricks_per_cell];
+            int neighbouring_cells[27];
+            grid.GetNeighbourCells(cell_index, neighbouring_cells);
+            uint32_t neighbour_bricks[27];
+            GetNeighbourBricks(bricks_per_axis, neighbouring_cells, brick_index % bricks_per_cell, cell_bricks, neighbour_bricks);
+
+            int16_t* voxels = brick_pool.voxels_.data() + brick_index * VOXELS_PER_BRICK;
+            int voxel = 0;
+            for (int z = 0; z < VOXELS_PER_AXIS_PER_BRICK; z++) {
+                for (int y = 0; y < VOXELS_PER_AXIS_PER_BRICK; y++) {
+                    for (int x = 0; x < VOXELS_PER_AXIS_PER_BRICK; x++, voxel++) {
+                        int dx = GetApronDirection(x), dy = GetApronDirection(y), dz = GetApronDirection(z);
+                        uint32_t neighbour_brick = neighbour_bricks[(dz + 1) * 9 + (dy + 1) * 3 + (dx + 1)];
+                        if ((dx | dy | dz) == 0 || neighbour_brick == INVALID_BRICK_SLOT) {
+                            continue;
+                        }
+
+                        // The voxel is CORE_VOXELS_PER_AXIS_PER_BRICK voxels back from the opposite side of the neighbour's core
+                        int nx = x - dx * CORE_VOXELS_PER_AXIS_PER_BRICK, ny = y - dy * CORE_VOXELS_PER_AXIS_PER_BRICK, nz = z - dz * CORE_VOXELS_PER_AXIS_PER_BRICK;
+                        voxels[voxel] = brick_pool.voxels_[(size_t)neighbour_brick * VOXELS_PER_BRICK +
+                            (nz * VOXELS_PER_AXIS_PER_BRICK + ny) * VOXELS_PER_AXIS_PER_BRICK + nx];
+                        copied++;
+                    }
+                }
+            }
+        }
+        copied_voxels.fetch_add(copied, std::memory_order_relaxed);
+    });
+
+    return copied_voxels;
+}
+
+struct ApronFillStats {
+    uint64_t evaluated_voxels_ = 0;     // Voxels whose SDF value was calculated
+    uint64_t copied_voxels_ = 0;        // Apron voxels copied from a neighbouring brick's core
+    uint64_t sdf_evaluations_ = 0;      // Particle distances calculated, ie. evaluated voxels times the brick's candidates
+};
+
+// CPU port of the apron-free brick pool fill in ComputeBrickPool.hlsl. Bricks are stored as in FillBrickPoolFrom, but only
+// the CORE_VOXELS_PER_AXIS_PER_BRICK^3 core voxels are calculated. Each apron voxel is the core voxel of the neighbouring
+// brick on that side, so once every core is filled the apron is copied from there. Only apron voxels with no brick on
+// that side, as the cell there isn't a surface cell, are calculated along with the core.
+// Candidate lists and kernels are as in FillBrickPoolFrom, so the cores match a full fill exactly. The full fill's aprons
+// over a cell's faces don't match the neighbouring cores though. Cells are only as wide as the 2 radii a particle's
+// surface reaches (see DeriveGridValues), while its centre counts up to 3 radii away, so the 27 cells around a brick's
+// cell don't hold every particle in reach of its outer voxels. An apron voxel over a cell's face and the core voxel at
+// the same point search 27 cells around different cells, each missing particles the other finds. That moves the voxel
+// by hundreds of snorm steps, or across the whole range where one side found none and kept the empty value 1.
+// The copied aprons are seamless instead, though no more complete than the cores they come from.
+template<typename Grid, typename PositionSource>
+ApronFillStats FillBrickPoolApronFree(const Grid& grid, const PositionSource& particle_positions, const std::vector<uint32_t>& cell_offsets,
+    BrickPool& brick_pool, ThreadPool* thread_pool, BrickKernelIsa kernel = GetBestBrickKernelIsa())
+{
+    const TestVariables& test_values = grid.GetTestValues();
+    const uint32_t bricks_per_axis = BricksPerAxisPerCell(test_values);
+    const uint32_t bricks_per_cell = bricks_per_axis * bricks_per_axis * bricks_per_axis;
+    const float voxel_size = 1.f / (test_values.cells_per_axis_ * bricks_per_axis * CORE_VOXELS_PER_AXIS_PER_BRICK);
+    const uint32_t surface_cells = grid.GetSurfaceCounts().surface_cells;
+    const std::vector<uint32_t>& surface_cell_indices = grid.GetSurfaceCellIndices();
+    const std::vector<uint32_t>& cell_counts = grid.GetCellCounts();
+
+    brick_pool.bricks_count_ = surface_cells * bricks_per_cell;
+    brick_pool.voxels_.resize((size_t)brick_pool.bricks_count_ * VOXELS_PER_BRICK);
+
+    std::vector<uint32_t> cell_bricks;
+    GetCellBricks(grid, cell_bricks, thread_pool);
+
+    std::atomic<uint64_t> evaluated_voxels = 0, sdf_evaluations = 0;
+
+    // Fill the cores, and any apron voxels without a neighbouring brick. One chunk item per brick, as with the GPU thread groups.
+    thread_pool->ParallelFor(0, brick_pool.bricks_count_, 1, [&](size_t begin, size_t end) {
+        std::vector<Float3> candidates;
+        alignas(64) float xs[PADDED_VOXELS_PER_BRICK], ys[PADDED_VOXELS_PER_BRICK], zs[PADDED_VOXELS_PER_BRICK];
+        uint16_t voxel_indices[VOXELS_PER_BRICK];
+        int16_t distances[VOXELS_PER_BRICK];
+        uint64_t evaluated = 0, evaluations = 0;
+
+        for (size_t brick_index = begin; brick_index < end; brick_index++) {
+            uint32_t cell_index = surface_cell_indices[brick_index / bricks_per_cell];
+            uint32_t intra_cell_brick_index = brick_index % bricks_per_cell;
+            Int3 cell_coords = grid.GetCellCoords(cell_index);
+
+            // Load list of indices of neighbouring cells
+            int neighbouring_cells[27];
+            grid.GetNeighbourCells(cell_index, neighbouring_cells);
+            uint32_t neighbour_bricks[27];
+            GetNeighbourBricks(bricks_per_axis, neighbouring_cells, intra_cell_brick_index, cell_bricks, neighbour_bricks);
+
+            Float3 brick_min = GetBrickAABB(test_values, cell_coords, intra_cell_brick_index).min_;
+            PositionSource brick_positions = particle_positions;
+            brick_positions.BeginBrick(test_values, cell_coords);
+            GatherBrickCandidates(GetBrickVoxelBounds(brick_min, voxel_size), neighbouring_cells, cell_counts, cell_offsets,
+                brick_positions, test_values.particle_radius_, candidates);
+
+            // Gather the voxels to calculate
+            size_t voxel_count = 0;
+            int voxel = 0;
+            for (int z = 0; z < VOXELS_PER_AXIS_PER_BRICK; z++) {
+                for (int y = 0; y < VOXELS_PER_AXIS_PER_BRICK; y++) {
+                    for (int x = 0; x < VOXELS_PER_AXIS_PER_BRICK; x++, voxel++) {
+                        int direction = (GetApronDirection(z) + 1) * 9 + (GetApronDirection(y) + 1) * 3 + (GetApronDirection(x) + 1);
+                        if (direction != 13 && neighbour_bricks[direction] != INVALID_BRICK_SLOT) {
+                            continue;
+                        }
+
+                        Float3 position = GetBrickVoxelPosition(brick_min, voxel_size, x, y, z);
+                        xs[voxel_count] = position.x;
+                        ys[voxel_count] = position.y;
+                        zs[voxel_count] = position.z;
+                        voxel_indices[voxel_count++] = (uint16_t)voxel;
+                    }
+                }
+            }
+
+            EvaluateVoxelCandidates(kernel, xs, ys, zs, voxel_count, candidates.data(), candidates.size(), test_values.particle_radius_, distances);
+
+            int16_t* voxels = brick_pool.voxels_.data() + brick_index * VOXELS_PER_BRICK;
+            for (size_t i = 0; i < voxel_count; i++) {
+                voxels[voxel_indices[i]] = distances[i];
+            }
+            evaluated += voxel_count;
+            evaluations += voxel_count * candidates.size();
+        }
+        evaluated_voxels.fetch_add(evaluated, std::memory_order_relaxed);
+        sdf_evaluations.fetch_add(evaluations, std::memory_order_relaxed);
+    });
+
+    // Copy the rest of the apron from the neighbouring bricks' cores, now they're all filled
+    ApronFillStats stats;
+    stats.evaluated_voxels_ = evaluated_voxels;
+    stats.copied_voxels_ = CopyBrickAprons(grid, cell_bricks, brick_pool, thread_pool);
+    stats.sdf_evaluations_ = sdf_evaluations;
+    return stats;
+}
+
+}
@@ -0,0 +1,95 @@
+#include "BrickKernel.h"
+#include "CpuFeatures.h"
+
+namespace CPUBackend {
+
+bool IsBrickKernelSupported(BrickKernelIsa isa)
+{
+    switch (isa) {
+    case BrickKernelScalar: return true;
+    case BrickKernelSse42: return HasBrickKernelSse42() && CpuSupportsFeature(CpuFeatureSse42);
+    case BrickKernelAvx2: return HasBrickKernelAvx2() && CpuSupportsFeature(CpuFeatureAvx2);
+    case BrickKernelAvx512: return HasBrickKernelAvx512() && CpuSupportsFeature(CpuFeatureAvx512F);
+    default: return false;
+    }
+}
+
+BrickKernelIsa GetBestBrickKernelIsa()
+{
+    static const BrickKernelIsa best_isa = [] {
+        for (int isa = BrickKernelIsaCount - 1; isa > BrickKernelScalar; isa--) {
+            if (IsBrickKernelSupported((BrickKernelIsa)isa)) {
+                return (BrickKernelIsa)isa;
+            }
+        }
+        return BrickKernelScalar;
+    }();
+    return best_isa;
+}
+
+const char* GetBrickKernelName(BrickKernelIsa isa)
+{
+    switch (isa) {
+    case BrickKernelScalar: return "scalar";
+    case BrickKernelSse42: return "SSE4.2";
+    case BrickKernelAvx2: return "AVX2";
+    case BrickKernelAvx512: return "AVX-512";
+    default: return "unknown";
+    }
+}
+
+void EvaluateVoxelDistances(BrickKernelIsa isa, float* xs, float* ys, float* zs, size_t voxel_count, const Float3* candidates,
+    size_t candidate_count, float particle_radius, float* distances)
+{
+    if (isa != BrickKernelScalar && !IsBrickKernelSupported(isa)) {
+        isa = BrickKernelScalar;
+    }
+
+    if (isa == BrickKernelScalar) {
+        for (size_t voxel = 0; voxel < voxel_count; voxel++) {
+            distances[voxel] = GetSignedDistanceCandidates(Float3{ xs[voxel], ys[voxel], zs[voxel] }, candidates, candidate_count, particle_radius);
+        }
+        return;
+    }
+
+    // Pad to a whole number of the widest vectors
+    const size_t padded_count = (voxel_count + 15) / 16 * 16;
+    for (size_t voxel = voxel_count; voxel < padded_count && voxel_count > 0; voxel++) {
+        xs[voxel] = xs[voxel_count - 1];
+        ys[voxel] = ys[voxel_count - 1];
+        zs[voxel] = zs[voxel_count - 1];
+    }
+
+    switch (isa) {
+    case BrickKernelSse42:
+        EvaluateBrickDistancesSse42(xs, ys, zs, padded_count, candidates, candidate_count, particle_radius, distances);
+        break;
+    case BrickKernelAvx2:
+        EvaluateBrickDistancesAvx2(xs, ys, zs, padded_count, candidates, candidate_count, particle_radius, distances);
+        break;
+    default:
+        EvaluateBrickDistancesAvx512(xs, ys, zs, padded_count, candidates, candidate_count, particle_radius, distances);
+        break;
+    }
+}
+
+void EvaluateVoxelCandidates(BrickKernelIsa isa, float* xs, float* ys, float* zs, size_t voxel_count, const Float3* candidates,
+    size_t candidate_count, float particle_radius, int16_t* voxels)
+{
+    alignas(64) float distances[PADDED_VOXELS_PER_BRICK];
+    EvaluateVoxelDistances(isa, xs, ys, zs, voxel_count, candidates, candidate_count, particle_radius, distances);
+
+    for (size_t voxel = 0; voxel < voxel_count; voxel++) {
+        voxels[voxel] = FloatToSnorm16(distances[voxel]);
+    }
+}
+
+void EvaluateBrickCandidates(BrickKernelIsa isa, const Float3& brick_min, float voxel_size, const Float3* candidates, size_t candidate_count,
+    float particle_radius, int16_t* voxels)
+{
+    alignas(64) float xs[PADDED_VOXELS_PER_BRICK], ys[PADDED_VOXELS_PER_BRICK], zs[PADDED_VOXELS_PER_BRICK];
+    GetBrickVoxelPositions(brick_min, voxel_size, xs, ys, zs);
+    EvaluateVoxelCandidates(isa, xs, ys, zs, VOXELS_PER_BRICK, candidates, candidate_count, particle_radius, voxels);
+}
+
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <cstddef>
+#include "SdfCommon.h"
+
+namespace CPUBackend {
+
+#define VOXELS_PER_BRICK (VOXELS_PER_AXIS_PER_BRICK * VOXELS_PER_AXIS_PER_BRICK * VOXELS_PER_AXIS_PER_BRICK)
+
+// Voxels per brick rounded up to a whole number of the widest vectors, for the kernels' scratch arrays
+#define PADDED_VOXELS_PER_BRICK ((VOXELS_PER_BRICK + 15) / 16 * 16)
+
+enum BrickKernelIsa {
+    BrickKernelScalar = 0,
+    BrickKernelSse42,       // 4 voxels at a time
+    BrickKernelAvx2,        // 8 voxels at a time
+    BrickKernelAvx512,      // 16 voxels at a time
+    BrickKernelIsaCount
+};
+
+// Voxel centre of voxel (x, y, z) of a brick with its core starting at brick_min, as in CSBrickPoolMain
+inline Float3 GetBrickVoxelPosition(const Float3& brick_min, float voxel_size, int x, int y, int z)
+{
+    // voxel offset is offset by -(1,1,1) to account for adjacency voxels
+    return brick_min + Float3{ (float)(x - 1), (float)(y - 1), (float)(z - 1) } * voxel_size + voxel_size * 0.5f;
+}
+
+// Writes the voxel centres of a brick in x, y, z order into separate arrays of PADDED_VOXELS_PER_BRICK floats,
+// repeating the last voxel in the padding
+inline void GetBrickVoxelPositions(const Float3& brick_min, float voxel_size, float* xs, float* ys, float* zs)
+{
+    int voxel = 0;
+    for (int z = 0; z < VOXELS_PER_AXIS_PER_BRICK; z++) {
+        for (int y = 0; y < VOXELS_PER_AXIS_PER_BRICK; y++) {
+            for (int x = 0; x < VOXELS_PER_AXIS_PER_BRICK; x++, voxel++) {
+                Float3 position = GetBrickVoxelPosition(brick_min, voxel_size, x, y, z);
+                xs[voxel] = position.x;
+                ys[voxel] = position.y;
+                zs[voxel] = position.z;
+            }
+        }
+    }
+    for (; voxel < PADDED_VOXELS_PER_BRICK; voxel++) {
+        xs[voxel] = xs[VOXELS_PER_BRICK - 1];
+        ys[voxel] = ys[VOXELS_PER_BRICK - 1];
+        zs[voxel] = zs[VOXELS_PER_BRICK - 1];
+    }
+}
+
+// Calculated SDF value from a brick's candidate particles
+inline float GetSignedDistanceCandidates(const Float3& position, const Float3* candidates, size_t candidate_count, float particle_radius)
+{
+    // Init to large value
+    float distance = 1000;
+
+    for (size_t i = 0; i < candidate_count; i++) {
+        // Incorporate particle into final SDF value
+        float distance1 = GetDistanceToSphere(candidates[i] - position, particle_radius);
+        if (distance1 <= particle_radius * 2) {
+            distance = SmoothMin(distance, distance1, particle_radius);
+        }
+    }
+
+    return distance;
+}
+
+// As GetSignedDistanceCandidates, along with the SDF's gradient
+inline float GetSignedDistanceGradientCandidates(const Float3& position, const Float3* candidates, size_t candidate_count, float particle_radius,
+    Float3& gradient)
+{
+    float distance = 1000;
+    gradient = { 0, 0, 0 };
+
+    for (size_t i = 0; i < candidate_count; i++) {
+        Float3 displacement = candidates[i] - position;
+        float distance1 = GetDistanceToSphere(displacement, particle_radius);
+        if (distance1 <= particle_radius * 2) {
+            distance = SmoothMinGradient(distance, gradient, distance1, GetSphereGradient(displacement), particle_radius, gradient);
+        }
+    }
+
+    return distance;
+}
+
+// Fills a brick's VOXELS_PER_BRICK R16_SNORM voxels from its candidate particles (see GatherBrickCandidates in BrickPool.h).
+// The vector kernels evaluate several voxels at once against each candidate in turn, doing the same float operations in the
+// same order as the scalar kernel, so every kernel gives identical voxels. Unsupported kernels fall back to the scalar one.
+void EvaluateBrickCandidates(BrickKernelIsa isa, const Float3& brick_min, float voxel_size, const Float3* candidates, size_t candidate_count,
+    float particle_radius, int16_t* voxels);
+
+// As EvaluateBrickCandidates, for any voxel_count (up to VOXELS_PER_BRICK) voxel centres in separate 64 byte aligned arrays,
+// eg. a brick's core. The arrays need room for padding to a multiple of 16 voxels, which is overwritten.
+void EvaluateVoxelCandidates(BrickKernelIsa isa, float* xs, float* ys, float* zs, size_t voxel_count, const Float3* candidates,
+    size_t candidate_count, float particle_radius, int16_t* voxels);
+
+// As EvaluateVoxelCandidates, writing the float distances before any conversion to a 64 byte aligned array with room for
+// the padding, eg. for storing the brick in another format
+void EvaluateVoxelDistances(BrickKernelIsa isa, float* xs, float* ys, float* zs, size_t voxel_count, const Float3* candidates,
+    size_t candidate_count, float particle_radius, float* distances);
+
+// Widest kernel both built and supported by this CPU, detected once
+BrickKernelIsa GetBestBrickKernelIsa();
+// Whether the kernel was built and the CPU supports it, see CpuFeatures.h
+bool IsBrickKernelSupported(BrickKernelIsa isa);
+const char* GetBrickKernelName(BrickKernelIsa isa);
+
+// Kernels for each instruction set, each in its own translation unit built with that instruction set enabled
+// (see CMakeLists.txt). The Has functions return whether the kernel was built, not whether the CPU supports it.
+// They take voxel_count voxel centres, a multiple of 16 such as from GetBrickVoxelPositions, and write voxel_count distances to
+// a 64 byte aligned array. The positions and snorm conversion are left to the dispatcher, as any inline function the kernels called could be
+// emitted with their instruction set and then picked by the linker for the rest of the backend.
+bool HasBrickKernelSse42();
+bool HasBrickKernelAvx2();
+bool HasBrickKernelAvx512();
+void EvaluateBrickDistancesSse42(const float* xs, const float* ys, const float* zs, size_t voxel_count, const Float3* candidates, size_t candidate_count, float particle_radius, float* distances);
+void EvaluateBrickDistancesAvx2(const float* xs, const float* ys, const float* zs, size_t voxel_count, const Float3* candidates, size_t candidate_count, float particle_radius, float* distances);
+void EvaluateBrickDistancesAvx512(const float* xs, const float* ys, const float* zs, size_t voxel_count, const Float3* candidates, size_t candidate_count, float particle_radius, float* distances);
+
+}
@@ -0,0 +1,51 @@
+#include "BrickKernel.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace CPUBackend {
+
+bool HasBrickKernelAvx2()
+{
+#if defined(__AVX2__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void EvaluateBrickDistancesAvx2(const float* xs, const float* ys, const float* zs, size_t voxel_count, const Float3* candidates, size_t candidate_count, float particle_radius, float* distances)
+{
+#if defined(__AVX2__)
+    const __m256 radius = _mm256_set1_ps(particle_radius);
+    const __m256 influence_radius = _mm256_set1_ps(particle_radius * 2);
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+    for (size_t voxel = 0; voxel < voxel_count; voxel += 8) {
+        const __m256 x = _mm256_load_ps(xs + voxel);
+        const __m256 y = _mm256_load_ps(ys + voxel);
+        const __m256 z = _mm256_load_ps(zs + voxel);
+        __m256 distance = _mm256_set1_ps(1000);
+
+        // Same operations as GetSignedDistanceCandidates and SmoothMin, in the same order
+        for (size_t i = 0; i < candidate_count; i++) {
+            __m256 dx = _mm256_sub_ps(_mm256_set1_ps(candidates[i].x), x);
+            __m256 dy = _mm256_sub_ps(_mm256_set1_ps(candidates[i].y), y);
+            __m256 dz = _mm256_sub_ps(_mm256_set1_ps(candidates[i].z), z);
+            __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+            __m256 distance1 = _mm256_sub_ps(length, radius);
+
+            __m256 e = _mm256_max_ps(_mm256_sub_ps(radius, _mm256_and_ps(_mm256_sub_ps(distance, distance1), abs_mask)), zero);
+            __m256 smooth_min = _mm256_sub_ps(_mm256_min_ps(distance1, distance), _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(e, e), quarter), radius));
+            distance = _mm256_blendv_ps(distance, smooth_min, _mm256_cmp_ps(distance1, influence_radius, _CMP_LE_OQ));
+        }
+        _mm256_store_ps(distances + voxel, distance);
+    }
+#else
+    (void)xs; (void)ys; (void)zs; (void)voxel_count; (void)candidates; (void)candidate_count; (void)particle_radius; (void)distances;
+#endif
+}
+
+}
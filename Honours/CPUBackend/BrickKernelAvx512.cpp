@@ -0,0 +1,58 @@
+#include "BrickKernel.h"
+#if defined(__AVX512F__)
+// GCC 12's AVX-512 sqrt/min/max pass _mm512_undefined_ps() as the unused merge source, which -Wmaybe-uninitialized flags
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+namespace CPUBackend {
+
+bool HasBrickKernelAvx512()
+{
+#if defined(__AVX512F__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void EvaluateBrickDistancesAvx512(const float* xs, const float* ys, const float* zs, size_t voxel_count, const Float3* candidates, size_t candidate_count, float particle_radius, float* distances)
+{
+#if defined(__AVX512F__)
+    const __m512 radius = _mm512_set1_ps(particle_radius);
+    const __m512 influence_radius = _mm512_set1_ps(particle_radius * 2);
+    const __m512 quarter = _mm512_set1_ps(0.25f);
+    const __m512 zero = _mm512_setzero_ps();
+
+    for (size_t voxel = 0; voxel < voxel_count; voxel += 16) {
+        const __m512 x = _mm512_load_ps(xs + voxel);
+        const __m512 y = _mm512_load_ps(ys + voxel);
+        const __m512 z = _mm512_load_ps(zs + voxel);
+        __m512 distance = _mm512_set1_ps(1000);
+
+        // Same operations as GetSignedDistanceCandidates and SmoothMin, in the same order
+        for (size_t i = 0; i < candidate_count; i++) {
+            __m512 dx = _mm512_sub_ps(_mm512_set1_ps(candidates[i].x), x);
+            __m512 dy = _mm512_sub_ps(_mm512_set1_ps(candidates[i].y), y);
+            __m512 dz = _mm512_sub_ps(_mm512_set1_ps(candidates[i].z), z);
+            __m512 length = _mm512_sqrt_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz)));
+            __m512 distance1 = _mm512_sub_ps(length, radius);
+
+            __m512 e = _mm512_max_ps(_mm512_sub_ps(radius, _mm512_abs_ps(_mm512_sub_ps(distance, distance1))), zero);
+            __m512 smooth_min = _mm512_sub_ps(_mm512_min_ps(distance1, distance), _mm512_div_ps(_mm512_mul_ps(_mm512_mul_ps(e, e), quarter), radius));
+            distance = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(distance1, influence_radius, _CMP_LE_OQ), distance, smooth_min);
+        }
+        _mm512_store_ps(distances + voxel, distance);
+    }
+#else
+    (void)xs; (void)ys; (void)zs; (void)voxel_count; (void)candidates; (void)candidate_count; (void)particle_radius; (void)distances;
+#endif
+}
+
+}
@@ -0,0 +1,51 @@
+#include "BrickKernel.h"
+#if defined(__SSE4_2__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#include <immintrin.h>
+#endif
+
+namespace CPUBackend {
+
+bool HasBrickKernelSse42()
+{
+#if defined(__SSE4_2__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+    return true;
+#else
+    return false;
+#endif
+}
+
+void EvaluateBrickDistancesSse42(const float* xs, const float* ys, const float* zs, size_t voxel_count, const Float3* candidates, size_t candidate_count, float particle_radius, float* distances)
+{
+#if defined(__SSE4_2__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+    const __m128 radius = _mm_set1_ps(particle_radius);
+    const __m128 influence_radius = _mm_set1_ps(particle_radius * 2);
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+    for (size_t voxel = 0; voxel < voxel_count; voxel += 4) {
+        const __m128 x = _mm_load_ps(xs + voxel);
+        const __m128 y = _mm_load_ps(ys + voxel);
+        const __m128 z = _mm_load_ps(zs + voxel);
+        __m128 distance = _mm_set1_ps(1000);
+
+        // Same operations as GetSignedDistanceCandidates and SmoothMin, in the same order
+        for (size_t i = 0; i < candidate_count; i++) {
+            __m128 dx = _mm_sub_ps(_mm_set1_ps(candidates[i].x), x);
+            __m128 dy = _mm_sub_ps(_mm_set1_ps(candidates[i].y), y);
+            __m128 dz = _mm_sub_ps(_mm_set1_ps(candidates[i].z), z);
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+            __m128 distance1 = _mm_sub_ps(length, radius);
+
+            __m128 e = _mm_max_ps(_mm_sub_ps(radius, _mm_and_ps(_mm_sub_ps(distance, distance1), abs_mask)), zero);
+            __m128 smooth_min = _mm_sub_ps(_mm_min_ps(distance1, distance), _mm_div_ps(_mm_mul_ps(_mm_mul_ps(e, e), quarter), radius));
+            distance = _mm_blendv_ps(distance, smooth_min, _mm_cmple_ps(distance1, influence_radius));
+        }
+        _mm_store_ps(distances + voxel, distance);
+    }
+#else
+    (void)xs; (void)ys; (void)zs; (void)voxel_count; (void)candidates; (void)candidate_count; (void)particle_radius; (void)distances;
+#endif
+}
+
+}
@@ -0,0 +1,270 @@
+#pragma once
+#include <bit>
+#include <cmath>
+#include "BrickApron.h"
+#include "BrickQuantise.h"
+
+namespace CPUBackend {
+
+// CPU port of the camera LOD (constant_buffer_.lod_bricks_). CSSelectCellLods picks a level for each surface cell from how
+// many pixels its voxels cover, at the cell's nearest point to the camera. Level l cells have BricksPerAxisAtLod(l) bricks
+// per axis, each voxel twice as wide as at the level before, so a cell of 64 bricks coarsens to 8 then 1.
+inline int SelectCellLod(const TestVariables& test_values, const Int3& cell_coords, const Float3& camera_position, float pixel_scale,
+    float pixels_per_voxel)
+{
+    const float cell_size = 1.f / test_values.cells_per_axis_;
+    const float voxel_size = cell_size / (BricksPerAxisPerCell(test_values) * CORE_VOXELS_PER_AXIS_PER_BRICK);
+
+    Float3 cell_min = Float3{ (float)cell_coords.x, (float)cell_coords.y, (float)cell_coords.z } * cell_size;
+    Float3 nearest = { std::clamp(camera_position.x, cell_min.x, cell_min.x + cell_size),
+        std::clamp(camera_position.y, cell_min.y, cell_min.y + cell_size),
+        std::clamp(camera_position.z, cell_min.z, cell_min.z + cell_size) };
+    float distance = std::max(Length(nearest - camera_position), 1e-6f);
+    float voxel_pixels = voxel_size * pixel_scale / distance;
+    return (int)std::clamp(std::floor(std::log2(pixels_per_voxel / voxel_pixels)), 0.f, (float)MaxBrickLod(test_values));
+}
+
+// Bounds of a brick within a cell at the level, as placed by CSBuildAABBs
+inline AABB GetLodBrickAABB(const TestVariables& test_values, const Int3& cell_coords, int lod, uint32_t intra_cell_brick_index)
+{
+    const uint32_t bricks_per_axis = BricksPerAxisAtLod(test_values, lod);
+    const uint32_t bricks_per_z = bricks_per_axis * bricks_per_axis;
+    const float brick_size = 1.f / (test_values.cells_per_axis_ * bricks_per_axis);
+
+    Float3 brick_offset = { (float)(intra_cell_brick_index % bricks_per_axis), (float)((intra_cell_brick_index % bricks_per_z) / bricks_per_axis), (float)(intra_cell_brick_index / bricks_per_z) };
+    AABB aabb;
+    aabb.min_ = Float3{ (float)cell_coords.x, (float)cell_coords.y, (float)cell_coords.z } / (float)test_values.cells_per_axis_ + brick_offset * brick_size;
+    aabb.max_ = aabb.min_ + brick_size;
+    return aabb;
+}
+
+// Brick pool with a level per surface cell. Each cell's bricks follow one another, as the GPU's slots do.
+struct LodBrickPool {
+    std::vector<int16_t> voxels_;
+    uint32_t bricks_count_ = 0;
+    uint32_t lod_cells_[MAX_BRICK_LODS] = {};   // Surface cells at each level
+
+    // Per cell, the first of its bricks or INVALID_BRICK_SLOT for cells that aren't surface cells, and its level
+    std::vector<uint32_t> cell_bricks_;
+    std::vector<uint8_t> cell_lods_;
+
+    inline int16_t* Brick(uint32_t brick_index) { return voxels_.data() + (size_t)brick_index * VOXELS_PER_BRICK; }
+    inline const int16_t* Brick(uint32_t brick_index) const { return voxels_.data() + (size_t)brick_index * VOXELS_PER_BRICK; }
+};
+
+// Picks each surface cell's level for the camera and lays out its bricks. A pixels_per_voxel of 0 keeps every cell at level 0.
+template<typename Grid>
+void SelectLodBricks(const Grid& grid, const Float3& camera_position, float pixel_scale, float pixels_per_voxel, LodBrickPool& brick_pool)
+{
+    const TestVariables& test_values = grid.GetTestValues();
+    const std::vector<uint32_t>& surface_cell_indices = grid.GetSurfaceCellIndices();
+
+    brick_pool.cell_bricks_.assign(grid.GetCellCounts().size(), INVALID_BRICK_SLOT);
+    brick_pool.cell_lods_.assign(grid.GetCellCounts().size(), 0);
+    std::fill(brick_pool.lod_cells_, brick_pool.lod_cells_ + MAX_BRICK_LODS, 0);
+    brick_pool.bricks_count_ = 0;
+    for (uint32_t i = 0; i < grid.GetSurfaceCounts().surface_cells; i++) {
+        uint32_t cell_index = surface_cell_indices[i];
+        int lod = pixels_per_voxel > 0 ? SelectCellLod(test_values, grid.GetCellCoords(cell_index), camera_position, pixel_scale, pixels_per_voxel) : 0;
+        int bricks_per_axis = BricksPerAxisAtLod(test_values, lod);
+
+        brick_pool.cell_bricks_[cell_index] = brick_pool.bricks_count_;
+        brick_pool.cell_lods_[cell_index] = (uint8_t)lod;
+        brick_pool.lod_cells_[lod]++;
+        brick_pool.bricks_count_ += bricks_per_axis * bricks_per_axis * bricks_per_axis;
+    }
+    brick_pool.voxels_.resize((size_t)brick_pool.bricks_count_ * VOXELS_PER_BRICK);
+}
+
+// Fills every brick at its cell's level, apron included, from the brick's candidate particles as FillBrick does
+template<typename Grid, typename PositionSource>
+void FillLodBrickPool(const Grid& grid, const PositionSource& particle_positions, const std::vector<uint32_t>& cell_offsets,
+    LodBrickPool& brick_pool, ThreadPool* thread_pool, BrickKernelIsa kernel = GetBestBrickKernelIsa())
+{
+    const TestVariables& test_values = grid.GetTestValues();
+    const std::vector<uint32_t>& surface_cell_indices = grid.GetSurfaceCellIndices();
+
+    // One chunk item per cell, as a coarse cell's bricks are as costly as a fine brick each
+    thread_pool->ParallelFor(0, grid.GetSurfaceCounts().surface_cells, 1, [&](size_t begin, size_t end) {
+        std::vector<Float3> candidates;
+        for (size_t i = begin; i < end; i++) {
+            uint32_t cell_index = surface_cell_indices[i];
+            Int3 cell_coords = grid.GetCellCoords(cell_index);
+            int lod = brick_pool.cell_lods_[cell_index];
+            int bricks_per_axis = BricksPerAxisAtLod(test_values, lod);
+            const float voxel_size = 1.f / (test_values.cells_per_axis_ * bricks_per_axis * CORE_VOXELS_PER_AXIS_PER_BRICK);
+
+            int neighbouring_cells[27];
+            grid.GetNeighbourCells(cell_index, neighbouring_cells);
+            PositionSource brick_positions = particle_positions;
+            brick_positions.BeginBrick(test_values, cell_coords);
+
+            for (int brick = 0; brick < bricks_per_axis * bricks_per_axis * bricks_per_axis; brick++) {
+                Float3 brick_min = GetLodBrickAABB(test_values, cell_coords, lod, brick).min_;
+                GatherBrickCandidates(GetBrickVoxelBounds(brick_min, voxel_size), neighbouring_cells, grid.GetCellCounts(), cell_offsets,
+                    brick_positions, test_values.particle_radius_, candidates);
+                EvaluateBrickCandidates(kernel, brick_min, voxel_size, candidates.data(), candidates.size(), test_values.particle_radius_,
+                    brick_pool.Brick(brick_pool.cell_bricks_[cell_index] + brick));
+            }
+        }
+    });
+}
+
+// Trilinear sample of the field a surface cell's bricks hold, at a point on or within the cell, as SampleCellBricks
+inline float SampleLodCell(const TestVariables& test_values, const LodBrickPool& brick_pool, uint32_t cell_index, const Int3& cell_coords,
+    const Float3& position)
+{
+    const int lod = brick_pool.cell_lods_[cell_index];
+    const int bricks_per_axis = BricksPerAxisAtLod(test_values, lod);
+    const float brick_size = 1.f / (test_values.cells_per_axis_ * bricks_per_axis);
+    Float3 cell_min = Float3{ (float)cell_coords.x, (float)cell_coords.y, (float)cell_coords.z } / (float)test_values.cells_per_axis_;
+
+    Float3 brick_position = (position - cell_min) / brick_size;
+    int x = std::clamp((int)std::floor(brick_position.x), 0, bricks_per_axis - 1);
+    int y = std::clamp((int)std::floor(brick_position.y), 0, bricks_per_axis - 1);
+    int z = std::clamp((int)std::floor(brick_position.z), 0, bricks_per_axis - 1);
+    uint32_t brick_index = brick_pool.cell_bricks_[cell_index] + (z * bricks_per_axis + y) * bricks_per_axis + x;
+
+    // Voxel i is centred on i, as the apron is voxel 0
+    Float3 voxel = (brick_position - Float3{ (float)x, (float)y, (float)z }) * CORE_VOXELS_PER_AXIS_PER_BRICK + 0.5f;
+    return SampleBrick(brick_pool.Brick(brick_index), voxel, [](int16_t stored) { return Snorm16ToFloat(stored); });
+}
+
+// The coarser surface cell an apron voxel of a brick lies in, or -1 where it's in the brick's own cell or one at the same
+// level or finer. direction is the side of the core the voxel is on along each axis, see GetApronDirection.
+template<typename Grid>
+inline int GetLodSeamCell(const Grid& grid, const LodBrickPool& brick_pool, const int neighbouring_cells[27], int lod,
+    uint32_t intra_cell_brick_index, const Int3& direction)
+{
+    const int bricks_per_axis = BricksPerAxisAtLod(grid.GetTestValues(), lod);
+    int offset[3] = { (int)(intra_cell_brick_index % bricks_per_axis) + direction.x,
+        (int)((intra_cell_brick_index / bricks_per_axis) % bricks_per_axis) + direction.y,
+        (int)(intra_cell_brick_index / (bricks_per_axis * bricks_per_axis)) + direction.z };
+    int cell_offset[3];
+    for (int axis = 0; axis < 3; axis++) {
+        cell_offset[axis] = (offset[axis] >= bricks_per_axis) - (offset[axis] < 0);
+    }
+    if (cell_offset[0] == 0 && cell_offset[1] == 0 && cell_offset[2] == 0) {
+        return -1;
+    }
+
+    int cell_index = neighbouring_cells[(cell_offset[2] + 1) * 9 + (cell_offset[1] + 1) * 3 + (cell_offset[0] + 1)];
+    if (cell_index < 0 || brick_pool.cell_bricks_[cell_index] == INVALID_BRICK_SLOT || brick_pool.cell_lods_[cell_index] <= lod) {
+        return -1;
+    }
+    return cell_index;
+}
+
+// The coarser cell an apron voxel is stitched to, and seam_direction, the axes it's stitched across. A voxel on a brick's
+// edge or corner is interpolated into the faces it borders, and the cell diagonally across only touches the brick along
+// an edge or at a corner, so cells across fewer axes come first. Coarse cells can disagree by over a voxel where they meet
+// away from the surface, and stitching to the diagonal one made the faces' seams worse between the face points. Returns -1
+// if no cell is coarser.
+template<typename Grid>
+inline int GetLodSeam(const Grid& grid, const LodBrickPool& brick_pool, const int neighbouring_cells[27], int lod,
+    uint32_t intra_cell_brick_index, const Int3& direction, Int3& seam_direction)
+{
+    const int outside_axes = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+    for (int axes = 1; axes <= outside_axes; axes++) {
+        for (int mask = 1; mask < 8; mask++) {
+            seam_direction = { (mask & 1) ? direction.x : 0, (mask & 2) ? direction.y : 0, (mask & 4) ? direction.z : 0 };
+            if (std::popcount((unsigned int)mask) != axes || std::abs(seam_direction.x) + std::abs(seam_direction.y) + std::abs(seam_direction.z) != axes) {
+                continue;
+            }
+            int cell_index = GetLodSeamCell(grid, brick_pool, neighbouring_cells, lod, intra_cell_brick_index, seam_direction);
+            if (cell_index >= 0) {
+                return cell_index;
+            }
+        }
+    }
+    return -1;
+}
+
+// CPU port of CSBrickLodSeamMain. Each apron voxel facing a coarser cell is set to 2^k times the coarse field at the face
+// point it shares with the voxels inside it along the k axes it's stitched across (see GetLodSeam), less those voxels, so
+// the brick's own field equals the coarse one there. Face voxels are set first, then edges, then corners. The GPU stitches every level in
+// one dispatch, so a coarse brick sampled at a 3 level junction may or may not be stitched yet; here the coarser levels
+// are stitched first. Returns the number of apron voxels set.
+template<typename Grid>
+uint64_t StitchLodSeams(const Grid& grid, LodBrickPool& brick_pool, ThreadPool* thread_pool)
+{
+    const TestVariables& test_values = grid.GetTestValues();
+    const std::vector<uint32_t>& surface_cell_indices = grid.GetSurfaceCellIndices();
+    std::atomic<uint64_t> stitched_voxels = 0;
+
+    for (int level = MaxBrickLod(test_values) - 1; level >= 0; level--) {
+        thread_pool->ParallelFor(0, grid.GetSurfaceCounts().surface_cells, 1, [&](size_t begin, size_t end) {
+            float distances[VOXELS_PER_BRICK];
+            uint64_t stitched = 0;
+            for (size_t i = begin; i < end; i++) {
+                uint32_t cell_index = surface_cell_indices[i];
+                int lod = brick_pool.cell_lods_[cell_index];
+                if (lod != level) {
+                    continue;
+                }
+
+                // Most cells only border cells at their own level
+                int neighbouring_cells[27];
+                grid.GetNeighbourCells(cell_index, neighbouring_cells);
+                if (std::none_of(neighbouring_cells, neighbouring_cells + 27, [&](int neighbour_index) {
+                    return neighbour_index > -1 && brick_pool.cell_bricks_[neighbour_index] != INVALID_BRICK_SLOT && brick_pool.cell_lods_[neighbour_index] > lod;
+                })) {
+                    continue;
+                }
+
+                Int3 cell_coords = grid.GetCellCoords(cell_index);
+                const int bricks_per_axis = BricksPerAxisAtLod(test_values, lod);
+                const float voxel_size = 1.f / (test_values.cells_per_axis_ * bricks_per_axis * CORE_VOXELS_PER_AXIS_PER_BRICK);
+
+                for (int brick = 0; brick < bricks_per_axis * bricks_per_axis * bricks_per_axis; brick++) {
+                    int16_t* voxels = brick_pool.Brick(brick_pool.cell_bricks_[cell_index] + brick);
+                    Float3 brick_min = GetLodBrickAABB(test_values, cell_coords, lod, brick).min_;
+                    for (int voxel = 0; voxel < VOXELS_PER_BRICK; voxel++) {
+                        distances[voxel] = Snorm16ToFloat(voxels[voxel]);
+                    }
+
+                    for (int axes = 1; axes <= 3; axes++) {
+                        for (int z = 0; z < VOXELS_PER_AXIS_PER_BRICK; z++) {
+                            for (int y = 0; y < VOXELS_PER_AXIS_PER_BRICK; y++) {
+                                for (int x = 0; x < VOXELS_PER_AXIS_PER_BRICK; x++) {
+                                    Int3 direction = { GetApronDirection(x), GetApronDirection(y), GetApronDirection(z) };
+                                    if (std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z) != axes) {
+                                        continue;
+                                    }
+                                    Int3 seam;
+                                    int seam_cell_index = GetLodSeam(grid, brick_pool, neighbouring_cells, lod, brick, direction, seam);
+                                    if (seam_cell_index < 0) {
+                                        continue;
+                                    }
+
+                                    // The voxels inside this one along the seam's axes are outside the brick on fewer axes, so are already set
+                                    Float3 face_point = brick_min + Float3{ x - 0.5f - seam.x * 0.5f, y - 0.5f - seam.y * 0.5f,
+                                        z - 0.5f - seam.z * 0.5f } * voxel_size;
+                                    const int seam_axes = std::abs(seam.x) + std::abs(seam.y) + std::abs(seam.z);
+                                    float total = SampleLodCell(test_values, brick_pool, seam_cell_index, grid.GetCellCoords(seam_cell_index), face_point) * (1 << seam_axes);
+                                    for (int inward = 1; inward < 8; inward++) {
+                                        int dx = inward & 1, dy = (inward >> 1) & 1, dz = inward >> 2;
+                                        if (dx > std::abs(seam.x) || dy > std::abs(seam.y) || dz > std::abs(seam.z)) {
+                                            continue;
+                                        }
+                                        int other = ((z - dz * seam.z) * VOXELS_PER_AXIS_PER_BRICK + (y - dy * seam.y)) * VOXELS_PER_AXIS_PER_BRICK + (x - dx * seam.x);
+                                        total -= distances[other];
+                                    }
+
+                                    int voxel = (z * VOXELS_PER_AXIS_PER_BRICK + y) * VOXELS_PER_AXIS_PER_BRICK + x;
+                                    voxels[voxel] = FloatToSnorm16(total);
+                                    distances[voxel] = total;
+                                    stitched++;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+            stitched_voxels += stitched;
+        });
+    }
+    return stitched_voxels;
+}
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "BrickQuantise.h"
+
+namespace CPUBackend {
+
+// CPU port of the brick pool's normal channel (constant_buffer_.brick_normals_ in ComputeBrickPool.hlsl). Each voxel stores
+// the normalised gradient of the SDF, accumulated alongside its distance, as R8G8B8A8_SNORM. The ray tracer then samples
+// one normal at a hit rather than differencing six distances. The gradient is filtered rather than encoded, eg. as an
+// octahedral normal, so the sampler's trilinear filtering stays correct.
+struct BrickNormal {
+    int8_t x_, y_, z_, w_;
+};
+
+// Fills a brick's VOXELS_PER_BRICK normals from its candidate particles (see GatherBrickCandidates in BrickPool.h)
+inline void FillBrickNormals(const Float3& brick_min, float voxel_size, const Float3* candidates, size_t candidate_count, float particle_radius,
+    BrickNormal* normals)
+{
+    for (int z = 0; z < VOXELS_PER_AXIS_PER_BRICK; z++) {
+        for (int y = 0; y < VOXELS_PER_AXIS_PER_BRICK; y++) {
+            for (int x = 0; x < VOXELS_PER_AXIS_PER_BRICK; x++) {
+                Float3 gradient;
+                GetSignedDistanceGradientCandidates(GetBrickVoxelPosition(brick_min, voxel_size, x, y, z), candidates, candidate_count, particle_radius, gradient);
+                gradient = gradient / std::max(Length(gradient), 1e-8f); // No gradient out of reach of the particles
+
+                *normals++ = { FloatToSnorm8(gradient.x), FloatToSnorm8(gradient.y), FloatToSnorm8(gradient.z), 0 };
+            }
+        }
+    }
+}
+
+// Normal at a position in voxels (see SampleBrick), from one trilinear sample of the normal channel
+inline Float3 SampleBrickNormalChannel(const BrickNormal* normals, const Float3& position)
+{
+    Float3 normal = SampleBrick(normals, position, [](const BrickNormal& voxel) {
+        return Float3{ Snorm8ToFloat(voxel.x_), Snorm8ToFloat(voxel.y_), Snorm8ToFloat(voxel.z_) };
+    });
+    float length = Length(normal);
+    return length > 0 ? normal / length : Float3{ 0, 0, 0 };
+}
+
+}
@@ -0,0 +1,245 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "BrickKernel.h"
+#include "Compaction.h"
+#include "ThreadPool.h"
+
+namespace CPUBackend {
+
+// Slack on a particle's reach when building candidate lists, so rounding in the voxel positions can't drop a particle
+// that the per-voxel influence test would keep. Must match BRICK_CANDIDATE_MARGIN in ComputeBrickPool.hlsl.
+#define BRICK_CANDIDATE_MARGIN 1.001f
+
+// Distance at which the ray tracer reports a hit, mirrors ComputeCommon.hlsli
+#define SPHERE_TRACING_THRESHOLD 0.001f
+
+enum BrickEvaluation {
+    BrickEvaluationNeighbourCells = 0,  // Every voxel walks the particles of all 27 neighbouring cells
+    BrickEvaluationCandidates           // Every voxel walks the brick's list of particles that can reach it
+};
+
+// CPU brick pool. Bricks are stored one after another rather than packed into a 3D atlas,
+// each being VOXELS_PER_BRICK R16_SNORM voxels in x, y, z order.
+// Brick i belongs to surface cell i / BRICKS_PER_CELL, as on the GPU.
+struct BrickPool {
+    std::vector<int16_t> voxels_;
+    uint32_t bricks_count_ = 0;
+
+    // Bricks left by CullEmptyBricks, which the BLAS would be built from. Only the first surface_bricks_count_ are valid.
+    std::vector<uint32_t> surface_brick_indices_;
+    uint32_t surface_bricks_count_ = 0;
+};
+
+// Reads ordered particle positions for the brick pool, from the AoS ParticleData buffer as on the GPU.
+// Position sources are set up once per brick with the brick's cell, then read with the index (0 to 26) of the neighbouring
+// cell and the particle's index in the ordered buffer. See ParticleStore.h for the SoA sources.
+struct ParticleDataPositionSource {
+    const std::vector<ParticleData>& particles_ordered_;
+
+    inline void BeginBrick(const TestVariables&, const Int3&) {}
+    inline Float3 operator()(int, uint32_t particle_index) const { return particles_ordered_[particle_index].position_; }
+};
+
+// Calculated SDF value, checking the 27 adjacent cells utilising the ordered particles list
+template<typename PositionSource>
+inline float GetSignedDistanceNNS(const Float3& position, const int neighbouring_cells[27], const std::vector<uint32_t>& cell_counts,
+    const std::vector<uint32_t>& cell_offsets, const PositionSource& particle_positions, float particle_radius)
+{
+    // Init to large value
+    float distance = 1000;
+
+    // For each of the 27 adjacent cells
+    for (int x = 0; x < 27; x++) {
+        int cell_index = neighbouring_cells[x];
+        if (cell_index < 0) {
+            continue;
+        }
+
+        uint32_t particle_count = cell_counts[cell_index];
+        uint32_t particle_index_offset = cell_offsets[cell_index];
+        for (uint32_t i = 0; i < particle_count; i++) {
+            // Incorporate particle into final SDF value
+            float distance1 = GetDistanceToSphere(particle_positions(x, particle_index_offset + i) - position, particle_radius);
+            if (distance1 <= particle_radius * 2) {
+                distance = SmoothMin(distance, distance1, particle_radius);
+            }
+        }
+    }
+
+    return distance;
+}
+
+inline float GetSignedDistanceNNS(const Float3& position, const int neighbouring_cells[27], const std::vector<uint32_t>& cell_counts,
+    const std::vector<uint32_t>& cell_offsets, const std::vector<ParticleData>& particles_ordered, float particle_radius)
+{
+    return GetSignedDistanceNNS(position, neighbouring_cells, cell_counts, cell_offsets, ParticleDataPositionSource{ particles_ordered }, particle_radius);
+}
+
+// Bounds of the centres of a brick's voxels, apron included, for a brick with its core starting at brick_min
+inline AABB GetBrickVoxelBounds(const Float3& brick_min, float voxel_size)
+{
+    AABB bounds;
+    bounds.min_ = brick_min - voxel_size * 0.5f;
+    bounds.max_ = brick_min + voxel_size * (VOXELS_PER_AXIS_PER_BRICK - 1.5f);
+    return bounds;
+}
+
+// Whether a particle can be within the influence radius of any voxel in the bounds.
+// A particle counts towards a voxel when its surface is within 2x radius, so its centre is within 3x radius.
+inline bool IsBrickCandidate(const Float3& particle_position, const AABB& voxel_bounds, float particle_radius)
+{
+    Float3 nearest = { std::clamp(particle_position.x, voxel_bounds.min_.x, voxel_bounds.max_.x),
+        std::clamp(particle_position.y, voxel_bounds.min_.y, voxel_bounds.max_.y),
+        std::clamp(particle_position.z, voxel_bounds.min_.z, voxel_bounds.max_.z) };
+    Float3 displacement = particle_position - nearest;
+    float reach = particle_radius * 3 * BRICK_CANDIDATE_MARGIN;
+    return Dot(displacement, displacement) <= reach * reach;
+}
+
+// Gathers the positions of the particles in the 27 neighbouring cells that can reach the brick's voxels, in the same
+// order as GetSignedDistanceNNS visits them, so the SDF values come out identical. Returns the number of particles tested.
+template<typename PositionSource>
+inline uint32_t GatherBrickCandidates(const AABB& voxel_bounds, const int neighbouring_cells[27], const std::vector<uint32_t>& cell_counts,
+    const std::vector<uint32_t>& cell_offsets, const PositionSource& particle_positions, float particle_radius, std::vector<Float3>& candidates)
+{
+    candidates.clear();
+    uint32_t tested = 0;
+    for (int x = 0; x < 27; x++) {
+        int cell_index = neighbouring_cells[x];
+        if (cell_index < 0) {
+            continue;
+        }
+
+        uint32_t particle_count = cell_counts[cell_index];
+        uint32_t particle_index_offset = cell_offsets[cell_index];
+        for (uint32_t i = 0; i < particle_count; i++) {
+            Float3 particle_position = particle_positions(x, particle_index_offset + i);
+            if (IsBrickCandidate(particle_position, voxel_bounds, particle_radius)) {
+                candidates.push_back(particle_position);
+            }
+        }
+        tested += particle_count;
+    }
+    return tested;
+}
+
+// Bounds of a brick within a cell, as placed by CSBuildAABBs
+inline AABB GetBrickAABB(const TestVariables& test_values, const Int3& cell_coords, uint32_t intra_cell_brick_index)
+{
+    const uint32_t bricks_per_axis = BricksPerAxisPerCell(test_values);
+    const uint32_t bricks_per_z = bricks_per_axis * bricks_per_axis;
+    const float brick_size = 1.f / (test_values.cells_per_axis_ * bricks_per_axis);
+
+    // Convert from grid-space cell coords to world-space, and offset by the brick's position within the cell
+    Float3 brick_offset = { (float)(intra_cell_brick_index % bricks_per_axis), (float)((intra_cell_brick_index % bricks_per_z) / bricks_per_axis), (float)(intra_cell_brick_index / bricks_per_z) };
+    AABB aabb;
+    aabb.min_ = Float3{ (float)cell_coords.x, (float)cell_coords.y, (float)cell_coords.z } / (float)test_values.cells_per_axis_ + brick_offset * brick_size;
+    aabb.max_ = aabb.min_ + brick_size;
+    return aabb;
+}
+
+// Fills the voxels of one brick of a surface cell, whose neighbouring cells have already been looked up.
+// candidates is scratch space for the candidate list, reused between bricks.
+template<typename Grid, typename PositionSource>
+void FillBrick(const Grid& grid, const PositionSource& particle_positions, const std::vector<uint32_t>& cell_offsets,
+    uint32_t cell_index, const int neighbouring_cells[27], uint32_t intra_cell_brick_index, int16_t* voxels,
+    std::vector<Float3>& candidates, BrickEvaluation evaluation, BrickKernelIsa kernel)
+{
+    const TestVariables& test_values = grid.GetTestValues();
+    const float voxel_size = 1.f / (test_values.cells_per_axis_ * BricksPerAxisPerCell(test_values) * CORE_VOXELS_PER_AXIS_PER_BRICK);
+    const std::vector<uint32_t>& cell_counts = grid.GetCellCounts();
+    Int3 cell_coords = grid.GetCellCoords(cell_index);
+
+    Float3 brick_min = GetBrickAABB(test_values, cell_coords, intra_cell_brick_index).min_;
+
+    PositionSource brick_positions = particle_positions;
+    brick_positions.BeginBrick(test_values, cell_coords);
+
+    if (evaluation == BrickEvaluationCandidates) {
+        GatherBrickCandidates(GetBrickVoxelBounds(brick_min, voxel_size), neighbouring_cells, cell_counts, cell_offsets,
+            brick_positions, test_values.particle_radius_, candidates);
+        EvaluateBrickCandidates(kernel, brick_min, voxel_size, candidates.data(), candidates.size(), test_values.particle_radius_, voxels);
+        return;
+    }
+
+    for (int z = 0; z < VOXELS_PER_AXIS_PER_BRICK; z++) {
+        for (int y = 0; y < VOXELS_PER_AXIS_PER_BRICK; y++) {
+            for (int x = 0; x < VOXELS_PER_AXIS_PER_BRICK; x++) {
+                Float3 position = GetBrickVoxelPosition(brick_min, voxel_size, x, y, z);
+
+                // Calculate and store SDF value
+                float distance = GetSignedDistanceNNS(position, neighbouring_cells, cell_counts, cell_offsets, brick_positions, test_values.particle_radius_);
+                *voxels++ = FloatToSnorm16(distance);
+            }
+        }
+    }
+}
+
+// CPU port of CSBrickPoolMain, including the brick placement from CSBuildAABBs.
+// Grid is either grid engine, both of which provide GetTestValues, GetSurfaceCounts, GetSurfaceCellIndices,
+// GetCellCounts, GetCellCoords and GetNeighbourCells. The ordered particles and cell_offsets come from ParticleReorder.h,
+// read through one of the position sources.
+// With candidate lists, each brick first gathers the particles that can reach any of its voxels, as ComputeBrickPool.hlsl
+// does in groupshared memory, so voxels skip the neighbouring particles that are too far from the brick. The brick is then
+// evaluated by the given kernel, see BrickKernel.h.
+template<typename Grid, typename PositionSource>
+void FillBrickPoolFrom(const Grid& grid, const PositionSource& particle_positions, const std::vector<uint32_t>& cell_offsets,
+    BrickPool& brick_pool, ThreadPool* thread_pool, BrickEvaluation evaluation = BrickEvaluationCandidates,
+    BrickKernelIsa kernel = GetBestBrickKernelIsa())
+{
+    const TestVariables& test_values = grid.GetTestValues();
+    const uint32_t bricks_per_axis = BricksPerAxisPerCell(test_values);
+    const uint32_t bricks_per_cell = bricks_per_axis * bricks_per_axis * bricks_per_axis;
+    const std::vector<uint32_t>& surface_cell_indices = grid.GetSurfaceCellIndices();
+
+    brick_pool.bricks_count_ = grid.GetSurfaceCounts().surface_cells * bricks_per_cell;
+    brick_pool.voxels_.resize((size_t)brick_pool.bricks_count_ * VOXELS_PER_BRICK);
+
+    // One chunk item per brick, as with the GPU thread groups
+    thread_pool->ParallelFor(0, brick_pool.bricks_count_, 1, [&](size_t begin, size_t end) {
+        std::vector<Float3> candidates;
+        for (size_t brick_index = begin; brick_index < end; brick_index++) {
+            uint32_t cell_index = surface_cell_indices[brick_index / bricks_per_cell];
+
+            // Load list of indices of neighbouring cells
+            int neighbouring_cells[27];
+            grid.GetNeighbourCells(cell_index, neighbouring_cells);
+
+            FillBrick(grid, particle_positions, cell_offsets, cell_index, neighbouring_cells, brick_index % bricks_per_cell,
+                brick_pool.voxels_.data() + brick_index * VOXELS_PER_BRICK, candidates, evaluation, kernel);
+        }
+    });
+}
+
+// Whether the ray tracer can hit a brick, ie. the smallest of its voxels is within the threshold.
+// Sampling interpolates between voxels, so it can't return less than the smallest of them.
+inline bool IsBrickOnSurface(const int16_t* voxels, float threshold)
+{
+    return Snorm16ToFloat(*std::min_element(voxels, voxels + VOXELS_PER_BRICK)) <= threshold;
+}
+
+// CPU port of the culling at the end of CSBrickPoolMain. Bricks that can't be hit are left out of the list the BLAS would be
+// built from. The GPU appends the bricks in whichever order the thread groups finish, here they're compacted in brick order.
+inline void CullEmptyBricks(BrickPool& brick_pool, ThreadPool* thread_pool, float threshold = SPHERE_TRACING_THRESHOLD)
+{
+    std::vector<uint8_t> flags(brick_pool.bricks_count_);
+    thread_pool->ParallelFor(0, brick_pool.bricks_count_, 64, [&](size_t begin, size_t end) {
+        for (size_t brick_index = begin; brick_index < end; brick_index++) {
+            flags[brick_index] = IsBrickOnSurface(brick_pool.voxels_.data() + brick_index * VOXELS_PER_BRICK, threshold);
+        }
+    });
+
+    brick_pool.surface_brick_indices_.resize(brick_pool.bricks_count_);
+    brick_pool.surface_bricks_count_ = CompactFlags(flags, brick_pool.surface_brick_indices_, thread_pool);
+}
+
+template<typename Grid>
+void FillBrickPool(const Grid& grid, const std::vector<ParticleData>& particles_ordered, const std::vector<uint32_t>& cell_offsets,
+    BrickPool& brick_pool, ThreadPool* thread_pool, BrickEvaluation evaluation = BrickEvaluationCandidates,
+    BrickKernelIsa kernel = GetBestBrickKernelIsa())
+{
+    FillBrickPoolFrom(grid, ParticleDataPositionSource{ particles_ordered }, cell_offsets, brick_pool, thread_pool, evaluation, kernel);
+}
+
+}
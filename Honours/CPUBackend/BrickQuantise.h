@@ -0,0 +1,109 @@
+#pragma once
+#include <climits>
+#include <cmath>
+#include "BrickKernel.h"
+
+namespace CPUBackend {
+
+// CPU port of the 8-bit bricks in ComputeBrickPool.hlsl. A narrow band brick's distances only span a few voxel widths, so
+// each brick stores its R8_SNORM voxels relative to the range of its own distances, (distance - offset_) / scale_.
+// Distances are first clamped to the band a ray can march through the brick in. The range is found in fixed point,
+// rounded outwards, as the GPU reduces it with integer atomics.
+#define BRICK_RANGE_FIXED_POINT 1048576.f
+
+struct BrickRange {
+    float offset_;
+    float scale_;
+};
+
+// The band an 8-bit brick's distances are clamped to, the brick's diagonal
+inline float GetBrickQuantiseBand(float voxel_size)
+{
+    return std::sqrt(3.f) * voxel_size * VOXELS_PER_AXIS_PER_BRICK;
+}
+
+// Conversion applied when a float is written to an R8_SNORM texture
+inline int8_t FloatToSnorm8(float value)
+{
+    value = std::clamp(value, -1.f, 1.f);
+    return (int8_t)std::lround(value * 127.f);
+}
+
+inline float Snorm8ToFloat(int8_t value)
+{
+    return std::max(value / 127.f, -1.f);
+}
+
+// Range of count distances, widened by margin, as StoreBrickRange
+inline BrickRange GetBrickRange(const float* distances, size_t count, float band, float margin = 0)
+{
+    int fixed_min = INT_MAX, fixed_max = -INT_MAX;
+    for (size_t i = 0; i < count; i++) {
+        float fixed_distance = std::clamp(distances[i], -band, band) / band * BRICK_RANGE_FIXED_POINT;
+        fixed_min = std::min(fixed_min, (int)std::floor(fixed_distance));
+        fixed_max = std::max(fixed_max, (int)std::ceil(fixed_distance));
+    }
+
+    float range_min = std::max(fixed_min / BRICK_RANGE_FIXED_POINT * band - margin, -band);
+    float range_max = std::min(fixed_max / BRICK_RANGE_FIXED_POINT * band + margin, band);
+    return { (range_min + range_max) * 0.5f, std::max((range_max - range_min) * 0.5f, 1e-6f) };
+}
+
+inline float QuantiseDistance(float distance, const BrickRange& range, float band)
+{
+    return (std::clamp(distance, -band, band) - range.offset_) / range.scale_;
+}
+
+inline float DequantiseDistance(float stored, const BrickRange& range)
+{
+    return range.offset_ + stored * range.scale_;
+}
+
+// Stores a brick's VOXELS_PER_BRICK distances as 8-bit voxels, returning the range they're relative to
+inline BrickRange QuantiseBrick(const float* distances, float band, int8_t* voxels)
+{
+    BrickRange range = GetBrickRange(distances, VOXELS_PER_BRICK, band);
+    for (int i = 0; i < VOXELS_PER_BRICK; i++) {
+        voxels[i] = FloatToSnorm8(QuantiseDistance(distances[i], range, band));
+    }
+    return range;
+}
+
+// Trilinear sample of a brick, as the sampler filters within a brick of the pool. The position is in voxels, (0, 0, 0)
+// being the centre of the first voxel, and decode turns a stored voxel into a distance (or any type that can be blended).
+template<typename Voxel, typename Decode>
+inline auto SampleBrick(const Voxel* voxels, const Float3& position, Decode decode)
+{
+    const float max_position = VOXELS_PER_AXIS_PER_BRICK - 1;
+    Float3 clamped = Clamp(position, 0, max_position);
+    int x = std::min((int)clamped.x, VOXELS_PER_AXIS_PER_BRICK - 2);
+    int y = std::min((int)clamped.y, VOXELS_PER_AXIS_PER_BRICK - 2);
+    int z = std::min((int)clamped.z, VOXELS_PER_AXIS_PER_BRICK - 2);
+    float tx = clamped.x - x, ty = clamped.y - y, tz = clamped.z - z;
+
+    auto voxel = [&](int dx, int dy, int dz) {
+        return decode(voxels[((z + dz) * VOXELS_PER_AXIS_PER_BRICK + (y + dy)) * VOXELS_PER_AXIS_PER_BRICK + (x + dx)]);
+    };
+    auto lerp = [](auto a, auto b, float t) { return a + (b - a) * t; };
+    auto c00 = lerp(voxel(0, 0, 0), voxel(1, 0, 0), tx);
+    auto c10 = lerp(voxel(0, 1, 0), voxel(1, 1, 0), tx);
+    auto c01 = lerp(voxel(0, 0, 1), voxel(1, 0, 1), tx);
+    auto c11 = lerp(voxel(0, 1, 1), voxel(1, 1, 1), tx);
+    return lerp(lerp(c00, c10, ty), lerp(c01, c11, ty), tz);
+}
+
+// Normal from central differences half a voxel apart, as CalculateNormal does for the brick pool
+template<typename Voxel, typename Decode>
+inline Float3 SampleBrickNormal(const Voxel* voxels, const Float3& position, Decode decode)
+{
+    const float h = 0.5f;
+    Float3 gradient = {
+        SampleBrick(voxels, position + Float3{ h, 0, 0 }, decode) - SampleBrick(voxels, position - Float3{ h, 0, 0 }, decode),
+        SampleBrick(voxels, position + Float3{ 0, h, 0 }, decode) - SampleBrick(voxels, position - Float3{ 0, h, 0 }, decode),
+        SampleBrick(voxels, position + Float3{ 0, 0, h }, decode) - SampleBrick(voxels, position - Float3{ 0, 0, h }, decode)
+    };
+    float length = Length(gradient);
+    return length > 0 ? gradient / length : Float3{ 0, 0, 0 };
+}
+
+}
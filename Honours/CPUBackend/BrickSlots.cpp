@@ -0,0 +1,72 @@
+#include "BrickSlots.h"
+#include "GridCommon.h"
+
+namespace CPUBackend {
+
+BrickSlotAllocator::BrickSlotAllocator(const TestVariables& test_values) :
+    test_values_(test_values)
+{
+    const uint32_t bricks_per_axis = BricksPerAxisPerCell(test_values_);
+    bricks_per_cell_ = bricks_per_axis * bricks_per_axis * bricks_per_axis;
+    cell_slots_.resize(test_values_.num_cells_);
+}
+
+void BrickSlotAllocator::Reset(uint32_t capacity)
+{
+    capacity_ = capacity;
+    free_slots_.resize(capacity_);
+    brick_slot_on_surface_.assign((size_t)capacity_ * bricks_per_cell_, 0);
+
+    CellBrickSlot empty_slot = {};
+    empty_slot.slot_ = INVALID_BRICK_SLOT;
+    std::fill(cell_slots_.begin(), cell_slots_.end(), empty_slot);
+
+    // Low slots on top
+    free_slots_count_ = capacity_;
+    for (uint32_t i = 0; i < capacity_; i++) {
+        free_slots_[i] = capacity_ - 1 - i;
+    }
+    valid_ = true;
+}
+
+void BrickSlotAllocator::MarkMovedParticles(const std::vector<ParticleData>& previous_particles, const std::vector<ParticleData>& particles, ThreadPool* thread_pool)
+{
+    thread_pool->ParallelFor(0, particles.size(), 1024, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const Float3& previous_position = previous_particles[i].position_;
+            const Float3& position = particles[i].position_;
+            if (position.x != previous_position.x || position.y != previous_position.y || position.z != previous_position.z) {
+                // Racing threads all store the same frame
+                std::atomic_ref<uint32_t>(cell_slots_[GetCellIndex(test_values_, previous_position)].changed_frame_).store(frame_, std::memory_order_relaxed);
+                std::atomic_ref<uint32_t>(cell_slots_[GetCellIndex(test_values_, position)].changed_frame_).store(frame_, std::memory_order_relaxed);
+            }
+        }
+    });
+}
+
+void BrickSlotAllocator::UpdateSlots(const std::vector<uint32_t>& surface_cell_indices, uint32_t surface_cells)
+{
+    // Mark this frame's surface cells
+    for (uint32_t i = 0; i < surface_cells; i++) {
+        cell_slots_[surface_cell_indices[i]].surface_frame_ = frame_;
+    }
+
+    // Free the slots of cells that are no longer surface cells
+    for (CellBrickSlot& cell_slot : cell_slots_) {
+        if (cell_slot.slot_ != INVALID_BRICK_SLOT && cell_slot.surface_frame_ != frame_) {
+            free_slots_[free_slots_count_++] = cell_slot.slot_;
+            cell_slot.slot_ = INVALID_BRICK_SLOT;
+        }
+    }
+
+    // Give surface cells without a slot one from the stack
+    for (uint32_t i = 0; i < surface_cells; i++) {
+        CellBrickSlot& cell_slot = cell_slots_[surface_cell_indices[i]];
+        if (cell_slot.slot_ == INVALID_BRICK_SLOT) {
+            cell_slot.slot_ = free_slots_[--free_slots_count_];
+            cell_slot.allocated_frame_ = frame_;
+        }
+    }
+}
+
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include "BrickPool.h"
+
+namespace CPUBackend {
+
+// CPU port of the persistent brick pool slots in ComputeBrickSlots.hlsl.
+// Each surface cell holds a slot of bricks_per_cell bricks in the pool for as long as it stays a surface cell, so bricks
+// with no moved particles in their 27 neighbouring cells keep their contents from the previous frame. Free slots are kept
+// on a stack, popped by new surface cells and pushed by cells that leave the surface. The GPU does this with atomics, so
+// which slot a cell gets differs from run to run there, here the stack is walked in cell order.
+// Cell indices are those of GridEngine.
+class BrickSlotAllocator
+{
+public:
+    BrickSlotAllocator(const TestVariables& test_values);
+
+    // CSResetBrickSlots, frees every slot of a pool holding capacity cells' bricks
+    void Reset(uint32_t capacity);
+    inline void Invalidate() { valid_ = false; }
+    inline bool IsValid() const { return valid_; }
+    inline void AdvanceFrame() { frame_++; }
+
+    // The stamps CSPosMain makes on the cells particles moved from and to. particles must be in the same order every frame.
+    void MarkMovedParticles(const std::vector<ParticleData>& previous_particles, const std::vector<ParticleData>& particles, ThreadPool* thread_pool);
+
+    // CSMarkSurfaceCells, CSReleaseBrickSlots and CSAllocateBrickSlots. The pool must hold a slot for every surface cell.
+    void UpdateSlots(const std::vector<uint32_t>& surface_cell_indices, uint32_t surface_cells);
+
+    // Whether the cell's bricks need filling this frame, as worked out in CSBrickPoolMain
+    inline bool IsBrickDirty(uint32_t cell_index, const int neighbouring_cells[27]) const
+    {
+        if (cell_slots_[cell_index].allocated_frame_ == frame_) {
+            return true;
+        }
+        for (int x = 0; x < 27; x++) {
+            if (neighbouring_cells[x] > -1 && cell_slots_[neighbouring_cells[x]].changed_frame_ == frame_) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline uint32_t GetBrickSlot(uint32_t cell_index, uint32_t intra_cell_brick_index) const { return cell_slots_[cell_index].slot_ * bricks_per_cell_ + intra_cell_brick_index; }
+    inline uint32_t GetCapacity() const { return capacity_; }
+    inline uint32_t GetFreeSlotsCount() const { return free_slots_count_; }
+
+    // Per brick in the pool, whether it was on the surface when last filled
+    std::vector<uint8_t> brick_slot_on_surface_;
+
+private:
+    std::vector<CellBrickSlot> cell_slots_;
+    std::vector<uint32_t> free_slots_;
+    uint32_t free_slots_count_ = 0;
+    uint32_t capacity_ = 0;
+    uint32_t bricks_per_cell_;
+    uint32_t frame_ = 1;
+    bool valid_ = false;
+
+    TestVariables test_values_;
+};
+
+// CPU port of the brick pool fill with persistent slots. Only the bricks that IsBrickDirty reports are filled, the rest keep
+// their slot's contents. brick_pool.voxels_ holds the allocator's slots, grown along with them, which frees every slot.
+// Bricks that can't be hit are culled as in CullEmptyBricks, with surface_brick_indices_ holding the kept bricks' slots in
+// brick order. Returns the number of bricks filled.
+template<typename Grid, typename PositionSource>
+uint32_t FillBrickPoolIncremental(const Grid& grid, const PositionSource& particle_positions, const std::vector<uint32_t>& cell_offsets,
+    BrickSlotAllocator& slots, BrickPool& brick_pool, ThreadPool* thread_pool, float threshold = SPHERE_TRACING_THRESHOLD,
+    BrickEvaluation evaluation = BrickEvaluationCandidates, BrickKernelIsa kernel = GetBestBrickKernelIsa())
+{
+    const TestVariables& test_values = grid.GetTestValues();
+    const uint32_t bricks_per_axis = BricksPerAxisPerCell(test_values);
+    const uint32_t bricks_per_cell = bricks_per_axis * bricks_per_axis * bricks_per_axis;
+    const uint32_t surface_cells = grid.GetSurfaceCounts().surface_cells;
+    const std::vector<uint32_t>& surface_cell_indices = grid.GetSurfaceCellIndices();
+
+    // Grow the pool when there are more surface cells than slots, as AllocateBrickPoolTexture does
+    if (surface_cells > slots.GetCapacity()) {
+        slots.Reset(surface_cells);
+        brick_pool.voxels_.resize((size_t)surface_cells * bricks_per_cell * VOXELS_PER_BRICK);
+    }
+    else if (!slots.IsValid()) {
+        slots.Reset(slots.GetCapacity());
+    }
+    slots.UpdateSlots(surface_cell_indices, surface_cells);
+
+    brick_pool.bricks_count_ = surface_cells * bricks_per_cell;
+    std::vector<uint8_t> flags(brick_pool.bricks_count_);
+    std::atomic<uint32_t> recomputed_count = 0;
+
+    // One chunk item per brick, as with the GPU thread groups
+    thread_pool->ParallelFor(0, brick_pool.bricks_count_, 1, [&](size_t begin, size_t end) {
+        std::vector<Float3> candidates;
+        uint32_t recomputed = 0;
+        for (size_t brick_index = begin; brick_index < end; brick_index++) {
+            uint32_t cell_index = surface_cell_indices[brick_index / bricks_per_cell];
+            uint32_t brick_slot = slots.GetBrickSlot(cell_index, brick_index % bricks_per_cell);
+
+            // Load list of indices of neighbouring cells
+            int neighbouring_cells[27];
+            grid.GetNeighbourCells(cell_index, neighbouring_cells);
+
+            if (slots.IsBrickDirty(cell_index, neighbouring_cells)) {
+                int16_t* voxels = brick_pool.voxels_.data() + (size_t)brick_slot * VOXELS_PER_BRICK;
+                FillBrick(grid, particle_positions, cell_offsets, cell_index, neighbouring_cells, brick_index % bricks_per_cell,
+                    voxels, candidates, evaluation, kernel);
+                slots.brick_slot_on_surface_[brick_slot] = IsBrickOnSurface(voxels, threshold);
+                recomputed++;
+            }
+            flags[brick_index] = slots.brick_slot_on_surface_[brick_slot];
+        }
+        recomputed_count.fetch_add(recomputed, std::memory_order_relaxed);
+    });
+
+    // Compact the kept bricks, then swap each for its slot
+    brick_pool.surface_brick_indices_.resize(brick_pool.bricks_count_);
+    brick_pool.surface_bricks_count_ = CompactFlags(flags, brick_pool.surface_brick_indices_, thread_pool);
+    thread_pool->ParallelFor(0, brick_pool.surface_bricks_count_, 1024, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            uint32_t brick_index = brick_pool.surface_brick_indices_[i];
+            brick_pool.surface_brick_indices_[i] = slots.GetBrickSlot(surface_cell_indices[brick_index / bricks_per_cell], brick_index % bricks_per_cell);
+        }
+    });
+
+    return recomputed_count;
+}
+
+}
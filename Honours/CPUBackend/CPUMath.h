@@ -0,0 +1,43 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace CPUBackend {
+
+// Minimal HLSL-style vector types so shader logic can be ported without DirectXMath
+struct Float3
+{
+    float x, y, z;
+};
+
+struct UInt3
+{
+    uint32_t x, y, z;
+};
+
+struct Int3
+{
+    int x, y, z;
+};
+
+inline Float3 operator+(const Float3& a, const Float3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+inline Float3 operator-(const Float3& a, const Float3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+inline Float3 operator*(const Float3& a, const Float3& b) { return { a.x * b.x, a.y * b.y, a.z * b.z }; }
+inline Float3 operator/(const Float3& a, const Float3& b) { return { a.x / b.x, a.y / b.y, a.z / b.z }; }
+inline Float3 operator+(const Float3& a, float b) { return { a.x + b, a.y + b, a.z + b }; }
+inline Float3 operator-(const Float3& a, float b) { return { a.x - b, a.y - b, a.z - b }; }
+inline Float3 operator*(const Float3& a, float b) { return { a.x * b, a.y * b, a.z * b }; }
+inline Float3 operator/(const Float3& a, float b) { return { a.x / b, a.y / b, a.z / b }; }
+
+inline float Dot(const Float3& a, const Float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float Length(const Float3& a) { return std::sqrt(Dot(a, a)); }
+inline Float3 Normalize(const Float3& a) { return a / Length(a); }
+inline Float3 Lerp(const Float3& a, const Float3& b, const Float3& t) { return a + (b - a) * t; }
+inline Float3 Clamp(const Float3& a, float lo, float hi)
+{
+    return { std::clamp(a.x, lo, hi), std::clamp(a.y, lo, hi), std::clamp(a.z, lo, hi) };
+}
+inline float Frac(float a) { return a - std::floor(a); }
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "CPUMath.h"
+#include "../TestValues.h"
+
+namespace CPUBackend {
+
+// Same layout as ParticleData in ComputeStructs.h / ComputeCommon.hlsli
+struct ParticleData {
+    Float3 position_;
+    Float3 start_pos_;
+    float speed_;
+    uint32_t intra_cell_index_;
+    uint32_t cell_index_;
+};
+static_assert(sizeof(ParticleData) == 36, "ParticleData must match the GPU structured buffer stride");
+
+// Same layout as AABB in RayTracingStructs.h, D3D12_RAYTRACING_AABB
+struct AABB {
+    Float3 min_;
+    Float3 max_;
+};
+
+// ---- Two-level Grid -----
+struct Cell
+{
+    uint32_t particle_count_;
+};
+
+struct Block
+{
+    uint32_t non_empty_cell_count_;
+};
+
+struct GridSurfaceCounts {
+    uint32_t surface_blocks;
+    uint32_t surface_cells;
+};
+
+// Same layout as CellBrickSlot in ComputeStructs.h / ComputeGridCommon.hlsli
+#define INVALID_BRICK_SLOT 0xffffffff
+struct CellBrickSlot {
+    uint32_t slot_;
+    uint32_t surface_frame_;
+    uint32_t allocated_frame_;
+    uint32_t changed_frame_;
+};
+
+}
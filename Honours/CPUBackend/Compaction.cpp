@@ -0,0 +1,47 @@
+#include "Compaction.h"
+#include "PrefixScan.h"
+#include <algorithm>
+
+namespace CPUBackend {
+
+// Flags per chunk, as for the cell offset scan
+#define COMPACT_GRAIN_SIZE 16384
+
+uint32_t CompactFlags(const std::vector<uint8_t>& flags, std::vector<uint32_t>& indices, ThreadPool* thread_pool)
+{
+    const size_t count = flags.size();
+    const size_t chunk_count = (count + COMPACT_GRAIN_SIZE - 1) / COMPACT_GRAIN_SIZE;
+    std::vector<uint32_t> chunk_counts(chunk_count);
+    std::vector<uint32_t> chunk_offsets(chunk_count);
+
+    // Count the flags in each chunk
+    thread_pool->ParallelFor(0, chunk_count, 1, [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; chunk++) {
+            size_t last = std::min((chunk + 1) * COMPACT_GRAIN_SIZE, count);
+            uint32_t flagged = 0;
+            for (size_t i = chunk * COMPACT_GRAIN_SIZE; i < last; i++) {
+                flagged += flags[i] != 0;
+            }
+            chunk_counts[chunk] = flagged;
+        }
+    });
+
+    uint32_t total = ExclusiveScanScalar(chunk_counts.data(), chunk_offsets.data(), chunk_count, 0);
+
+    // Each chunk writes its flagged indices in order, from its offset
+    thread_pool->ParallelFor(0, chunk_count, 1, [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; chunk++) {
+            size_t last = std::min((chunk + 1) * COMPACT_GRAIN_SIZE, count);
+            uint32_t* out = indices.data() + chunk_offsets[chunk];
+            for (size_t i = chunk * COMPACT_GRAIN_SIZE; i < last; i++) {
+                if (flags[i]) {
+                    *out++ = (uint32_t)i;
+                }
+            }
+        }
+    });
+
+    return total;
+}
+
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "ThreadPool.h"
+
+namespace CPUBackend {
+
+// Ordered stream compaction: flag -> scan -> scatter.
+// Writes the index of every non-zero flag to indices in ascending order and returns how many there are.
+// Unlike appending with an atomic counter, the output is the same on every run and for any thread count.
+//
+// The flags are split into chunks. Each chunk counts its flags, the chunk counts are scanned into output offsets,
+// then each chunk writes its indices from its offset. indices must have room for every flag.
+uint32_t CompactFlags(const std::vector<uint8_t>& flags, std::vector<uint32_t>& indices, ThreadPool* thread_pool);
+
+}
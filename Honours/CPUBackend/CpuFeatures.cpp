@@ -0,0 +1,36 @@
+#include "CpuFeatures.h"
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace CPUBackend {
+
+bool CpuSupportsFeature(CpuFeature feature)
+{
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    switch (feature) {
+    case CpuFeatureSse42: return __builtin_cpu_supports("sse4.2");
+    case CpuFeatureAvx2: return __builtin_cpu_supports("avx2");
+    case CpuFeatureAvx512F: return __builtin_cpu_supports("avx512f");
+    default: return false;
+    }
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 1);
+    const bool sse42 = (info[2] & (1 << 20)) != 0;
+    const bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x06) == 0x06;
+    const bool os_saves_zmm = os_saves_ymm && (_xgetbv(0) & 0xe0) == 0xe0;
+    __cpuidex(info, 7, 0);
+    switch (feature) {
+    case CpuFeatureSse42: return sse42;
+    case CpuFeatureAvx2: return os_saves_ymm && (info[1] & (1 << 5)) != 0;
+    case CpuFeatureAvx512F: return os_saves_zmm && (info[1] & (1 << 16)) != 0;
+    default: return false;
+    }
+#else
+    (void)feature;
+    return false;
+#endif
+}
+
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+namespace CPUBackend {
+
+// x86 instruction set extensions the backend has paths for
+enum CpuFeature {
+    CpuFeatureSse42 = 0,
+    CpuFeatureAvx2,
+    CpuFeatureAvx512F
+};
+
+// Whether the CPU (and OS, for the wider registers) supports the extension, whether or not a path was built for it.
+// Picks the brick kernels, the bitmask surface detection's and the prefix scan's paths at runtime.
+bool CpuSupportsFeature(CpuFeature feature);
+
+}
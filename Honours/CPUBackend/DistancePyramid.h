@@ -0,0 +1,177 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "SphereTracing.h"
+#include "ThreadPool.h"
+
+namespace CPUBackend {
+
+// CPU port of the Simple method's distance pyramid (CSDistancePyramidMain in ComputeTexture.hlsl) and the hierarchical
+// sphere tracing through it in RayTracing.hlsl. Each level halves the resolution of the one below, its texels holding the
+// lowest voxel the linear sampler can blend into any point within them. A texel above the threshold has no hit in it, so
+// rays far from the surface skip straight to where they leave the coarsest such texel around them, rather than stepping
+// only as far as the distance sampled.
+
+#define DISTANCE_PYRAMID_LEVELS 6 // Texels 2 up to 64 voxels wide
+
+struct DistancePyramid {
+    int texture_res_ = 0;
+    std::vector<float> levels_[DISTANCE_PYRAMID_LEVELS]; // From the finest, in x, y, z order
+    std::vector<int16_t> rows_, columns_;                 // The first level's voxels reduced along x, then along y too
+
+    // Of level 1 up to DISTANCE_PYRAMID_LEVELS
+    inline int LevelResolution(int level) const { return (texture_res_ + (1 << level) - 1) >> level; }
+    inline float LevelTexel(int level, int x, int y, int z) const
+    {
+        const int res = LevelResolution(level);
+        return levels_[level - 1][((size_t)z * res + y) * res + x];
+    }
+};
+
+// The first level's texels cover 2 voxels per axis, but a sample within them blends the voxels either side of those too.
+// As a min over a box, it's taken along x, then y, then z, rather than over all 64 voxels for every texel.
+inline void BuildDistancePyramid(const std::vector<int16_t>& voxels, int texture_res, DistancePyramid& pyramid, ThreadPool* thread_pool)
+{
+    pyramid.texture_res_ = texture_res;
+    const int first_res = pyramid.LevelResolution(1);
+    auto window = [](int texel, int reach, int below_res, int& begin, int& end) {
+        begin = std::max(2 * texel - reach, 0);
+        end = std::min(2 * texel + 1 + reach, below_res - 1);
+    };
+
+    // Converting is monotonic, so the voxels stay R16_SNORM until the last axis
+    pyramid.rows_.resize((size_t)texture_res * texture_res * first_res);
+    thread_pool->ParallelFor(0, (size_t)texture_res * texture_res, 64, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++) {
+            for (int x = 0; x < first_res; x++) {
+                int x_begin, x_end;
+                window(x, 1, texture_res, x_begin, x_end);
+                int16_t lowest = INT16_MAX;
+                for (int bx = x_begin; bx <= x_end; bx++) {
+                    lowest = std::min(lowest, voxels[row * texture_res + bx]);
+                }
+                pyramid.rows_[row * first_res + x] = lowest;
+            }
+        }
+    });
+    pyramid.columns_.resize((size_t)texture_res * first_res * first_res);
+    thread_pool->ParallelFor(0, (size_t)texture_res * first_res, 64, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++) {
+            const int y = (int)(row % first_res), z = (int)(row / first_res);
+            int y_begin, y_end;
+            window(y, 1, texture_res, y_begin, y_end);
+            for (int x = 0; x < first_res; x++) {
+                int16_t lowest = INT16_MAX;
+                for (int by = y_begin; by <= y_end; by++) {
+                    lowest = std::min(lowest, pyramid.rows_[((size_t)z * texture_res + by) * first_res + x]);
+                }
+                pyramid.columns_[row * first_res + x] = lowest;
+            }
+        }
+    });
+    pyramid.levels_[0].resize((size_t)first_res * first_res * first_res);
+    thread_pool->ParallelFor(0, (size_t)first_res * first_res, 64, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++) {
+            const int y = (int)(row % first_res), z = (int)(row / first_res);
+            int z_begin, z_end;
+            window(z, 1, texture_res, z_begin, z_end);
+            for (int x = 0; x < first_res; x++) {
+                int16_t lowest = INT16_MAX;
+                for (int bz = z_begin; bz <= z_end; bz++) {
+                    lowest = std::min(lowest, pyramid.columns_[((size_t)bz * first_res + y) * first_res + x]);
+                }
+                pyramid.levels_[0][row * first_res + x] = Snorm16ToFloat(lowest);
+            }
+        }
+    });
+
+    // The rest are the lowest of the 8 texels below them
+    for (int level = 2; level <= DISTANCE_PYRAMID_LEVELS; level++) {
+        const int res = pyramid.LevelResolution(level);
+        const int below_res = pyramid.LevelResolution(level - 1);
+        std::vector<float>& texels = pyramid.levels_[level - 1];
+        texels.resize((size_t)res * res * res);
+
+        thread_pool->ParallelFor(0, (size_t)res * res, 16, [&](size_t begin, size_t end) {
+            for (size_t row = begin; row < end; row++) {
+                const int y = (int)(row % res), z = (int)(row / res);
+                int y_begin, y_end, z_begin, z_end;
+                window(y, 0, below_res, y_begin, y_end);
+                window(z, 0, below_res, z_begin, z_end);
+                for (int x = 0; x < res; x++) {
+                    int x_begin, x_end;
+                    window(x, 0, below_res, x_begin, x_end);
+                    float lowest = 1e30f;
+                    for (int bz = z_begin; bz <= z_end; bz++) {
+                        for (int by = y_begin; by <= y_end; by++) {
+                            for (int bx = x_begin; bx <= x_end; bx++) {
+                                lowest = std::min(lowest, pyramid.LevelTexel(level - 1, bx, by, bz));
+                            }
+                        }
+                    }
+                    texels[row * res + x] = lowest;
+                }
+            }
+        });
+    }
+}
+
+// Where the ray leaves the coarsest texel around the position with no hit in it, or -1 if even the finest could have one.
+// Texels are never below the ones they contain, so it starts from the coarsest, which away from the surface is the first
+// read, and descends until one has no hit in it.
+inline float GetDistancePyramidSkip(const DistancePyramid& pyramid, const Float3& origin, const Float3& direction, const Float3& position,
+    int& coarse_samples)
+{
+    const float o[3] = { origin.x, origin.y, origin.z }, d[3] = { direction.x, direction.y, direction.z };
+    const float p[3] = { position.x, position.y, position.z };
+    for (int level = DISTANCE_PYRAMID_LEVELS; level >= 1; level--) {
+        const int res = pyramid.LevelResolution(level);
+        const float texel_size = (float)(1 << level) / pyramid.texture_res_;
+        int texel[3];
+        for (int axis = 0; axis < 3; axis++) {
+            texel[axis] = std::min((int)(p[axis] / texel_size), res - 1);
+        }
+        coarse_samples++;
+        if (pyramid.LevelTexel(level, texel[0], texel[1], texel[2]) <= SPHERE_TRACING_THRESHOLD) {
+            continue;
+        }
+
+        float t_exit = 1e30f;
+        for (int axis = 0; axis < 3; axis++) {
+            if (d[axis] != 0) {
+                float face = std::min((texel[axis] + (d[axis] > 0 ? 1 : 0)) * texel_size, 1.f);
+                t_exit = std::min(t_exit, (face - o[axis]) / d[axis]);
+            }
+        }
+        return t_exit;
+    }
+    return -1;
+}
+
+// Sphere traces the ray through the texture as SphereTraceDenseTexture does, but steps to where it leaves the coarsest
+// texel around it with no hit in it when that's further than the distance sampled
+inline SphereTraceResult SphereTraceDistancePyramid(const std::vector<int16_t>& voxels, const DistancePyramid& pyramid,
+    const Float3& origin, const Float3& direction)
+{
+    SphereTraceResult result;
+    float t_min, t_max;
+    if (!RayUnitCubeIntersection(origin, direction, t_min, t_max)) {
+        return result;
+    }
+
+    t_min = std::max(t_min, 0.f);
+    while (result.steps_ < MAX_SPHERE_TRACING_STEPS && t_min <= t_max) {
+        result.steps_++;
+        Float3 position = Clamp(origin + direction * t_min, 0, 1);
+        float distance = SampleDenseTexture(voxels, pyramid.texture_res_, position);
+        if (distance <= SPHERE_TRACING_THRESHOLD) {
+            result.hit_ = true;
+            break;
+        }
+        t_min = std::max(t_min + distance, GetDistancePyramidSkip(pyramid, origin, direction, position, result.coarse_samples_));
+    }
+    result.t_ = t_min;
+    return result;
+}
+
+}
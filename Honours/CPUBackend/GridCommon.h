@@ -0,0 +1,167 @@
+#pragma once
+#include "CPUStructs.h"
+#include "Morton.h"
+
+// CPU ports of the indexing helpers in ComputeGridCommon.hlsli.
+// The grid layout is passed in explicitly, in place of the shaders' test_values_ constant buffer.
+
+namespace CPUBackend {
+
+// Turns grid-space cell coords into a cell index, according to the cell indexing mode
+inline uint32_t CellCoordsToIndex(const TestVariables& vars, uint32_t x, uint32_t y, uint32_t z)
+{
+    if (vars.cell_indexing_ == CellIndexingMorton) {
+        return MortonEncode(x, y, z);
+    }
+
+    const uint32_t cells_per_axis = vars.cells_per_axis_;
+    return x + (y * cells_per_axis) + (z * cells_per_axis * cells_per_axis);
+}
+
+// Get the cell index based on particle position
+inline uint32_t GetCellIndex(const TestVariables& vars, const Float3& particle_pos)
+{
+    const float cell_size = 1.f / vars.cells_per_axis_;
+
+    uint32_t x = (uint32_t)(particle_pos.x / cell_size);
+    uint32_t y = (uint32_t)(particle_pos.y / cell_size);
+    uint32_t z = (uint32_t)(particle_pos.z / cell_size);
+
+    return CellCoordsToIndex(vars, x, y, z);
+}
+
+// Get the grid-space coordinates of the cell (eg. for a grid of 3x3x3 cells, coords range from (0,0,0) to (2,2,2))
+inline UInt3 CellIndexTo3DCoords(const TestVariables& vars, uint32_t cell_index)
+{
+    if (vars.cell_indexing_ == CellIndexingMorton) {
+        return MortonDecode(cell_index);
+    }
+
+    const uint32_t cells_per_axis = vars.cells_per_axis_;
+    const uint32_t cells_per_z = cells_per_axis * cells_per_axis;
+
+    UInt3 coords;
+    coords.z = cell_index / cells_per_z;
+    coords.y = (cell_index % cells_per_z) / cells_per_axis;
+    coords.x = cell_index % cells_per_axis;
+
+    return coords;
+}
+
+// Get the index of a cell given a current cell index and an offset to apply. Returns -1 if out of bounds.
+inline int OffsetCellIndex(const TestVariables& vars, uint32_t cell_index, const Int3& cell_offset)
+{
+    UInt3 coords = CellIndexTo3DCoords(vars, cell_index);
+    int x = (int)coords.x + cell_offset.x;
+    int y = (int)coords.y + cell_offset.y;
+    int z = (int)coords.z + cell_offset.z;
+
+    if (x < 0 || y < 0 || z < 0 || x >= vars.cells_per_axis_ || y >= vars.cells_per_axis_ || z >= vars.cells_per_axis_) {
+        return -1;
+    }
+
+    return (int)CellCoordsToIndex(vars, x, y, z);
+}
+
+// Get the index of the block containing the cell with the given grid-space coords. Returns -1 if out of bounds.
+inline int Cell3DCoordsToBlockIndex(const TestVariables& vars, const UInt3& coords, const Int3& block_offset)
+{
+    int bx = (int)(coords.x / NUM_CELLS_PER_AXIS_PER_BLOCK) + block_offset.x;
+    int by = (int)(coords.y / NUM_CELLS_PER_AXIS_PER_BLOCK) + block_offset.y;
+    int bz = (int)(coords.z / NUM_CELLS_PER_AXIS_PER_BLOCK) + block_offset.z;
+
+    if (bx < 0 || by < 0 || bz < 0 || bx >= vars.blocks_per_axis_ || by >= vars.blocks_per_axis_ || bz >= vars.blocks_per_axis_) {
+        return -1;
+    }
+
+    return (bz * vars.blocks_per_axis_ * vars.blocks_per_axis_) + (by * vars.blocks_per_axis_) + bx;
+}
+
+// Works out the index of the block containing the given cell, and blocks neighbouring the cell
+inline void CellIndexToNeighbourBlockIndices(const TestVariables& vars, uint32_t cell_index, int block_indices[8])
+{
+    for (int i = 0; i < 8; i++) {
+        block_indices[i] = -1;
+    }
+
+    UInt3 coords = CellIndexTo3DCoords(vars, cell_index);
+    UInt3 intra_block_coords = { coords.x % NUM_CELLS_PER_AXIS_PER_BLOCK, coords.y % NUM_CELLS_PER_AXIS_PER_BLOCK, coords.z % NUM_CELLS_PER_AXIS_PER_BLOCK };
+
+    Int3 block_offset = { 0, 0, 0 };
+
+    block_indices[0] = Cell3DCoordsToBlockIndex(vars, coords, block_offset);
+
+    if (intra_block_coords.x == 0) {
+        block_offset.x = -1;
+    }
+    else if (intra_block_coords.x == NUM_CELLS_PER_AXIS_PER_BLOCK - 1) {
+        block_offset.x = 1;
+    }
+    if (block_offset.x) {
+        block_indices[1] = Cell3DCoordsToBlockIndex(vars, coords, { block_offset.x, 0, 0 });
+    }
+
+    if (intra_block_coords.y == 0) {
+        block_offset.y = -1;
+    }
+    else if (intra_block_coords.y == NUM_CELLS_PER_AXIS_PER_BLOCK - 1) {
+        block_offset.y = 1;
+    }
+    if (block_offset.y) {
+        block_indices[2] = Cell3DCoordsToBlockIndex(vars, coords, { 0, block_offset.y, 0 });
+    }
+
+    if (intra_block_coords.z == 0) {
+        block_offset.z = -1;
+    }
+    else if (intra_block_coords.z == NUM_CELLS_PER_AXIS_PER_BLOCK - 1) {
+        block_offset.z = 1;
+    }
+    if (block_offset.z) {
+        block_indices[3] = Cell3DCoordsToBlockIndex(vars, coords, { 0, 0, block_offset.z });
+    }
+
+    if (block_offset.x && block_offset.y)
+        block_indices[4] = Cell3DCoordsToBlockIndex(vars, coords, { block_offset.x, block_offset.y, 0 });
+    if (block_offset.y && block_offset.z)
+        block_indices[5] = Cell3DCoordsToBlockIndex(vars, coords, { 0, block_offset.y, block_offset.z });
+    if (block_offset.x && block_offset.z)
+        block_indices[6] = Cell3DCoordsToBlockIndex(vars, coords, { block_offset.x, 0, block_offset.z });
+    if (block_offset.x && block_offset.y && block_offset.z)
+        block_indices[7] = Cell3DCoordsToBlockIndex(vars, coords, block_offset);
+}
+
+// Works out the index of the cell from the block index and cell offset
+inline uint32_t BlockIndexToCellIndex(const TestVariables& vars, uint32_t block_index, const UInt3& cell_offset)
+{
+    // Convert block index to its (bx, by, bz) block coordinates
+    const uint32_t blocks_per_axis = vars.blocks_per_axis_;
+    const uint32_t blocks_per_z = blocks_per_axis * blocks_per_axis;
+    uint32_t bz = block_index / blocks_per_z;
+    uint32_t by = (block_index % blocks_per_z) / blocks_per_axis;
+    uint32_t bx = block_index % blocks_per_axis;
+
+    // Compute the absolute cell coordinates
+    uint32_t x = bx * NUM_CELLS_PER_AXIS_PER_BLOCK + cell_offset.x;
+    uint32_t y = by * NUM_CELLS_PER_AXIS_PER_BLOCK + cell_offset.y;
+    uint32_t z = bz * NUM_CELLS_PER_AXIS_PER_BLOCK + cell_offset.z;
+
+    return CellCoordsToIndex(vars, x, y, z);
+}
+
+// Return true if the block is at an edge of the grid
+inline bool IsBlockAtEdge(const TestVariables& vars, uint32_t block_index)
+{
+    const uint32_t blocks_per_axis = vars.blocks_per_axis_;
+    const uint32_t blocks_per_z = blocks_per_axis * blocks_per_axis;
+
+    uint32_t bz = block_index / blocks_per_z;
+    uint32_t by = (block_index % blocks_per_z) / blocks_per_axis;
+    uint32_t bx = block_index % blocks_per_axis;
+
+    return bx == 0 || bx == blocks_per_axis - 1 ||
+           by == 0 || by == blocks_per_axis - 1 ||
+           bz == 0 || bz == blocks_per_axis - 1;
+}
+
+}
@@ -0,0 +1,246 @@
+#include "GridEngine.h"
+#include "Compaction.h"
+#include "GridCommon.h"
+#include <atomic>
+
+namespace CPUBackend {
+
+// Work is split into chunks of this many items, roughly matching the 1024 thread groups used on the GPU
+#define GRID_GRAIN_SIZE 1024
+
+// Set in a block's count by BlockNeighbourFlagged when a neighbouring cell is non-empty
+#define BLOCK_NEIGHBOUR_FLAG 0x80000000u
+
+GridEngine::GridEngine(ThreadPool* thread_pool, const TestVariables& test_values) :
+    test_values_(test_values),
+    thread_pool_(thread_pool)
+{
+    cells_.resize(test_values_.num_cells_);
+    blocks_.resize(test_values_.num_blocks_);
+    surface_block_indices_.resize(test_values_.num_blocks_);
+    surface_cell_indices_.resize(test_values_.num_cells_);
+}
+
+void GridEngine::ComputeGrid(std::vector<ParticleData>& particles)
+{
+    ClearGridCounts();
+    BuildGrid(particles);
+    DetectSurfaceBlocks();
+
+    if (surface_counts_.surface_blocks > 0) {
+        DetectSurfaceCells();
+    }
+}
+
+// Clears the count of surface blocks and cells
+void GridEngine::ClearGridCounts()
+{
+    surface_counts_ = {};
+
+    thread_pool_->ParallelFor(0, cells_.size(), GRID_GRAIN_SIZE, [this](size_t begin, size_t end) {
+        std::fill(cells_.begin() + begin, cells_.begin() + end, 0);
+    });
+    std::fill(blocks_.begin(), blocks_.end(), 0);
+}
+
+// Builds the grid
+void GridEngine::BuildGrid(std::vector<ParticleData>& particles)
+{
+    thread_pool_->ParallelFor(0, particles.size(), GRID_GRAIN_SIZE, [this, &particles](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            ParticleData& particle = particles[i];
+
+            // Identify the cell containing the target particle, store it to be used in particle reordering
+            uint32_t cell_index = GetCellIndex(test_values_, particle.position_);
+            particle.cell_index_ = cell_index;
+
+            // Increment the cell's particle count and assign intra-cell offset
+            uint32_t particle_intra_cell_index = std::atomic_ref<uint32_t>(cells_[cell_index]).fetch_add(1, std::memory_order_relaxed);
+            particle.intra_cell_index_ = particle_intra_cell_index;
+
+            // If this is the first particle in the cell, increment the blocks non empty cell counter
+            // and the counters of neighbouring blocks closest to the particle
+            if (particle_intra_cell_index == 0) {
+                int block_indices[8];
+                CellIndexToNeighbourBlockIndices(test_values_, cell_index, block_indices);
+
+                for (int b = 0; b < 8; b++) {
+                    int block_index = block_indices[b];
+                    if (block_index > -1) {
+                        std::atomic_ref<uint32_t> block_count(blocks_[block_index]);
+                        if (b == 0) {
+                            block_count.fetch_add(1, std::memory_order_relaxed);
+                        }
+                        else if (block_neighbour_rule_ == BlockNeighbourFlagged) {
+                            // Whether the neighbour count is added depends on which thread gets there first,
+                            // so flag it instead to keep the surface blocks the same every run
+                            block_count.fetch_or(BLOCK_NEIGHBOUR_FLAG, std::memory_order_relaxed);
+                        }
+                        else if (block_count.load(std::memory_order_relaxed) == 0) {
+                            block_count.fetch_add(1, std::memory_order_relaxed);
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+// Detects surface blocks
+void GridEngine::DetectSurfaceBlocks()
+{
+    if (surface_list_order_ == SurfaceListSorted) {
+        surface_block_flags_.resize(blocks_.size());
+        thread_pool_->ParallelFor(0, blocks_.size(), GRID_GRAIN_SIZE, [this](size_t begin, size_t end) {
+            for (size_t block_index = begin; block_index < end; block_index++) {
+                surface_block_flags_[block_index] = IsSurfaceBlock((uint32_t)block_index);
+            }
+        });
+        surface_counts_.surface_blocks = CompactFlags(surface_block_flags_, surface_block_indices_, thread_pool_);
+        return;
+    }
+
+    thread_pool_->ParallelFor(0, blocks_.size(), GRID_GRAIN_SIZE, [this](size_t begin, size_t end) {
+        for (size_t block_index = begin; block_index < end; block_index++) {
+            if (!IsSurfaceBlock((uint32_t)block_index)) {
+                continue;
+            }
+
+            // The block is a surface block. Increment the count of surface blocks and store the index.
+            uint32_t surface_block_array_index = std::atomic_ref<uint32_t>(surface_counts_.surface_blocks).fetch_add(1, std::memory_order_relaxed);
+            surface_block_indices_[surface_block_array_index] = (uint32_t)block_index;
+        }
+    });
+}
+
+// Detects surface cells within the surface blocks. One chunk item per surface block, as with the GPU thread groups.
+void GridEngine::DetectSurfaceCells()
+{
+    const bool sorted = surface_list_order_ == SurfaceListSorted;
+    if (sorted) {
+        // Only cells in surface blocks are flagged, so the rest must be cleared
+        surface_cell_flags_.resize(cells_.size());
+        thread_pool_->ParallelFor(0, cells_.size(), GRID_GRAIN_SIZE * 16, [this](size_t begin, size_t end) {
+            std::fill(surface_cell_flags_.begin() + begin, surface_cell_flags_.begin() + end, 0);
+        });
+    }
+
+    thread_pool_->ParallelFor(0, surface_counts_.surface_blocks, 1, [this, sorted](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            uint32_t block_index = surface_block_indices_[i];
+
+            for (uint32_t z = 0; z < NUM_CELLS_PER_AXIS_PER_BLOCK; z++) {
+                for (uint32_t y = 0; y < NUM_CELLS_PER_AXIS_PER_BLOCK; y++) {
+                    for (uint32_t x = 0; x < NUM_CELLS_PER_AXIS_PER_BLOCK; x++) {
+                        uint32_t cell_index = BlockIndexToCellIndex(test_values_, block_index, { x, y, z });
+                        if (sorted) {
+                            surface_cell_flags_[cell_index] = IsSurfaceCell(cell_index);
+                        }
+                        else if (IsSurfaceCell(cell_index)) {
+                            MarkAsSurfaceCell(cell_index);
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    if (sorted) {
+        surface_counts_.surface_cells = CompactFlags(surface_cell_flags_, surface_cell_indices_, thread_pool_);
+    }
+}
+
+// If the non-empty cell count is 0, or 64 and not at the edge, the block is not a surface block
+bool GridEngine::IsSurfaceBlock(uint32_t block_index) const
+{
+    uint32_t non_empty_cell_count = blocks_[block_index];
+    if (block_neighbour_rule_ == BlockNeighbourFlagged) {
+        return non_empty_cell_count != 0 && !((non_empty_cell_count & ~BLOCK_NEIGHBOUR_FLAG) == NUM_CELLS_PER_BLOCK && !IsBlockAtEdge(test_values_, block_index));
+    }
+    return !(non_empty_cell_count == 0 || (non_empty_cell_count == NUM_CELLS_PER_BLOCK && !IsBlockAtEdge(test_values_, block_index)));
+}
+
+bool GridEngine::IsSurfaceCell(uint32_t cell_index) const
+{
+    // If the cell is not completely empty and not completely full, it's a surface cell for certain
+    uint32_t particle_count = cells_[cell_index];
+    if (particle_count > 0 && particle_count < CELL_MAX_PARTICLE_COUNT) {
+        return true;
+    }
+
+    // Otherwise must check if any neighbours are different 'fullness' (completely empty or completely full).
+    // If so, this cell is a surface cell.
+    bool is_surface = false;
+    for (int k = -1; k < 2 && !is_surface; k++) {
+        for (int j = -1; j < 2 && !is_surface; j++) {
+            for (int l = -1; l < 2 && !is_surface; l++) {
+                // Don't check the current cell itself
+                if (l == 0 && j == 0 && k == 0) {
+                    continue;
+                }
+
+                bool neighbour_empty;
+                bool neighbour_exists = IsNeighbourEmpty(cell_index, { l, j, k }, neighbour_empty);
+
+                is_surface = neighbour_exists && ((particle_count == 0) ^ neighbour_empty);
+            }
+        }
+    }
+
+    return is_surface;
+}
+
+// Finds if a neighbouring cell is empty, given a current index and an offset
+// Returns true if neighbour cell exists
+bool GridEngine::IsNeighbourEmpty(uint32_t cell_index, const Int3& offset, bool& empty) const
+{
+    int new_index = OffsetCellIndex(test_values_, cell_index, offset);
+
+    if (new_index > -1) {
+        empty = (cells_[new_index] == 0);
+        return true;
+    }
+
+    return false;
+}
+
+// Increment the count of surface cells and store the cell's index.
+void GridEngine::MarkAsSurfaceCell(uint32_t cell_index)
+{
+    uint32_t surface_cells_array_index = std::atomic_ref<uint32_t>(surface_counts_.surface_cells).fetch_add(1, std::memory_order_relaxed);
+    surface_cell_indices_[surface_cells_array_index] = cell_index;
+}
+
+Int3 GridEngine::GetCellCoords(uint32_t cell_index) const
+{
+    UInt3 coords = CellIndexTo3DCoords(test_values_, cell_index);
+    return { (int)coords.x, (int)coords.y, (int)coords.z };
+}
+
+// Find all cells with offsets between -(1,1,1) to (1,1,1), -1 where out of bounds
+void GridEngine::GetNeighbourCells(uint32_t cell_index, int neighbouring_cells[27]) const
+{
+    // Same as OffsetCellIndex for each offset, but only decoding the cell's coords once
+    const int cells_per_axis = test_values_.cells_per_axis_;
+    UInt3 coords = CellIndexTo3DCoords(test_values_, cell_index);
+
+    for (int z = 0; z < 3; z++) {
+        for (int y = 0; y < 3; y++) {
+            for (int x = 0; x < 3; x++) {
+                int nx = (int)coords.x + x - 1;
+                int ny = (int)coords.y + y - 1;
+                int nz = (int)coords.z + z - 1;
+                bool in_bounds = nx >= 0 && ny >= 0 && nz >= 0 && nx < cells_per_axis && ny < cells_per_axis && nz < cells_per_axis;
+                neighbouring_cells[(z * 9) + (y * 3) + x] = in_bounds ? (int)CellCoordsToIndex(test_values_, nx, ny, nz) : -1;
+            }
+        }
+    }
+}
+
+size_t GridEngine::GetMemoryFootprint() const
+{
+    return (cells_.size() + blocks_.size() + surface_block_indices_.size() + surface_cell_indices_.size()) * sizeof(uint32_t) +
+        surface_block_flags_.size() + surface_cell_flags_.size();
+}
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <vector>
+#include "CPUStructs.h"
+#include "ThreadPool.h"
+
+namespace CPUBackend {
+
+enum SurfaceListOrder {
+    SurfaceListAppend = 0,  // Appended with an atomic counter as on the GPU by default, so in a different order each run
+    SurfaceListSorted       // Flagged, then compacted in index order (see Compaction.h), as ComputeCB::sorted_surface_lists_ does
+};
+
+// How CSGridMain counts a non-empty cell towards the neighbouring blocks closest to it
+enum BlockNeighbourRule {
+    BlockNeighbourCounted = 0, // Added to the block's count only while the block is still empty, as on the GPU
+    BlockNeighbourFlagged      // Flagged in the count's top bit, leaving the count to the block's own cells, as ComputeCB::flag_block_neighbours_ does
+};
+
+// Headless CPU implementation of the two-level grid construction and surface detection in ComputeGrid.hlsl.
+// Each stage is one ParallelFor over the same domain the GPU dispatch covers, and produces the same
+// cell counts, block counts, surface block list and surface cell list. By default the list order is not deterministic,
+// as on the GPU. SurfaceListSorted puts the lists, and so the AABBs and brick pool built from them, in index order.
+// The set of surface blocks isn't deterministic by default either: the GPU only adds a neighbouring cell to a block's
+// count if the block is still empty, so whether a block's count ends on 64, culling it, depends on whether a neighbour
+// got there before the block's own cells. BlockNeighbourFlagged keeps neighbours out of the count, so blocks with all 64
+// cells occupied are always culled. Lists that are the same every run need both.
+class GridEngine
+{
+public:
+    // Buffers are sized from the grid layout in test_values, see DeriveGridValues in TestValues.h
+    GridEngine(ThreadPool* thread_pool, const TestVariables& test_values);
+
+    // Runs all stages in the order Computer::ComputeGrid dispatches them
+    void ComputeGrid(std::vector<ParticleData>& particles);
+
+    // Individual stages, for profiling
+    void ClearGridCounts();                                 // CSClearGridCounts
+    void BuildGrid(std::vector<ParticleData>& particles);   // CSGridMain
+    void DetectSurfaceBlocks();                             // CSDetectSurfaceBlocksMain
+    void DetectSurfaceCells();                              // CSDetectSurfaceCellsMain
+
+    inline void SetSurfaceListOrder(SurfaceListOrder order) { surface_list_order_ = order; }
+    inline SurfaceListOrder GetSurfaceListOrder() const { return surface_list_order_; }
+    inline void SetBlockNeighbourRule(BlockNeighbourRule rule) { block_neighbour_rule_ = rule; }
+    inline BlockNeighbourRule GetBlockNeighbourRule() const { return block_neighbour_rule_; }
+
+    inline const std::vector<uint32_t>& GetCellCounts() const { return cells_; }
+    inline const std::vector<uint32_t>& GetBlockCounts() const { return blocks_; }
+    inline const GridSurfaceCounts& GetSurfaceCounts() const { return surface_counts_; }
+    inline const TestVariables& GetTestValues() const { return test_values_; }
+
+    // Only the first GetSurfaceCounts().surface_blocks / surface_cells entries are valid
+    inline const std::vector<uint32_t>& GetSurfaceBlockIndices() const { return surface_block_indices_; }
+    inline const std::vector<uint32_t>& GetSurfaceCellIndices() const { return surface_cell_indices_; }
+
+    // Cell lookups for the brick pool stage
+    Int3 GetCellCoords(uint32_t cell_index) const;
+    void GetNeighbourCells(uint32_t cell_index, int neighbouring_cells[27]) const;
+
+    // Bytes held by the grid's buffers
+    size_t GetMemoryFootprint() const;
+
+private:
+    bool IsNeighbourEmpty(uint32_t cell_index, const Int3& offset, bool& empty) const;
+    bool IsSurfaceBlock(uint32_t block_index) const;
+    bool IsSurfaceCell(uint32_t cell_index) const;
+    void MarkAsSurfaceCell(uint32_t cell_index);
+
+    // Accessed atomically with std::atomic_ref, which keeps them readable as plain arrays afterwards
+    std::vector<uint32_t> cells_;
+    std::vector<uint32_t> blocks_;
+    std::vector<uint32_t> surface_block_indices_;
+    std::vector<uint32_t> surface_cell_indices_;
+    GridSurfaceCounts surface_counts_ = {};
+
+    // Surface flags per block / cell, for SurfaceListSorted
+    SurfaceListOrder surface_list_order_ = SurfaceListAppend;
+    BlockNeighbourRule block_neighbour_rule_ = BlockNeighbourCounted;
+    std::vector<uint8_t> surface_block_flags_;
+    std::vector<uint8_t> surface_cell_flags_;
+
+    TestVariables test_values_;
+
+    ThreadPool* thread_pool_;
+};
+
+}
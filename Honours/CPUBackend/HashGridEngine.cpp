@@ -0,0 +1,239 @@
+#include "HashGridEngine.h"
+#include <cmath>
+
+namespace CPUBackend {
+
+#define HASH_GRID_GRAIN_SIZE 1024
+#define HASH_GRID_MIN_CAPACITY 1024
+
+// Cell coordinates are packed into 21 bits each, so this key is never a valid cell
+#define EMPTY_KEY ~0ull
+#define KEY_COORD_BITS 21
+#define KEY_COORD_MASK ((1ull << KEY_COORD_BITS) - 1)
+#define KEY_COORD_BIAS (1 << (KEY_COORD_BITS - 1))
+
+static uint64_t PackKey(const Int3& coords)
+{
+    return ((uint64_t)(coords.x + KEY_COORD_BIAS) & KEY_COORD_MASK) |
+           (((uint64_t)(coords.y + KEY_COORD_BIAS) & KEY_COORD_MASK) << KEY_COORD_BITS) |
+           (((uint64_t)(coords.z + KEY_COORD_BIAS) & KEY_COORD_MASK) << (KEY_COORD_BITS * 2));
+}
+
+static Int3 UnpackKey(uint64_t key)
+{
+    return { (int)(key & KEY_COORD_MASK) - KEY_COORD_BIAS,
+             (int)((key >> KEY_COORD_BITS) & KEY_COORD_MASK) - KEY_COORD_BIAS,
+             (int)((key >> (KEY_COORD_BITS * 2)) & KEY_COORD_MASK) - KEY_COORD_BIAS };
+}
+
+// Fibonacci hashing, spreads neighbouring coordinates across the table
+static uint32_t HashKey(uint64_t key)
+{
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+// Keys are written by compare-exchange during the build, so even lookups must load them atomically
+static uint64_t LoadKey(const uint64_t& key)
+{
+    return std::atomic_ref<uint64_t>(const_cast<uint64_t&>(key)).load(std::memory_order_acquire);
+}
+
+HashGridEngine::HashGridEngine(ThreadPool* thread_pool, const TestVariables& test_values) :
+    test_values_(test_values),
+    thread_pool_(thread_pool)
+{
+    Resize(HASH_GRID_MIN_CAPACITY);
+}
+
+void HashGridEngine::ComputeGrid(std::vector<ParticleData>& particles)
+{
+    while (true) {
+        ClearGrid();
+        if (BuildGrid(particles) && DetectSurfaceCells()) {
+            return;
+        }
+
+        Resize(GetCapacity() * 2);
+    }
+}
+
+// Empties the table and clears the counts
+void HashGridEngine::ClearGrid()
+{
+    surface_counts_ = {};
+    occupied_cells_count_ = 0;
+    entries_count_ = 0;
+    overflowed_ = false;
+
+    thread_pool_->ParallelFor(0, keys_.size(), HASH_GRID_GRAIN_SIZE * 16, [this](size_t begin, size_t end) {
+        std::fill(keys_.begin() + begin, keys_.begin() + end, EMPTY_KEY);
+        std::fill(cells_.begin() + begin, cells_.begin() + end, 0);
+    });
+}
+
+// Builds the grid, inserting each particle's cell into the table
+bool HashGridEngine::BuildGrid(std::vector<ParticleData>& particles)
+{
+    const float cell_size = 1.f / test_values_.cells_per_axis_;
+
+    thread_pool_->ParallelFor(0, particles.size(), HASH_GRID_GRAIN_SIZE, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end && !overflowed_.load(std::memory_order_relaxed); i++) {
+            ParticleData& particle = particles[i];
+
+            // Identify the cell containing the target particle, store it to be used in particle reordering
+            Int3 coords = { (int)std::floor(particle.position_.x / cell_size), (int)std::floor(particle.position_.y / cell_size), (int)std::floor(particle.position_.z / cell_size) };
+            bool inserted = false;
+            int cell_index = FindOrInsertCell(coords, inserted);
+            if (cell_index < 0) {
+                return;
+            }
+            particle.cell_index_ = cell_index;
+
+            // The thread which added the cell records it as occupied
+            if (inserted) {
+                uint32_t occupied_array_index = std::atomic_ref<uint32_t>(occupied_cells_count_).fetch_add(1, std::memory_order_relaxed);
+                occupied_cell_indices_[occupied_array_index] = cell_index;
+            }
+
+            // Increment the cell's particle count and assign intra-cell offset
+            particle.intra_cell_index_ = std::atomic_ref<uint32_t>(cells_[cell_index]).fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    return !overflowed_;
+}
+
+// Detects surface cells. An occupied cell is a surface cell if it isn't full or if it has an empty neighbour,
+// and an empty cell is a surface cell if it has an occupied neighbour.
+bool HashGridEngine::DetectSurfaceCells()
+{
+    thread_pool_->ParallelFor(0, occupied_cells_count_, HASH_GRID_GRAIN_SIZE / 16, [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end && !overflowed_.load(std::memory_order_relaxed); i++) {
+            uint32_t cell_index = occupied_cell_indices_[i];
+            Int3 coords = GetCellCoords(cell_index);
+            bool is_surface = cells_[cell_index] < CELL_MAX_PARTICLE_COUNT;
+
+            for (int k = -1; k < 2; k++) {
+                for (int j = -1; j < 2; j++) {
+                    for (int l = -1; l < 2; l++) {
+                        // Don't check the current cell itself
+                        if (l == 0 && j == 0 && k == 0) {
+                            continue;
+                        }
+
+                        // Empty neighbours are added to the table, so the brick pool can look them up.
+                        // Only the thread which adds one marks it, so each is only recorded once.
+                        bool inserted = false;
+                        int neighbour_index = FindOrInsertCell({ coords.x + l, coords.y + j, coords.z + k }, inserted);
+                        if (neighbour_index < 0) {
+                            return;
+                        }
+                        if (inserted) {
+                            MarkAsSurfaceCell(neighbour_index);
+                        }
+
+                        is_surface |= (cells_[neighbour_index] == 0);
+                    }
+                }
+            }
+
+            if (is_surface) {
+                MarkAsSurfaceCell(cell_index);
+            }
+        }
+    });
+
+    return !overflowed_;
+}
+
+int HashGridEngine::FindCell(const Int3& coords) const
+{
+    const uint64_t key = PackKey(coords);
+    const uint32_t mask = GetCapacity() - 1;
+
+    for (uint32_t slot = HashKey(key) & mask;; slot = (slot + 1) & mask) {
+        uint64_t slot_key = LoadKey(keys_[slot]);
+        if (slot_key == key) {
+            return (int)slot;
+        }
+        if (slot_key == EMPTY_KEY) {
+            return -1;
+        }
+    }
+}
+
+// Returns the cell's slot, adding it to the table if it isn't there yet. Returns -1 if the table is full.
+int HashGridEngine::FindOrInsertCell(const Int3& coords, bool& inserted)
+{
+    const uint64_t key = PackKey(coords);
+    const uint32_t mask = GetCapacity() - 1;
+
+    for (uint32_t slot = HashKey(key) & mask;; slot = (slot + 1) & mask) {
+        std::atomic_ref<uint64_t> slot_key(keys_[slot]);
+        uint64_t current_key = slot_key.load(std::memory_order_acquire);
+
+        if (current_key == EMPTY_KEY) {
+            // At most one extra insert per thread can get past this check, and the table is always at least half empty,
+            // so probing always finds either the key or an empty slot
+            if (entries_count_.load(std::memory_order_relaxed) >= max_entries_) {
+                overflowed_ = true;
+                return -1;
+            }
+
+            if (slot_key.compare_exchange_strong(current_key, key, std::memory_order_acq_rel)) {
+                entries_count_.fetch_add(1, std::memory_order_relaxed);
+                inserted = true;
+                return (int)slot;
+            }
+            // Otherwise another thread claimed the slot first, current_key now holds its key
+        }
+
+        if (current_key == key) {
+            return (int)slot;
+        }
+    }
+}
+
+Int3 HashGridEngine::GetCellCoords(uint32_t cell_index) const
+{
+    return UnpackKey(LoadKey(keys_[cell_index]));
+}
+
+// Find all cells with offsets between -(1,1,1) to (1,1,1), -1 where not in the table
+void HashGridEngine::GetNeighbourCells(uint32_t cell_index, int neighbouring_cells[27]) const
+{
+    Int3 coords = GetCellCoords(cell_index);
+
+    for (int z = 0; z < 3; z++) {
+        for (int y = 0; y < 3; y++) {
+            for (int x = 0; x < 3; x++) {
+                neighbouring_cells[(z * 9) + (y * 3) + x] = FindCell({ coords.x + x - 1, coords.y + y - 1, coords.z + z - 1 });
+            }
+        }
+    }
+}
+
+size_t HashGridEngine::GetMemoryFootprint() const
+{
+    return keys_.size() * sizeof(uint64_t) +
+           (cells_.size() + occupied_cell_indices_.size() + surface_cell_indices_.size()) * sizeof(uint32_t);
+}
+
+// Capacity must be a power of 2
+void HashGridEngine::Resize(uint32_t capacity)
+{
+    keys_.resize(capacity);
+    cells_.resize(capacity);
+    occupied_cell_indices_.resize(capacity);
+    surface_cell_indices_.resize(capacity);
+    max_entries_ = capacity / 2;
+}
+
+// Increment the count of surface cells and store the cell's index.
+void HashGridEngine::MarkAsSurfaceCell(uint32_t cell_index)
+{
+    uint32_t surface_cells_array_index = std::atomic_ref<uint32_t>(surface_counts_.surface_cells).fetch_add(1, std::memory_order_relaxed);
+    surface_cell_indices_[surface_cells_array_index] = cell_index;
+}
+
+}
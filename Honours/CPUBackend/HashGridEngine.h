@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include "CPUStructs.h"
+#include "ThreadPool.h"
+
+namespace CPUBackend {
+
+// Sparse alternative to GridEngine for domains that aren't the unit cube.
+// Cells are keyed by their integer coordinate in an open-addressing hash table (linear probing), so particles
+// can be anywhere within +-2^20 cells of the origin and memory scales with the number of occupied cells rather
+// than with the volume of the domain. Cell size is 1 / test_values.cells_per_axis_, as with the dense grid.
+//
+// A cell index is a slot in the table, so GetCellCounts, the reorder and the brick pool stages work exactly as
+// they do for GridEngine. There are no blocks; surface detection visits each occupied cell and its 26 neighbours,
+// adding the empty neighbours to the table as it goes.
+//
+// The table is sized from the previous frame's cell count, and if a frame needs more it is doubled and the frame is rebuilt.
+class HashGridEngine
+{
+public:
+    HashGridEngine(ThreadPool* thread_pool, const TestVariables& test_values);
+
+    // Runs all stages, growing the table and starting again if it fills up
+    void ComputeGrid(std::vector<ParticleData>& particles);
+
+    // Individual stages, for profiling. These return false if the table filled up.
+    void ClearGrid();
+    bool BuildGrid(std::vector<ParticleData>& particles);
+    bool DetectSurfaceCells();
+
+    // Indexed by cell (table slot), unused slots have a count of 0
+    inline const std::vector<uint32_t>& GetCellCounts() const { return cells_; }
+    inline const GridSurfaceCounts& GetSurfaceCounts() const { return surface_counts_; }
+    inline const TestVariables& GetTestValues() const { return test_values_; }
+    inline uint32_t GetOccupiedCellCount() const { return occupied_cells_count_; }
+    inline uint32_t GetCapacity() const { return (uint32_t)keys_.size(); }
+
+    // Only the first GetSurfaceCounts().surface_cells / GetOccupiedCellCount() entries are valid
+    inline const std::vector<uint32_t>& GetSurfaceCellIndices() const { return surface_cell_indices_; }
+    inline const std::vector<uint32_t>& GetOccupiedCellIndices() const { return occupied_cell_indices_; }
+
+    // Cell lookups. FindCell returns -1 if the cell isn't in the table (and is therefore empty).
+    int FindCell(const Int3& coords) const;
+    Int3 GetCellCoords(uint32_t cell_index) const;
+    void GetNeighbourCells(uint32_t cell_index, int neighbouring_cells[27]) const;
+
+    // Bytes held by the table and cell lists
+    size_t GetMemoryFootprint() const;
+
+private:
+    int FindOrInsertCell(const Int3& coords, bool& inserted);
+    void Resize(uint32_t capacity);
+    void MarkAsSurfaceCell(uint32_t cell_index);
+
+    std::vector<uint64_t> keys_;
+    std::vector<uint32_t> cells_;
+    std::vector<uint32_t> occupied_cell_indices_;
+    std::vector<uint32_t> surface_cell_indices_;
+    uint32_t occupied_cells_count_ = 0;
+    GridSurfaceCounts surface_counts_ = {};
+
+    // Inserts beyond max_entries_ (half the capacity) fail, which keeps probe sequences short
+    std::atomic<uint32_t> entries_count_ = 0;
+    uint32_t max_entries_ = 0;
+    std::atomic<bool> overflowed_ = false;
+
+    TestVariables test_values_;
+    ThreadPool* thread_pool_;
+};
+
+}
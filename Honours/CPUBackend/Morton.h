@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+#include "CPUMath.h"
+
+// Morton (Z-order) codes for up to 10 bits per axis, matching Part1By2 / Compact1By2 in ComputeGridCommon.hlsli.
+// Uses BMI2 pdep/pext when compiled for it (HONOURS_CPU_BMI2 in CMakeLists.txt), lookup tables otherwise.
+
+namespace CPUBackend {
+
+#define MORTON_MASK_X 0x09249249u
+#define MORTON_MASK_Y 0x12492492u
+#define MORTON_MASK_Z 0x24924924u
+
+struct MortonTables {
+    uint32_t spread_[256];  // 8 bits spread out to every third of 24 bits
+    uint16_t compact_[512]; // 9 interleaved bits (3 per axis) packed as x | y << 3 | z << 6
+};
+
+constexpr MortonTables BuildMortonTables()
+{
+    MortonTables tables = {};
+    for (uint32_t value = 0; value < 256; value++) {
+        for (uint32_t bit = 0; bit < 8; bit++) {
+            tables.spread_[value] |= ((value >> bit) & 1) << (bit * 3);
+        }
+    }
+    for (uint32_t code = 0; code < 512; code++) {
+        uint32_t packed = 0;
+        for (uint32_t bit = 0; bit < 3; bit++) {
+            packed |= ((code >> (bit * 3)) & 1) << bit;
+            packed |= ((code >> (bit * 3 + 1)) & 1) << (bit + 3);
+            packed |= ((code >> (bit * 3 + 2)) & 1) << (bit + 6);
+        }
+        tables.compact_[code] = (uint16_t)packed;
+    }
+    return tables;
+}
+
+inline constexpr MortonTables morton_tables = BuildMortonTables();
+
+inline uint32_t MortonEncodeLUT(uint32_t x, uint32_t y, uint32_t z)
+{
+    const uint32_t* spread = morton_tables.spread_;
+    uint32_t low = spread[x & 0xff] | (spread[y & 0xff] << 1) | (spread[z & 0xff] << 2);
+    uint32_t high = spread[(x >> 8) & 0x3] | (spread[(y >> 8) & 0x3] << 1) | (spread[(z >> 8) & 0x3] << 2);
+    return low | (high << 24);
+}
+
+inline UInt3 MortonDecodeLUT(uint32_t code)
+{
+    UInt3 coords = { 0, 0, 0 };
+    for (uint32_t chunk = 0; chunk < 4; chunk++) {
+        uint32_t packed = morton_tables.compact_[(code >> (chunk * 9)) & 0x1ff];
+        coords.x |= (packed & 0x7) << (chunk * 3);
+        coords.y |= ((packed >> 3) & 0x7) << (chunk * 3);
+        coords.z |= ((packed >> 6) & 0x7) << (chunk * 3);
+    }
+    return coords;
+}
+
+#if defined(__BMI2__)
+inline uint32_t MortonEncode(uint32_t x, uint32_t y, uint32_t z)
+{
+    return _pdep_u32(x, MORTON_MASK_X) | _pdep_u32(y, MORTON_MASK_Y) | _pdep_u32(z, MORTON_MASK_Z);
+}
+
+inline UInt3 MortonDecode(uint32_t code)
+{
+    return { _pext_u32(code, MORTON_MASK_X), _pext_u32(code, MORTON_MASK_Y), _pext_u32(code, MORTON_MASK_Z) };
+}
+#else
+inline uint32_t MortonEncode(uint32_t x, uint32_t y, uint32_t z) { return MortonEncodeLUT(x, y, z); }
+inline UInt3 MortonDecode(uint32_t code) { return MortonDecodeLUT(code); }
+#endif
+
+}
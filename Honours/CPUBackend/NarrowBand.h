@@ -0,0 +1,363 @@
+#pragma once
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <vector>
+#include "SimpleTexture.h"
+
+namespace CPUBackend {
+
+// CPU port of the Simple method's narrow band texture (CSNarrowBandCellsMain, CSTexNarrowBandMain, CSJumpFloodMain and
+// CSTexFarFieldMain in ComputeTexture.hlsl). Only the voxels within a band of voxels around the cells the surface can be
+// in get the grid's distance. The rest get a cheaper distance flooded out from them over a coarser grid, which is never
+// further than the surface, so sphere tracing still takes safe steps through them.
+
+#define NARROW_BAND_FLOOD_SCALE 8 // Texture voxels per axis per voxel of the coarse grid the far field is flooded over
+#define NARROW_BAND_INVALID_SEED UINT32_MAX
+#define NARROW_BAND_NO_SEED_DISTANCE 1000.f
+
+// Per cell, if the surface can be within it, or only next to it, which is as far as the band can reach
+#define NARROW_BAND_CELL_NONE 0
+#define NARROW_BAND_CELL_NEAR 1
+#define NARROW_BAND_CELL_SURFACE 2
+
+struct NarrowBand {
+    int band_voxels_ = 4;                   // How far past the surface cells voxels get the exact distance
+    std::vector<uint8_t> band_cells_;       // Per cell, one of NARROW_BAND_CELL_*
+    std::vector<uint32_t> seed_distances_;  // Per flood voxel, the bits of the nearest distance to the surface of its band voxels
+    std::vector<uint32_t> flood_[2];        // Per flood voxel, the packed coords of its seed, ping-ponged between passes
+    int flood_result_ = 0;                  // Which of flood_ holds the result
+    std::vector<float> flood_distances_;    // Per flood voxel, the distance its flooded seed gives it
+    std::vector<int> cell_voxels_;          // Per cell coord along an axis, the first voxel within it, then the end
+
+    inline int FloodResolution(const TestVariables& test_values) const
+    {
+        return (test_values.texture_res_ + NARROW_BAND_FLOOD_SCALE - 1) / NARROW_BAND_FLOOD_SCALE;
+    }
+};
+
+// The band can't reach past the cells around a voxel's cell
+inline int ClampBandVoxels(const TestVariables& test_values, int band_voxels)
+{
+    return std::clamp(band_voxels, 1, std::max(test_values.texture_res_ / test_values.cells_per_axis_, 1));
+}
+
+// As CSDetectSurfaceCellsMain, but for every cell rather than those in surface blocks: partially full cells, and empty or
+// full cells next to one that isn't. The surface can only be within or next to particles, so only within these cells.
+template<typename Grid>
+inline bool IsNarrowBandCell(const Grid& grid, uint32_t cell_index)
+{
+    uint32_t particle_count = grid.GetCellCounts()[cell_index];
+    if (particle_count > 0 && particle_count < CELL_MAX_PARTICLE_COUNT) {
+        return true;
+    }
+
+    int neighbouring_cells[27];
+    grid.GetNeighbourCells(cell_index, neighbouring_cells);
+    for (int neighbour : neighbouring_cells) {
+        if (neighbour >= 0 && (particle_count == 0) != (grid.GetCellCounts()[neighbour] == 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// If the voxel at the position is within the band of voxels around a band cell. Only the cells around its own that are
+// within reach along each axis need checking, usually none but its own, and none at all if none of them are band cells.
+inline bool IsNarrowBandVoxel(const TestVariables& test_values, const NarrowBand& band, const int neighbouring_cells[27],
+    const Int3& cell_coords, const Float3& position)
+{
+    if (band.band_cells_[neighbouring_cells[13]] == NARROW_BAND_CELL_NONE) {
+        return false;
+    }
+    const float cell_size = 1.f / test_values.cells_per_axis_;
+    const float reach = band.band_voxels_ / (float)test_values.texture_res_;
+    const float to_lower[3] = { position.x - cell_coords.x * cell_size, position.y - cell_coords.y * cell_size, position.z - cell_coords.z * cell_size };
+    int begin[3], end[3];
+    for (int axis = 0; axis < 3; axis++) {
+        begin[axis] = to_lower[axis] <= reach ? 0 : 1;
+        end[axis] = cell_size - to_lower[axis] <= reach ? 3 : 2;
+    }
+
+    for (int z = begin[2]; z < end[2]; z++) {
+        for (int y = begin[1]; y < end[1]; y++) {
+            for (int x = begin[0]; x < end[0]; x++) {
+                int neighbour = neighbouring_cells[(z * 9) + (y * 3) + x];
+                if (neighbour < 0 || band.band_cells_[neighbour] != NARROW_BAND_CELL_SURFACE) {
+                    continue;
+                }
+                // Distance to the neighbour along each axis it's offset in, 1 being the voxel's own cell
+                auto outside = [&](int offset, int axis) {
+                    return offset == 1 ? 0.f : offset == 0 ? to_lower[axis] : cell_size - to_lower[axis];
+                };
+                float dx = outside(x, 0), dy = outside(y, 1), dz = outside(z, 2);
+                if (dx * dx + dy * dy + dz * dz <= reach * reach) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// The voxels along an axis within each cell coord, as GetCellIndex places their centres
+inline void ComputeCellVoxels(const TestVariables& test_values, std::vector<int>& cell_voxels)
+{
+    const float cell_size = 1.f / test_values.cells_per_axis_;
+    cell_voxels.assign(test_values.cells_per_axis_ + 1, test_values.texture_res_);
+    for (int voxel = test_values.texture_res_ - 1; voxel >= 0; voxel--) {
+        uint32_t cell = (uint32_t)(GetSimpleTextureVoxelPosition(test_values.texture_res_, voxel, 0, 0).x / cell_size);
+        cell_voxels[cell] = voxel;
+    }
+    for (int cell = test_values.cells_per_axis_ - 1; cell >= 0; cell--) {
+        cell_voxels[cell] = std::min(cell_voxels[cell], cell_voxels[cell + 1]); // Cells no voxel centre is within
+    }
+}
+
+// Flood voxels' seeds are their coords packed 10 bits per axis, so decoding them doesn't take divides
+inline uint32_t FloodVoxelIndex(int flood_res, int x, int y, int z)
+{
+    return ((uint32_t)z * flood_res + y) * flood_res + x;
+}
+
+inline uint32_t PackFloodSeed(int x, int y, int z)
+{
+    return (uint32_t)x | ((uint32_t)y << 10) | ((uint32_t)z << 20);
+}
+
+inline Int3 UnpackFloodSeed(uint32_t seed)
+{
+    return { (int)(seed & 0x3ff), (int)((seed >> 10) & 0x3ff), (int)(seed >> 20) };
+}
+
+// Distance to the surface the seed gives the flood voxel, the seed's own plus the distance between them. Takes the flood
+// grid's resolution and voxel size, as it's called for every neighbour of every flood voxel each pass.
+inline float GetFloodCost(const NarrowBand& band, int flood_res, float flood_voxel_size, uint32_t seed, const Int3& coords)
+{
+    Int3 seed_coords = UnpackFloodSeed(seed);
+    Float3 offset = { (float)(coords.x - seed_coords.x), (float)(coords.y - seed_coords.y), (float)(coords.z - seed_coords.z) };
+    uint32_t seed_index = FloodVoxelIndex(flood_res, seed_coords.x, seed_coords.y, seed_coords.z);
+    return std::bit_cast<float>(band.seed_distances_[seed_index]) + Length(offset) * flood_voxel_size;
+}
+
+// CPU port of CSNarrowBandCellsMain and CSTexNarrowBandMain. Flags the band cells, then fills the band's voxels as
+// FillSimpleTextureGrid does, keeping each flood voxel's nearest distance to the surface as its seed. The cells next to
+// band cells are flagged after them, and voxels are visited a cell at a time, so cells no band reaches are skipped whole
+// and the particles around a cell are gathered once for all of its voxels.
+template<typename Grid, typename PositionSource>
+void FillNarrowBand(const Grid& grid, const PositionSource& particle_positions, const std::vector<uint32_t>& cell_offsets,
+    NarrowBand& band, std::vector<int16_t>& voxels, ThreadPool* thread_pool)
+{
+    const TestVariables& test_values = grid.GetTestValues();
+    const int texture_res = test_values.texture_res_;
+    const int flood_res = band.FloodResolution(test_values);
+    const int cells_per_axis = test_values.cells_per_axis_;
+    voxels.resize((size_t)texture_res * texture_res * texture_res);
+    band.band_voxels_ = ClampBandVoxels(test_values, band.band_voxels_);
+    ComputeCellVoxels(test_values, band.cell_voxels_);
+
+    band.band_cells_.resize(grid.GetCellCounts().size());
+    thread_pool->ParallelFor(0, band.band_cells_.size(), 1024, [&](size_t begin, size_t end) {
+        for (size_t cell_index = begin; cell_index < end; cell_index++) {
+            band.band_cells_[cell_index] = cell_index < (size_t)test_values.num_cells_ && IsNarrowBandCell(grid, (uint32_t)cell_index)
+                ? NARROW_BAND_CELL_SURFACE : NARROW_BAND_CELL_NONE;
+        }
+    });
+    const std::vector<uint8_t> surface_cells = band.band_cells_;
+    thread_pool->ParallelFor(0, band.band_cells_.size(), 1024, [&](size_t begin, size_t end) {
+        for (size_t cell_index = begin; cell_index < end; cell_index++) {
+            if (surface_cells[cell_index] != NARROW_BAND_CELL_NONE || cell_index >= (size_t)test_values.num_cells_) {
+                continue;
+            }
+            int neighbouring_cells[27];
+            grid.GetNeighbourCells((uint32_t)cell_index, neighbouring_cells);
+            for (int neighbour : neighbouring_cells) {
+                if (neighbour >= 0 && surface_cells[neighbour] == NARROW_BAND_CELL_SURFACE) {
+                    band.band_cells_[cell_index] = NARROW_BAND_CELL_NEAR;
+                    break;
+                }
+            }
+        }
+    });
+    band.seed_distances_.assign((size_t)flood_res * flood_res * flood_res, std::bit_cast<uint32_t>(NARROW_BAND_NO_SEED_DISTANCE));
+
+    thread_pool->ParallelFor(0, (size_t)cells_per_axis * cells_per_axis * cells_per_axis, 1, [&](size_t begin, size_t end) {
+        std::vector<Float3> neighbour_particles;
+        for (size_t cell = begin; cell < end; cell++) {
+            Int3 cell_coords = { (int)(cell % cells_per_axis), (int)((cell / cells_per_axis) % cells_per_axis), (int)(cell / cells_per_axis / cells_per_axis) };
+            uint32_t cell_index = CellCoordsToIndex(test_values, cell_coords.x, cell_coords.y, cell_coords.z);
+            if (band.band_cells_[cell_index] == NARROW_BAND_CELL_NONE) {
+                continue;
+            }
+            int neighbouring_cells[27];
+            grid.GetNeighbourCells(cell_index, neighbouring_cells);
+            bool gathered = false;
+
+            for (int z = band.cell_voxels_[cell_coords.z]; z < band.cell_voxels_[cell_coords.z + 1]; z++) {
+                for (int y = band.cell_voxels_[cell_coords.y]; y < band.cell_voxels_[cell_coords.y + 1]; y++) {
+                    for (int x = band.cell_voxels_[cell_coords.x]; x < band.cell_voxels_[cell_coords.x + 1]; x++) {
+                        Float3 position = GetSimpleTextureVoxelPosition(texture_res, x, y, z);
+                        if (!IsNarrowBandVoxel(test_values, band, neighbouring_cells, cell_coords, position)) {
+                            continue;
+                        }
+                        if (!gathered) {
+                            GatherNeighbourParticles(grid, particle_positions, cell_offsets, cell_index, neighbour_particles);
+                            gathered = true;
+                        }
+
+                        float distance = GetSimpleTextureGridDistance(test_values, cell_coords, position, neighbour_particles);
+                        voxels[((size_t)z * texture_res + y) * texture_res + x] = FloatToSnorm16(distance);
+
+                        // Positive floats order as their bits do
+                        uint32_t seed = FloodVoxelIndex(flood_res, x / NARROW_BAND_FLOOD_SCALE, y / NARROW_BAND_FLOOD_SCALE, z / NARROW_BAND_FLOOD_SCALE);
+                        uint32_t distance_bits = std::bit_cast<uint32_t>(std::abs(distance));
+                        std::atomic_ref<uint32_t> seed_distance(band.seed_distances_[seed]);
+                        uint32_t current = seed_distance.load(std::memory_order_relaxed);
+                        while (distance_bits < current && !seed_distance.compare_exchange_weak(current, distance_bits, std::memory_order_relaxed)) {}
+                    }
+                }
+            }
+        }
+    });
+}
+
+// CPU port of the CSJumpFloodMain passes: jump flooding (Rong & Tan, 2006) the nearest seed, by the distance it gives the
+// flood voxel, out over the coarse grid. Steps halve from half the grid down to 1, then one more step of 1 to fix up the
+// voxels the larger steps got wrong.
+inline void FloodNarrowBand(const TestVariables& test_values, NarrowBand& band, ThreadPool* thread_pool)
+{
+    const int flood_res = band.FloodResolution(test_values);
+    const float flood_voxel_size = (float)NARROW_BAND_FLOOD_SCALE / test_values.texture_res_;
+    const size_t flood_voxels = (size_t)flood_res * flood_res * flood_res;
+    band.flood_[0].resize(flood_voxels);
+    band.flood_[1].resize(flood_voxels);
+
+    std::vector<int> steps;
+    for (int step = std::max(flood_res / 2, 1); step >= 1; step /= 2) {
+        steps.push_back(step);
+    }
+    steps.push_back(1);
+
+    for (size_t pass = 0; pass < steps.size(); pass++) {
+        const int step = steps[pass];
+        const std::vector<uint32_t>& flood_in = band.flood_[pass % 2];
+        std::vector<uint32_t>& flood_out = band.flood_[(pass + 1) % 2];
+
+        thread_pool->ParallelFor(0, (size_t)flood_res * flood_res, 1, [&](size_t begin, size_t end) {
+            for (size_t row = begin; row < end; row++) {
+                for (int coords_x = 0; coords_x < flood_res; coords_x++) {
+                    Int3 coords = { coords_x, (int)(row % flood_res), (int)(row / flood_res) };
+                    uint32_t best_seed = NARROW_BAND_INVALID_SEED;
+                    float best_cost = NARROW_BAND_NO_SEED_DISTANCE;
+                    // The 27 neighbours a step away, as in CSJumpFloodMain, skipping those off the grid an axis at a time
+                    for (int z = coords.z - step; z <= coords.z + step; z += step) {
+                        if (z < 0 || z >= flood_res) {
+                            continue;
+                        }
+                        for (int y = coords.y - step; y <= coords.y + step; y += step) {
+                            if (y < 0 || y >= flood_res) {
+                                continue;
+                            }
+                            for (int x = coords.x - step; x <= coords.x + step; x += step) {
+                                if (x < 0 || x >= flood_res) {
+                                    continue;
+                                }
+
+                                // The first pass takes the seeds straight from the band
+                                uint32_t neighbour_index = FloodVoxelIndex(flood_res, x, y, z);
+                                uint32_t seed = flood_in[neighbour_index];
+                                if (pass == 0) {
+                                    bool is_seed = std::bit_cast<float>(band.seed_distances_[neighbour_index]) < NARROW_BAND_NO_SEED_DISTANCE;
+                                    seed = is_seed ? PackFloodSeed(x, y, z) : NARROW_BAND_INVALID_SEED;
+                                }
+                                if (seed == NARROW_BAND_INVALID_SEED) {
+                                    continue;
+                                }
+
+                                float cost = GetFloodCost(band, flood_res, flood_voxel_size, seed, coords);
+                                if (cost < best_cost) {
+                                    best_cost = cost;
+                                    best_seed = seed;
+                                }
+                            }
+                        }
+                    }
+                    flood_out[FloodVoxelIndex(flood_res, coords.x, coords.y, coords.z)] = best_seed;
+                }
+            }
+        });
+    }
+    band.flood_result_ = steps.size() % 2;
+
+    // Far field voxels all take their flood voxel's distance, so it's found once for them
+    band.flood_distances_.resize(flood_voxels);
+    thread_pool->ParallelFor(0, flood_voxels, 1024, [&](size_t begin, size_t end) {
+        for (size_t index = begin; index < end; index++) {
+            Int3 coords = { (int)(index % flood_res), (int)((index / flood_res) % flood_res), (int)(index / flood_res / flood_res) };
+            uint32_t seed = band.flood_[band.flood_result_][index];
+            band.flood_distances_[index] = seed == NARROW_BAND_INVALID_SEED ? NARROW_BAND_NO_SEED_DISTANCE : GetFloodCost(band, flood_res, flood_voxel_size, seed, coords);
+        }
+    });
+}
+
+// How far the flooded distance can be past the surface, from the seeds and voxels being at flood voxel centres rather than
+// where the band's voxels are, and those being a voxel apart
+inline float GetFloodMargin(const TestVariables& test_values)
+{
+    return std::sqrt(3.f) * (NARROW_BAND_FLOOD_SCALE + 1) / test_values.texture_res_;
+}
+
+// Far field voxel, from the flooded distance less the margin, so it's never further than the surface. It's at least the
+// band's width, as the voxel is further than that from every cell the surface can be in. Voxels in cells with particles
+// are inside the fluid, as their cell isn't a band cell, so isn't next to an empty one.
+inline float GetFarFieldDistance(const TestVariables& test_values, const NarrowBand& band, bool inside, int x, int y, int z)
+{
+    const int flood_res = band.FloodResolution(test_values);
+    float flooded = band.flood_distances_[FloodVoxelIndex(flood_res, x / NARROW_BAND_FLOOD_SCALE, y / NARROW_BAND_FLOOD_SCALE, z / NARROW_BAND_FLOOD_SCALE)];
+
+    float distance = std::max(flooded - GetFloodMargin(test_values), band.band_voxels_ / (float)test_values.texture_res_);
+    return inside ? -distance : distance;
+}
+
+// CPU port of CSTexFarFieldMain, filling the voxels FillNarrowBand left. Only the voxels of cells the band reaches are
+// checked, the rest are all far field.
+template<typename Grid>
+void FillFarField(const Grid& grid, const NarrowBand& band, std::vector<int16_t>& voxels, ThreadPool* thread_pool)
+{
+    const TestVariables& test_values = grid.GetTestValues();
+    const int texture_res = test_values.texture_res_;
+    const int cells_per_axis = test_values.cells_per_axis_;
+
+    thread_pool->ParallelFor(0, (size_t)cells_per_axis * cells_per_axis * cells_per_axis, 1, [&](size_t begin, size_t end) {
+        for (size_t cell = begin; cell < end; cell++) {
+            Int3 cell_coords = { (int)(cell % cells_per_axis), (int)((cell / cells_per_axis) % cells_per_axis), (int)(cell / cells_per_axis / cells_per_axis) };
+            uint32_t cell_index = CellCoordsToIndex(test_values, cell_coords.x, cell_coords.y, cell_coords.z);
+            bool inside = grid.GetCellCounts()[cell_index] > 0;
+            int neighbouring_cells[27];
+            grid.GetNeighbourCells(cell_index, neighbouring_cells);
+
+            for (int z = band.cell_voxels_[cell_coords.z]; z < band.cell_voxels_[cell_coords.z + 1]; z++) {
+                for (int y = band.cell_voxels_[cell_coords.y]; y < band.cell_voxels_[cell_coords.y + 1]; y++) {
+                    int16_t* row = voxels.data() + ((size_t)z * texture_res + y) * texture_res;
+                    if (band.band_cells_[cell_index] != NARROW_BAND_CELL_NONE) {
+                        for (int x = band.cell_voxels_[cell_coords.x]; x < band.cell_voxels_[cell_coords.x + 1]; x++) {
+                            if (!IsNarrowBandVoxel(test_values, band, neighbouring_cells, cell_coords, GetSimpleTextureVoxelPosition(texture_res, x, y, z))) {
+                                row[x] = FloatToSnorm16(GetFarFieldDistance(test_values, band, inside, x, y, z));
+                            }
+                        }
+                        continue;
+                    }
+
+                    // No band voxels, so the voxels within each flood voxel all take the same distance
+                    for (int x = band.cell_voxels_[cell_coords.x]; x < band.cell_voxels_[cell_coords.x + 1];) {
+                        int run_end = std::min((x / NARROW_BAND_FLOOD_SCALE + 1) * NARROW_BAND_FLOOD_SCALE, band.cell_voxels_[cell_coords.x + 1]);
+                        std::fill(row + x, row + run_end, FloatToSnorm16(GetFarFieldDistance(test_values, band, inside, x, y, z)));
+                        x = run_end;
+                    }
+                }
+            }
+        }
+    });
+}
+
+}
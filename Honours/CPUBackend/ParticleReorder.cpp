@@ -0,0 +1,65 @@
+#include "ParticleReorder.h"
+
+namespace CPUBackend {
+
+// Cells per chunk of the scan, large enough that the sequential pass over the chunk totals is negligible
+#define SCAN_GRAIN_SIZE 16384
+#define REORDER_GRAIN_SIZE 1024
+
+void ComputeCellOffsets(const std::vector<uint32_t>& cell_counts, std::vector<uint32_t>& cell_offsets, ThreadPool* thread_pool)
+{
+    const size_t count = cell_counts.size();
+    cell_offsets.resize(count);
+
+    // Reduce each chunk
+    const size_t chunk_count = (count + SCAN_GRAIN_SIZE - 1) / SCAN_GRAIN_SIZE;
+    std::vector<uint32_t> chunk_offsets(chunk_count);
+    thread_pool->ParallelFor(0, chunk_count, 1, [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; chunk++) {
+            size_t last = std::min((chunk + 1) * SCAN_GRAIN_SIZE, count);
+            uint32_t sum = 0;
+            for (size_t i = chunk * SCAN_GRAIN_SIZE; i < last; i++) {
+                sum += cell_counts[i];
+            }
+            chunk_offsets[chunk] = sum;
+        }
+    });
+
+    // Scan the chunk totals
+    uint32_t running_total = 0;
+    for (uint32_t& chunk_offset : chunk_offsets) {
+        uint32_t sum = chunk_offset;
+        chunk_offset = running_total;
+        running_total += sum;
+    }
+
+    // Scan within each chunk, starting from its offset
+    thread_pool->ParallelFor(0, chunk_count, 1, [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; chunk++) {
+            size_t last = std::min((chunk + 1) * SCAN_GRAIN_SIZE, count);
+            uint32_t offset = chunk_offsets[chunk];
+            for (size_t i = chunk * SCAN_GRAIN_SIZE; i < last; i++) {
+                cell_offsets[i] = offset;
+                offset += cell_counts[i];
+            }
+        }
+    });
+}
+
+void ReorderParticles(const std::vector<ParticleData>& particles_unordered, const std::vector<uint32_t>& cell_offsets,
+    std::vector<ParticleData>& particles_ordered, ThreadPool* thread_pool)
+{
+    particles_ordered.resize(particles_unordered.size());
+
+    thread_pool->ParallelFor(0, particles_unordered.size(), REORDER_GRAIN_SIZE, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const ParticleData& particle_data = particles_unordered[i];
+
+            // Calculate new index from global and intra-cell offsets. Copy the data to the new address in the sorted buffer.
+            uint32_t new_index = cell_offsets[particle_data.cell_index_] + particle_data.intra_cell_index_;
+            particles_ordered[new_index] = particle_data;
+        }
+    });
+}
+
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <vector>
+#include "CPUStructs.h"
+#include "ThreadPool.h"
+
+namespace CPUBackend {
+
+// CPU ports of the cell count prefix scan (ChainedScanDecoupledLookback) and CSReorderParticlesMain.
+// Both work on any cell indexing, as long as particle.cell_index_ indexes the counts array.
+
+// Exclusive prefix sum of the per-cell particle counts, giving each cell's offset into the sorted particle buffer
+void ComputeCellOffsets(const std::vector<uint32_t>& cell_counts, std::vector<uint32_t>& cell_offsets, ThreadPool* thread_pool);
+
+// Scatters each particle to its cell's offset plus its intra-cell index
+void ReorderParticles(const std::vector<ParticleData>& particles_unordered, const std::vector<uint32_t>& cell_offsets,
+    std::vector<ParticleData>& particles_ordered, ThreadPool* thread_pool);
+
+}
@@ -0,0 +1,134 @@
+#include "ParticleScenes.h"
+
+namespace CPUBackend {
+
+// From https://stackoverflow.com/a/10625698
+static float Random(float px, float py)
+{
+    const float k1x = 23.14069263277926f; // e^pi (Gelfond's constant)
+    const float k1y = 2.665144142690225f; // 2^sqrt(2) (Gelfond-Schneider constant)
+    return Frac(std::cos(px * k1x + py * k1y) * 12345.6789f);
+}
+
+// Gets the coords within a grid of variable size given an index
+static Float3 IndexTo3DCoords(uint32_t index, uint32_t per_axis)
+{
+    uint32_t per_z = per_axis * per_axis;
+    return { (float)(index % per_axis), (float)((index % per_z) / per_axis), (float)(index / per_z) };
+}
+
+// Number of particles per axis when packing particle_count into a cube.
+// Nudged before truncating so perfect cubes (343 etc.) aren't rounded down.
+static int ParticlesPerAxis(uint32_t particle_count)
+{
+    return std::max((int)(std::cbrt((double)particle_count) + 1e-4), 1);
+}
+
+static ParticleData GenerateParticle(const TestVariables& test_values, uint32_t index)
+{
+    const SceneType scene = test_values.scene_;
+    const uint32_t particle_count = test_values.num_particles_;
+    const float radius = test_values.particle_radius_;
+    ParticleData particle = {};
+
+    if (scene == SceneRandom) { // Generate particles randomly
+        float seed_x = (float)index;
+        float seed_y = (float)index;
+
+        particle.position_.x = Random(seed_x, seed_y);
+        seed_x += particle.position_.x;
+
+        particle.position_.y = Random(seed_x, seed_y);
+        seed_y += particle.position_.y;
+
+        particle.position_.z = Random(seed_x, seed_y);
+        seed_x += particle.position_.z;
+
+        particle.start_pos_ = particle.position_;
+        particle.speed_ = Random(seed_x, seed_y) * 4;
+    }
+    else if (scene == SceneGrid) { // Place particles in a grid, tightly packed so each particle is touching its neighbours
+        int particles_per_axis = ParticlesPerAxis(particle_count);
+
+        float lower = radius + 0.01f;
+        float up = std::min((std::max(particles_per_axis - 1, 1) * radius * 2) + radius, 0.99f - radius);
+
+        // Centre everything
+        float centring = (0.99f - radius - up) / 2;
+        Float3 lower3 = { lower + centring, lower + centring, lower + centring };
+        Float3 upper3 = { up + centring, up + centring, up + centring };
+
+        particle.position_ = Lerp(lower3, upper3, IndexTo3DCoords(index, particles_per_axis) / (float)std::max(particles_per_axis - 1, 1));
+        particle.start_pos_ = particle.position_;
+        particle.speed_ = 0;
+    }
+    else if (scene == SceneWave) { // Same as above but squish the height-wise and make some of the particles faster than the rest
+        int particles_per_axis = ParticlesPerAxis(particle_count);
+
+        float lower = radius + 0.01f;
+        float up = std::min(((particles_per_axis - 1) * radius * 2) + radius, 0.99f - radius);
+
+        // Centre everything horizontally
+        float centring = (0.99f - radius - up) / 2;
+        Float3 lower3 = { lower + centring, lower, lower + centring };
+        Float3 upper3 = { up + centring, 0.3f, up + centring };
+
+        particle.position_ = Lerp(lower3, upper3, IndexTo3DCoords(index, particles_per_axis) / (float)std::max(particles_per_axis - 1, 1));
+        particle.start_pos_ = particle.position_;
+
+        particle.speed_ = 1;
+        if (Random((float)index, particle.position_.z) > 0.95f) { // 5% chance to be speedy
+            particle.speed_ = 3;
+        }
+    }
+    else if (scene == SceneNormals) { // The first 10 particles are put in a sine wave shape, the rest are put in the corner
+        if (index > 9) {
+            particle.position_ = { 0.1f, 0.1f, 0.1f };
+        }
+        else {
+            float upper = std::min((10 - 1) * radius * 2, 0.99f - radius);
+            particle.position_ = { upper * ((float)index / 10) + radius + 0.01f, 0.1f * std::sin(5 * (float)index / 10) + 0.5f, 0.5f };
+        }
+
+        particle.start_pos_ = particle.position_;
+        particle.speed_ = 0;
+    }
+
+    return particle;
+}
+
+void GenerateParticles(const TestVariables& test_values, std::vector<ParticleData>& particles, ThreadPool* thread_pool)
+{
+    particles.resize(test_values.num_particles_);
+
+    thread_pool->ParallelFor(0, particles.size(), 1024, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            particles[i] = GenerateParticle(test_values, (uint32_t)i);
+        }
+    });
+}
+
+void ComputePositions(const TestVariables& test_values, float time, std::vector<ParticleData>& particles, ThreadPool* thread_pool)
+{
+    const SceneType scene = test_values.scene_;
+
+    thread_pool->ParallelFor(0, particles.size(), 1024, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            ParticleData& particle = particles[i];
+            float index = (float)i;
+
+            if (scene == SceneRandom) { // Animate particles by moving them back and forth along a random vector
+                Float3 direction = Normalize({ Random(index, particle.speed_) - 0.5f, Random(index, particle.start_pos_.z) - 0.5f, Random(index, particle.start_pos_.y) - 0.5f });
+                particle.position_ = particle.start_pos_ + direction * 0.2f * std::sin(particle.speed_ * time);
+            }
+            else if (scene == SceneWave) { // Animate particles by moving them up and down in a sine wave according to the x position
+                particle.position_.y = particle.start_pos_.y + 0.1f * std::sin(5 * particle.position_.x + 2 * time * particle.speed_);
+            }
+
+            // Clamp to within the bounds
+            particle.position_ = Clamp(particle.position_, 0.1f, 0.9f);
+        }
+    });
+}
+
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <vector>
+#include "CPUStructs.h"
+#include "ThreadPool.h"
+
+namespace CPUBackend {
+
+// CPU ports of CSParticleGen and CSPosMain in ComputePositions.hlsl, so the headless tools see the same scenes
+
+// Generate test_values.num_particles_ particles for test_values.scene_
+void GenerateParticles(const TestVariables& test_values, std::vector<ParticleData>& particles, ThreadPool* thread_pool);
+
+// Animate particles to the given time, then clamp them to within the bounds
+void ComputePositions(const TestVariables& test_values, float time, std::vector<ParticleData>& particles, ThreadPool* thread_pool);
+
+}
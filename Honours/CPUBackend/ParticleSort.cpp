@@ -0,0 +1,228 @@
+#include "ParticleSort.h"
+#include "GridCommon.h"
+#include "ParticleReorder.h"
+#include <bit>
+
+namespace CPUBackend {
+
+// Smallest number of particles worth giving a chunk of its own
+#define SORT_MIN_CHUNK_SIZE 4096
+#define SORT_GRAIN_SIZE 16384
+#define RADIX_BITS 8
+#define RADIX_DIGITS (1 << RADIX_BITS)
+
+ParticleSorter::ParticleSorter(ThreadPool* thread_pool, const TestVariables& test_values) :
+    test_values_(test_values),
+    thread_pool_(thread_pool)
+{
+    cell_counts_.resize(test_values_.num_cells_);
+    cell_offsets_.resize(test_values_.num_cells_);
+}
+
+void ParticleSorter::Sort(const std::vector<ParticleData>& particles_unordered, std::vector<ParticleData>& particles_ordered, SortAlgorithm algorithm)
+{
+    const size_t count = particles_unordered.size();
+    particles_ordered.resize(count);
+
+    // Chunks depend only on the thread count, the result doesn't depend on them at all
+    chunk_count_ = std::max<size_t>(std::min<size_t>(thread_pool_->GetThreadCount(), count / SORT_MIN_CHUNK_SIZE), 1);
+    chunk_size_ = (count + chunk_count_ - 1) / chunk_count_;
+
+    ComputeKeys(particles_unordered);
+
+    if (algorithm == SortRadix) {
+        RadixSort(particles_unordered, particles_ordered);
+    }
+    else {
+        CountingSort(particles_unordered, particles_ordered);
+    }
+}
+
+// Finds the cell containing each particle, as CSGridMain does
+void ParticleSorter::ComputeKeys(const std::vector<ParticleData>& particles)
+{
+    keys_.resize(particles.size());
+
+    thread_pool_->ParallelFor(0, particles.size(), SORT_GRAIN_SIZE, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            keys_[i] = GetCellIndex(test_values_, particles[i].position_);
+        }
+    });
+}
+
+void ParticleSorter::CountingSort(const std::vector<ParticleData>& particles_unordered, std::vector<ParticleData>& particles_ordered)
+{
+    const size_t count = particles_unordered.size();
+    const size_t num_cells = cell_counts_.size();
+    chunk_cell_offsets_.resize(chunk_count_ * num_cells);
+
+    // Count the particles of each chunk in each cell
+    thread_pool_->ParallelFor(0, chunk_count_, 1, [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; chunk++) {
+            uint32_t* histogram = chunk_cell_offsets_.data() + chunk * num_cells;
+            std::fill(histogram, histogram + num_cells, 0);
+
+            size_t last = std::min((chunk + 1) * chunk_size_, count);
+            for (size_t i = chunk * chunk_size_; i < last; i++) {
+                histogram[keys_[i]]++;
+            }
+        }
+    });
+
+    // Sum the histograms into the cell counts, and scan them into the cell offsets
+    thread_pool_->ParallelFor(0, num_cells, SORT_GRAIN_SIZE, [&](size_t begin, size_t end) {
+        for (size_t cell = begin; cell < end; cell++) {
+            uint32_t cell_count = 0;
+            for (size_t chunk = 0; chunk < chunk_count_; chunk++) {
+                cell_count += chunk_cell_offsets_[chunk * num_cells + cell];
+            }
+            cell_counts_[cell] = cell_count;
+        }
+    });
+    ComputeCellOffsets(cell_counts_, cell_offsets_, thread_pool_);
+
+    // Within a cell, each chunk writes after the chunks before it
+    thread_pool_->ParallelFor(0, num_cells, SORT_GRAIN_SIZE, [&](size_t begin, size_t end) {
+        for (size_t cell = begin; cell < end; cell++) {
+            uint32_t offset = cell_offsets_[cell];
+            for (size_t chunk = 0; chunk < chunk_count_; chunk++) {
+                uint32_t& chunk_offset = chunk_cell_offsets_[chunk * num_cells + cell];
+                uint32_t chunk_cell_count = chunk_offset;
+                chunk_offset = offset;
+                offset += chunk_cell_count;
+            }
+        }
+    });
+
+    // Scatter each chunk in order
+    thread_pool_->ParallelFor(0, chunk_count_, 1, [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; chunk++) {
+            uint32_t* offsets = chunk_cell_offsets_.data() + chunk * num_cells;
+
+            size_t last = std::min((chunk + 1) * chunk_size_, count);
+            for (size_t i = chunk * chunk_size_; i < last; i++) {
+                uint32_t cell_index = keys_[i];
+                uint32_t new_index = offsets[cell_index]++;
+
+                ParticleData& particle_data = particles_ordered[new_index];
+                particle_data = particles_unordered[i];
+                particle_data.cell_index_ = cell_index;
+                particle_data.intra_cell_index_ = new_index - cell_offsets_[cell_index];
+            }
+        }
+    });
+}
+
+void ParticleSorter::RadixSort(const std::vector<ParticleData>& particles_unordered, std::vector<ParticleData>& particles_ordered)
+{
+    const size_t count = particles_unordered.size();
+    const size_t num_cells = cell_counts_.size();
+    const int passes = (std::max<int>(std::bit_width((uint32_t)num_cells - 1), 1) + RADIX_BITS - 1) / RADIX_BITS;
+
+    for (int b = 0; b < 2; b++) {
+        sorted_keys_[b].resize(count);
+        sorted_indices_[b].resize(count);
+    }
+    digit_offsets_.resize(chunk_count_ * RADIX_DIGITS);
+
+    thread_pool_->ParallelFor(0, count, SORT_GRAIN_SIZE, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            sorted_keys_[0][i] = keys_[i];
+            sorted_indices_[0][i] = (uint32_t)i;
+        }
+    });
+
+    int src = 0;
+    for (int pass = 0; pass < passes; pass++) {
+        const int shift = pass * RADIX_BITS;
+        const uint32_t* src_keys = sorted_keys_[src].data();
+        const uint32_t* src_indices = sorted_indices_[src].data();
+        uint32_t* dst_keys = sorted_keys_[src ^ 1].data();
+        uint32_t* dst_indices = sorted_indices_[src ^ 1].data();
+
+        // Count each chunk's digits
+        thread_pool_->ParallelFor(0, chunk_count_, 1, [&](size_t begin, size_t end) {
+            for (size_t chunk = begin; chunk < end; chunk++) {
+                uint32_t* histogram = digit_offsets_.data() + chunk * RADIX_DIGITS;
+                std::fill(histogram, histogram + RADIX_DIGITS, 0);
+
+                size_t last = std::min((chunk + 1) * chunk_size_, count);
+                for (size_t i = chunk * chunk_size_; i < last; i++) {
+                    histogram[(src_keys[i] >> shift) & (RADIX_DIGITS - 1)]++;
+                }
+            }
+        });
+
+        // Scan digit-major, so within a digit each chunk writes after the chunks before it
+        uint32_t offset = 0;
+        for (size_t digit = 0; digit < RADIX_DIGITS; digit++) {
+            for (size_t chunk = 0; chunk < chunk_count_; chunk++) {
+                uint32_t& digit_offset = digit_offsets_[chunk * RADIX_DIGITS + digit];
+                uint32_t digit_count = digit_offset;
+                digit_offset = offset;
+                offset += digit_count;
+            }
+        }
+
+        thread_pool_->ParallelFor(0, chunk_count_, 1, [&](size_t begin, size_t end) {
+            for (size_t chunk = begin; chunk < end; chunk++) {
+                uint32_t* offsets = digit_offsets_.data() + chunk * RADIX_DIGITS;
+
+                size_t last = std::min((chunk + 1) * chunk_size_, count);
+                for (size_t i = chunk * chunk_size_; i < last; i++) {
+                    uint32_t new_index = offsets[(src_keys[i] >> shift) & (RADIX_DIGITS - 1)]++;
+                    dst_keys[new_index] = src_keys[i];
+                    dst_indices[new_index] = src_indices[i];
+                }
+            }
+        });
+
+        src ^= 1;
+    }
+
+    const std::vector<uint32_t>& sorted_keys = sorted_keys_[src];
+    const std::vector<uint32_t>& sorted_indices = sorted_indices_[src];
+
+    // A cell's offset is the position of the first key at or above its index
+    thread_pool_->ParallelFor(0, count, SORT_GRAIN_SIZE, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            uint32_t first_cell = i == 0 ? 0 : sorted_keys[i - 1] + 1;
+            for (uint32_t cell = first_cell; cell <= sorted_keys[i]; cell++) {
+                cell_offsets_[cell] = (uint32_t)i;
+            }
+        }
+    });
+    for (size_t cell = count == 0 ? 0 : sorted_keys[count - 1] + 1; cell < num_cells; cell++) {
+        cell_offsets_[cell] = (uint32_t)count;
+    }
+
+    thread_pool_->ParallelFor(0, num_cells, SORT_GRAIN_SIZE, [&](size_t begin, size_t end) {
+        for (size_t cell = begin; cell < end; cell++) {
+            uint32_t next_offset = cell + 1 < num_cells ? cell_offsets_[cell + 1] : (uint32_t)count;
+            cell_counts_[cell] = next_offset - cell_offsets_[cell];
+        }
+    });
+
+    // Gather the particles into their sorted order
+    thread_pool_->ParallelFor(0, count, SORT_GRAIN_SIZE, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            uint32_t cell_index = sorted_keys[i];
+
+            ParticleData& particle_data = particles_ordered[i];
+            particle_data = particles_unordered[sorted_indices[i]];
+            particle_data.cell_index_ = cell_index;
+            particle_data.intra_cell_index_ = (uint32_t)i - cell_offsets_[cell_index];
+        }
+    });
+}
+
+size_t ParticleSorter::GetMemoryFootprint() const
+{
+    size_t words = keys_.size() + cell_counts_.size() + cell_offsets_.size() + chunk_cell_offsets_.size() + digit_offsets_.size();
+    for (int b = 0; b < 2; b++) {
+        words += sorted_keys_[b].size() + sorted_indices_[b].size();
+    }
+    return words * sizeof(uint32_t);
+}
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include "CPUStructs.h"
+#include "ThreadPool.h"
+
+namespace CPUBackend {
+
+enum SortAlgorithm {
+    SortCounting = 0,   // One pass counting sort over all cells, with per-chunk histograms
+    SortRadix           // LSD radix sort of (cell index, particle index) pairs, 8 bits per pass
+};
+
+// Standalone replacement for the grid build's intra-cell indices, the cell offset scan and CSReorderParticlesMain.
+// Particles are sorted by the cell containing them, producing the same ordered particle buffer and cell offset table
+// as SortParticleData, but stable: particles in a cell keep their original relative order, so the output is the same
+// on every run and for any thread count.
+//
+// The particles are split into one chunk per thread. Each chunk's cell histogram is turned into per-chunk write
+// offsets for every cell, then each chunk is scattered in order, which is what keeps the sort stable.
+class ParticleSorter
+{
+public:
+    ParticleSorter(ThreadPool* thread_pool, const TestVariables& test_values);
+
+    // Sorts particles by the cell containing their position. The ordered particles have their cell_index_ and
+    // intra_cell_index_ filled in, as after CSGridMain.
+    void Sort(const std::vector<ParticleData>& particles_unordered, std::vector<ParticleData>& particles_ordered, SortAlgorithm algorithm);
+
+    inline const std::vector<uint32_t>& GetCellCounts() const { return cell_counts_; }
+    inline const std::vector<uint32_t>& GetCellOffsets() const { return cell_offsets_; }
+
+    // Bytes held by the sorter's buffers
+    size_t GetMemoryFootprint() const;
+
+private:
+    void ComputeKeys(const std::vector<ParticleData>& particles);
+    void CountingSort(const std::vector<ParticleData>& particles_unordered, std::vector<ParticleData>& particles_ordered);
+    void RadixSort(const std::vector<ParticleData>& particles_unordered, std::vector<ParticleData>& particles_ordered);
+
+    size_t chunk_count_ = 0;
+    size_t chunk_size_ = 0;
+
+    std::vector<uint32_t> keys_;
+    std::vector<uint32_t> cell_counts_;
+    std::vector<uint32_t> cell_offsets_;
+
+    // Counting sort, chunk_count_ histograms of every cell
+    std::vector<uint32_t> chunk_cell_offsets_;
+
+    // Radix sort, double buffered pairs and chunk_count_ histograms of each digit
+    std::vector<uint32_t> sorted_keys_[2];
+    std::vector<uint32_t> sorted_indices_[2];
+    std::vector<uint32_t> digit_offsets_;
+
+    TestVariables test_values_;
+    ThreadPool* thread_pool_;
+};
+
+}
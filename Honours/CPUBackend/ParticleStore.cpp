@@ -0,0 +1,63 @@
+#include "ParticleStore.h"
+#include "GridCommon.h"
+
+namespace CPUBackend {
+
+#define REORDER_GRAIN_SIZE 1024
+
+size_t ParticleStore::GetMemoryFootprint() const
+{
+    return positions_.size() * sizeof(Float3) + start_positions_.size() * sizeof(Float3) + speeds_.size() * sizeof(float) +
+        (cell_indices_.size() + intra_cell_indices_.size()) * sizeof(uint32_t) + quantised_positions_.size() * sizeof(QuantisedPosition);
+}
+
+QuantisedPosition QuantisePosition(const TestVariables& test_values, const Float3& position, uint32_t cell_index)
+{
+    UInt3 cell_coords = CellIndexTo3DCoords(test_values, cell_index);
+    const float cells_per_axis = (float)test_values.cells_per_axis_;
+
+    auto quantise = [&](float coord, uint32_t cell_coord) {
+        float within_cell = coord * cells_per_axis - (float)cell_coord;
+        return (uint16_t)std::lround(std::clamp(within_cell, 0.f, 1.f) * 65535.f);
+    };
+    return { quantise(position.x, cell_coords.x), quantise(position.y, cell_coords.y), quantise(position.z, cell_coords.z) };
+}
+
+void ReorderParticlesSoA(const TestVariables& test_values, const std::vector<ParticleData>& particles_unordered, const std::vector<uint32_t>& cell_offsets,
+    uint32_t streams, ParticleStore& particles_ordered, ThreadPool* thread_pool)
+{
+    const size_t count = particles_unordered.size();
+    particles_ordered.streams_ = streams;
+    particles_ordered.count_ = count;
+    particles_ordered.positions_.resize(streams & ParticleStreamPositions ? count : 0);
+    particles_ordered.start_positions_.resize(streams & ParticleStreamSimulation ? count : 0);
+    particles_ordered.speeds_.resize(streams & ParticleStreamSimulation ? count : 0);
+    particles_ordered.cell_indices_.resize(streams & ParticleStreamGrid ? count : 0);
+    particles_ordered.intra_cell_indices_.resize(streams & ParticleStreamGrid ? count : 0);
+    particles_ordered.quantised_positions_.resize(streams & ParticleStreamQuantisedPositions ? count : 0);
+
+    thread_pool->ParallelFor(0, count, REORDER_GRAIN_SIZE, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const ParticleData& particle_data = particles_unordered[i];
+
+            // Calculate new index from global and intra-cell offsets, and copy each requested stream's fields there
+            uint32_t new_index = cell_offsets[particle_data.cell_index_] + particle_data.intra_cell_index_;
+            if (streams & ParticleStreamPositions) {
+                particles_ordered.positions_[new_index] = particle_data.position_;
+            }
+            if (streams & ParticleStreamSimulation) {
+                particles_ordered.start_positions_[new_index] = particle_data.start_pos_;
+                particles_ordered.speeds_[new_index] = particle_data.speed_;
+            }
+            if (streams & ParticleStreamGrid) {
+                particles_ordered.cell_indices_[new_index] = particle_data.cell_index_;
+                particles_ordered.intra_cell_indices_[new_index] = particle_data.intra_cell_index_;
+            }
+            if (streams & ParticleStreamQuantisedPositions) {
+                particles_ordered.quantised_positions_[new_index] = QuantisePosition(test_values, particle_data.position_, particle_data.cell_index_);
+            }
+        }
+    });
+}
+
+}
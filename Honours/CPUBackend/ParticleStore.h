@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include "CPUStructs.h"
+#include "ThreadPool.h"
+
+namespace CPUBackend {
+
+// Position within the particle's cell, in 1/65535ths of the cell size on each axis
+struct QuantisedPosition {
+    uint16_t x, y, z;
+};
+static_assert(sizeof(QuantisedPosition) == 6, "QuantisedPosition must be tightly packed");
+
+// Streams of the structure-of-arrays particle store
+enum ParticleStreams {
+    ParticleStreamPositions = 1 << 0,           // position_
+    ParticleStreamSimulation = 1 << 1,          // start_pos_, speed_
+    ParticleStreamGrid = 1 << 2,                // cell_index_, intra_cell_index_
+    ParticleStreamQuantisedPositions = 1 << 3,  // position_ relative to the cell, 16 bits per axis
+    ParticleStreamAll = ParticleStreamPositions | ParticleStreamSimulation | ParticleStreamGrid
+};
+
+// Structure-of-arrays particle storage. The brick pool only reads positions, which are 12 of ParticleData's 36 bytes,
+// so keeping each group of fields in its own stream means every cache line fetched holds only data that is used.
+// Only the requested streams are filled, and the rest are left empty.
+struct ParticleStore {
+    std::vector<Float3> positions_;
+
+    std::vector<Float3> start_positions_;
+    std::vector<float> speeds_;
+
+    std::vector<uint32_t> cell_indices_;
+    std::vector<uint32_t> intra_cell_indices_;
+
+    std::vector<QuantisedPosition> quantised_positions_;
+
+    uint32_t streams_ = 0;
+    size_t count_ = 0;
+
+    // Bytes held by the filled streams
+    size_t GetMemoryFootprint() const;
+};
+
+// As ReorderParticles, scattering the particles to their cell's offset plus their intra-cell index, but into the
+// requested streams of the SoA store. Quantised positions need the cell indexing from test_values to find each cell's origin.
+void ReorderParticlesSoA(const TestVariables& test_values, const std::vector<ParticleData>& particles_unordered, const std::vector<uint32_t>& cell_offsets,
+    uint32_t streams, ParticleStore& particles_ordered, ThreadPool* thread_pool);
+
+// Cell-relative quantisation, exact to within half a step of 1/65535th of a cell
+QuantisedPosition QuantisePosition(const TestVariables& test_values, const Float3& position, uint32_t cell_index);
+
+// Brick pool position sources (see ParticleDataPositionSource in BrickPool.h)
+
+// Reads the position stream
+struct SoAPositionSource {
+    const std::vector<Float3>& positions_;
+
+    inline void BeginBrick(const TestVariables&, const Int3&) {}
+    inline Float3 operator()(int, uint32_t particle_index) const { return positions_[particle_index]; }
+};
+
+// Reads the quantised position stream, offsetting by the origins of the brick's 27 neighbouring cells
+struct QuantisedPositionSource {
+    const std::vector<QuantisedPosition>& quantised_positions_;
+    Float3 cell_origins_[27] = {};
+    float step_ = 0;
+
+    inline void BeginBrick(const TestVariables& test_values, const Int3& cell_coords)
+    {
+        const float cell_size = 1.f / test_values.cells_per_axis_;
+        step_ = cell_size / 65535.f;
+        for (int z = 0; z < 3; z++) {
+            for (int y = 0; y < 3; y++) {
+                for (int x = 0; x < 3; x++) {
+                    cell_origins_[(z * 9) + (y * 3) + x] = Float3{ (float)(cell_coords.x + x - 1), (float)(cell_coords.y + y - 1), (float)(cell_coords.z + z - 1) } * cell_size;
+                }
+            }
+        }
+    }
+
+    inline Float3 operator()(int neighbour, uint32_t particle_index) const
+    {
+        const QuantisedPosition& quantised = quantised_positions_[particle_index];
+        return cell_origins_[neighbour] + Float3{ (float)quantised.x, (float)quantised.y, (float)quantised.z } * step_;
+    }
+};
+
+}
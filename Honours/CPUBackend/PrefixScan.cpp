@@ -0,0 +1,120 @@
+#include "PrefixScan.h"
+#include <algorithm>
+#include <atomic>
+#include "CpuFeatures.h"
+
+namespace CPUBackend {
+
+// Elements per partition, sized so a partition's input and output stay in L2 between the local scan and the fix-up
+#define SCAN_PARTITION_SIZE 8192
+
+// Partition state flags, as in the GPU lookback
+#define FLAG_NOT_READY 0ull
+#define FLAG_REDUCTION 1ull
+#define FLAG_INCLUSIVE 2ull
+
+PrefixScan::PrefixScan(ThreadPool* thread_pool, ScanVariant variant) :
+    variant_(variant),
+    thread_pool_(thread_pool)
+{
+    if (variant_ == ScanAvx2 && !HasAvx2()) {
+        variant_ = ScanScalar;
+    }
+}
+
+bool PrefixScan::HasAvx2()
+{
+    static const bool has_avx2 = HasExclusiveScanAvx2() && CpuSupportsFeature(CpuFeatureAvx2);
+    return has_avx2;
+}
+
+void PrefixScan::UpdateSize(uint32_t size)
+{
+    if (scan_in_.size() != size) {
+        scan_in_.resize(size);
+        scan_out_.resize(size);
+        partition_states_.resize((size + SCAN_PARTITION_SIZE - 1) / SCAN_PARTITION_SIZE);
+    }
+}
+
+void PrefixScan::DispatchScan()
+{
+    switch (variant_) {
+    case ScanScalar:
+        ExclusiveScanScalar(scan_in_.data(), scan_out_.data(), scan_in_.size(), 0);
+        break;
+    case ScanAvx2:
+        ExclusiveScanAvx2(scan_in_.data(), scan_out_.data(), scan_in_.size(), 0);
+        break;
+    case ScanDecoupledLookback:
+        DispatchDecoupledLookback();
+        break;
+    }
+}
+
+void PrefixScan::DispatchDecoupledLookback()
+{
+    const size_t size = scan_in_.size();
+    const size_t partitions = partition_states_.size();
+    std::fill(partition_states_.begin(), partition_states_.end(), FLAG_NOT_READY << 32);
+    partition_counter_ = 0;
+
+    // One task per participant, each taking partitions until there are none left
+    thread_pool_->ParallelFor(0, std::min<size_t>(thread_pool_->GetThreadCount(), partitions), 1, [&](size_t begin, size_t end) {
+        for (size_t task = begin; task < end; task++) {
+            while (true) {
+                // Partitions are taken in order, so every partition before this one is already being worked on
+                size_t partition = std::atomic_ref<uint32_t>(partition_counter_).fetch_add(1, std::memory_order_relaxed);
+                if (partition >= partitions) {
+                    break;
+                }
+
+                size_t first = partition * SCAN_PARTITION_SIZE;
+                size_t count = std::min<size_t>(SCAN_PARTITION_SIZE, size - first);
+                uint32_t* out = scan_out_.data() + first;
+                uint32_t reduction = HasAvx2() ? ExclusiveScanAvx2(scan_in_.data() + first, out, count, 0) :
+                    ExclusiveScanScalar(scan_in_.data() + first, out, count, 0);
+
+                // Publish the reduction so later partitions can carry on looking back past this one
+                std::atomic_ref<uint64_t> state(partition_states_[partition]);
+                state.store(((partition == 0 ? FLAG_INCLUSIVE : FLAG_REDUCTION) << 32) | reduction, std::memory_order_release);
+
+                // Look back until reaching an inclusive prefix
+                uint32_t prefix = 0;
+                for (size_t lookback = partition; lookback > 0; lookback--) {
+                    std::atomic_ref<uint64_t> previous_state(partition_states_[lookback - 1]);
+                    uint64_t previous = previous_state.load(std::memory_order_acquire);
+                    while ((previous >> 32) == FLAG_NOT_READY) {
+                        std::this_thread::yield();
+                        previous = previous_state.load(std::memory_order_acquire);
+                    }
+
+                    prefix += (uint32_t)previous;
+                    if ((previous >> 32) == FLAG_INCLUSIVE) {
+                        break;
+                    }
+                }
+
+                if (partition > 0) {
+                    state.store((FLAG_INCLUSIVE << 32) | (uint32_t)(prefix + reduction), std::memory_order_release);
+                    for (size_t i = 0; i < count; i++) {
+                        out[i] += prefix;
+                    }
+                }
+            }
+        }
+    });
+}
+
+uint32_t ExclusiveScanScalar(const uint32_t* in, uint32_t* out, size_t count, uint32_t initial)
+{
+    uint32_t sum = initial;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t value = in[i];
+        out[i] = sum;
+        sum += value;
+    }
+    return sum;
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "ThreadPool.h"
+
+namespace CPUBackend {
+
+enum ScanVariant {
+    ScanScalar = 0,             // Serial reference
+    ScanAvx2,                   // Serial, scanning 8 elements at a time in registers
+    ScanDecoupledLookback       // Multithreaded chained scan with decoupled lookback
+};
+
+// CPU version of GPUPrefixSums' ChainedScanDecoupledLookback, with the same exclusive scan contract:
+// UpdateSize, fill GetScanInBuffer, DispatchScan, then read GetScanOutBuffer.
+//
+// The decoupled lookback variant splits the input into partitions, handed out in order from an atomic counter as on the GPU.
+// Each worker scans its partition locally and publishes the partition's reduction, then walks back over the preceding
+// partitions' published values until it reaches one with an inclusive prefix. This needs a single pass over the input,
+// with no barrier between reducing and scanning. The local scans use the AVX2 path when it's built
+// (HONOURS_CPU_AVX2 in CMakeLists.txt) and the CPU supports it.
+class PrefixScan
+{
+public:
+    PrefixScan(ThreadPool* thread_pool, ScanVariant variant);
+
+    // Resizes the buffers, if the size has changed
+    void UpdateSize(uint32_t size);
+
+    // Exclusive prefix sum of the scan in buffer into the scan out buffer
+    void DispatchScan();
+
+    inline std::vector<uint32_t>& GetScanInBuffer() { return scan_in_; }
+    inline const std::vector<uint32_t>& GetScanOutBuffer() const { return scan_out_; }
+
+    inline ScanVariant GetVariant() const { return variant_; }
+    // Whether the AVX2 scan was built and the CPU supports it
+    static bool HasAvx2();
+
+private:
+    void DispatchDecoupledLookback();
+
+    std::vector<uint32_t> scan_in_;
+    std::vector<uint32_t> scan_out_;
+
+    // Per partition, the flag in the top 32 bits and the reduction or inclusive prefix in the bottom 32 bits
+    std::vector<uint64_t> partition_states_;
+    uint32_t partition_counter_ = 0;
+
+    ScanVariant variant_;
+    ThreadPool* thread_pool_;
+};
+
+// Exclusive scans of count elements starting from initial, returning the total. The AVX2 scan is in its own translation
+// unit built with AVX2 enabled (see CMakeLists.txt), and must only be called when PrefixScan::HasAvx2().
+uint32_t ExclusiveScanScalar(const uint32_t* in, uint32_t* out, size_t count, uint32_t initial);
+uint32_t ExclusiveScanAvx2(const uint32_t* in, uint32_t* out, size_t count, uint32_t initial);
+bool HasExclusiveScanAvx2(); // Whether the AVX2 scan was built, not whether the CPU supports it
+
+}
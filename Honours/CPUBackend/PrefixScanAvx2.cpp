@@ -0,0 +1,44 @@
+#include "PrefixScan.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace CPUBackend {
+
+bool HasExclusiveScanAvx2()
+{
+#if defined(__AVX2__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint32_t ExclusiveScanAvx2(const uint32_t* in, uint32_t* out, size_t count, uint32_t initial)
+{
+#if defined(__AVX2__)
+    __m256i carry = _mm256_set1_epi32((int)initial);
+    const __m256i last_lane = _mm256_set1_epi32(7);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i values = _mm256_loadu_si256((const __m256i*)(in + i));
+
+        // Inclusive scan within each 128-bit half, then add the low half's total to the high half
+        __m256i scan = _mm256_add_epi32(values, _mm256_slli_si256(values, 4));
+        scan = _mm256_add_epi32(scan, _mm256_slli_si256(scan, 8));
+        scan = _mm256_add_epi32(scan, _mm256_shuffle_epi32(_mm256_permute2x128_si256(scan, scan, 0x08), 0xFF));
+
+        // Exclusive result is the inclusive scan less the element itself
+        scan = _mm256_add_epi32(scan, carry);
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_sub_epi32(scan, values));
+        carry = _mm256_permutevar8x32_epi32(scan, last_lane);
+    }
+
+    return ExclusiveScanScalar(in + i, out + i, count - i, (uint32_t)_mm256_cvtsi256_si32(carry));
+#else
+    return ExclusiveScanScalar(in, out, count, initial);
+#endif
+}
+
+}
@@ -0,0 +1,414 @@
+#include "ReferenceRenderer.h"
+#include <chrono>
+#include <fstream>
+#include "BrickQuantise.h"
+#include "GridEngine.h"
+#include "ParticleReorder.h"
+#include "ParticleScenes.h"
+#include "SimpleTexture.h"
+
+namespace CPUBackend {
+
+typedef std::chrono::high_resolution_clock Clock;
+typedef float Matrix4[4][4];
+
+// Lighting constants, from SdfHelpers.hlsli and ClosestHitShader
+#define LIGHT_DIRECTION -1.f, -1.f, 1.f
+#define SPECULAR_POWER 50.f
+#define AMBIENT 0.5f
+#define SURFACE_COLOUR 0.306f, 0.941f, 0.933f
+#define SPECULAR 0.9f
+#define MISS_COLOUR 0.0f, 0.2f, 0.4f
+#define ANALYTICAL_NORMAL_STEP 0.001f // As CalculateNormal's analytical path
+
+// Projection of HonoursApplication::OnInit
+#define FIELD_OF_VIEW (3.14159265f / 4)
+#define NEAR_PLANE 0.01f
+#define FAR_PLANE 100.f
+
+static void MultiplyMatrices(const Matrix4& a, const Matrix4& b, Matrix4& result)
+{
+    for (int row = 0; row < 4; row++) {
+        for (int column = 0; column < 4; column++) {
+            result[row][column] = 0;
+            for (int i = 0; i < 4; i++) {
+                result[row][column] += a[row][i] * b[i][column];
+            }
+        }
+    }
+}
+
+// Gauss-Jordan elimination with partial pivoting, for the view projection as XMMatrixInverse does
+static void InvertMatrix(const Matrix4& matrix, Matrix4& inverse)
+{
+    double rows[4][8];
+    for (int row = 0; row < 4; row++) {
+        for (int column = 0; column < 4; column++) {
+            rows[row][column] = matrix[row][column];
+            rows[row][column + 4] = row == column ? 1 : 0;
+        }
+    }
+    for (int column = 0; column < 4; column++) {
+        int pivot = column;
+        for (int row = column + 1; row < 4; row++) {
+            if (std::abs(rows[row][column]) > std::abs(rows[pivot][column])) {
+                pivot = row;
+            }
+        }
+        std::swap(rows[column], rows[pivot]);
+        double scale = 1 / rows[column][column];
+        for (int i = 0; i < 8; i++) {
+            rows[column][i] *= scale;
+        }
+        for (int row = 0; row < 4; row++) {
+            if (row != column) {
+                double factor = rows[row][column];
+                for (int i = 0; i < 8; i++) {
+                    rows[row][i] -= factor * rows[column][i];
+                }
+            }
+        }
+    }
+    for (int row = 0; row < 4; row++) {
+        for (int column = 0; column < 4; column++) {
+            inverse[row][column] = (float)rows[row][column + 4];
+        }
+    }
+}
+
+void BuildReferenceScene(const TestVariables& test_values, ImplementationType implementation, float time, ReferenceScene& scene,
+    ThreadPool* thread_pool)
+{
+    scene.test_values_ = test_values;
+    DeriveGridValues(scene.test_values_);
+    scene.implementation_ = implementation;
+    const TestVariables& values = scene.test_values_;
+
+    std::vector<ParticleData> particles;
+    GenerateParticles(values, particles, thread_pool);
+    ComputePositions(values, time, particles, thread_pool);
+
+    if (implementation == Naive) {
+        scene.particle_positions_.resize(particles.size());
+        for (size_t i = 0; i < particles.size(); i++) {
+            scene.particle_positions_[i] = particles[i].position_;
+        }
+        return;
+    }
+
+    // Sorted surface lists, so the brick pool and images come out the same every run
+    GridEngine grid(thread_pool, values);
+    grid.SetSurfaceListOrder(SurfaceListSorted);
+    grid.SetBlockNeighbourRule(BlockNeighbourFlagged);
+    std::vector<uint32_t> cell_offsets;
+    std::vector<ParticleData> particles_ordered;
+    grid.ComputeGrid(particles);
+    ComputeCellOffsets(grid.GetCellCounts(), cell_offsets, thread_pool);
+    ReorderParticles(particles, cell_offsets, particles_ordered, thread_pool);
+
+    if (implementation == Simple) {
+        scene.texture_voxels_.assign((size_t)values.texture_res_ * values.texture_res_ * values.texture_res_, 0);
+        FillSimpleTextureGrid(grid, ParticleDataPositionSource{ particles_ordered }, cell_offsets, scene.texture_voxels_, thread_pool, 0,
+            values.texture_res_);
+        return;
+    }
+
+    FillBrickPool(grid, particles_ordered, cell_offsets, scene.brick_pool_, thread_pool);
+    CullEmptyBricks(scene.brick_pool_, thread_pool);
+
+    // Place the surface bricks in the lattice, as CSBuildAABBs places their AABBs
+    const int bricks_per_axis = BricksPerAxisPerCell(values);
+    const uint32_t bricks_per_cell = bricks_per_axis * bricks_per_axis * bricks_per_axis;
+    scene.lattice_res_ = values.cells_per_axis_ * bricks_per_axis;
+    scene.brick_lattice_.assign((size_t)scene.lattice_res_ * scene.lattice_res_ * scene.lattice_res_, INVALID_BRICK_SLOT);
+    for (uint32_t i = 0; i < scene.brick_pool_.surface_bricks_count_; i++) {
+        uint32_t brick_index = scene.brick_pool_.surface_brick_indices_[i];
+        Int3 cell_coords = grid.GetCellCoords(grid.GetSurfaceCellIndices()[brick_index / bricks_per_cell]);
+        uint32_t intra_cell_index = brick_index % bricks_per_cell;
+        int x = cell_coords.x * bricks_per_axis + (int)(intra_cell_index % bricks_per_axis);
+        int y = cell_coords.y * bricks_per_axis + (int)((intra_cell_index / bricks_per_axis) % bricks_per_axis);
+        int z = cell_coords.z * bricks_per_axis + (int)(intra_cell_index / (bricks_per_axis * bricks_per_axis));
+        scene.brick_lattice_[((size_t)z * scene.lattice_res_ + y) * scene.lattice_res_ + x] = brick_index;
+    }
+}
+
+RenderCamera GetOrbitalRenderCamera(const TestVariables& test_values, float view_dist, float time, int width, int height)
+{
+    RenderCamera camera;
+    Float3 eye = { 0.5f + view_dist * std::cos(time), test_values.scene_ == SceneWave ? 0.3f : 0.5f, 0.5f + view_dist * std::sin(time) };
+    camera.camera_pos_ = eye;
+
+    // XMMatrixLookAtLH, looking horizontally at the middle of the scene
+    Float3 forward = Normalize(Float3{ 0.5f, eye.y, 0.5f } - eye);
+    Float3 right = Normalize(Float3{ forward.z, 0, -forward.x });
+    Float3 up = { right.y * forward.z - right.z * forward.y, right.z * forward.x - right.x * forward.z, right.x * forward.y - right.y * forward.x };
+    Matrix4 view = {
+        { right.x, up.x, forward.x, 0 },
+        { right.y, up.y, forward.y, 0 },
+        { right.z, up.z, forward.z, 0 },
+        { -Dot(right, eye), -Dot(up, eye), -Dot(forward, eye), 1 }
+    };
+
+    // XMMatrixPerspectiveFovLH
+    float y_scale = 1 / std::tan(FIELD_OF_VIEW / 2);
+    float x_scale = y_scale * height / width;
+    float range = FAR_PLANE / (FAR_PLANE - NEAR_PLANE);
+    Matrix4 projection = {
+        { x_scale, 0, 0, 0 },
+        { 0, y_scale, 0, 0 },
+        { 0, 0, range, 1 },
+        { 0, 0, -range * NEAR_PLANE, 0 }
+    };
+
+    Matrix4 view_proj;
+    MultiplyMatrices(view, projection, view_proj);
+    InvertMatrix(view_proj, camera.inv_view_proj_);
+    return camera;
+}
+
+void GenerateCameraRay(const RenderCamera& camera, int width, int height, int px, int py, Float3& origin, Float3& direction)
+{
+    // Centre of the pixel, with y inverted for DirectX-style coordinates
+    float screen_x = (px + 0.5f) / width * 2 - 1;
+    float screen_y = -((py + 0.5f) / height * 2 - 1);
+
+    // Unproject the pixel coordinate into a ray
+    const float screen[4] = { screen_x, screen_y, 0, 1 };
+    float world[4] = {};
+    for (int column = 0; column < 4; column++) {
+        for (int i = 0; i < 4; i++) {
+            world[column] += screen[i] * camera.inv_view_proj_[i][column];
+        }
+    }
+    origin = camera.camera_pos_;
+    direction = Normalize(Float3{ world[0], world[1], world[2] } / world[3] - origin);
+}
+
+// RayAABBIntersectionTest in RayHelpers.hlsli, for a ray with TracePrimaryRay's extents
+static bool RayAABBIntersectionTest(const Float3& origin, const Float3& direction, const AABB& aabb, float& t_min, float& t_max)
+{
+    const float o[3] = { origin.x, origin.y, origin.z }, d[3] = { direction.x, direction.y, direction.z };
+    const float lo[3] = { aabb.min_.x, aabb.min_.y, aabb.min_.z }, hi[3] = { aabb.max_.x, aabb.max_.y, aabb.max_.z };
+    t_min = -1e30f;
+    t_max = 1e30f;
+    for (int axis = 0; axis < 3; axis++) {
+        float inverse = 1.f / d[axis];
+        float t0 = (lo[axis] - o[axis]) * inverse, t1 = (hi[axis] - o[axis]) * inverse;
+        t_min = std::max(t_min, std::min(t0, t1));
+        t_max = std::min(t_max, std::max(t0, t1));
+    }
+    return t_max > t_min && t_max >= RAY_T_MIN && t_min <= 10000;
+}
+
+struct ReferenceHit {
+    bool hit_ = false;
+    float t_ = 0;
+    Float3 normal_ = { 0, 0, 0 };
+};
+
+inline Float3 NormalizeGradient(const Float3& gradient)
+{
+    float length = Length(gradient);
+    return length > 0 ? gradient / length : Float3{ 0, 0, 0 };
+}
+
+// Naive and Simple rays are traced through the unit AABB, sampling the SDF analytically or from the texture
+static ReferenceHit TraceUnitAABB(const ReferenceScene& scene, const Float3& origin, const Float3& direction, const MarchingOptions& options,
+    ReferenceRenderStats& stats)
+{
+    ReferenceHit hit;
+    float t_min, t_max;
+    if (!RayAABBIntersectionTest(origin, direction, AABB{ { 0, 0, 0 }, { 1, 1, 1 } }, t_min, t_max)) {
+        return hit;
+    }
+    stats.aabbs_tested_++;
+
+    const TestVariables& values = scene.test_values_;
+    auto get_distance = [&](const Float3& position) {
+        if (scene.implementation_ == Naive) {
+            return GetAnalyticalSignedDistance(position, scene.particle_positions_.data(), scene.particle_positions_.size(), values.particle_radius_);
+        }
+        return SampleDenseTexture(scene.texture_voxels_, values.texture_res_, position);
+    };
+    auto position_at = [&](float t) { return Clamp(origin + direction * std::max(t, 0.f), 0, 1); };
+
+    SphereTraceResult result = SphereTraceSegment([&](float t) { return get_distance(position_at(t)); }, t_min, t_max, options);
+    stats.steps_ += result.steps_;
+    if (!result.hit_) {
+        return hit;
+    }
+
+    // Central differences, a voxel apart through the texture
+    const Float3 position = position_at(result.t_);
+    const float h = scene.implementation_ == Naive ? ANALYTICAL_NORMAL_STEP : 1.f / values.texture_res_;
+    hit.normal_ = NormalizeGradient({
+        get_distance(position + Float3{ h, 0, 0 }) - get_distance(position - Float3{ h, 0, 0 }),
+        get_distance(position + Float3{ 0, h, 0 }) - get_distance(position - Float3{ 0, h, 0 }),
+        get_distance(position + Float3{ 0, 0, h }) - get_distance(position - Float3{ 0, 0, h }) });
+    hit.hit_ = true;
+    hit.t_ = std::max(result.t_, RAY_T_MIN);
+    return hit;
+}
+
+// Complex rays step through the brick lattice (Amanatides & Woo, 1987), sphere tracing each surface brick they pass
+// through. The bricks don't overlap, so the first hit is the nearest, as the closest hit shader would see.
+static ReferenceHit TraceBrickLattice(const ReferenceScene& scene, const Float3& origin, const Float3& direction, const MarchingOptions& options,
+    ReferenceRenderStats& stats)
+{
+    ReferenceHit hit;
+    float t_enter, t_exit;
+    if (!RayAABBIntersectionTest(origin, direction, AABB{ { 0, 0, 0 }, { 1, 1, 1 } }, t_enter, t_exit)) {
+        return hit;
+    }
+
+    const int res = scene.lattice_res_;
+    const float brick_size = 1.f / res;
+    const float o[3] = { origin.x, origin.y, origin.z }, d[3] = { direction.x, direction.y, direction.z };
+    const Float3 start = origin + direction * std::max(t_enter, 0.f);
+    const float p[3] = { start.x, start.y, start.z };
+    int brick[3], step[3];
+    float t_next[3], t_delta[3];
+    for (int axis = 0; axis < 3; axis++) {
+        brick[axis] = std::clamp((int)(p[axis] * res), 0, res - 1);
+        step[axis] = d[axis] > 0 ? 1 : -1;
+        t_next[axis] = d[axis] != 0 ? ((brick[axis] + (d[axis] > 0 ? 1 : 0)) * brick_size - o[axis]) / d[axis] : 1e30f;
+        t_delta[axis] = d[axis] != 0 ? brick_size / std::abs(d[axis]) : 1e30f;
+    }
+
+    auto decode = [](int16_t voxel) { return Snorm16ToFloat(voxel); };
+    while (true) {
+        uint32_t brick_index = scene.brick_lattice_[((size_t)brick[2] * res + brick[1]) * res + brick[0]];
+        AABB aabb;
+        aabb.min_ = Float3{ (float)brick[0], (float)brick[1], (float)brick[2] } * brick_size;
+        aabb.max_ = aabb.min_ + brick_size;
+        float t_min, t_max;
+        if (brick_index != INVALID_BRICK_SLOT && RayAABBIntersectionTest(origin, direction, aabb, t_min, t_max)) {
+            stats.aabbs_tested_++;
+
+            // In the brick's voxels, see SampleBrick, as the intersection shader finds the uvw within the brick pool
+            const int16_t* voxels = scene.brick_pool_.voxels_.data() + (size_t)brick_index * VOXELS_PER_BRICK;
+            const Float3 local_origin = origin - aabb.min_;
+            auto voxel_position_at = [&](float t) {
+                return Clamp(local_origin + direction * std::max(t, 0.f), 0, 1) / brick_size * CORE_VOXELS_PER_AXIS_PER_BRICK + 0.5f;
+            };
+
+            SphereTraceResult result = SphereTraceSegment([&](float t) { return SampleBrick(voxels, voxel_position_at(t), decode); },
+                t_min, t_max, options);
+            stats.steps_ += result.steps_;
+            if (result.hit_) {
+                hit.hit_ = true;
+                hit.t_ = std::max(result.t_, RAY_T_MIN);
+                hit.normal_ = SampleBrickNormal(voxels, voxel_position_at(result.t_), decode);
+                return hit;
+            }
+        }
+
+        int axis = t_next[0] < t_next[1] ? (t_next[0] < t_next[2] ? 0 : 2) : (t_next[1] < t_next[2] ? 1 : 2);
+        if (t_next[axis] > t_exit) {
+            return hit;
+        }
+        brick[axis] += step[axis];
+        if (brick[axis] < 0 || brick[axis] >= res) {
+            return hit;
+        }
+        t_next[axis] += t_delta[axis];
+    }
+}
+
+// ClosestHitShader and MissShader
+static Float3 ShadeHit(const ReferenceHit& hit, const RenderCamera& camera, const Float3& origin, const Float3& direction, bool render_normals)
+{
+    if (!hit.hit_) {
+        return { MISS_COLOUR };
+    }
+    if (render_normals) {
+        return hit.normal_;
+    }
+
+    // Blinn-phong, CalculateLighting in SdfHelpers.hlsli
+    const Float3 position = origin + direction * hit.t_;
+    const Float3 light_vector = Float3{ LIGHT_DIRECTION } * -1.f;
+    float diffuse = std::clamp(Dot(hit.normal_, light_vector), 0.f, 1.f);
+    Float3 view_vector = Normalize(camera.camera_pos_ - position);
+    Float3 halfway = Normalize(light_vector + view_vector);
+    float specular = SPECULAR * std::pow(std::max(Dot(hit.normal_, halfway), 0.f), SPECULAR_POWER);
+
+    return Float3{ SURFACE_COLOUR } * (diffuse + AMBIENT) + specular;
+}
+
+ReferenceRenderStats RenderReference(const ReferenceScene& scene, const RenderCamera& camera, const ReferenceRenderOptions& options,
+    std::vector<Float3>& colours, ThreadPool* thread_pool)
+{
+    const int width = options.width_, height = options.height_;
+    const int tiles_x = (width + REFERENCE_TILE_SIZE - 1) / REFERENCE_TILE_SIZE;
+    const int tiles_y = (height + REFERENCE_TILE_SIZE - 1) / REFERENCE_TILE_SIZE;
+    colours.resize((size_t)width * height);
+
+    // Per thread, so the counts aren't contended
+    std::vector<ReferenceRenderStats> thread_stats(thread_pool->GetThreadCount());
+    Clock::time_point start = Clock::now();
+    thread_pool->ParallelForIndexed(0, (size_t)tiles_x * tiles_y, 1, [&](size_t begin, size_t end, unsigned int thread) {
+        ReferenceRenderStats& stats = thread_stats[thread];
+        for (size_t tile = begin; tile < end; tile++) {
+            const int x_begin = (int)(tile % tiles_x) * REFERENCE_TILE_SIZE, y_begin = (int)(tile / tiles_x) * REFERENCE_TILE_SIZE;
+            for (int py = y_begin; py < std::min(y_begin + REFERENCE_TILE_SIZE, height); py++) {
+                for (int px = x_begin; px < std::min(x_begin + REFERENCE_TILE_SIZE, width); px++) {
+                    Float3 origin, direction;
+                    GenerateCameraRay(camera, width, height, px, py, origin, direction);
+                    ReferenceHit hit = scene.implementation_ == Complex ? TraceBrickLattice(scene, origin, direction, options.marching_, stats)
+                        : TraceUnitAABB(scene, origin, direction, options.marching_, stats);
+                    stats.hits_ += hit.hit_;
+                    colours[(size_t)py * width + px] = ShadeHit(hit, camera, origin, direction, options.render_normals_);
+                }
+            }
+        }
+    });
+
+    ReferenceRenderStats stats;
+    stats.ms_ = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    for (const ReferenceRenderStats& chunk : thread_stats) {
+        stats.hits_ += chunk.hits_;
+        stats.steps_ += chunk.steps_;
+        stats.aabbs_tested_ += chunk.aabbs_tested_;
+    }
+    stats.rays_per_second_ = stats.ms_ > 0 ? (double)width * height / (stats.ms_ / 1000) : 0.0;
+    return stats;
+}
+
+bool WritePPM(const std::string& path, int width, int height, const std::vector<Float3>& colours)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    file << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<uint8_t> row((size_t)width * 3);
+    auto to_unorm8 = [](float value) { return (uint8_t)std::lround(std::clamp(value, 0.f, 1.f) * 255.f); };
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const Float3& colour = colours[(size_t)y * width + x];
+            row[x * 3] = to_unorm8(colour.x);
+            row[x * 3 + 1] = to_unorm8(colour.y);
+            row[x * 3 + 2] = to_unorm8(colour.z);
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+    return (bool)file;
+}
+
+bool WritePFM(const std::string& path, int width, int height, const std::vector<Float3>& colours)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    file << "PF\n" << width << " " << height << "\n-1.0\n"; // Negative scale for little endian
+
+    // Rows go from the bottom up
+    for (int y = height - 1; y >= 0; y--) {
+        file.write(reinterpret_cast<const char*>(colours.data() + (size_t)y * width), (std::streamsize)width * sizeof(Float3));
+    }
+    return (bool)file;
+}
+
+}
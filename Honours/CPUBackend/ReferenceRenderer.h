@@ -0,0 +1,76 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "BrickPool.h"
+#include "SphereTracing.h"
+#include "ThreadPool.h"
+
+namespace CPUBackend {
+
+// Headless CPU port of the ray tracing in RayTracing.hlsl, for reference images and profiling the marching without DXR.
+// Each pixel's ray is generated as RayGenerationShader does, intersected with the implementation's AABBs and sphere traced
+// through them as IntersectionShader does, then shaded as ClosestHitShader or MissShader would. The flags it renders with
+// are the app's defaults: finite difference normals, 16-bit bricks and no camera LOD.
+
+#define RAY_T_MIN 0.01f // TracePrimaryRay's rayDesc.TMin
+#define REFERENCE_TILE_SIZE 16 // Pixels along each side of the tiles the threads render
+
+// The fields of RayTracingCB the ray generation and closest hit shaders read. inv_view_proj_ is in DirectXMath's row
+// vector convention, as the shader's mul(float4, matrix) sees the transposed matrix the app uploads.
+struct RenderCamera {
+    float inv_view_proj_[4][4];
+    Float3 camera_pos_;
+};
+
+struct ReferenceRenderOptions {
+    ImplementationType implementation_ = Simple;
+    int width_ = 480;
+    int height_ = 270;
+    bool render_normals_ = false; // As RENDERING_FLAG_NORMALS, showing the normal rather than lighting it
+    MarchingOptions marching_;
+};
+
+// What the implementation's rays are traced through, see BuildReferenceScene
+struct ReferenceScene {
+    TestVariables test_values_;
+    ImplementationType implementation_ = Simple;
+    std::vector<Float3> particle_positions_; // Naive, every particle blended in at every step
+    std::vector<int16_t> texture_voxels_;    // Simple, the grid texture (see SimpleTexture.h)
+    BrickPool brick_pool_;                   // Complex, with the bricks that can't be hit culled
+
+    // Complex: the brick pool index of the surface brick at each position of the brick lattice, x then y then z, or
+    // INVALID_BRICK_SLOT. Rays step through it in order, finding the nearest brick as the BLAS does.
+    int lattice_res_ = 0;
+    std::vector<uint32_t> brick_lattice_;
+};
+
+struct ReferenceRenderStats {
+    double ms_ = 0;
+    double rays_per_second_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t steps_ = 0;        // SDF samples taken by every ray
+    uint64_t aabbs_tested_ = 0; // AABBs rays sphere traced through
+};
+
+// Generates, animates and sorts the particles for the scene at the given time, then builds what the implementation traces
+void BuildReferenceScene(const TestVariables& test_values, ImplementationType implementation, float time, ReferenceScene& scene,
+    ThreadPool* thread_pool);
+
+// Camera of OrbitalCamera::Update at the given time, with the app's projection
+RenderCamera GetOrbitalRenderCamera(const TestVariables& test_values, float view_dist, float time, int width, int height);
+
+// GenerateCameraRay in RayHelpers.hlsli
+void GenerateCameraRay(const RenderCamera& camera, int width, int height, int px, int py, Float3& origin, Float3& direction);
+
+// Renders the scene into colours, width * height of them from the top left, in tiles of REFERENCE_TILE_SIZE shared between
+// the threads. Colours are as the shaders write them, so may be above 1 where the specular adds to the diffuse.
+ReferenceRenderStats RenderReference(const ReferenceScene& scene, const RenderCamera& camera, const ReferenceRenderOptions& options,
+    std::vector<Float3>& colours, ThreadPool* thread_pool);
+
+// Binary PPM, clamped to 8 bits as the app's R8G8B8A8_UNORM output is. Returns false if the file can't be written.
+bool WritePPM(const std::string& path, int width, int height, const std::vector<Float3>& colours);
+
+// Little endian PFM, unclamped
+bool WritePFM(const std::string& path, int width, int height, const std::vector<Float3>& colours);
+
+}
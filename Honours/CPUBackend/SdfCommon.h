@@ -0,0 +1,49 @@
+#pragma once
+#include "CPUStructs.h"
+
+// CPU ports of the SDF helpers in SdfHelpers.hlsli
+
+namespace CPUBackend {
+
+// quadratic polynomial smooth minimum
+// (Evans, 2015, pp. 30) https://advances.realtimerendering.com/s2015/AlexEvans_SIGGRAPH-2015-sml.pdf
+// r is the radius of influence
+inline float SmoothMin(float a, float b, float r)
+{
+    float e = std::max(r - std::abs(a - b), 0.0f);
+    return std::min(a, b) - e * e * 0.25f / r;
+}
+
+// SmoothMin, also blending the gradients of a and b by how much each contributes
+inline float SmoothMinGradient(float a, const Float3& gradient_a, float b, const Float3& gradient_b, float r, Float3& gradient)
+{
+    float e = std::max(r - std::abs(a - b), 0.0f);
+    float h = e * 0.5f / r;
+    gradient = a < b ? gradient_a + (gradient_b - gradient_a) * h : gradient_b + (gradient_a - gradient_b) * h;
+    return std::min(a, b) - e * e * 0.25f / r;
+}
+
+inline float GetDistanceToSphere(const Float3& displacement, float radius)
+{
+    return Length(displacement) - radius;
+}
+
+// Gradient of GetDistanceToSphere at the position, pointing away from the sphere's centre
+inline Float3 GetSphereGradient(const Float3& displacement)
+{
+    return displacement / -std::max(Length(displacement), 1e-8f);
+}
+
+// Conversion applied when a float is written to an R16_SNORM texture
+inline int16_t FloatToSnorm16(float value)
+{
+    value = std::clamp(value, -1.f, 1.f);
+    return (int16_t)std::lround(value * 32767.f);
+}
+
+inline float Snorm16ToFloat(int16_t value)
+{
+    return std::max(value / 32767.f, -1.f);
+}
+
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "BrickPool.h"
+#include "GridCommon.h"
+
+namespace CPUBackend {
+
+// CPU ports of the Simple method's dense SDF texture (ComputeTexture.hlsl), TEXTURE_RESOLUTION^3 R16_SNORM voxels in
+// x, y, z order. CSTexMain visits every particle for every voxel, so is O(particles * voxels). CSTexGridMain only
+// visits the particles of the 27 cells around the voxel's cell, once they've been sorted by cell as for the brick pool.
+
+// Voxel centre, as CSTexMain
+inline Float3 GetSimpleTextureVoxelPosition(int texture_res, int x, int y, int z)
+{
+    return Float3{ x + 0.5f, y + 0.5f, z + 0.5f } / (float)texture_res;
+}
+
+// GetAnalyticalSignedDistance in SdfHelpers.hlsli, every particle blended in without the influence cut-off
+inline float GetAnalyticalSignedDistance(const Float3& position, const Float3* particle_positions, size_t particle_count, float particle_radius)
+{
+    float distance = 1000;
+    for (size_t i = 0; i < particle_count; i++) {
+        distance = SmoothMin(distance, GetDistanceToSphere(particle_positions[i] - position, particle_radius), particle_radius);
+    }
+    return distance;
+}
+
+// Nearest the surface of a particle outside the 27 cells around the voxel's cell can be. Those particles are past the
+// nearest face of the 3 x 3 x 3 cells, which is at least a cell away as cells are at least 2 radii wide.
+inline float GetSimpleTextureFarDistance(const TestVariables& test_values, const Int3& cell_coords, const Float3& position)
+{
+    const float cell_size = 1.f / test_values.cells_per_axis_;
+    Float3 block_min = Float3{ cell_coords.x - 1.f, cell_coords.y - 1.f, cell_coords.z - 1.f } * cell_size;
+    Float3 block_max = block_min + cell_size * 3;
+    float to_face = std::min({ position.x - block_min.x, position.y - block_min.y, position.z - block_min.z,
+        block_max.x - position.x, block_max.y - position.y, block_max.z - position.z });
+    return to_face - test_values.particle_radius_;
+}
+
+// Gathers the positions of the particles in the 27 cells around a cell, in the order GetSignedDistanceNNS visits them
+template<typename Grid, typename PositionSource>
+inline void GatherNeighbourParticles(const Grid& grid, const PositionSource& particle_positions, const std::vector<uint32_t>& cell_offsets,
+    uint32_t cell_index, std::vector<Float3>& neighbour_particles)
+{
+    int neighbouring_cells[27];
+    grid.GetNeighbourCells(cell_index, neighbouring_cells);
+    PositionSource cell_positions = particle_positions;
+    cell_positions.BeginBrick(grid.GetTestValues(), grid.GetCellCoords(cell_index));
+
+    neighbour_particles.clear();
+    for (int x = 0; x < 27; x++) {
+        if (neighbouring_cells[x] < 0) {
+            continue;
+        }
+        uint32_t particle_count = grid.GetCellCounts()[neighbouring_cells[x]];
+        uint32_t particle_index_offset = cell_offsets[neighbouring_cells[x]];
+        for (uint32_t i = 0; i < particle_count; i++) {
+            neighbour_particles.push_back(cell_positions(x, particle_index_offset + i));
+        }
+    }
+}
+
+// Voxel of the grid-accelerated texture, blending in the particles around its cell as GetAnalyticalSignedDistance does.
+// Where those are all empty, or further than the far distance, the voxel takes the far distance instead, so sphere tracing
+// can't step past a particle outside them. As with the brick pool's neighbour search, particles outside the 27 cells are
+// left out of the blend, so where many particles are blended together the surface can differ slightly from CSTexMain's.
+inline float GetSimpleTextureGridDistance(const TestVariables& test_values, const Int3& cell_coords, const Float3& position,
+    const std::vector<Float3>& neighbour_particles)
+{
+    float far_distance = GetSimpleTextureFarDistance(test_values, cell_coords, position);
+    if (neighbour_particles.empty()) {
+        return far_distance;
+    }
+    return std::min(GetAnalyticalSignedDistance(position, neighbour_particles.data(), neighbour_particles.size(), test_values.particle_radius_),
+        far_distance);
+}
+
+// CPU port of CSTexMain, for the z slices [z_begin, z_end) of the texture
+inline void FillSimpleTextureNaive(const TestVariables& test_values, const std::vector<Float3>& particle_positions, std::vector<int16_t>& voxels,
+    ThreadPool* thread_pool, int z_begin, int z_end)
+{
+    const int texture_res = test_values.texture_res_;
+    voxels.resize((size_t)texture_res * texture_res * texture_res);
+
+    thread_pool->ParallelFor((size_t)z_begin * texture_res, (size_t)z_end * texture_res, 1, [&](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++) {
+            int y = (int)(row % texture_res), z = (int)(row / texture_res);
+            for (int x = 0; x < texture_res; x++) {
+                float distance = GetAnalyticalSignedDistance(GetSimpleTextureVoxelPosition(texture_res, x, y, z), particle_positions.data(),
+                    particle_positions.size(), test_values.particle_radius_);
+                voxels[row * texture_res + x] = FloatToSnorm16(distance);
+            }
+        }
+    });
+}
+
+// CPU port of CSTexGridMain, for the z slices [z_begin, z_end) of the texture. The particles must be ordered by cell,
+// see ParticleReorder.h. Each row of voxels gathers the particles around a cell once, for every voxel of the row within it.
+template<typename Grid, typename PositionSource>
+void FillSimpleTextureGrid(const Grid& grid, const PositionSource& particle_positions, const std::vector<uint32_t>& cell_offsets,
+    std::vector<int16_t>& voxels, ThreadPool* thread_pool, int z_begin, int z_end)
+{
+    const TestVariables& test_values = grid.GetTestValues();
+    const int texture_res = test_values.texture_res_;
+    voxels.resize((size_t)texture_res * texture_res * texture_res);
+
+    thread_pool->ParallelFor((size_t)z_begin * texture_res, (size_t)z_end * texture_res, 1, [&](size_t begin, size_t end) {
+        std::vector<Float3> neighbour_particles;
+        for (size_t row = begin; row < end; row++) {
+            int y = (int)(row % texture_res), z = (int)(row / texture_res);
+            uint32_t gathered_cell = UINT32_MAX;
+            Int3 cell_coords = {};
+            for (int x = 0; x < texture_res; x++) {
+                Float3 position = GetSimpleTextureVoxelPosition(texture_res, x, y, z);
+                uint32_t cell_index = GetCellIndex(test_values, position);
+                if (cell_index != gathered_cell) {
+                    GatherNeighbourParticles(grid, particle_positions, cell_offsets, cell_index, neighbour_particles);
+                    cell_coords = grid.GetCellCoords(cell_index);
+                    gathered_cell = cell_index;
+                }
+                voxels[row * texture_res + x] = FloatToSnorm16(GetSimpleTextureGridDistance(test_values, cell_coords, position, neighbour_particles));
+            }
+        }
+    });
+}
+
+}
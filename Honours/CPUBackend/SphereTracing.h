@@ -0,0 +1,196 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <vector>
+#include "SdfCommon.h"
+
+namespace CPUBackend {
+
+// CPU port of the sphere tracing in RayTracing.hlsl, through the Simple method's dense SDF texture, for measuring how many
+// steps rays take through a texture and where they hit.
+
+#define SPHERE_TRACING_THRESHOLD 0.001f
+#define MAX_SPHERE_TRACING_STEPS 512
+
+struct SphereTraceResult {
+    bool hit_ = false;
+    float t_ = 0;    // Along the ray where it hit, or where it left the texture
+    int steps_ = 0;  // Texture samples taken
+    int coarse_samples_ = 0; // Distance pyramid texels read, see DistancePyramid.h
+    int overshoots_ = 0;     // Relaxed steps that passed the surface, see MarchingMode
+};
+
+// Trilinear sample of the dense texture at a uvw position, as the linear sampler with clamp addressing does
+inline float SampleDenseTexture(const std::vector<int16_t>& voxels, int texture_res, const Float3& uvw)
+{
+    Float3 clamped = Clamp(uvw * (float)texture_res - 0.5f, 0, (float)(texture_res - 1));
+    int x = std::min((int)clamped.x, texture_res - 2);
+    int y = std::min((int)clamped.y, texture_res - 2);
+    int z = std::min((int)clamped.z, texture_res - 2);
+    float tx = clamped.x - x, ty = clamped.y - y, tz = clamped.z - z;
+
+    auto voxel = [&](int dx, int dy, int dz) {
+        return Snorm16ToFloat(voxels[((size_t)(z + dz) * texture_res + (y + dy)) * texture_res + (x + dx)]);
+    };
+    auto lerp = [](float a, float b, float t) { return a + (b - a) * t; };
+    float c00 = lerp(voxel(0, 0, 0), voxel(1, 0, 0), tx);
+    float c10 = lerp(voxel(0, 1, 0), voxel(1, 1, 0), tx);
+    float c01 = lerp(voxel(0, 0, 1), voxel(1, 0, 1), tx);
+    float c11 = lerp(voxel(0, 1, 1), voxel(1, 1, 1), tx);
+    return lerp(lerp(c00, c10, ty), lerp(c01, c11, ty), tz);
+}
+
+// Where the ray enters and leaves the unit cube the texture covers, false if it misses
+inline bool RayUnitCubeIntersection(const Float3& origin, const Float3& direction, float& t_min, float& t_max)
+{
+    t_min = -1e30f;
+    t_max = 1e30f;
+    const float o[3] = { origin.x, origin.y, origin.z }, d[3] = { direction.x, direction.y, direction.z };
+    for (int axis = 0; axis < 3; axis++) {
+        float inverse = 1.f / d[axis];
+        float t0 = (0 - o[axis]) * inverse, t1 = (1 - o[axis]) * inverse;
+        t_min = std::max(t_min, std::min(t0, t1));
+        t_max = std::min(t_max, std::max(t0, t1));
+    }
+    return t_max >= std::max(t_min, 0.f);
+}
+
+// Ways of stepping along the ray, as the intersection shader can with the rendering flags
+enum MarchingMode {
+    MarchingSphere,      // Steps by the distance sampled
+    MarchingOverRelaxed, // Steps further by OVER_RELAXATION, stepping back if the surface could have been passed (Keinert et al., 2014)
+    MarchingRelaxedCone  // Steps towards where the distances sampled reach the surface, searching for it once it's passed
+};
+
+#define OVER_RELAXATION 1.6f
+#define RELAXED_CONE_MAX_RELAXATION 2.f // At most this many times the distance sampled
+#define RELAXED_CONE_SEARCH_STEPS 6      // Halving the last step, once it's passed the surface
+#define STEP_HISTOGRAM_BINS 10           // Of rays taking 1, 2-3, 4-7, ... 512 steps
+
+struct MarchingOptions {
+    MarchingMode mode_ = MarchingSphere;
+    float pixel_radius_ = 0; // Of a pixel's footprint a unit from the camera, for a threshold growing with distance, or 0 for the fixed one
+};
+
+// Distance at which a ray hits, along it from the camera. The adaptive threshold is a pixel's footprint there, so rays
+// stop once the surface is closer than they can resolve.
+inline float GetMarchingThreshold(const MarchingOptions& options, float t)
+{
+    return options.pixel_radius_ > 0 ? t * options.pixel_radius_ : SPHERE_TRACING_THRESHOLD;
+}
+
+// How much further than the distance sampled the next step goes
+inline float GetRelaxation(const MarchingOptions& options, float distance, float previous_distance, float step)
+{
+    if (options.mode_ == MarchingOverRelaxed) {
+        return OVER_RELAXATION;
+    }
+    // The distances along the ray fall by the slope between the last two, so would reach the surface after distance / -slope.
+    // The SDF can't fall faster than 1 per unit, so that's never short of the distance itself. Like relaxed cone stepping
+    // through relief maps (Policarpo & Oliveira, 2007), it can pass the surface, but then searches back for it.
+    float slope = step > 0 ? (distance - previous_distance) / step : -1;
+    return slope < -1.f / RELAXED_CONE_MAX_RELAXATION ? std::max(-1 / slope, 1.f) : RELAXED_CONE_MAX_RELAXATION;
+}
+
+// Sphere traces [t_min, t_max] along a ray, as the intersection shader's loop does through an AABB. get_distance(t) gives
+// the SDF at t along the ray.
+template<typename GetDistance>
+inline SphereTraceResult SphereTraceSegment(GetDistance&& get_distance, float t_min, float t_max, const MarchingOptions& options = MarchingOptions())
+{
+    SphereTraceResult result;
+    auto sample = [&](float t) {
+        result.steps_++;
+        return get_distance(t);
+    };
+
+    bool relaxed = options.mode_ != MarchingSphere; // Over-relaxed steps stop once one passes the surface
+    float previous_distance = 0, step = 0;
+    while (result.steps_ < MAX_SPHERE_TRACING_STEPS && t_min <= t_max) {
+        float distance = sample(t_min);
+        float threshold = GetMarchingThreshold(options, t_min);
+
+        // Only a step further than the distance before it can have passed the surface
+        if (step > previous_distance) {
+            if (options.mode_ == MarchingRelaxedCone && distance < -threshold) {
+                // Inside, so the surface was passed. Halve the step towards it, as relaxed cone stepping's binary search.
+                result.overshoots_++;
+                float outside = t_min - step, inside = t_min;
+                for (int i = 0; i < RELAXED_CONE_SEARCH_STEPS && result.steps_ < MAX_SPHERE_TRACING_STEPS; i++) {
+                    float middle = 0.5f * (outside + inside);
+                    if (sample(middle) > GetMarchingThreshold(options, middle)) {
+                        outside = middle;
+                    }
+                    else {
+                        inside = middle;
+                    }
+                }
+                result.hit_ = true;
+                result.t_ = inside;
+                return result;
+            }
+            if (options.mode_ == MarchingOverRelaxed && distance + previous_distance < step) {
+                // The spheres either side don't overlap, so the surface could be between them. Take the plain step instead,
+                // which over-relaxed rays keep to from then on.
+                result.overshoots_++;
+                t_min += previous_distance - step;
+                step = previous_distance;
+                relaxed = false;
+                continue;
+            }
+        }
+
+        if (distance <= threshold) {
+            result.hit_ = true;
+            break;
+        }
+
+        float next_step = relaxed ? distance * GetRelaxation(options, distance, previous_distance, step) : distance;
+        previous_distance = distance;
+        step = next_step;
+        t_min += step;
+    }
+    result.t_ = t_min;
+    return result;
+}
+
+// Sphere traces the ray through the texture, as the intersection shader does for the Simple method's AABB
+inline SphereTraceResult SphereTraceDenseTexture(const std::vector<int16_t>& voxels, int texture_res, const Float3& origin,
+    const Float3& direction, const MarchingOptions& options = MarchingOptions())
+{
+    float t_min, t_max;
+    if (!RayUnitCubeIntersection(origin, direction, t_min, t_max)) {
+        return SphereTraceResult();
+    }
+    return SphereTraceSegment([&](float t) { return SampleDenseTexture(voxels, texture_res, Clamp(origin + direction * t, 0, 1)); },
+        std::max(t_min, 0.f), t_max, options);
+}
+
+// Bins the rays' steps by their power of 2, leaving out rays that took none
+inline void GetStepHistogram(const std::vector<SphereTraceResult>& results, uint64_t (&bins)[STEP_HISTOGRAM_BINS])
+{
+    std::fill(bins, bins + STEP_HISTOGRAM_BINS, 0);
+    for (const SphereTraceResult& result : results) {
+        if (result.steps_ > 0) {
+            bins[std::min((int)std::bit_width((unsigned int)result.steps_) - 1, STEP_HISTOGRAM_BINS - 1)]++;
+        }
+    }
+}
+
+// Primary ray through a pixel of the orbital camera, at its start looking horizontally at the middle of the scene, for
+// the app's PI / 4 vertical field of view
+inline void GetOrbitalCameraRay(float view_dist, float camera_height, int width, int height, int px, int py, Float3& origin,
+    Float3& direction)
+{
+    origin = { 0.5f + view_dist, camera_height, 0.5f };
+    Float3 forward = Normalize(Float3{ 0.5f, camera_height, 0.5f } - origin);
+    Float3 right = { forward.z, 0, -forward.x }; // Left handed, y up
+    Float3 up = { 0, 1, 0 };
+
+    const float tan_half_fov = std::tan(3.14159265f / 8);
+    float u = ((px + 0.5f) / width * 2 - 1) * tan_half_fov * width / height;
+    float v = (1 - (py + 0.5f) / height * 2) * tan_half_fov;
+    direction = Normalize(forward + right * u + up * v);
+}
+
+}
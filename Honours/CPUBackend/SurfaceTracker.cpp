@@ -0,0 +1,202 @@
+#include "SurfaceTracker.h"
+#include "BrickPool.h"
+#include "GridCommon.h"
+#include <atomic>
+#include <limits>
+
+namespace CPUBackend {
+
+#define TRACKER_GRAIN_SIZE 1024
+
+SurfaceTracker::SurfaceTracker(ThreadPool* thread_pool, const TestVariables& test_values) :
+    test_values_(test_values),
+    thread_pool_(thread_pool)
+{
+    dirty_stamps_.resize(test_values_.num_cells_);
+    evaluated_stamps_.resize(test_values_.num_cells_);
+    surface_slot_of_cell_.resize(test_values_.num_cells_);
+    dirty_cells_.resize(test_values_.num_cells_);
+    changed_cells_.resize(test_values_.num_cells_);
+    Reset();
+}
+
+void SurfaceTracker::Reset()
+{
+    particle_cells_.clear();
+    std::fill(dirty_stamps_.begin(), dirty_stamps_.end(), 0);
+    std::fill(evaluated_stamps_.begin(), evaluated_stamps_.end(), 0);
+    std::fill(surface_slot_of_cell_.begin(), surface_slot_of_cell_.end(), INVALID_SURFACE_SLOT);
+    frame_ = 0;
+
+    surface_slots_.clear();
+    free_slots_.clear();
+    surface_cells_count_ = 0;
+}
+
+void SurfaceTracker::Update(const GridEngine& grid, const std::vector<ParticleData>& particles)
+{
+    frame_++;
+    dirty_cells_count_ = 0;
+    changed_cells_count_ = 0;
+    evaluated_cells_count_ = 0;
+
+    if (particle_cells_.size() != particles.size()) {
+        // First frame (or the particles changed), every cell is dirty
+        particle_cells_.resize(particles.size());
+        thread_pool_->ParallelFor(0, particles.size(), TRACKER_GRAIN_SIZE, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                particle_cells_[i] = particles[i].cell_index_;
+            }
+        });
+
+        const uint32_t cells_per_axis = test_values_.cells_per_axis_;
+        thread_pool_->ParallelFor(0, test_values_.num_cells_, TRACKER_GRAIN_SIZE, [&](size_t begin, size_t end) {
+            for (size_t cell_index = begin; cell_index < end; cell_index++) {
+                // Skip the padding of Morton indexed grids
+                UInt3 coords = CellIndexTo3DCoords(test_values_, (uint32_t)cell_index);
+                if (coords.x < cells_per_axis && coords.y < cells_per_axis && coords.z < cells_per_axis) {
+                    EvaluateCell(grid, (uint32_t)cell_index);
+                }
+            }
+        });
+    }
+    else {
+        // Cells which particles have moved into or out of are dirty
+        thread_pool_->ParallelFor(0, particles.size(), TRACKER_GRAIN_SIZE, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                uint32_t cell_index = particles[i].cell_index_;
+                if (cell_index != particle_cells_[i]) {
+                    MarkDirty(particle_cells_[i]);
+                    MarkDirty(cell_index);
+                    particle_cells_[i] = cell_index;
+                }
+            }
+        });
+
+        // Re-evaluate dirty cells and their neighbours
+        thread_pool_->ParallelFor(0, dirty_cells_count_, TRACKER_GRAIN_SIZE / 16, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                int neighbouring_cells[27];
+                grid.GetNeighbourCells(dirty_cells_[i], neighbouring_cells);
+
+                for (int cell_index : neighbouring_cells) {
+                    if (cell_index > -1) {
+                        EvaluateCell(grid, cell_index);
+                    }
+                }
+            }
+        });
+    }
+
+    ApplyChanges();
+}
+
+void SurfaceTracker::MarkDirty(uint32_t cell_index)
+{
+    // Only the first thread to mark the cell this frame adds it to the list
+    if (std::atomic_ref<uint32_t>(dirty_stamps_[cell_index]).exchange(frame_, std::memory_order_relaxed) != frame_) {
+        uint32_t dirty_array_index = std::atomic_ref<uint32_t>(dirty_cells_count_).fetch_add(1, std::memory_order_relaxed);
+        dirty_cells_[dirty_array_index] = cell_index;
+    }
+}
+
+// Works out whether the cell is a surface cell, and records it if that has changed.
+// Neighbouring dirty cells share neighbours, so each cell is only evaluated by the first thread to reach it.
+void SurfaceTracker::EvaluateCell(const GridEngine& grid, uint32_t cell_index)
+{
+    if (std::atomic_ref<uint32_t>(evaluated_stamps_[cell_index]).exchange(frame_, std::memory_order_relaxed) == frame_) {
+        return;
+    }
+    std::atomic_ref<uint32_t>(evaluated_cells_count_).fetch_add(1, std::memory_order_relaxed);
+
+    // If the cell is not completely empty and not completely full, it's a surface cell for certain.
+    // Otherwise it is if any neighbours are different 'fullness' (completely empty or completely full).
+    const std::vector<uint32_t>& cell_counts = grid.GetCellCounts();
+    uint32_t particle_count = cell_counts[cell_index];
+    bool is_surface = particle_count > 0 && particle_count < CELL_MAX_PARTICLE_COUNT;
+
+    if (!is_surface) {
+        int neighbouring_cells[27];
+        grid.GetNeighbourCells(cell_index, neighbouring_cells);
+        for (int neighbour_index : neighbouring_cells) {
+            if (neighbour_index > -1 && ((particle_count == 0) ^ (cell_counts[neighbour_index] == 0))) {
+                is_surface = true;
+                break;
+            }
+        }
+    }
+
+    if (is_surface != IsSurfaceCell(cell_index)) {
+        uint32_t changed_array_index = std::atomic_ref<uint32_t>(changed_cells_count_).fetch_add(1, std::memory_order_relaxed);
+        changed_cells_[changed_array_index] = cell_index;
+    }
+}
+
+// Moves changed cells into or out of the surface slots. Serial, as it is only O(changed cells).
+void SurfaceTracker::ApplyChanges()
+{
+    added_cells_.clear();
+    added_slots_.clear();
+    removed_cells_.clear();
+    removed_slots_.clear();
+
+    // Each cell is evaluated once per update, so a changed cell either just left the surface or just joined it.
+    // Free slots first, so cells joining this frame can reuse them.
+    for (uint32_t i = 0; i < changed_cells_count_; i++) {
+        uint32_t cell_index = changed_cells_[i];
+        uint32_t slot = surface_slot_of_cell_[cell_index];
+        if (slot != INVALID_SURFACE_SLOT) {
+            surface_slots_[slot] = INVALID_SURFACE_SLOT;
+            free_slots_.push_back(slot);
+            removed_cells_.push_back(cell_index);
+            removed_slots_.push_back(slot);
+            surface_cells_count_--;
+        }
+        else {
+            added_cells_.push_back(cell_index);
+        }
+    }
+    for (uint32_t cell_index : removed_cells_) {
+        surface_slot_of_cell_[cell_index] = INVALID_SURFACE_SLOT;
+    }
+
+    for (uint32_t cell_index : added_cells_) {
+        uint32_t slot;
+        if (!free_slots_.empty()) {
+            slot = free_slots_.back();
+            free_slots_.pop_back();
+        }
+        else {
+            slot = (uint32_t)surface_slots_.size();
+            surface_slots_.push_back(INVALID_SURFACE_SLOT);
+        }
+
+        surface_slots_[slot] = cell_index;
+        surface_slot_of_cell_[cell_index] = slot;
+        added_slots_.push_back(slot);
+        surface_cells_count_++;
+    }
+}
+
+void SurfaceTracker::UpdateAABBs(const GridEngine& grid, std::vector<AABB>& aabbs) const
+{
+    const uint32_t bricks_per_axis = BricksPerAxisPerCell(test_values_);
+    const uint32_t bricks_per_cell = bricks_per_axis * bricks_per_axis * bricks_per_axis;
+    aabbs.resize(surface_slots_.size() * bricks_per_cell);
+
+    // An AABB with a NaN minimum x is inactive in D3D12 acceleration structures
+    AABB inactive = {};
+    inactive.min_.x = std::numeric_limits<float>::quiet_NaN();
+    for (uint32_t slot : removed_slots_) {
+        std::fill(aabbs.begin() + slot * bricks_per_cell, aabbs.begin() + (slot + 1) * bricks_per_cell, inactive);
+    }
+
+    for (size_t i = 0; i < added_slots_.size(); i++) {
+        Int3 cell_coords = grid.GetCellCoords(added_cells_[i]);
+        for (uint32_t brick = 0; brick < bricks_per_cell; brick++) {
+            aabbs[added_slots_[i] * bricks_per_cell + brick] = GetBrickAABB(test_values_, cell_coords, brick);
+        }
+    }
+}
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <vector>
+#include "GridEngine.h"
+
+namespace CPUBackend {
+
+// Keeps the set of surface cells up to date across frames, re-evaluating only around cells whose particle count changed.
+//
+// A cell's surface status only depends on its own count and whether its 26 neighbours are empty, so after the grid is
+// built only cells that particles moved into or out of (dirty cells) and their neighbours can change status.
+// Dirty cells are found from the particles whose cell index differs from the previous frame.
+// Surface detection is then O(changed cells) rather than O(cells), after a full evaluation on the first frame.
+//
+// The status used is the per-cell test of CSDetectSurfaceCellsMain applied to every cell. This matches GridEngine except
+// inside blocks with no empty cells, which GridEngine skips entirely.
+//
+// Surface cells keep the same slot for as long as they stay on the surface, and freed slots are reused, so
+// downstream stages only need to touch the added and removed slots (see UpdateAABBs).
+class SurfaceTracker
+{
+public:
+    SurfaceTracker(ThreadPool* thread_pool, const TestVariables& test_values);
+
+    // Call after GridEngine::BuildGrid each frame. particles must be in the same order every frame.
+    void Update(const GridEngine& grid, const std::vector<ParticleData>& particles);
+
+    // Forgets the previous frame, so the next update re-evaluates every cell
+    void Reset();
+
+    // Slot to surface cell index, with INVALID_SURFACE_SLOT in free slots
+    inline const std::vector<uint32_t>& GetSurfaceSlots() const { return surface_slots_; }
+    inline uint32_t GetSurfaceCellCount() const { return surface_cells_count_; }
+
+    // Changes made by the last update. The slot lists line up with the cell lists.
+    inline const std::vector<uint32_t>& GetAddedCells() const { return added_cells_; }
+    inline const std::vector<uint32_t>& GetAddedSlots() const { return added_slots_; }
+    inline const std::vector<uint32_t>& GetRemovedCells() const { return removed_cells_; }
+    inline const std::vector<uint32_t>& GetRemovedSlots() const { return removed_slots_; }
+
+    // Work done by the last update
+    inline uint32_t GetDirtyCellCount() const { return dirty_cells_count_; }
+    inline uint32_t GetEvaluatedCellCount() const { return evaluated_cells_count_; }
+
+    inline bool IsSurfaceCell(uint32_t cell_index) const { return surface_slot_of_cell_[cell_index] != INVALID_SURFACE_SLOT; }
+
+    // Writes the brick AABBs of added slots and deactivates those of removed slots, leaving the rest untouched.
+    // aabbs holds BRICKS_PER_CELL AABBs per slot and is grown to cover every slot.
+    void UpdateAABBs(const GridEngine& grid, std::vector<AABB>& aabbs) const;
+
+    static const uint32_t INVALID_SURFACE_SLOT = ~0u;
+
+private:
+    void MarkDirty(uint32_t cell_index);
+    void EvaluateCell(const GridEngine& grid, uint32_t cell_index);
+    void ApplyChanges();
+
+    // Previous frame's cell of each particle
+    std::vector<uint32_t> particle_cells_;
+
+    // Per cell. Stamps hold the frame a cell was last marked dirty / evaluated, so they never need clearing.
+    std::vector<uint32_t> dirty_stamps_;
+    std::vector<uint32_t> evaluated_stamps_;
+    std::vector<uint32_t> surface_slot_of_cell_;
+    uint32_t frame_ = 0;
+
+    // Accessed atomically with std::atomic_ref during an update
+    std::vector<uint32_t> dirty_cells_;
+    std::vector<uint32_t> changed_cells_;
+    uint32_t dirty_cells_count_ = 0;
+    uint32_t changed_cells_count_ = 0;
+    uint32_t evaluated_cells_count_ = 0;
+
+    std::vector<uint32_t> surface_slots_;
+    std::vector<uint32_t> free_slots_;
+    uint32_t surface_cells_count_ = 0;
+
+    std::vector<uint32_t> added_cells_;
+    std::vector<uint32_t> added_slots_;
+    std::vector<uint32_t> removed_cells_;
+    std::vector<uint32_t> removed_slots_;
+
+    TestVariables test_values_;
+    ThreadPool* thread_pool_;
+};
+
+}
@@ -0,0 +1,145 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace CPUBackend {
+
+// Pool and participant index of the worker running on this thread, so nested ParallelFor calls use the right queue.
+// Any thread which isn't one of the pool's workers acts as participant 0.
+static thread_local const ThreadPool* owning_pool_ = nullptr;
+static thread_local unsigned int participant_index_ = 0;
+
+ThreadPool::ThreadPool(unsigned int thread_count) :
+    thread_count_(std::max(thread_count, 1u))
+{
+    for (unsigned int i = 0; i < thread_count_; i++) {
+        queues_.push_back(std::make_unique<WorkQueue>());
+    }
+
+    // Participant 0 is whichever thread calls ParallelFor
+    for (unsigned int i = 1; i < thread_count_; i++) {
+        workers_.emplace_back(&ThreadPool::WorkerMain, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stop_ = true;
+    }
+    wake_cv_.notify_all();
+
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::ParallelFor(size_t begin, size_t end, size_t grain_size, const std::function<void(size_t, size_t)>& func)
+{
+    ParallelForIndexed(begin, end, grain_size, [&func](size_t chunk_begin, size_t chunk_end, unsigned int) { func(chunk_begin, chunk_end); });
+}
+
+void ThreadPool::ParallelForIndexed(size_t begin, size_t end, size_t grain_size, const std::function<void(size_t, size_t, unsigned int)>& func)
+{
+    if (begin >= end) {
+        return;
+    }
+    grain_size = std::max<size_t>(grain_size, 1);
+    size_t chunk_count = (end - begin + grain_size - 1) / grain_size;
+
+    unsigned int caller = owning_pool_ == this ? participant_index_ : 0;
+
+    // Nothing to share, run inline
+    if (thread_count_ == 1 || chunk_count == 1) {
+        func(begin, end, caller);
+        return;
+    }
+
+    Job job;
+    job.func_ = &func;
+    job.remaining_chunks_ = chunk_count;
+
+    // Count the chunks before queueing them, so the counter can't drop below zero when they're popped
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        queued_tasks_ += chunk_count;
+    }
+
+    // Deal the chunks out round-robin, starting with the caller's own queue
+    for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+        size_t chunk_begin = begin + chunk * grain_size;
+        WorkQueue& queue = *queues_[(caller + chunk) % thread_count_];
+        std::lock_guard<std::mutex> lock(queue.mutex_);
+        queue.tasks_.push_back({ chunk_begin, std::min(chunk_begin + grain_size, end), &job });
+    }
+    wake_cv_.notify_all();
+
+    // Help out until every chunk of this job has finished. Tasks from other jobs may be run too.
+    Task task;
+    while (job.remaining_chunks_.load(std::memory_order_acquire) > 0) {
+        if (PopOrSteal(caller, task)) {
+            RunTask(task, caller);
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ThreadPool::WorkerMain(unsigned int worker_index)
+{
+    owning_pool_ = this;
+    participant_index_ = worker_index;
+
+    Task task;
+    while (true) {
+        if (PopOrSteal(worker_index, task)) {
+            RunTask(task, worker_index);
+            continue;
+        }
+
+        // Nothing to do, sleep until more work is queued
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        wake_cv_.wait(lock, [this] { return stop_ || queued_tasks_.load() > 0; });
+        if (stop_) {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::PopOrSteal(unsigned int participant_index, Task& task)
+{
+    // Newest work from our own queue first, as it is most likely to still be in cache
+    {
+        WorkQueue& own = *queues_[participant_index];
+        std::lock_guard<std::mutex> lock(own.mutex_);
+        if (!own.tasks_.empty()) {
+            task = own.tasks_.back();
+            own.tasks_.pop_back();
+            queued_tasks_--;
+            return true;
+        }
+    }
+
+    // Otherwise steal the oldest work from another participant
+    for (unsigned int i = 1; i < thread_count_; i++) {
+        WorkQueue& victim = *queues_[(participant_index + i) % thread_count_];
+        std::lock_guard<std::mutex> lock(victim.mutex_);
+        if (!victim.tasks_.empty()) {
+            task = victim.tasks_.front();
+            victim.tasks_.pop_front();
+            queued_tasks_--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::RunTask(const Task& task, unsigned int participant_index)
+{
+    (*task.job_->func_)(task.begin_, task.end_, participant_index);
+    task.job_->remaining_chunks_.fetch_sub(1, std::memory_order_release);
+}
+
+}
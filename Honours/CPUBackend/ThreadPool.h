@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace CPUBackend {
+
+// A work-stealing thread pool.
+// Each participant (the worker threads plus the thread calling ParallelFor) owns a queue of range chunks.
+// Participants pop from the back of their own queue and steal from the front of the others when it runs dry.
+class ThreadPool
+{
+public:
+    // thread_count includes the calling thread, so a count of 1 runs everything inline
+    explicit ThreadPool(unsigned int thread_count = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    inline unsigned int GetThreadCount() const { return thread_count_; }
+
+    // Splits [begin, end) into chunks of at most grain_size and runs func(chunk_begin, chunk_end) on each.
+    // Blocks until every chunk has completed.
+    void ParallelFor(size_t begin, size_t end, size_t grain_size, const std::function<void(size_t, size_t)>& func);
+
+    // As above, but also passes the index (0 to GetThreadCount() - 1) of the participant running the chunk,
+    // for kernels which keep per-thread scratch data.
+    void ParallelForIndexed(size_t begin, size_t end, size_t grain_size, const std::function<void(size_t, size_t, unsigned int)>& func);
+
+private:
+    struct Job {
+        const std::function<void(size_t, size_t, unsigned int)>* func_;
+        std::atomic<size_t> remaining_chunks_;
+    };
+
+    struct Task {
+        size_t begin_;
+        size_t end_;
+        Job* job_;
+    };
+
+    struct WorkQueue {
+        std::mutex mutex_;
+        std::deque<Task> tasks_;
+    };
+
+    void WorkerMain(unsigned int worker_index);
+    bool PopOrSteal(unsigned int participant_index, Task& task);
+    void RunTask(const Task& task, unsigned int participant_index);
+
+    unsigned int thread_count_;
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<WorkQueue>> queues_;
+
+    // Used to put idle workers to sleep
+    std::mutex wake_mutex_;
+    std::condition_variable wake_cv_;
+    std::atomic<size_t> queued_tasks_ = 0;
+    bool stop_ = false;
+};
+
+}
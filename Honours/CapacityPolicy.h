@@ -0,0 +1,121 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Shared by the app and the CPU backend, so it only depends on the standard library
+// (std::min/max are parenthesised throughout to dodge the windows.h macros)
+
+struct CapacityPolicySettings {
+	float growth_factor_ = 1.5f;			// Capacity is grown to this multiple of what's required
+	float shrink_usage_ = 0.25f;			// Capacity is shrunk once less than this fraction of it is used...
+	uint32_t shrink_frames_ = 120;			// ...for this many frames in a row
+	uint64_t budget_bytes_ = UINT64_MAX;	// Growth stops at this size, unless more than it is required
+};
+
+struct CapacityStats {
+	uint32_t reallocations_ = 0;	// Since the policy was created
+	uint32_t over_budget_ = 0;		// Frames where more than the budget was required
+	uint64_t allocated_bytes_ = 0;
+	uint64_t wasted_bytes_ = 0;		// Allocated but not required by the last frame
+
+	inline CapacityStats& operator+=(const CapacityStats& other)
+	{
+		reallocations_ += other.reallocations_;
+		over_budget_ += other.over_budget_;
+		allocated_bytes_ += other.allocated_bytes_;
+		wasted_bytes_ += other.wasted_bytes_;
+		return *this;
+	}
+};
+
+// Decides when a growable resource (the brick pool, its buffers, the AABB buffer and the BLAS) is reallocated, and to what
+// capacity. Reallocating to exactly the new high-water mark means a requirement that creeps upwards reallocates every frame.
+// Instead capacity grows geometrically, and only shrinks once usage has stayed low for shrink_frames_ frames, so a
+// requirement hovering around either boundary doesn't reallocate over and over. Capacity is kept within the budget, unless
+// more than the budget is required.
+// Capacities are in elements of element_size bytes.
+class CapacityPolicy
+{
+public:
+	CapacityPolicy(uint64_t element_size = 1, const CapacityPolicySettings& settings = CapacityPolicySettings()) :
+		element_size_(element_size),
+		settings_(settings)
+	{
+	}
+
+	// Call once a frame with what the frame requires. Returns true when the resource needs reallocating at GetCapacity().
+	inline bool Update(uint64_t required)
+	{
+		required_ = required;
+		if (required * element_size_ > settings_.budget_bytes_) {
+			stats_.over_budget_++;
+		}
+
+		// Grow, or come back within the budget as soon as what's required fits it again
+		if (required > capacity_ || (GetCapacityBytes() > settings_.budget_bytes_ && required * element_size_ <= settings_.budget_bytes_)) {
+			low_usage_frames_ = 0;
+			return Resize(GrownCapacity(required));
+		}
+
+		// Count the frames in a row that use little of the capacity
+		if (required < capacity_ * (double)settings_.shrink_usage_) {
+			if (++low_usage_frames_ >= settings_.shrink_frames_) {
+				low_usage_frames_ = 0;
+				return Resize(GrownCapacity(required));
+			}
+		}
+		else {
+			low_usage_frames_ = 0;
+		}
+		return false;
+	}
+
+	// Grows without counting as a frame, for when more room turns out to be needed after Update
+	inline bool Grow(uint64_t required)
+	{
+		required_ = (std::max)(required_, required);
+		return required > capacity_ && Resize(GrownCapacity(required));
+	}
+
+	// For resources that round the capacity they're given up, eg. the brick pool's dimensions
+	inline void SetCapacity(uint64_t capacity) { capacity_ = capacity; }
+
+	inline uint64_t GetCapacity() const { return capacity_; }
+	inline uint64_t GetCapacityBytes() const { return capacity_ * element_size_; }
+
+	inline CapacityStats GetStats() const
+	{
+		CapacityStats stats = stats_;
+		stats.allocated_bytes_ = GetCapacityBytes();
+		stats.wasted_bytes_ = (capacity_ - (std::min)(required_, capacity_)) * element_size_;
+		return stats;
+	}
+
+private:
+	// Capacity to allocate for required elements, at least one so there's always a resource to bind
+	inline uint64_t GrownCapacity(uint64_t required) const
+	{
+		uint64_t grown = (uint64_t)std::ceil(required * (double)settings_.growth_factor_);
+		grown = (std::min)(grown, settings_.budget_bytes_ / element_size_);
+		return (std::max)((std::max)(grown, required), (uint64_t)1);
+	}
+
+	inline bool Resize(uint64_t capacity)
+	{
+		if (capacity == capacity_) {
+			return false;
+		}
+		capacity_ = capacity;
+		stats_.reallocations_++;
+		return true;
+	}
+
+	uint64_t element_size_;
+	CapacityPolicySettings settings_;
+
+	uint64_t capacity_ = 0;
+	uint64_t required_ = 0;
+	uint32_t low_usage_frames_ = 0;
+	CapacityStats stats_;
+};
@@ -5,10 +5,17 @@
 #include "SdfHelpers.hlsli"
 
 RWTexture3D<snorm float> output_texture_ : register(u0);
+RWStructuredBuffer<AABB> surface_aabbs_ : register(u1);
+RWStructuredBuffer<uint> surface_brick_indices_ : register(u2);
+RWStructuredBuffer<GridSurfaceCounts> surface_counts_ : register(u3);
+RWStructuredBuffer<uint> brick_slot_on_surface_ : register(u4);
+RWStructuredBuffer<BrickRange> brick_ranges_ : register(u5);
+RWTexture3D<snorm float4> normal_texture_ : register(u6); // Normalised SDF gradient of each voxel, when constant_buffer_.brick_normals_
 StructuredBuffer<AABB> aabbs_ : register(t1);
 StructuredBuffer<Cell> cell_particle_counts_ : register(t2);
 StructuredBuffer<uint> cell_global_index_offsets_ : register(t3);
 StructuredBuffer<uint> surface_cell_indices_ : register(t4);
+StructuredBuffer<CellBrickSlot> cell_brick_slots_ : register(t5);
 ConstantBuffer<ComputeCB> constant_buffer_ : register(b1);
 
 groupshared AABB aabb;
@@ -16,6 +23,64 @@ groupshared uint cell_index;
 groupshared uint3 brick_pool_dimensions;
 groupshared uint neighbouring_cells[27];
 
+// Particles that can reach this brick's voxels, in the order GetSignedDistanceNNS would visit them.
+// Bricks with more candidates than fit fall back to walking the neighbouring cells.
+#define MAX_BRICK_CANDIDATES 512
+#define BRICK_CANDIDATE_MARGIN 1.001f // Slack on a particle's reach, so rounding in the voxel positions can't drop a particle
+groupshared float3 candidate_positions[MAX_BRICK_CANDIDATES];
+groupshared uint cell_candidate_counts[27];
+groupshared uint candidate_count;
+
+// Set if any of the brick's voxels is close enough to the surface for the ray tracer to hit.
+// Values are compared a snorm step above the threshold, as the stored values are rounded.
+#define BRICK_CULL_THRESHOLD (SPHERE_TRACING_THRESHOLD + 1.f / 32767.f)
+groupshared uint brick_on_surface;
+
+// The brick's slot in the brick pool, and whether it needs filling. Bricks in slots allocated in earlier frames keep their
+// contents unless a particle moved in one of the 27 neighbouring cells.
+groupshared uint brick_slot;
+groupshared uint brick_dirty;
+
+// The cell's level of detail, and whether the cell uses this brick at that level (see CSBuildAABBs)
+groupshared uint brick_lod;
+groupshared uint brick_used;
+
+// Each pass over the bricks that fills some of their voxels. The last pass culls the bricks, see CullFilledBrick.
+#define BRICK_PASS_FILL 0
+#define BRICK_PASS_APRON 1
+#define BRICK_PASS_LOD_SEAM 2
+
+// 8-bit bricks (constant_buffer_.quantised_bricks_).
+// A narrow band brick's distances only span a few voxel widths, so they're stored relative to the brick's own range (see
+// BrickRange) rather than over [-1, 1]. Distances are first clamped to the band a ray can march through the brick in,
+// which only shortens steps that would leave the brick anyway. The range is reduced in fixed point, rounded outwards so
+// it holds every distance.
+#define BRICK_QUANTISE_BAND (length(BrickVoxelSize()) * VOXELS_PER_AXIS_PER_BRICK)
+#define BRICK_RANGE_FIXED_POINT 1048576.f
+groupshared int brick_range_min;
+groupshared int brick_range_max;
+groupshared BrickRange brick_range;
+
+// Spacing of this brick's voxels, which doubles with each level of detail
+float3 BrickVoxelSize()
+{
+    return (aabb.max_ - aabb.min_) / CORE_VOXELS_PER_AXIS_PER_BRICK;
+}
+
+// Whether this pass is the last to fill the bricks, so culls them
+bool IsLastBrickPass(uint pass)
+{
+    if (constant_buffer_.lod_bricks_)
+    {
+        return pass == BRICK_PASS_LOD_SEAM;
+    }
+    if (constant_buffer_.apron_free_bricks_)
+    {
+        return pass == BRICK_PASS_APRON;
+    }
+    return pass == BRICK_PASS_FILL;
+}
+
 // Works out the index of the voxel from the brick index and voxel offset
 uint3 BrickIndexToVoxelPosition(uint brick_index, uint3 voxel_offset)
 {
@@ -34,11 +99,12 @@ uint3 BrickIndexToVoxelPosition(uint brick_index, uint3 voxel_offset)
     return uint3(x, y, z);
 }
 
-// Calculated SDF value, checking the 27 adjacent cells utilising the ordered particles list
-float GetSignedDistanceNNS(float3 position)
+// Calculated SDF value and its gradient, checking the 27 adjacent cells utilising the ordered particles list
+float GetSignedDistanceNNS(float3 position, out float3 gradient)
 {
     // Init to large value
     float distance = 1000;
+    gradient = float3(0, 0, 0);
     
     // For each of the 27 adjacent cells
     for (uint x = 0; x < 27; x++)
@@ -55,10 +121,11 @@ float GetSignedDistanceNNS(float3 position)
                 for (uint i = 0; i < particle_count; i++) // For each particle
                 {
                     // Incorporate particle into final SDF value
-                    float distance1 = GetDistanceToSphere(particles_[particle_index_offset + i].position_ - position, PARTICLE_RADIUS);
+                    float3 displacement = particles_[particle_index_offset + i].position_ - position;
+                    float distance1 = GetDistanceToSphere(displacement, PARTICLE_RADIUS);
                     if (distance1 <= PARTICLE_INFLUENCE_RADIUS)
                     {
-                        distance = SmoothMin(distance, distance1, PARTICLE_RADIUS);
+                        distance = SmoothMinGradient(distance, gradient, distance1, GetSphereGradient(displacement), PARTICLE_RADIUS, gradient);
                     }
                 }                
             }
@@ -69,33 +136,555 @@ float GetSignedDistanceNNS(float3 position)
     return distance;
 }
 
-// Shader for creating SDF 3D texture 
-[numthreads(VOXELS_PER_AXIS_PER_BRICK, VOXELS_PER_AXIS_PER_BRICK, VOXELS_PER_AXIS_PER_BRICK)]
-void CSBrickPoolMain(int3 brick_index : SV_GroupID, int3 voxel_offset : SV_GroupThreadID, uint voxel_index : SV_GroupIndex)
+// Whether a particle can be within the influence radius of any voxel centre in the bounds.
+// A particle counts towards a voxel when its surface is within the influence radius, so its centre is within 3x radius.
+bool IsBrickCandidate(float3 particle_position, float3 voxels_min, float3 voxels_max)
+{
+    float3 displacement = particle_position - clamp(particle_position, voxels_min, voxels_max);
+    float reach = (PARTICLE_RADIUS + PARTICLE_INFLUENCE_RADIUS) * BRICK_CANDIDATE_MARGIN;
+    return dot(displacement, displacement) <= reach * reach;
+}
+
+// Counts the candidates in one of the neighbouring cells, storing them from candidate_offset onwards if store is set
+uint GatherCellCandidates(uint neighbour_list_index, float3 voxels_min, float3 voxels_max, bool store, uint candidate_offset)
+{
+    int cell_index = neighbouring_cells[neighbour_list_index];
+    if (cell_index < 0 || cell_index >= NUM_CELLS)
+    {
+        return 0;
+    }
+
+    uint cell_candidates = 0;
+    uint particle_count = cell_particle_counts_[cell_index].particle_count_;
+    uint particle_index_offset = cell_global_index_offsets_[cell_index];
+    for (uint i = 0; i < particle_count; i++)
+    {
+        float3 particle_position = particles_[particle_index_offset + i].position_;
+        if (IsBrickCandidate(particle_position, voxels_min, voxels_max))
+        {
+            if (store)
+            {
+                candidate_positions[candidate_offset + cell_candidates] = particle_position;
+            }
+            cell_candidates++;
+        }
+    }
+    return cell_candidates;
+}
+
+// Calculated SDF value and its gradient from the brick's candidate particles
+float GetSignedDistanceCandidates(float3 position, out float3 gradient)
+{
+    // Init to large value
+    float distance = 1000;
+    gradient = float3(0, 0, 0);
+
+    for (uint i = 0; i < candidate_count; i++)
+    {
+        // Incorporate particle into final SDF value
+        float3 displacement = candidate_positions[i] - position;
+        float distance1 = GetDistanceToSphere(displacement, PARTICLE_RADIUS);
+        if (distance1 <= PARTICLE_INFLUENCE_RADIUS)
+        {
+            distance = SmoothMinGradient(distance, gradient, distance1, GetSphereGradient(displacement), PARTICLE_RADIUS, gradient);
+        }
+    }
+
+    return distance;
+}
+
+// SDF value of a voxel, and its gradient when the brick pool stores normals. Functions are inlined, so the gradient is
+// only worked out in the branch that uses it. (?: would evaluate both sides)
+float GetVoxelDistance(float3 position, bool use_candidates, out float3 gradient)
+{
+    gradient = float3(0, 0, 0);
+    if (constant_buffer_.brick_normals_)
+    {
+        if (use_candidates)
+        {
+            return GetSignedDistanceCandidates(position, gradient);
+        }
+        return GetSignedDistanceNNS(position, gradient);
+    }
+
+    float3 unused_gradient;
+    if (use_candidates)
+    {
+        return GetSignedDistanceCandidates(position, unused_gradient);
+    }
+    return GetSignedDistanceNNS(position, unused_gradient);
+}
+
+// Loads this brick's AABB, cell, slot and neighbouring cells into groupshared memory, and works out if it needs filling.
+// Returns false for bricks the cell doesn't use at its level of detail, which every thread of the group returns on.
+bool LoadBrick(uint brick_index, int3 voxel_offset, uint voxel_index)
 {
-    // Load this bricks AABB, cell index and the brick pool's dimensions into groupshared memory
     if (voxel_index == 0)
     {
-        aabb = aabbs_[brick_index.x];
-        cell_index = surface_cell_indices_[brick_index.x / BRICKS_PER_CELL];
+        aabb = aabbs_[brick_index];
+        cell_index = surface_cell_indices_[brick_index / BRICKS_PER_CELL];
         brick_pool_dimensions = constant_buffer_.brick_pool_dimensions_;
+        brick_on_surface = 0;
+
+        CellBrickSlot cell_slot = cell_brick_slots_[cell_index];
+        uint intra_cell_brick_index = brick_index % BRICKS_PER_CELL;
+        brick_lod = cell_slot.lod_;
+        brick_used = intra_cell_brick_index < BricksPerCellAtLod(cell_slot.lod_);
+        brick_slot = cell_slot.slot_ + intra_cell_brick_index;
+        brick_dirty = cell_slot.allocated_frame_ == constant_buffer_.frame_;
+
+        // The fill replaces the range, the later passes use the range the fill stored
+        brick_range_min = 0x7fffffff;
+        brick_range_max = -0x7fffffff;
+        if (constant_buffer_.quantised_bricks_ && brick_used)
+        {
+            brick_range = brick_ranges_[brick_slot];
+        }
     }
     GroupMemoryBarrierWithGroupSync();
+
+    if (!brick_used)
+    {
+        return false;
+    }
     
-    // Load list of indices of neighbouring cells into groupshared memory
+    // Load list of indices of neighbouring cells into groupshared memory, and check if particles moved in any of them
     if (voxel_offset.x <= 2 && voxel_offset.y <= 2 && voxel_offset.z <= 2)
     {
         int neighbour_list_index = (voxel_offset.z * 9) + (voxel_offset.y * 3) + voxel_offset.x;
-        neighbouring_cells[neighbour_list_index] = OffsetCellIndex(cell_index, voxel_offset - 1); // find all cells with offsets between -(1,1,1) to (1,1,1), to give neighbours
+        int neighbour_index = OffsetCellIndex(cell_index, voxel_offset - 1); // find all cells with offsets between -(1,1,1) to (1,1,1), to give neighbours
+        neighbouring_cells[neighbour_list_index] = neighbour_index;
+
+        if (neighbour_index > -1 && neighbour_index < NUM_CELLS && cell_brick_slots_[neighbour_index].changed_frame_ == constant_buffer_.frame_)
+        {
+            InterlockedOr(brick_dirty, 1);
+        }
+    }
+    GroupMemoryBarrierWithGroupSync();
+    return true;
+}
+
+// Append the brick's AABB and slot to the compacted lists the BLAS is built from
+void AppendSurfaceBrick()
+{
+    uint surface_brick_index;
+    InterlockedAdd(surface_counts_[0].surface_bricks, 1, surface_brick_index);
+    surface_aabbs_[surface_brick_index] = aabb;
+    surface_brick_indices_[surface_brick_index] = brick_slot;
+}
+
+// Culls the brick once every thread has its voxel's distance, appending it if the ray tracer can hit it
+void CullFilledBrick(float distance, uint voxel_index)
+{
+    // Sampling interpolates between voxels, so a brick whose voxels are all above the threshold can't be hit
+    if (distance <= BRICK_CULL_THRESHOLD)
+    {
+        InterlockedOr(brick_on_surface, 1);
     }
     GroupMemoryBarrierWithGroupSync();
+
+    if (voxel_index == 0)
+    {
+        brick_slot_on_surface_[brick_slot] = brick_on_surface;
+        InterlockedAdd(surface_counts_[0].recomputed_bricks, 1);
+
+        if (brick_on_surface || !constant_buffer_.cull_empty_bricks_)
+        {
+            AppendSurfaceBrick();
+        }
+    }
+}
+
+// Adds a distance to the range of the brick's distances
+void AddToBrickRange(float distance)
+{
+    float band = BRICK_QUANTISE_BAND;
+    float fixed_distance = clamp(distance, -band, band) / band * BRICK_RANGE_FIXED_POINT;
+    InterlockedMin(brick_range_min, (int) floor(fixed_distance));
+    InterlockedMax(brick_range_max, (int) ceil(fixed_distance));
+}
+
+// Works out the brick's range once all its distances are added, widened by margin, and stores it for the ray tracer
+void StoreBrickRange(float margin)
+{
+    float band = BRICK_QUANTISE_BAND;
+    float range_min = max((brick_range_min / BRICK_RANGE_FIXED_POINT * band) - margin, -band);
+    float range_max = min((brick_range_max / BRICK_RANGE_FIXED_POINT * band) + margin, band);
+    brick_range.offset_ = (range_min + range_max) * 0.5f;
+    brick_range.scale_ = max((range_max - range_min) * 0.5f, 1e-6f); // Even a brick of one distance needs a scale
+    brick_ranges_[brick_slot] = brick_range;
+}
+
+// Value to store for a distance in an 8-bit brick with the given range
+float QuantiseDistance(float distance, BrickRange range)
+{
+    float band = BRICK_QUANTISE_BAND;
+    return (clamp(distance, -band, band) - range.offset_) / range.scale_;
+}
+
+float DequantiseDistance(float stored, BrickRange range)
+{
+    return range.offset_ + (stored * range.scale_);
+}
+
+// The distance the ray tracer reads back from this 8-bit brick, once rounded to R8_SNORM, for culling
+float RoundTripDistance(float distance)
+{
+    float stored = round(clamp(QuantiseDistance(distance, brick_range), -1.f, 1.f) * 127.f) / 127.f;
+    return DequantiseDistance(stored, brick_range);
+}
+
+// Apron-free bricks (constant_buffer_.apron_free_bricks_).
+// Each apron voxel of a brick is a core voxel of the neighbouring brick on that side, so CSBrickPoolMain only calculates
+// the core voxels, and the apron voxels with no brick on that side as the cell there isn't a surface cell. Once every
+// core is filled, CSBrickApronMain copies the rest of the apron from the neighbouring bricks, then culls the brick as that
+// needs all of its voxels. This roughly halves the voxels calculated, as 512 of the 1000 are core voxels.
+// Reading the cores back needs typed UAV loads of the brick pool's formats, see Computer::IsTypedUAVLoadSupported.
+
+// The slot of the brick whose core holds this voxel, for apron voxels with a brick on that side, otherwise
+// INVALID_BRICK_SLOT. owner_voxel_offset is the voxel's offset within that brick. With camera LOD, only a brick at the
+// same level of detail has the voxel in its core, so those facing a cell at another level are calculated.
+uint GetApronOwnerBrickSlot(uint brick_index, int3 voxel_offset, out int3 owner_voxel_offset)
+{
+    int3 direction = int3(voxel_offset == VOXELS_PER_AXIS_PER_BRICK - 1) - int3(voxel_offset == 0);
+    owner_voxel_offset = voxel_offset - (direction * CORE_VOXELS_PER_AXIS_PER_BRICK);
+    if (all(direction == 0))
+    {
+        return INVALID_BRICK_SLOT;
+    }
+
+    // Step into the neighbouring cell when the brick is on the edge of its own
+    int bricks_per_axis = BricksPerAxisAtLod(brick_lod);
+    int3 brick_offset = int3(BrickIndexTo3DOffset(brick_index % BRICKS_PER_CELL, bricks_per_axis)) + direction;
+    int3 cell_offset = int3(brick_offset >= bricks_per_axis) - int3(brick_offset < 0);
+    brick_offset -= cell_offset * bricks_per_axis;
+
+    int owner_cell_index = neighbouring_cells[((cell_offset.z + 1) * 9) + ((cell_offset.y + 1) * 3) + (cell_offset.x + 1)];
+    if (owner_cell_index < 0 || owner_cell_index >= NUM_CELLS)
+    {
+        return INVALID_BRICK_SLOT;
+    }
+
+    // Only surface cells hold a slot
+    CellBrickSlot owner_cell_slot = cell_brick_slots_[owner_cell_index];
+    if (owner_cell_slot.slot_ == INVALID_BRICK_SLOT || owner_cell_slot.lod_ != brick_lod)
+    {
+        return INVALID_BRICK_SLOT;
+    }
+    return owner_cell_slot.slot_ + (((brick_offset.z * bricks_per_axis) + brick_offset.y) * bricks_per_axis) + brick_offset.x;
+}
+
+// Shader for creating SDF 3D texture
+[numthreads(VOXELS_PER_AXIS_PER_BRICK, VOXELS_PER_AXIS_PER_BRICK, VOXELS_PER_AXIS_PER_BRICK)]
+void CSBrickPoolMain(int3 brick_index : SV_GroupID, int3 voxel_offset : SV_GroupThreadID, uint voxel_index : SV_GroupIndex)
+{
+    if (!LoadBrick(brick_index.x, voxel_offset, voxel_index))
+    {
+        return;
+    }
+
+    // Keep the brick's contents from the previous frame, it only needs adding to the list the BLAS is built from
+    // (by the last pass, for apron-free bricks or with camera LOD)
+    if (!brick_dirty)
+    {
+        if (voxel_index == 0 && IsLastBrickPass(BRICK_PASS_FILL) && (brick_slot_on_surface_[brick_slot] || !constant_buffer_.cull_empty_bricks_))
+        {
+            AppendSurfaceBrick();
+        }
+        return;
+    }
     
-    float3 voxel_size = VOXEL_SIZE;
+    float3 voxel_size = BrickVoxelSize();
     float3 position = aabb.min_ + (voxel_size * (float3) (voxel_offset - 1)) + (voxel_size * 0.5f); // voxel offset is offset by -(1,1,1) to account for adjacency voxels
-   
-    // Calculate and store SDF value
-    output_texture_[BrickIndexToVoxelPosition(brick_index.x, voxel_offset)] = GetSignedDistanceNNS(position);                 
-    
+
+    // Bounds of the brick's voxel centres, apron included
+    float3 voxels_min = aabb.min_ - (voxel_size * 0.5f);
+    float3 voxels_max = aabb.min_ + (voxel_size * (VOXELS_PER_AXIS_PER_BRICK - 1.5f));
+
+    // Build the candidate list once per brick, with a thread per neighbouring cell. Each counts its cell's candidates,
+    // then stores them after those of the cells before it, keeping the order of the 27 cell walk.
+    if (voxel_index < 27)
+    {
+        cell_candidate_counts[voxel_index] = GatherCellCandidates(voxel_index, voxels_min, voxels_max, false, 0);
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    uint candidate_offset = 0;
+    if (voxel_index < 27)
+    {
+        for (uint i = 0; i < voxel_index; i++)
+        {
+            candidate_offset += cell_candidate_counts[i];
+        }
+        if (voxel_index == 26)
+        {
+            candidate_count = candidate_offset + cell_candidate_counts[26];
+        }
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    bool use_candidates = candidate_count <= MAX_BRICK_CANDIDATES;
+    if (voxel_index < 27 && use_candidates)
+    {
+        GatherCellCandidates(voxel_index, voxels_min, voxels_max, true, candidate_offset);
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    // Apron voxels of apron-free bricks with a brick on that side are left for CSBrickApronMain
+    int3 owner_voxel_offset;
+    bool calculate = !constant_buffer_.apron_free_bricks_ || GetApronOwnerBrickSlot(brick_index.x, voxel_offset, owner_voxel_offset) == INVALID_BRICK_SLOT;
+
+    // Calculate SDF value
+    float distance = 1000;
+    float3 gradient = float3(0, 0, 0);
+    if (calculate)
+    {
+        distance = GetVoxelDistance(position, use_candidates, gradient);
+    }
+
+    // 8-bit bricks are stored relative to the range of their distances. Apron-free bricks don't have their apron yet,
+    // so the range is widened by a voxel's diagonal to hold it, the furthest an apron voxel is from a calculated voxel.
+    // The apron voxels CSBrickLodSeamMain adjusts are held likewise, give or take the difference between the levels.
+    float stored_distance = distance;
+    if (constant_buffer_.quantised_bricks_)
+    {
+        if (calculate)
+        {
+            AddToBrickRange(distance);
+        }
+        GroupMemoryBarrierWithGroupSync();
+
+        if (voxel_index == 0)
+        {
+            StoreBrickRange(constant_buffer_.apron_free_bricks_ || constant_buffer_.lod_bricks_ ? length(voxel_size) : 0.f);
+        }
+        GroupMemoryBarrierWithGroupSync();
+
+        stored_distance = QuantiseDistance(distance, brick_range);
+        distance = RoundTripDistance(distance);
+    }
+
+    if (calculate)
+    {
+        output_texture_[BrickIndexToVoxelPosition(brick_slot, voxel_offset)] = stored_distance;
+        if (constant_buffer_.brick_normals_)
+        {
+            normal_texture_[BrickIndexToVoxelPosition(brick_slot, voxel_offset)] = float4(gradient / max(length(gradient), 1e-8f), 0); // No gradient out of reach of the particles
+        }
+    }
+
+    if (IsLastBrickPass(BRICK_PASS_FILL))
+    {
+        CullFilledBrick(distance, voxel_index);
+    }
+}
+
+// Second pass for apron-free bricks, copying the apron voxels CSBrickPoolMain left from the neighbouring bricks' cores
+[numthreads(VOXELS_PER_AXIS_PER_BRICK, VOXELS_PER_AXIS_PER_BRICK, VOXELS_PER_AXIS_PER_BRICK)]
+void CSBrickApronMain(int3 brick_index : SV_GroupID, int3 voxel_offset : SV_GroupThreadID, uint voxel_index : SV_GroupIndex)
+{
+    if (!LoadBrick(brick_index.x, voxel_offset, voxel_index))
+    {
+        return;
+    }
+
+    // Kept bricks' aprons are still valid, as a particle that changes an apron voxel is in one of the neighbouring cells
+    if (!brick_dirty)
+    {
+        if (voxel_index == 0 && IsLastBrickPass(BRICK_PASS_APRON) && (brick_slot_on_surface_[brick_slot] || !constant_buffer_.cull_empty_bricks_))
+        {
+            AppendSurfaceBrick();
+        }
+        return;
+    }
+
+    // Only core voxels of other bricks are read, and only this brick's apron voxels written, so groups can't race
+    uint3 voxel_position = BrickIndexToVoxelPosition(brick_slot, voxel_offset);
+    int3 owner_voxel_offset;
+    uint owner_brick_slot = GetApronOwnerBrickSlot(brick_index.x, voxel_offset, owner_voxel_offset);
+    float distance;
+    if (owner_brick_slot != INVALID_BRICK_SLOT)
+    {
+        uint3 owner_voxel_position = BrickIndexToVoxelPosition(owner_brick_slot, owner_voxel_offset);
+        distance = output_texture_[owner_voxel_position];
+        if (constant_buffer_.brick_normals_)
+        {
+            normal_texture_[voxel_position] = normal_texture_[owner_voxel_position];
+        }
+
+        // 8-bit bricks each have their own range, so the voxel is requantised
+        if (constant_buffer_.quantised_bricks_)
+        {
+            distance = DequantiseDistance(distance, brick_ranges_[owner_brick_slot]);
+            output_texture_[voxel_position] = QuantiseDistance(distance, brick_range);
+            distance = RoundTripDistance(distance);
+        }
+        else
+        {
+            output_texture_[voxel_position] = distance;
+        }
+    }
+    else
+    {
+        distance = output_texture_[voxel_position];
+        if (constant_buffer_.quantised_bricks_)
+        {
+            distance = DequantiseDistance(distance, brick_range);
+        }
+    }
+
+    if (IsLastBrickPass(BRICK_PASS_APRON))
+    {
+        CullFilledBrick(distance, voxel_index);
+    }
+}
+
+// Camera LOD seams (constant_buffer_.lod_bricks_).
+// Where a cell borders a coarser one, each side of the shared face interpolates its own voxels, so the surface would
+// step where the levels meet. The face lies halfway between a brick's apron voxels and the core voxels inside them, so
+// once every brick is filled, CSBrickLodSeamMain sets each apron voxel facing a coarser cell to 2 * coarse - core, making
+// the fine brick's field equal the coarse brick's at each fine voxel centre on the face. Apron voxels on the brick's
+// edges and corners are averaged with 4 and 8 voxels at the face points they sit on, so are set in turn once the face
+// voxels are. They're stitched to a coarser cell across a single face before one across an edge or corner, as that only
+// touches the brick along a line, and neighbouring coarse cells can disagree by over a voxel away from the surface.
+// Between the face points the two sides differ by at most the coarse field's interpolation error, and the coarse side
+// isn't changed, as the fine brick's aprons match it rather than the other way around.
+// The coarse bricks are sampled by hand, which needs typed UAV loads as for apron-free bricks.
+groupshared float seam_distances[VOXELS_PER_AXIS_PER_BRICK * VOXELS_PER_AXIS_PER_BRICK * VOXELS_PER_AXIS_PER_BRICK];
+
+// Trilinear sample of the field a coarser cell's bricks hold, at a point on or within the cell
+float SampleCellBricks(uint sample_cell_index, CellBrickSlot sample_cell_slot, float3 position)
+{
+    float3 cell_min = lerp(WORLD_MIN, WORLD_MAX, CellIndexTo3DCoords(sample_cell_index) / float3(NUM_CELLS_PER_AXIS));
+    uint bricks_per_axis = BricksPerAxisAtLod(sample_cell_slot.lod_);
+    float3 brick_size = CELL_SIZE / (float) bricks_per_axis;
+    uint3 brick_offset = (uint3) clamp(floor((position - cell_min) / brick_size), 0.f, (float) (bricks_per_axis - 1));
+    uint sample_brick_slot = sample_cell_slot.slot_ + (((brick_offset.z * bricks_per_axis) + brick_offset.y) * bricks_per_axis) + brick_offset.x;
+
+    // Position in the brick's voxels, voxel i being centred on i as the apron is voxel 0
+    float3 brick_min = cell_min + (brick_offset * brick_size);
+    float3 voxel = clamp(((position - brick_min) / (brick_size / CORE_VOXELS_PER_AXIS_PER_BRICK)) + 0.5f, 0.f, VOXELS_PER_AXIS_PER_BRICK - 1.f);
+    uint3 base_voxel = min((uint3) voxel, VOXELS_PER_AXIS_PER_BRICK - 2);
+    float3 t = voxel - base_voxel;
+
+    float distance = 0;
+    for (uint corner = 0; corner < 8; corner++)
+    {
+        uint3 corner_offset = uint3(corner & 1, (corner >> 1) & 1, corner >> 2);
+        float3 weights = lerp(1.f - t, t, (float3) corner_offset);
+        distance += weights.x * weights.y * weights.z * output_texture_[BrickIndexToVoxelPosition(sample_brick_slot, base_voxel + corner_offset)];
+    }
+    if (constant_buffer_.quantised_bricks_)
+    {
+        distance = DequantiseDistance(distance, brick_ranges_[sample_brick_slot]);
+    }
+    return distance;
+}
+
+// The coarser surface cell across the given axes of an apron voxel, or -1 where it's in the brick's own cell or one at
+// the same level or finer
+int GetLodSeamCell(uint intra_cell_brick_index, int3 seam_direction, out CellBrickSlot seam_cell_slot)
+{
+    int bricks_per_axis = BricksPerAxisAtLod(brick_lod);
+    int3 brick_offset = int3(BrickIndexTo3DOffset(intra_cell_brick_index, bricks_per_axis)) + seam_direction;
+    int3 cell_offset = int3(brick_offset >= bricks_per_axis) - int3(brick_offset < 0);
+    int seam_cell_index = neighbouring_cells[((cell_offset.z + 1) * 9) + ((cell_offset.y + 1) * 3) + (cell_offset.x + 1)];
+    seam_cell_slot = (CellBrickSlot) 0;
+    if (all(cell_offset == 0) || seam_cell_index < 0 || seam_cell_index >= NUM_CELLS)
+    {
+        return -1;
+    }
+    seam_cell_slot = cell_brick_slots_[seam_cell_index];
+    return seam_cell_slot.slot_ != INVALID_BRICK_SLOT && seam_cell_slot.lod_ > brick_lod ? seam_cell_index : -1;
+}
+
+// Last pass with camera LOD, matching the aprons of bricks bordering coarser cells to them, then culling the bricks
+[numthreads(VOXELS_PER_AXIS_PER_BRICK, VOXELS_PER_AXIS_PER_BRICK, VOXELS_PER_AXIS_PER_BRICK)]
+void CSBrickLodSeamMain(int3 brick_index : SV_GroupID, int3 voxel_offset : SV_GroupThreadID, uint voxel_index : SV_GroupIndex)
+{
+    if (!LoadBrick(brick_index.x, voxel_offset, voxel_index))
+    {
+        return;
+    }
+
+    // Kept bricks' aprons are still valid, as a cell that changes level marks itself changed
+    if (!brick_dirty)
+    {
+        if (voxel_index == 0 && (brick_slot_on_surface_[brick_slot] || !constant_buffer_.cull_empty_bricks_))
+        {
+            AppendSurfaceBrick();
+        }
+        return;
+    }
+
+    uint3 voxel_position = BrickIndexToVoxelPosition(brick_slot, voxel_offset);
+    float distance = output_texture_[voxel_position];
+    if (constant_buffer_.quantised_bricks_)
+    {
+        distance = DequantiseDistance(distance, brick_range);
+    }
+    seam_distances[voxel_index] = distance;
+
+    // Apron voxels facing a coarser surface cell take 2^k times the coarse field at the face point they share with the
+    // voxels inside them, less those voxels, k being the number of axes they're stitched across. Cells across fewer of
+    // the axes the voxel is outside the brick on come first
+    int3 direction = int3(voxel_offset == VOXELS_PER_AXIS_PER_BRICK - 1) - int3(voxel_offset == 0);
+    uint outside_axes = abs(direction.x) + abs(direction.y) + abs(direction.z);
+    int3 seam = int3(0, 0, 0);
+    float seam_total = 0;
+    bool on_seam = false;
+    for (uint seam_axes = 1; seam_axes <= outside_axes && !on_seam; seam_axes++)
+    {
+        for (uint mask = 1; mask < 8 && !on_seam; mask++)
+        {
+            seam = direction * int3(mask & 1, (mask >> 1) & 1, mask >> 2);
+            CellBrickSlot seam_cell_slot;
+            int seam_cell_index = countbits(mask) == seam_axes && (uint) (abs(seam.x) + abs(seam.y) + abs(seam.z)) == seam_axes ? GetLodSeamCell(brick_index.x % BRICKS_PER_CELL, seam, seam_cell_slot) : -1;
+            if (seam_cell_index > -1)
+            {
+                float3 voxel_size = BrickVoxelSize();
+                float3 face_point = aabb.min_ + (voxel_size * ((float3) voxel_offset - 0.5f - (seam * 0.5f)));
+                seam_total = SampleCellBricks(seam_cell_index, seam_cell_slot, face_point) * (1 << seam_axes);
+                on_seam = true;
+            }
+        }
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    // Face voxels first, then edges, then corners, each only reading voxels outside the brick on fewer axes
+    for (uint axes = 1; axes <= 3; axes++)
+    {
+        if (on_seam && outside_axes == axes)
+        {
+            for (uint inward = 1; inward < 8; inward++)
+            {
+                int3 inward_axes = int3(inward & 1, (inward >> 1) & 1, inward >> 2);
+                if (all(inward_axes <= abs(seam))) // Only along the axes the voxel is stitched across
+                {
+                    int3 other = voxel_offset - (inward_axes * seam);
+                    seam_total -= seam_distances[(((other.z * VOXELS_PER_AXIS_PER_BRICK) + other.y) * VOXELS_PER_AXIS_PER_BRICK) + other.x];
+                }
+            }
+            seam_distances[voxel_index] = seam_total;
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    distance = seam_distances[voxel_index];
+    if (on_seam)
+    {
+        if (constant_buffer_.quantised_bricks_)
+        {
+            output_texture_[voxel_position] = QuantiseDistance(distance, brick_range);
+            distance = RoundTripDistance(distance);
+        }
+        else
+        {
+            output_texture_[voxel_position] = distance;
+        }
+    }
+
+    CullFilledBrick(distance, voxel_index);
 }
 
 #endif
\ No newline at end of file
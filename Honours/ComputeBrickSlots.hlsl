@@ -0,0 +1,162 @@
+#ifndef COMPUTE_BRICK_SLOTS_HLSL
+#define COMPUTE_BRICK_SLOTS_HLSL
+
+#include "ComputeGridCommon.hlsli"
+
+RWStructuredBuffer<CellBrickSlot> cell_brick_slots_ : register(u0);
+RWStructuredBuffer<uint> free_brick_slots_ : register(u1);
+RWStructuredBuffer<uint> free_brick_slots_count_ : register(u2);
+RWStructuredBuffer<GridSurfaceCounts> surface_counts_ : register(u3);
+StructuredBuffer<uint> surface_cell_indices_ : register(t0);
+ConstantBuffer<ComputeCB> constant_buffer_ : register(b1);
+
+// Persistent brick pool slots.
+// Each surface cell holds a slot of bricks in the brick pool for as long as it stays a surface cell at the same level of
+// detail, so bricks whose particles haven't moved keep their contents from the previous frame. Free slots are kept on a
+// stack per level, as a level's slots hold BricksPerCellAtLod bricks. Every frame the surface cells are marked, the slots
+// of cells that are no longer surface cells or changed level are pushed onto their level's stack, then the new surface
+// cells pop slots off the stack of their level. The brick pool holds a slot for every surface cell at each level, so the
+// stacks can't run out.
+// The levels' stacks and bricks are laid out coarsest first, so level 0 takes whatever the packing leaves at the end.
+
+// Where a level's free slots start in free_brick_slots_
+uint GetLodStackBase(uint lod)
+{
+    uint base = 0;
+    for (uint level = lod + 1; level < MAX_BRICK_LODS; level++)
+    {
+        base += constant_buffer_.lod_slot_capacities_[level];
+    }
+    return base;
+}
+
+// Where a level's bricks start in the brick pool
+uint GetLodBrickBase(uint lod)
+{
+    uint base = 0;
+    for (uint level = lod + 1; level < MAX_BRICK_LODS; level++)
+    {
+        base += constant_buffer_.lod_slot_capacities_[level] * BricksPerCellAtLod(level);
+    }
+    return base;
+}
+
+// Empties every cell's slot and fills the stacks with every slot. The cells keep this frame's level of detail.
+[numthreads(1024, 1, 1)]
+void CSResetBrickSlots(int3 dispatch_ID : SV_DispatchThreadID)
+{
+    if (dispatch_ID.x < MAX_BRICK_LODS)
+    {
+        free_brick_slots_count_[dispatch_ID.x] = constant_buffer_.lod_slot_capacities_[dispatch_ID.x];
+    }
+    if (dispatch_ID.x < NUM_CELLS)
+    {
+        CellBrickSlot cell_slot = (CellBrickSlot)0;
+        cell_slot.slot_ = INVALID_BRICK_SLOT;
+        cell_slot.lod_ = cell_brick_slots_[dispatch_ID.x].lod_;
+        cell_brick_slots_[dispatch_ID.x] = cell_slot;
+    }
+    if (dispatch_ID.x < constant_buffer_.brick_slot_capacity_)
+    {
+        // Find the level whose stack this entry is in
+        uint lod = MAX_BRICK_LODS - 1;
+        uint stack_base = 0;
+        while (lod > 0 && dispatch_ID.x >= stack_base + constant_buffer_.lod_slot_capacities_[lod])
+        {
+            stack_base += constant_buffer_.lod_slot_capacities_[lod];
+            lod--;
+        }
+
+        uint capacity = constant_buffer_.lod_slot_capacities_[lod];
+        uint slot_index = capacity - 1 - (dispatch_ID.x - stack_base); // Low slots on top
+        free_brick_slots_[dispatch_ID.x] = GetLodBrickBase(lod) + (slot_index * BricksPerCellAtLod(lod));
+    }
+}
+
+// Picks each surface cell's level of detail from the pixels its voxels cover, measured at the point of the cell nearest
+// the camera. A cell takes the coarsest level whose voxels still cover no more than lod_pixels_per_voxel_ pixels, and
+// as a voxel's projected size halves each time the distance doubles, each level starts twice as far away as the last.
+// Without camera LOD every cell is at level 0. Counts the cells at each level, which the brick pool is sized from.
+[numthreads(1024, 1, 1)]
+void CSSelectCellLods(int3 dispatch_ID : SV_DispatchThreadID)
+{
+    if (dispatch_ID.x >= surface_counts_[0].surface_cells)
+    {
+        return;
+    }
+
+    uint cell_index = surface_cell_indices_[dispatch_ID.x];
+    uint lod = 0;
+    if (constant_buffer_.lod_bricks_)
+    {
+        float3 cell_min = lerp(WORLD_MIN, WORLD_MAX, CellIndexTo3DCoords(cell_index) / float3(NUM_CELLS_PER_AXIS));
+        float3 nearest = clamp(constant_buffer_.camera_position_, cell_min, cell_min + CELL_SIZE);
+        float distance = max(length(nearest - constant_buffer_.camera_position_), 1e-6f);
+        float voxel_pixels = BRICK_VOXEL_SIZE.x * constant_buffer_.lod_pixel_scale_ / distance;
+        lod = (uint) clamp(floor(log2(constant_buffer_.lod_pixels_per_voxel_ / voxel_pixels)), 0.f, (float) MaxBrickLod());
+    }
+
+    cell_brick_slots_[cell_index].lod_ = lod;
+    InterlockedAdd(surface_counts_[0].lod_surface_cells[lod], 1);
+}
+
+// Marks this frame's surface cells
+[numthreads(1024, 1, 1)]
+void CSMarkSurfaceCells(int3 dispatch_ID : SV_DispatchThreadID)
+{
+    if (dispatch_ID.x >= surface_counts_[0].surface_cells)
+    {
+        return;
+    }
+
+    cell_brick_slots_[surface_cell_indices_[dispatch_ID.x]].surface_frame_ = constant_buffer_.frame_;
+}
+
+// Frees the slots of cells that are no longer surface cells, or whose level of detail changed
+[numthreads(1024, 1, 1)]
+void CSReleaseBrickSlots(int3 dispatch_ID : SV_DispatchThreadID)
+{
+    if (dispatch_ID.x >= NUM_CELLS)
+    {
+        return;
+    }
+
+    CellBrickSlot cell_slot = cell_brick_slots_[dispatch_ID.x];
+    bool surface_cell = cell_slot.surface_frame_ == constant_buffer_.frame_;
+    if (cell_slot.slot_ != INVALID_BRICK_SLOT && (!surface_cell || cell_slot.slot_lod_ != cell_slot.lod_))
+    {
+        uint free_index;
+        InterlockedAdd(free_brick_slots_count_[cell_slot.slot_lod_], 1, free_index);
+        free_brick_slots_[GetLodStackBase(cell_slot.slot_lod_) + free_index] = cell_slot.slot_;
+        cell_brick_slots_[dispatch_ID.x].slot_ = INVALID_BRICK_SLOT;
+
+        // The neighbouring bricks' aprons depend on this cell's level, so they're refilled too
+        if (surface_cell)
+        {
+            cell_brick_slots_[dispatch_ID.x].changed_frame_ = constant_buffer_.frame_;
+        }
+    }
+}
+
+// Gives surface cells without a slot one from their level's stack, their bricks then get filled by CSBrickPoolMain
+[numthreads(1024, 1, 1)]
+void CSAllocateBrickSlots(int3 dispatch_ID : SV_DispatchThreadID)
+{
+    if (dispatch_ID.x >= surface_counts_[0].surface_cells)
+    {
+        return;
+    }
+
+    uint cell_index = surface_cell_indices_[dispatch_ID.x];
+    CellBrickSlot cell_slot = cell_brick_slots_[cell_index];
+    if (cell_slot.slot_ == INVALID_BRICK_SLOT)
+    {
+        uint free_count;
+        InterlockedAdd(free_brick_slots_count_[cell_slot.lod_], -1, free_count);
+        cell_brick_slots_[cell_index].slot_ = free_brick_slots_[GetLodStackBase(cell_slot.lod_) + free_count - 1];
+        cell_brick_slots_[cell_index].slot_lod_ = cell_slot.lod_;
+        cell_brick_slots_[cell_index].allocated_frame_ = constant_buffer_.frame_;
+    }
+}
+
+#endif
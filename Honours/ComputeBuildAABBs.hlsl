@@ -5,9 +5,12 @@
 
 StructuredBuffer<uint> surface_cell_indices_ : register(t0);
 StructuredBuffer<GridSurfaceCounts> surface_counts_ : register(t1);
+StructuredBuffer<CellBrickSlot> cell_brick_slots_ : register(t2);
 RWStructuredBuffer<AABB> aabbs_ : register(u0);
 
-// Builds Array of AABBs in for surface cells world space
+// Builds Array of AABBs in for surface cells world space.
+// Every cell is given BRICKS_PER_CELL AABBs, of which a cell at a coarser level of detail only uses its first
+// BricksPerCellAtLod, each covering more of the cell. The rest are left empty, and skipped by CSBrickPoolMain.
 [numthreads(1024, 1, 1)]
 void CSBuildAABBs(int3 dispatch_ID : SV_DispatchThreadID)
 {
@@ -27,13 +30,22 @@ void CSBuildAABBs(int3 dispatch_ID : SV_DispatchThreadID)
     float3 world_pos = lerp(WORLD_MIN, WORLD_MAX, grid_cell_coords_3d / float3(NUM_CELLS_PER_AXIS));
     
     // Determine which brick within the cell the AABB is for
-    uint intra_cell_brick_index = dispatch_ID.x % BRICKS_PER_CELL;    
-    float3 brick_offset = BrickIndexTo3DOffset(intra_cell_brick_index);
+    uint lod = cell_brick_slots_[grid_cell_index].lod_;
+    uint bricks_per_axis = BricksPerAxisAtLod(lod);
+    uint intra_cell_brick_index = dispatch_ID.x % BRICKS_PER_CELL;
+    if (intra_cell_brick_index >= BricksPerCellAtLod(lod))
+    {
+        AABB empty_aabb = { world_pos, world_pos };
+        aabbs_[dispatch_ID.x] = empty_aabb;
+        return;
+    }
+    float3 brick_offset = BrickIndexTo3DOffset(intra_cell_brick_index, bricks_per_axis);
+    float3 brick_size = CELL_SIZE / (float) bricks_per_axis;
     
     // Create and store the AABB
     AABB aabb;
-    aabb.min_ = world_pos + (brick_offset * BRICK_SIZE);
-    aabb.max_ = aabb.min_ + BRICK_SIZE;
+    aabb.min_ = world_pos + (brick_offset * brick_size);
+    aabb.max_ = aabb.min_ + brick_size;
 
     aabbs_[dispatch_ID.x] = aabb;
 }
@@ -3,6 +3,9 @@
 
 #include "GlobalValues.hlsli"
 
+// Distance at which sphere tracing reports a hit, also used to cull bricks that can't be hit
+#define SPHERE_TRACING_THRESHOLD 0.001f
+
 struct ParticleData
 {
     float3 position_;
@@ -16,6 +19,29 @@ struct ComputeCB
 {
     float time_;
     uint3 brick_pool_dimensions_;
+    uint cull_empty_bricks_; // Whether bricks the ray tracer can't hit are left out of the BLAS
+    uint frame_; // Counts up every frame, for the brick slots
+    uint brick_slot_capacity_; // Cells' worth of bricks the brick pool can hold
+    uint apron_free_bricks_; // Whether bricks only calculate their cores, copying the apron from their neighbours
+    uint quantised_bricks_; // Whether the brick pool is 8-bit, with a BrickRange per brick
+    uint brick_normals_; // Whether the brick pool has a normal channel, filled from the SDF's gradient
+    uint lod_bricks_; // Whether cells get fewer bricks the further they are from the camera, see CSSelectCellLods
+    float lod_pixels_per_voxel_; // Cells are coarsened while their voxels would still cover fewer pixels than this
+    float3 camera_position_;
+    float lod_pixel_scale_; // Pixels a unit covers at a distance of one unit from the camera
+    uint4 lod_slot_capacities_; // Cells' worth of bricks the brick pool holds at each level, see ComputeBrickSlots.hlsl
+    uint narrow_band_voxels_; // Voxels past the surface cells the Simple method's texture is exact within, 0 for everywhere
+    uint distance_pyramid_; // Whether the Simple method's texture has a distance pyramid built over it, for rays to skip empty space
+    uint sorted_surface_lists_; // Whether surface blocks and cells are flagged, scanned and scattered in index order, rather than appended
+    uint flag_block_neighbours_; // Whether neighbouring blocks are marked with BLOCK_NEIGHBOUR_FLAG rather than counted, see CSGridMain
+};
+
+// 8-bit bricks store each voxel as (distance - offset_) / scale_, in R8_SNORM.
+// Trilinear filtering is linear, so a sample is dequantised the same way, offset_ + scale_ * sample.
+struct BrickRange
+{
+    float offset_;
+    float scale_;
 };
 
 struct AABB
@@ -24,6 +50,29 @@ struct AABB
     float3 max_;
 };
 
+// Distance pyramid over the Simple method's texture, see CPUBackend/DistancePyramid.h. Each level halves the resolution of
+// the one below, its texels holding the lowest distance the texture can be sampled at within them. The levels are one after
+// another in a buffer, from the finest.
+#define DISTANCE_PYRAMID_LEVELS 6 // Texels 2 up to 64 voxels wide
+
+uint DistancePyramidResolution(uint level)
+{
+    return (TEXTURE_RESOLUTION + (1u << level) - 1) >> level;
+}
+
+// Index of a texel of a level, from 1 up to DISTANCE_PYRAMID_LEVELS
+uint DistancePyramidIndex(uint level, uint3 texel)
+{
+    uint offset = 0;
+    for (uint below = 1; below < level; below++)
+    {
+        uint below_res = DistancePyramidResolution(below);
+        offset += below_res * below_res * below_res;
+    }
+    uint res = DistancePyramidResolution(level);
+    return offset + (texel.z * res + texel.y) * res + texel.x;
+}
+
 
 
 #endif
\ No newline at end of file
@@ -10,9 +10,22 @@ RWStructuredBuffer<uint> surface_block_indices_ : register(u3);
 RWStructuredBuffer<uint> surface_cell_indices_ : register(u4);
 RWStructuredBuffer<GridSurfaceCounts> surface_counts_ : register(u5);
 
+// With constant_buffer_.sorted_surface_lists_, each block and cell is flagged if it's on the surface, and the flags are
+// scanned (see Computer::ComputeGrid) so surface blocks and cells are scattered into their lists in index order
+RWStructuredBuffer<uint> surface_block_flags_ : register(u6);
+RWStructuredBuffer<uint> surface_block_offsets_ : register(u7); // Exclusive scan of surface_block_flags_
+RWStructuredBuffer<uint> surface_cell_flags_ : register(u8);
+RWStructuredBuffer<uint> surface_cell_offsets_ : register(u9); // Exclusive scan of surface_cell_flags_
 
-// Blocks: 4 x 4 x 4 total
-// Cells: 16 x 16 x 16 total, 4 x 4 x 4 per block
+ConstantBuffer<ComputeCB> constant_buffer_ : register(b1);
+
+// Set on a block's count by the cells next to it, rather than counting them, so whether the count ends on
+// NUM_CELLS_PER_BLOCK doesn't depend on the order the particles arrive in. See CPUBackend/GridEngine.h.
+#define BLOCK_NEIGHBOUR_FLAG 0x80000000u
+
+
+// Blocks: (cells per axis / 4) cubed total
+// Cells: set at run time from the particle radius (16 x 16 x 16 by default), 4 x 4 x 4 per block
 
 // Finds if a neighbouring cell is empty, given a current index and an offset
 // Returns true if neighbour cell exists
@@ -32,6 +45,12 @@ bool IsNeighbourEmpty(int cell_index, int3 offset, out bool empty)
 // Increment the count of surface cells and store the cell's index.
 void MarkAsSurfaceCell(uint cell_index)
 {
+    if (constant_buffer_.sorted_surface_lists_)
+    {
+        surface_cell_flags_[cell_index] = 1; // Each cell is visited by its own block's group only
+        return;
+    }
+
     uint surface_cells_array_index;
     InterlockedAdd(surface_counts_[0].surface_cells, 1, surface_cells_array_index);
     surface_cell_indices_[surface_cells_array_index] = cell_index;
@@ -48,12 +67,22 @@ void CSClearGridCounts(int3 dispatch_ID : SV_DispatchThreadID)
     {
         surface_counts_[0].surface_blocks = 0;
         surface_counts_[0].surface_cells = 0;        
+        surface_counts_[0].surface_bricks = 0;
+        surface_counts_[0].recomputed_bricks = 0;
+    }
+    if (dispatch_ID.x < MAX_BRICK_LODS)
+    {
+        surface_counts_[0].lod_surface_cells[dispatch_ID.x] = 0;
     }
-    if (dispatch_ID.x <= NUM_CELLS)
+    if (dispatch_ID.x < NUM_CELLS)
     {
         cells_[dispatch_ID.x].particle_count_ = 0;
+        if (constant_buffer_.sorted_surface_lists_)
+        {
+            surface_cell_flags_[dispatch_ID.x] = 0; // Only the cells of surface blocks are flagged
+        }
     }
-    if (dispatch_ID.x <= NUM_BLOCKS)
+    if (dispatch_ID.x < NUM_BLOCKS)
     {
         blocks_[dispatch_ID.x].non_empty_cell_count_ = 0;
     }
@@ -96,7 +125,15 @@ void CSGridMain(int3 dispatch_ID : SV_DispatchThreadID)
             int block_index = block_indices[i];
             if (block_index > -1)
             {
-                if (i == 0 || blocks_[block_index].non_empty_cell_count_ == 0)
+                if (i == 0)
+                {
+                    InterlockedAdd(blocks_[block_index].non_empty_cell_count_, 1);
+                }
+                else if (constant_buffer_.flag_block_neighbours_)
+                {
+                    InterlockedOr(blocks_[block_index].non_empty_cell_count_, BLOCK_NEIGHBOUR_FLAG);
+                }
+                else if (blocks_[block_index].non_empty_cell_count_ == 0)
                 {
                     InterlockedAdd(blocks_[block_index].non_empty_cell_count_, 1);
                 }
@@ -124,7 +161,14 @@ void CSDetectSurfaceBlocksMain(int3 dispatch_ID : SV_DispatchThreadID)
     
     // If the non-empty cell count is 0, or 64 and not at the edge, the block is not a surface block
     // Technically a surface block could be full and not at the edge of the bounds, but hopefully this isnt common enough to cause artifacts
-    if (blocks_[block_index].non_empty_cell_count_ == 0 || (blocks_[block_index].non_empty_cell_count_ == NUM_CELLS_PER_BLOCK && !IsBlockAtEdge(block_index)))
+    uint non_empty_cell_count = blocks_[block_index].non_empty_cell_count_;
+    bool surface_block = !(non_empty_cell_count == 0 || ((non_empty_cell_count & ~BLOCK_NEIGHBOUR_FLAG) == NUM_CELLS_PER_BLOCK && !IsBlockAtEdge(block_index)));
+    if (constant_buffer_.sorted_surface_lists_)
+    {
+        surface_block_flags_[block_index] = surface_block;
+        return;
+    }
+    if (!surface_block)
     {
         return;
     }
@@ -138,6 +182,46 @@ void CSDetectSurfaceBlocksMain(int3 dispatch_ID : SV_DispatchThreadID)
     return;
 }
 
+// Writes each flagged block to its place in the list of surface blocks, the last block writing the count
+[numthreads(1024, 1, 1)]
+void CSScatterSurfaceBlocksMain(int3 dispatch_ID : SV_DispatchThreadID)
+{
+    uint block_index = dispatch_ID.x;
+    if (block_index >= NUM_BLOCKS)
+    {
+        return;
+    }
+
+    if (surface_block_flags_[block_index])
+    {
+        surface_block_indices_[surface_block_offsets_[block_index]] = block_index;
+    }
+    if (block_index == NUM_BLOCKS - 1)
+    {
+        surface_counts_[0].surface_blocks = surface_block_offsets_[block_index] + surface_block_flags_[block_index];
+    }
+}
+
+// Writes each flagged cell to its place in the list of surface cells, the last cell writing the count
+[numthreads(1024, 1, 1)]
+void CSScatterSurfaceCellsMain(int3 dispatch_ID : SV_DispatchThreadID)
+{
+    uint cell_index = dispatch_ID.x;
+    if (cell_index >= NUM_CELLS)
+    {
+        return;
+    }
+
+    if (surface_cell_flags_[cell_index])
+    {
+        surface_cell_indices_[surface_cell_offsets_[cell_index]] = cell_index;
+    }
+    if (cell_index == NUM_CELLS - 1)
+    {
+        surface_counts_[0].surface_cells = surface_cell_offsets_[cell_index] + surface_cell_flags_[cell_index];
+    }
+}
+
 groupshared uint block_index;
 
 // Shader for detecting surface cells
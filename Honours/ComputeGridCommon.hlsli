@@ -20,10 +20,61 @@ struct GridSurfaceCounts
 {
     uint surface_blocks;
     uint surface_cells;
+    uint surface_bricks; // Bricks left after culling, see CSBrickPoolMain
+    uint recomputed_bricks; // Bricks filled this frame, the rest kept their slot's contents
+    uint lod_surface_cells[MAX_BRICK_LODS]; // Surface cells at each level of detail, see CSSelectCellLods
+};
+
+// Where a cell's bricks live in the brick pool, kept from frame to frame. See ComputeBrickSlots.hlsl.
+// Frames are those in ComputeCB, so a value equal to the current frame means it happened this frame.
+#define INVALID_BRICK_SLOT 0xffffffff
+struct CellBrickSlot
+{
+    uint slot_; // First of the cell's bricks in the pool, BricksPerCellAtLod(slot_lod_) of them
+    uint surface_frame_; // Last frame the cell was a surface cell
+    uint allocated_frame_; // Frame the slot was allocated
+    uint changed_frame_; // Last frame a particle moved within, into or out of the cell, or its level of detail changed
+    uint lod_; // Level of detail picked for the cell this frame
+    uint slot_lod_; // Level of detail the slot was allocated for
 };
 
 static const int invalid_block_indices[8] = { -1, -1, -1, -1, -1, -1, -1, -1 };
 
+// Spreads the lower 10 bits of x out to every third bit
+// From https://fgiesen.wordpress.com/2009/12/13/decoding-morton-codes/
+uint Part1By2(uint x)
+{
+    x &= 0x000003ff;
+    x = (x ^ (x << 16)) & 0xff0000ff;
+    x = (x ^ (x << 8)) & 0x0300f00f;
+    x = (x ^ (x << 4)) & 0x030c30c3;
+    x = (x ^ (x << 2)) & 0x09249249;
+    return x;
+}
+
+// Inverse of Part1By2
+uint Compact1By2(uint x)
+{
+    x &= 0x09249249;
+    x = (x ^ (x >> 2)) & 0x030c30c3;
+    x = (x ^ (x >> 4)) & 0x0300f00f;
+    x = (x ^ (x >> 8)) & 0xff0000ff;
+    x = (x ^ (x >> 16)) & 0x000003ff;
+    return x;
+}
+
+// Turns grid-space cell coords into a cell index, according to the cell indexing mode
+uint CellCoordsToIndex(uint3 coords)
+{
+    if (CELL_INDEXING == CellIndexingMorton)
+    {
+        return Part1By2(coords.x) | (Part1By2(coords.y) << 1) | (Part1By2(coords.z) << 2);
+    }
+    
+    uint3 cells_per_axis = uint3(NUM_CELLS_PER_AXIS);
+    return (coords.z * cells_per_axis.x * cells_per_axis.y) + (coords.y * cells_per_axis.x) + coords.x;
+}
+
 // Get the cell index based on particle position
 // Based on http://www.gamedev.net/forums/topic/582945-find-grid-index-based-on-position/4709749/
 int GetCellIndex(float3 particle_pos)
@@ -32,7 +83,7 @@ int GetCellIndex(float3 particle_pos)
     
     float3 cell_size = WORLD_MAX / cells_per_axis;
     
-    uint cell_ID = (uint) (particle_pos.x / cell_size.x) + ((uint) (particle_pos.y / cell_size.y) * cells_per_axis.x) + ((uint) (particle_pos.z / cell_size.z) * cells_per_axis.x * cells_per_axis.y);
+    uint cell_ID = CellCoordsToIndex(uint3(particle_pos / cell_size));
     
     return cell_ID;
 }
@@ -40,6 +91,11 @@ int GetCellIndex(float3 particle_pos)
 // Get the grid-space coordinates of the cell (eg. for a grid of 3x3x3 cells, coords range from (0,0,0) to (2,2,2))
 uint3 CellIndexTo3DCoords(uint cell_index)
 {
+    if (CELL_INDEXING == CellIndexingMorton)
+    {
+        return uint3(Compact1By2(cell_index), Compact1By2(cell_index >> 1), Compact1By2(cell_index >> 2));
+    }
+    
     uint3 cells_per_axis = uint3(NUM_CELLS_PER_AXIS);
     uint3 coords = uint3(0,0,0);
     
@@ -58,12 +114,12 @@ int OffsetCellIndex(uint cell_index, int3 cell_offset)
     uint3 cells_per_axis = uint3(NUM_CELLS_PER_AXIS);    
     
     //// Invalid if new cell is out of bounds
-    if (cell_coords.x < 0 || cell_coords.y < 0 || cell_coords.z < 0 || cell_coords.x > cells_per_axis.x || cell_coords.y > cells_per_axis.y || cell_coords.z > cells_per_axis.z)
+    if (cell_coords.x < 0 || cell_coords.y < 0 || cell_coords.z < 0 || cell_coords.x >= cells_per_axis.x || cell_coords.y >= cells_per_axis.y || cell_coords.z >= cells_per_axis.z)
     {
         return -1;
     }
 
-    int new_index = (cell_coords.z * cells_per_axis.x * cells_per_axis.y) + (cell_coords.y * cells_per_axis.x) + cell_coords.x;
+    int new_index = CellCoordsToIndex(cell_coords);
     
     return new_index;
 }
@@ -79,7 +135,7 @@ int Cell3DCoordsToBlockIndex(uint3 coords, int3 block_offset)
     int bz = (coords.z / cells_per_block.z) + block_offset.z;
     
     // Invalid if new block is out of bounds
-    if (bx < 0 || by < 0 || bz < 0 || bx > cells_per_block.x || by > cells_per_block.y || bz > cells_per_block.z)
+    if (bx < 0 || by < 0 || bz < 0 || bx >= blocks_per_axis.x || by >= blocks_per_axis.y || bz >= blocks_per_axis.z)
     {
         return -1;
     }
@@ -158,8 +214,7 @@ int BlockIndexToCellIndex(uint block_index, uint3 cell_offset)
     uint z = bz * cells_per_block.z + cell_offset.z;
     
     // Turn this into an index
-    uint3 cells_per_axis = uint3(NUM_CELLS_PER_AXIS);
-    return (z * cells_per_axis.x * cells_per_axis.y) + (y * cells_per_axis.x) + x;
+    return CellCoordsToIndex(uint3(x, y, z));
 }
 
 // Return true if the block is at an edge of the grid
@@ -187,15 +242,33 @@ bool IsBlockAtEdge(uint block_index)
     return false;
 }
 
+// Bricks along each axis of a cell at a level of detail
+uint BricksPerAxisAtLod(uint lod)
+{
+    return max(BRICKS_PER_AXIS_PER_CELL >> lod, 1);
+}
+
+uint BricksPerCellAtLod(uint lod)
+{
+    uint bricks_per_axis = BricksPerAxisAtLod(lod);
+    return bricks_per_axis * bricks_per_axis * bricks_per_axis;
+}
+
+// Coarsest level that still halves the bricks per axis
+uint MaxBrickLod()
+{
+    return min(firstbithigh(BRICKS_PER_AXIS_PER_CELL), MAX_BRICK_LODS - 1);
+}
+
 // Takes the index of a brick within a cell to determine a 3D offset of the brick within the cell
-uint3 BrickIndexTo3DOffset(uint brick_index)
+uint3 BrickIndexTo3DOffset(uint brick_index, uint bricks_per_axis)
 {
     uint3 offset = uint3(0, 0, 0);
     
-    uint bricks_per_z = BRICKS_PER_AXIS_PER_CELL * BRICKS_PER_AXIS_PER_CELL;
+    uint bricks_per_z = bricks_per_axis * bricks_per_axis;
     offset.z = brick_index / bricks_per_z;
-    offset.y = (brick_index % bricks_per_z) / BRICKS_PER_AXIS_PER_CELL;
-    offset.x = brick_index % BRICKS_PER_AXIS_PER_CELL;
+    offset.y = (brick_index % bricks_per_z) / bricks_per_axis;
+    offset.x = brick_index % bricks_per_axis;
     
     return offset;
 }
@@ -1,9 +1,10 @@
 #ifndef COMPUTE_POS_HLSL
 #define COMPUTE_POS_HLSL
 
-#include "ComputeCommon.hlsli"
+#include "ComputeGridCommon.hlsli"
 
 RWStructuredBuffer<ParticleData> particle_positions_ : register(u0);
+RWStructuredBuffer<CellBrickSlot> cell_brick_slots_ : register(u1);
 ConstantBuffer<ComputeCB> constant_buffer_ : register(b1);
 
 // From https://stackoverflow.com/a/10625698
@@ -146,6 +147,14 @@ void CSPosMain(int3 dispatch_ID : SV_DispatchThreadID)
     // Clamp to within the bounds
     particle.position_ = clamp(particle.position_, WORLD_MIN + 0.1f, WORLD_MAX - 0.1f);
     
+    // Mark the cells the particle moved from and to, so the bricks around them get filled again
+    float3 previous_position = particle_positions_[dispatch_ID.x].position_;
+    if (any(particle.position_ != previous_position))
+    {
+        cell_brick_slots_[GetCellIndex(previous_position)].changed_frame_ = constant_buffer_.frame_;
+        cell_brick_slots_[GetCellIndex(particle.position_)].changed_frame_ = constant_buffer_.frame_;
+    }
+    
     // Store position
     particle_positions_[dispatch_ID.x].position_ = particle.position_;
     
@@ -15,6 +15,27 @@ struct ParticleData {
 struct ComputeCB {
 	float time_ = 0;
 	XMUINT3 brick_pool_dimensions_;
+	UINT32 cull_empty_bricks_ = 1;
+	UINT32 frame_ = 0;
+	UINT32 brick_slot_capacity_ = 0;
+	UINT32 apron_free_bricks_ = 0;
+	UINT32 quantised_bricks_ = 0;
+	UINT32 brick_normals_ = 0;
+	UINT32 lod_bricks_ = 0;
+	float lod_pixels_per_voxel_ = 0;
+	XMFLOAT3 camera_position_ = { 0, 0, 0 };
+	float lod_pixel_scale_ = 0;
+	XMUINT4 lod_slot_capacities_ = { 0, 0, 0, 0 };
+	UINT32 narrow_band_voxels_ = 0;
+	UINT32 distance_pyramid_ = 0;
+	UINT32 sorted_surface_lists_ = 0;
+	UINT32 flag_block_neighbours_ = 0;
+};
+
+// Range of an 8-bit brick's distances, see ComputeCommon.hlsli
+struct BrickRange {
+	float offset_;
+	float scale_;
 };
 
 // ---- Two-level Grid -----
@@ -31,4 +52,17 @@ struct Block
 struct GridSurfaceCounts {
 	unsigned int surface_blocks;
 	unsigned int surface_cells;
+	unsigned int surface_bricks; // Bricks left after culling
+	unsigned int recomputed_bricks; // Bricks filled this frame
+	unsigned int lod_surface_cells[MAX_BRICK_LODS]; // Surface cells at each level of detail
+};
+
+// Where a cell's bricks live in the brick pool, kept from frame to frame
+struct CellBrickSlot {
+	unsigned int slot_;
+	unsigned int surface_frame_;
+	unsigned int allocated_frame_;
+	unsigned int changed_frame_;
+	unsigned int lod_;
+	unsigned int slot_lod_;
 };
@@ -1,10 +1,32 @@
 #ifndef COMPUTE_TEX_HLSL
 #define COMPUTE_TEX_HLSL
 
-#include "ComputeCommon.hlsli"
+#include "ComputeGridCommon.hlsli"
 #include "SdfHelpers.hlsli"
 
 RWTexture3D<snorm float> output_texture_ : register(u0);
+StructuredBuffer<Cell> cell_particle_counts_ : register(t1); // For CSTexGridMain, with particles_ ordered by cell
+StructuredBuffer<uint> cell_global_index_offsets_ : register(t2);
+
+// Narrow band texture, see CPUBackend/NarrowBand.h
+#define NARROW_BAND_FLOOD_SCALE 8 // Texture voxels per axis per voxel of the coarse grid the far field is flooded over
+#define NARROW_BAND_INVALID_SEED 0xffffffff
+#define NARROW_BAND_NO_SEED_DISTANCE 1000.f
+#define NARROW_BAND_FLOOD_RESOLUTION ((TEXTURE_RESOLUTION + NARROW_BAND_FLOOD_SCALE - 1) / NARROW_BAND_FLOOD_SCALE)
+
+ConstantBuffer<ComputeCB> constant_buffer_ : register(b1);
+RWStructuredBuffer<uint> band_cells_ : register(u1); // Per cell, if the surface can be within it
+RWStructuredBuffer<uint> seed_distances_ : register(u2); // Per flood voxel, the bits of the nearest distance to the surface of its band voxels
+RWStructuredBuffer<uint> flood_in_ : register(u3); // Per flood voxel, the packed coords of its seed
+RWStructuredBuffer<uint> flood_out_ : register(u4);
+RWStructuredBuffer<float> distance_pyramid_ : register(u5); // Levels one after another, see ComputeCommon.hlsli
+
+struct PassConstants
+{
+    uint step_; // The jump flood step, or the distance pyramid level being built
+    uint first_pass_; // The first jump flood pass takes the seeds straight from the band
+};
+ConstantBuffer<PassConstants> pass_constants_ : register(b2);
 
 // Shader for creating the simple SDF 3D texture 
 [numthreads(32, 32, 1)]
@@ -14,4 +36,244 @@ void CSTexMain(int3 dispatch_ID : SV_DispatchThreadID)
     output_texture_[dispatch_ID] = GetAnalyticalSignedDistance(position);
 }
 
+// Nearest the surface of a particle outside the 27 cells around the voxel's cell can be. Those particles are past the
+// nearest face of the 3 x 3 x 3 cells, which is at least a cell away as cells are at least 2 radii wide.
+float GetFarDistance(uint3 cell_coords, float3 position)
+{
+    float3 cell_size = WORLD_MAX / float3(NUM_CELLS_PER_AXIS);
+    float3 block_min = (float3(cell_coords) - 1.f) * cell_size;
+    float3 block_max = block_min + (3.f * cell_size);
+    float3 to_faces = min(position - block_min, block_max - position);
+    return min(to_faces.x, min(to_faces.y, to_faces.z)) - PARTICLE_RADIUS;
+}
+
+// As CSTexMain, but only blending in the particles of the 27 cells around the voxel's cell, once they've been sorted by
+// cell, rather than every particle. Voxels take the far distance where it's nearer, including where the cells are empty,
+// so sphere tracing can't step past a particle outside them. See CPUBackend/SimpleTexture.h.
+float GetGridDistance(uint cell_index, float3 position)
+{
+    float distance = 1000;
+
+    // For each of the 27 adjacent cells
+    for (uint x = 0; x < 27; x++)
+    {
+        int neighbour_index = OffsetCellIndex(cell_index, int3(x % 3, (x / 3) % 3, x / 9) - 1);
+        if (neighbour_index > -1 && neighbour_index < NUM_CELLS) // Ensure cell is valid
+        {
+            uint particle_count = cell_particle_counts_[neighbour_index].particle_count_;
+            uint particle_index_offset = cell_global_index_offsets_[neighbour_index];
+            for (uint i = 0; i < particle_count; i++)
+            {
+                float distance1 = GetDistanceToSphere(particles_[particle_index_offset + i].position_ - position, PARTICLE_RADIUS);
+                distance = SmoothMin(distance, distance1, PARTICLE_RADIUS);
+            }
+        }
+    }
+
+    return min(distance, GetFarDistance(CellIndexTo3DCoords(cell_index), position));
+}
+
+[numthreads(32, 32, 1)]
+void CSTexGridMain(int3 dispatch_ID : SV_DispatchThreadID)
+{
+    float3 position = lerp(WORLD_MIN, WORLD_MAX, ((dispatch_ID + 0.5f) / TEXTURE_RESOLUTION));
+    output_texture_[dispatch_ID] = GetGridDistance(GetCellIndex(position), position);
+}
+
+// Flags the cells the surface can be within, as CSDetectSurfaceCellsMain does but for every cell, and clears the seeds.
+// Dispatched over whichever of the cells and flood voxels there are more of.
+[numthreads(1024, 1, 1)]
+void CSNarrowBandCellsMain(int3 dispatch_ID : SV_DispatchThreadID)
+{
+    uint flood_res = NARROW_BAND_FLOOD_RESOLUTION;
+    if (dispatch_ID.x < flood_res * flood_res * flood_res)
+    {
+        seed_distances_[dispatch_ID.x] = asuint(NARROW_BAND_NO_SEED_DISTANCE);
+    }
+    if (dispatch_ID.x >= NUM_CELLS)
+    {
+        return;
+    }
+
+    uint particle_count = cell_particle_counts_[dispatch_ID.x].particle_count_;
+    bool band_cell = particle_count > 0 && particle_count < CELL_MAX_PARTICLE_COUNT;
+    for (uint x = 0; x < 27 && !band_cell; x++)
+    {
+        int neighbour_index = OffsetCellIndex(dispatch_ID.x, int3(x % 3, (x / 3) % 3, x / 9) - 1);
+        band_cell = neighbour_index > -1 && (particle_count == 0) != (cell_particle_counts_[neighbour_index].particle_count_ == 0);
+    }
+    band_cells_[dispatch_ID.x] = band_cell;
+}
+
+// If the voxel is within the band of voxels around a band cell. Only the cells around its own within reach along each
+// axis are checked, usually none but its own.
+bool IsNarrowBandVoxel(uint cell_index, float3 position)
+{
+    float3 cell_size = WORLD_MAX / float3(NUM_CELLS_PER_AXIS);
+    float reach = constant_buffer_.narrow_band_voxels_ * VOXEL_SIZE;
+    float3 to_lower = position - float3(CellIndexTo3DCoords(cell_index)) * cell_size;
+    int3 begin = to_lower <= reach ? 0 : 1;
+    int3 end = cell_size - to_lower <= reach ? 3 : 2;
+
+    for (int z = begin.z; z < end.z; z++)
+    {
+        for (int y = begin.y; y < end.y; y++)
+        {
+            for (int x = begin.x; x < end.x; x++)
+            {
+                int neighbour_index = OffsetCellIndex(cell_index, int3(x, y, z) - 1);
+                if (neighbour_index < 0 || !band_cells_[neighbour_index])
+                {
+                    continue;
+                }
+                // Distance to the neighbour along each axis it's offset in
+                int3 offset = int3(x, y, z);
+                float3 outside = offset == 1 ? 0 : (offset == 0 ? to_lower : cell_size - to_lower);
+                if (dot(outside, outside) <= reach * reach)
+                {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+uint FloodVoxelIndex(uint3 coords)
+{
+    uint flood_res = NARROW_BAND_FLOOD_RESOLUTION;
+    return (coords.z * flood_res + coords.y) * flood_res + coords.x;
+}
+
+// Seeds are their flood voxel's coords, 10 bits per axis
+uint PackFloodSeed(uint3 coords)
+{
+    return coords.x | (coords.y << 10) | (coords.z << 20);
+}
+
+uint3 UnpackFloodSeed(uint seed)
+{
+    return uint3(seed & 0x3ff, (seed >> 10) & 0x3ff, seed >> 20);
+}
+
+// Distance to the surface the seed gives the flood voxel, the seed's own plus the distance between them
+float GetFloodCost(uint seed, uint3 coords)
+{
+    uint3 seed_coords = UnpackFloodSeed(seed);
+    return asfloat(seed_distances_[FloodVoxelIndex(seed_coords)]) + length(float3(coords) - float3(seed_coords)) * NARROW_BAND_FLOOD_SCALE * VOXEL_SIZE;
+}
+
+// Fills the band's voxels as CSTexGridMain does, keeping each flood voxel's nearest distance to the surface as its seed
+[numthreads(32, 32, 1)]
+void CSTexNarrowBandMain(int3 dispatch_ID : SV_DispatchThreadID)
+{
+    float3 position = lerp(WORLD_MIN, WORLD_MAX, ((dispatch_ID + 0.5f) / TEXTURE_RESOLUTION));
+    uint cell_index = GetCellIndex(position);
+    if (!IsNarrowBandVoxel(cell_index, position))
+    {
+        return;
+    }
+
+    float distance = GetGridDistance(cell_index, position);
+    output_texture_[dispatch_ID] = distance;
+
+    // Positive floats order as their bits do
+    InterlockedMin(seed_distances_[FloodVoxelIndex(dispatch_ID / NARROW_BAND_FLOOD_SCALE)], asuint(abs(distance)));
+}
+
+// A pass of jump flooding (Rong & Tan, 2006) the nearest seed, by the distance it gives the flood voxel, over the coarse grid
+[numthreads(8, 8, 8)]
+void CSJumpFloodMain(int3 dispatch_ID : SV_DispatchThreadID)
+{
+    int flood_res = NARROW_BAND_FLOOD_RESOLUTION;
+    if (any(dispatch_ID >= flood_res))
+    {
+        return;
+    }
+
+    uint best_seed = NARROW_BAND_INVALID_SEED;
+    float best_cost = NARROW_BAND_NO_SEED_DISTANCE;
+    for (uint x = 0; x < 27; x++)
+    {
+        int3 neighbour = dispatch_ID + (int3(x % 3, (x / 3) % 3, x / 9) - 1) * (int)pass_constants_.step_;
+        if (any(neighbour < 0) || any(neighbour >= flood_res))
+        {
+            continue;
+        }
+
+        uint neighbour_index = FloodVoxelIndex(neighbour);
+        uint seed = flood_in_[neighbour_index];
+        if (pass_constants_.first_pass_)
+        {
+            seed = asfloat(seed_distances_[neighbour_index]) < NARROW_BAND_NO_SEED_DISTANCE ? PackFloodSeed(neighbour) : NARROW_BAND_INVALID_SEED;
+        }
+        if (seed == NARROW_BAND_INVALID_SEED)
+        {
+            continue;
+        }
+
+        float cost = GetFloodCost(seed, dispatch_ID);
+        if (cost < best_cost)
+        {
+            best_cost = cost;
+            best_seed = seed;
+        }
+    }
+    flood_out_[FloodVoxelIndex(dispatch_ID)] = best_seed;
+}
+
+// Fills the voxels CSTexNarrowBandMain left, with the flooded distance less how far it can be past the surface, from
+// the seeds and voxels being at flood voxel centres and band voxels being a voxel apart. It's at least the band's width.
+// Voxels in cells with particles are inside the fluid, as their cell isn't a band cell, so isn't next to an empty one.
+[numthreads(32, 32, 1)]
+void CSTexFarFieldMain(int3 dispatch_ID : SV_DispatchThreadID)
+{
+    float3 position = lerp(WORLD_MIN, WORLD_MAX, ((dispatch_ID + 0.5f) / TEXTURE_RESOLUTION));
+    uint cell_index = GetCellIndex(position);
+    if (IsNarrowBandVoxel(cell_index, position))
+    {
+        return;
+    }
+
+    uint3 flood_coords = dispatch_ID / NARROW_BAND_FLOOD_SCALE;
+    uint seed = flood_in_[FloodVoxelIndex(flood_coords)];
+    float cost = seed == NARROW_BAND_INVALID_SEED ? NARROW_BAND_NO_SEED_DISTANCE : GetFloodCost(seed, flood_coords);
+    float margin = sqrt(3.f) * (NARROW_BAND_FLOOD_SCALE + 1) * VOXEL_SIZE;
+
+    float distance = max(cost - margin, constant_buffer_.narrow_band_voxels_ * VOXEL_SIZE);
+    output_texture_[dispatch_ID] = cell_particle_counts_[cell_index].particle_count_ > 0 ? -distance : distance;
+}
+
+// Builds a level of the distance pyramid from the one below it, the first from the texture, which needs typed UAV loads
+// of its format. The linear sampler blends the voxels either side of the 2 a first level texel covers per axis into
+// samples within it too, so the first level takes the lowest of the 4 voxels per axis around it.
+[numthreads(4, 4, 4)]
+void CSDistancePyramidMain(int3 dispatch_ID : SV_DispatchThreadID)
+{
+    uint level = pass_constants_.step_;
+    int res = DistancePyramidResolution(level);
+    if (any(dispatch_ID >= res))
+    {
+        return;
+    }
+
+    int below_res = level == 1 ? TEXTURE_RESOLUTION : DistancePyramidResolution(level - 1);
+    int reach = level == 1 ? 1 : 0;
+    int3 below_min = max(dispatch_ID * 2 - reach, 0);
+    int3 below_max = min(dispatch_ID * 2 + 1 + reach, below_res - 1);
+
+    float lowest = 1000;
+    for (int z = below_min.z; z <= below_max.z; z++)
+    {
+        for (int y = below_min.y; y <= below_max.y; y++)
+        {
+            for (int x = below_min.x; x <= below_max.x; x++)
+            {
+                lowest = min(lowest, level == 1 ? output_texture_[int3(x, y, z)] : distance_pyramid_[DistancePyramidIndex(level - 1, uint3(x, y, z))]);
+            }
+        }
+    }
+    distance_pyramid_[DistancePyramidIndex(level, dispatch_ID)] = lowest;
+}
+
 #endif
\ No newline at end of file
@@ -4,11 +4,44 @@
 #include "RayTracer.h"
 
 
+// The brick pool can't grow past the largest 3D texture D3D12 allows
+static CapacityPolicySettings BrickPoolCapacitySettings()
+{
+    UINT64 bricks_per_axis = D3D12_REQ_TEXTURE3D_U_V_OR_W_DIMENSION / VOXELS_PER_AXIS_PER_BRICK;
+
+    CapacityPolicySettings settings;
+    settings.budget_bytes_ = bricks_per_axis * bricks_per_axis * bricks_per_axis * BRICK_POOL_BYTES_PER_BRICK;
+    return settings;
+}
+
+// Bricks each cell holds at a level of detail, see BricksPerCellAtLod in ComputeGridCommon.hlsli
+static UINT BricksPerCellAtLod(int lod)
+{
+    UINT bricks_per_axis = BricksPerAxisAtLod(test_vars_, lod);
+    return bricks_per_axis * bricks_per_axis * bricks_per_axis;
+}
+
 Computer::Computer(DX::DeviceResources* device_resources, HonoursApplication* app) :
-	device_resources_(device_resources), application_(app)
+	device_resources_(device_resources), application_(app),
+	brick_buffers_capacity_(sizeof(D3D12_RAYTRACING_AABB) + sizeof(unsigned int))
 {
+    for (int lod = 0; lod < MAX_BRICK_LODS; lod++) {
+        brick_pool_capacities_[lod] = CapacityPolicy(BricksPerCellAtLod(lod) * BRICK_POOL_BYTES_PER_BRICK, BrickPoolCapacitySettings());
+    }
+
     device_resources_->GetCommandList()->Reset(device_resources_->GetCommandAllocator(), nullptr);
 
+    // Apron-free bricks, camera LOD seams and the distance pyramid read the brick pool or the Simple method's texture back in a
+    // compute shader, which their formats need additional typed UAV loads for
+    typed_uav_load_supported_ = true;
+    for (DXGI_FORMAT format : { DXGI_FORMAT_R16_SNORM, DXGI_FORMAT_R8_SNORM, DXGI_FORMAT_R8G8B8A8_SNORM }) {
+        D3D12_FEATURE_DATA_FORMAT_SUPPORT format_support = { format };
+        if (FAILED(device_resources_->GetD3DDevice()->CheckFeatureSupport(D3D12_FEATURE_FORMAT_SUPPORT, &format_support, sizeof(format_support))) ||
+            !(format_support.Support2 & D3D12_FORMAT_SUPPORT2_UAV_TYPED_LOAD)) {
+            typed_uav_load_supported_ = false;
+        }
+    }
+
 	CreateRootSignatures();
 	CreateComputePipelineStateObjects();
     CreateBuffers();
@@ -41,6 +74,9 @@ void Computer::GenerateParticles()
 {
     auto command_list = device_resources_->GetCommandList();
 
+    // Every particle has moved, so none of the bricks can be kept
+    InvalidateBrickSlots();
+
     command_list->SetPipelineState(compute_generate_state_object_.Get());
     command_list->SetComputeRootSignature(compute_pos_root_signature_.Get());
 
@@ -52,6 +88,13 @@ void Computer::GenerateParticles()
     command_list->Dispatch(particle_threadgroups_, 1, 1);
 }
 
+// Moves on the frame number, which the brick slots use to tell what has happened this frame
+void Computer::AdvanceFrame()
+{
+    compute_cb_->Values().frame_++;
+    compute_cb_->CopyData(0);
+}
+
 // Shader to simulate particles
 void Computer::ComputePostitions()
 {
@@ -64,6 +107,7 @@ void Computer::ComputePostitions()
     command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(particle_buffer_unordered_.Get()));
 
     command_list->SetComputeRootUnorderedAccessView(ComputePositionsRootSignatureParams::ParticlePositionsBufferSlot, particle_buffer_unordered_->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputePositionsRootSignatureParams::CellBrickSlotsSlot, cell_brick_slots_buffer_->GetGPUVirtualAddress());
     command_list->SetComputeRootConstantBufferView(ComputePositionsRootSignatureParams::ConstantBufferSlot, compute_cb_->Resource()->GetGPUVirtualAddress());
     command_list->SetComputeRootConstantBufferView(ComputePositionsRootSignatureParams::TestValuesSlot, test_vals_cb_->Resource()->GetGPUVirtualAddress());
 
@@ -71,12 +115,11 @@ void Computer::ComputePostitions()
 
 }
 
-// Grid construction
-void Computer::ComputeGrid(Profiler* profiler)
+// Binds the grid root signature and the buffers the grid shaders use
+void Computer::BindGridResources()
 {
     auto command_list = device_resources_->GetCommandList();
 
-    // Bind root signature and resources
     command_list->SetComputeRootSignature(compute_grid_root_signature_.Get());
     command_list->SetComputeRootUnorderedAccessView(ComputeGridRootSignatureParams::ParticlePositionsBufferSlot, particle_buffer_unordered_->GetGPUVirtualAddress());
     command_list->SetComputeRootUnorderedAccessView(ComputeGridRootSignatureParams::CellsSlot, scan_shader_->GetScanInBuffer()->GetGPUVirtualAddress());
@@ -84,15 +127,33 @@ void Computer::ComputeGrid(Profiler* profiler)
     command_list->SetComputeRootUnorderedAccessView(ComputeGridRootSignatureParams::SurfaceBlocksSlot, surface_block_indices_buffer_->GetGPUVirtualAddress());
     command_list->SetComputeRootUnorderedAccessView(ComputeGridRootSignatureParams::SurfaceCellsSlot, surface_cell_indices_buffer_->GetGPUVirtualAddress());
     command_list->SetComputeRootUnorderedAccessView(ComputeGridRootSignatureParams::SurfaceCountsSlot, surface_counts_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeGridRootSignatureParams::SurfaceBlockFlagsSlot, surface_blocks_scan_->GetScanInBuffer()->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeGridRootSignatureParams::SurfaceBlockOffsetsSlot, surface_blocks_scan_->GetScanOutBuffer()->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeGridRootSignatureParams::SurfaceCellFlagsSlot, surface_cells_scan_->GetScanInBuffer()->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeGridRootSignatureParams::SurfaceCellOffsetsSlot, surface_cells_scan_->GetScanOutBuffer()->GetGPUVirtualAddress());
+    command_list->SetComputeRootConstantBufferView(ComputeGridRootSignatureParams::ConstantBufferSlot, compute_cb_->Resource()->GetGPUVirtualAddress());
     command_list->SetComputeRootConstantBufferView(ComputeGridRootSignatureParams::TestValuesSlot, test_vals_cb_->Resource()->GetGPUVirtualAddress());
+}
+
+// Counts the particles in each cell, for sorting them with SortParticleData. ComputeGrid goes on to detect the surface.
+void Computer::BuildGrid(Profiler* profiler)
+{
+    auto command_list = device_resources_->GetCommandList();
 
-    D3D12_RESOURCE_BARRIER grid_uav_barriers[6];
+    // Bind root signature and resources
+    BindGridResources();
+
+    D3D12_RESOURCE_BARRIER grid_uav_barriers[10];
     grid_uav_barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(scan_shader_->GetScanInBuffer());
     grid_uav_barriers[1] = CD3DX12_RESOURCE_BARRIER::UAV(blocks_buffer_.Get());
     grid_uav_barriers[2] = CD3DX12_RESOURCE_BARRIER::UAV(surface_block_indices_buffer_.Get());
     grid_uav_barriers[3] = CD3DX12_RESOURCE_BARRIER::UAV(surface_cell_indices_buffer_.Get());
     grid_uav_barriers[4] = CD3DX12_RESOURCE_BARRIER::UAV(surface_counts_buffer_.Get());
     grid_uav_barriers[5] = CD3DX12_RESOURCE_BARRIER::UAV(particle_buffer_unordered_.Get());
+    grid_uav_barriers[6] = CD3DX12_RESOURCE_BARRIER::UAV(surface_blocks_scan_->GetScanInBuffer());
+    grid_uav_barriers[7] = CD3DX12_RESOURCE_BARRIER::UAV(surface_blocks_scan_->GetScanOutBuffer());
+    grid_uav_barriers[8] = CD3DX12_RESOURCE_BARRIER::UAV(surface_cells_scan_->GetScanInBuffer());
+    grid_uav_barriers[9] = CD3DX12_RESOURCE_BARRIER::UAV(surface_cells_scan_->GetScanOutBuffer());
 
     command_list->ResourceBarrier(ARRAYSIZE(grid_uav_barriers), grid_uav_barriers);
 
@@ -112,6 +173,26 @@ void Computer::ComputeGrid(Profiler* profiler)
     profiler->PopRange(command_list);
 
     command_list->ResourceBarrier(ARRAYSIZE(grid_uav_barriers), grid_uav_barriers);
+}
+
+// Grid construction
+void Computer::ComputeGrid(Profiler* profiler)
+{
+    auto command_list = device_resources_->GetCommandList();
+
+    BuildGrid(profiler); // Leaves the grid root signature and resources bound
+
+    D3D12_RESOURCE_BARRIER grid_uav_barriers[10];
+    grid_uav_barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(scan_shader_->GetScanInBuffer());
+    grid_uav_barriers[1] = CD3DX12_RESOURCE_BARRIER::UAV(blocks_buffer_.Get());
+    grid_uav_barriers[2] = CD3DX12_RESOURCE_BARRIER::UAV(surface_block_indices_buffer_.Get());
+    grid_uav_barriers[3] = CD3DX12_RESOURCE_BARRIER::UAV(surface_cell_indices_buffer_.Get());
+    grid_uav_barriers[4] = CD3DX12_RESOURCE_BARRIER::UAV(surface_counts_buffer_.Get());
+    grid_uav_barriers[5] = CD3DX12_RESOURCE_BARRIER::UAV(particle_buffer_unordered_.Get());
+    grid_uav_barriers[6] = CD3DX12_RESOURCE_BARRIER::UAV(surface_blocks_scan_->GetScanInBuffer());
+    grid_uav_barriers[7] = CD3DX12_RESOURCE_BARRIER::UAV(surface_blocks_scan_->GetScanOutBuffer());
+    grid_uav_barriers[8] = CD3DX12_RESOURCE_BARRIER::UAV(surface_cells_scan_->GetScanInBuffer());
+    grid_uav_barriers[9] = CD3DX12_RESOURCE_BARRIER::UAV(surface_cells_scan_->GetScanOutBuffer());
 
     // Profile surface detection
     profiler->PushRange(command_list, "Surface Detection");
@@ -122,6 +203,11 @@ void Computer::ComputeGrid(Profiler* profiler)
     
     command_list->ResourceBarrier(ARRAYSIZE(grid_uav_barriers), grid_uav_barriers);
 
+    // Sorted lists have only flagged the surface blocks so far
+    const bool sorted_surface_lists = compute_cb_->Values().sorted_surface_lists_;
+    if (sorted_surface_lists) {
+        CompactSurfaceList(surface_blocks_scan_.get(), compute_scatter_surface_blocks_state_object_.Get(), blocks_threadgroups_);
+    }
 
     // Read back the count of surface blocks
     ReadBackBlocksCount();
@@ -129,19 +215,16 @@ void Computer::ComputeGrid(Profiler* profiler)
     if (surface_blocks_count_ > 0) {
         // Detect surface cells
         command_list->SetPipelineState(compute_surface_cells_state_object_.Get());
-        command_list->SetComputeRootSignature(compute_grid_root_signature_.Get());
-
-        command_list->SetComputeRootUnorderedAccessView(ComputeGridRootSignatureParams::ParticlePositionsBufferSlot, particle_buffer_unordered_->GetGPUVirtualAddress());
-        command_list->SetComputeRootUnorderedAccessView(ComputeGridRootSignatureParams::CellsSlot, scan_shader_->GetScanInBuffer()->GetGPUVirtualAddress());
-        command_list->SetComputeRootUnorderedAccessView(ComputeGridRootSignatureParams::BlocksSlot, blocks_buffer_->GetGPUVirtualAddress());
-        command_list->SetComputeRootUnorderedAccessView(ComputeGridRootSignatureParams::SurfaceBlocksSlot, surface_block_indices_buffer_->GetGPUVirtualAddress());
-        command_list->SetComputeRootUnorderedAccessView(ComputeGridRootSignatureParams::SurfaceCellsSlot, surface_cell_indices_buffer_->GetGPUVirtualAddress());
-        command_list->SetComputeRootUnorderedAccessView(ComputeGridRootSignatureParams::SurfaceCountsSlot, surface_counts_buffer_->GetGPUVirtualAddress());
-        command_list->SetComputeRootConstantBufferView(ComputeGridRootSignatureParams::TestValuesSlot, test_vals_cb_->Resource()->GetGPUVirtualAddress());
+        BindGridResources();
 
         command_list->ResourceBarrier(ARRAYSIZE(grid_uav_barriers), grid_uav_barriers);
 
         command_list->Dispatch(surface_blocks_count_, 1, 1);
+
+        if (sorted_surface_lists) {
+            command_list->ResourceBarrier(ARRAYSIZE(grid_uav_barriers), grid_uav_barriers);
+            CompactSurfaceList(surface_cells_scan_.get(), compute_scatter_surface_cells_state_object_.Get(), clear_counts_threadgroups_);
+        }
     }
 
     profiler->PopRange(command_list);
@@ -150,31 +233,54 @@ void Computer::ComputeGrid(Profiler* profiler)
 
 }
 
+// Scans the surface flags a detection shader left, then scatters the flagged blocks or cells into their list in index order,
+// so the list and everything built from it (the AABBs, the brick pool's order) are the same from run to run
+void Computer::CompactSurfaceList(ChainedScanDecoupledLookback* scan, ID3D12PipelineState* scatter_state_object, UINT threadgroups)
+{
+    scan->DispatchScan(); // Executes the command list, leaving nothing bound
+
+    auto command_list = device_resources_->GetCommandList();
+    command_list->SetPipelineState(scatter_state_object);
+    BindGridResources();
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(scan->GetScanOutBuffer()));
+
+    command_list->Dispatch(threadgroups, 1, 1);
+
+    D3D12_RESOURCE_BARRIER list_barriers[] = { CD3DX12_RESOURCE_BARRIER::UAV(surface_block_indices_buffer_.Get()),
+        CD3DX12_RESOURCE_BARRIER::UAV(surface_cell_indices_buffer_.Get()), CD3DX12_RESOURCE_BARRIER::UAV(surface_counts_buffer_.Get()) };
+    command_list->ResourceBarrier(ARRAYSIZE(list_barriers), list_barriers);
+}
+
 // Create AABBs for surface cells
 void Computer::ComputeAABBs(Profiler* profiler)
 {
     auto command_list = device_resources_->GetCommandList();
 
-    // Read back new count of surface cells
+    // Pick each surface cell's level of detail, then read back the new count of surface cells at each
+    SelectCellLods();
     ReadBackCellCount();
 
     if (bricks_count_ > 0) {
         device_resources_->ResetCommandList();
 
-        // If necessary, reallocate the memory for AABBs and the brick pool texture
-        ray_tracer_->GetAccelerationStructure()->AllocateAABBBuffer(bricks_count_);
+        // If necessary, reallocate the memory for AABBs and the brick pool texture.
+        // The BLAS is built from the bricks left after culling, so its count is set once the brick pool is filled
+        ray_tracer_->GetAccelerationStructure()->ReserveAABBBuffer(bricks_count_);
+        AllocateBrickBuffers();
         AllocateBrickPoolTexture();
 
         // Fill AABB buffer with AABBs
         command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(surface_counts_buffer_.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_GENERIC_READ));
         command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(surface_cell_indices_buffer_.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_GENERIC_READ));
-        command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(ray_tracer_->GetAccelerationStructure()->GetAABBBuffer(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+        command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(brick_aabbs_buffer_.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+        command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(cell_brick_slots_buffer_.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_GENERIC_READ));
 
         command_list->SetPipelineState(compute_AABBs_state_object_.Get());
         command_list->SetComputeRootSignature(compute_AABBs_root_signature_.Get());
         command_list->SetComputeRootShaderResourceView(ComputeAABBsRootSignatureParams::SurfaceCellIndicesSlot, surface_cell_indices_buffer_->GetGPUVirtualAddress());
         command_list->SetComputeRootShaderResourceView(ComputeAABBsRootSignatureParams::SurfaceCountsSlot, surface_counts_buffer_->GetGPUVirtualAddress());
-        command_list->SetComputeRootUnorderedAccessView(ComputeAABBsRootSignatureParams::AABBBufferSlot, ray_tracer_->GetAccelerationStructure()->GetAABBBuffer()->GetGPUVirtualAddress());
+        command_list->SetComputeRootShaderResourceView(ComputeAABBsRootSignatureParams::CellBrickSlotsSlot, cell_brick_slots_buffer_->GetGPUVirtualAddress());
+        command_list->SetComputeRootUnorderedAccessView(ComputeAABBsRootSignatureParams::AABBBufferSlot, brick_aabbs_buffer_->GetGPUVirtualAddress());
         command_list->SetComputeRootConstantBufferView(ComputeAABBsRootSignatureParams::TestValuesSlot, test_vals_cb_->Resource()->GetGPUVirtualAddress());
 
         profiler->PushRange(command_list, "AABB Creation");
@@ -184,7 +290,8 @@ void Computer::ComputeAABBs(Profiler* profiler)
         profiler->PopRange(command_list);
 
         command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(surface_counts_buffer_.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));      
-        command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(ray_tracer_->GetAccelerationStructure()->GetAABBBuffer(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_GENERIC_READ));
+        command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(brick_aabbs_buffer_.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_GENERIC_READ));
+        command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(cell_brick_slots_buffer_.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
 
         // Execute and wait for work to finish 
         device_resources_->ExecuteCommandList();
@@ -192,6 +299,70 @@ void Computer::ComputeAABBs(Profiler* profiler)
     }
 }
 
+// Read back the count of bricks left after culling, and build the BLAS from them
+void Computer::ReadBackSurfaceBrickCount()
+{
+    if (bricks_count_ == 0) {
+        return;
+    }
+
+    // Execute and wait for the brick pool to finish 
+    device_resources_->ExecuteCommandList();
+    device_resources_->WaitForGpu();
+    device_resources_->ResetCommandList();
+
+    auto command_list = device_resources_->GetCommandList();
+
+    // Schedule to copy the data to the default buffer to the readback buffer.
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(surface_counts_buffer_.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE));
+    command_list->CopyResource(surface_counts_readback_buffer_.Get(), surface_counts_buffer_.Get());
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(surface_counts_buffer_.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+
+    // Execute and wait for the copy to finish 
+    device_resources_->ExecuteCommandList();
+    device_resources_->WaitForGpu();
+
+
+    // Map the data so we can read it on CPU.
+    GridSurfaceCounts* mapped_data = nullptr;
+    ThrowIfFailed(surface_counts_readback_buffer_->Map(0, nullptr, reinterpret_cast<void**>(&mapped_data)));
+
+    surface_bricks_count_ = mapped_data->surface_bricks;
+    recomputed_bricks_count_ = mapped_data->recomputed_bricks;
+
+    surface_counts_readback_buffer_->Unmap(0, nullptr);
+
+    ray_tracer_->GetAccelerationStructure()->AllocateAABBBuffer(surface_bricks_count_);
+    Profiler::UpdateCurrentBrickCounts(bricks_count_, bricks_count_ - surface_bricks_count_, recomputed_bricks_count_);
+}
+
+// Without the brick pool there is nothing to cull by, so the BLAS is built from every brick
+void Computer::CopyAllBrickAABBs()
+{
+    if (bricks_count_ == 0) {
+        return;
+    }
+
+    device_resources_->ResetCommandList();
+    auto command_list = device_resources_->GetCommandList();
+    ID3D12Resource* aabb_buffer = ray_tracer_->GetAccelerationStructure()->GetAABBBuffer();
+
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(brick_aabbs_buffer_.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_SOURCE));
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(aabb_buffer, D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_DEST));
+    command_list->CopyBufferRegion(aabb_buffer, 0, brick_aabbs_buffer_.Get(), 0, bricks_count_ * sizeof(D3D12_RAYTRACING_AABB));
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(brick_aabbs_buffer_.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_GENERIC_READ));
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(aabb_buffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ));
+
+    // Execute and wait for the copy to finish 
+    device_resources_->ExecuteCommandList();
+    device_resources_->WaitForGpu();
+
+    surface_bricks_count_ = bricks_count_;
+    recomputed_bricks_count_ = 0;
+    ray_tracer_->GetAccelerationStructure()->AllocateAABBBuffer(surface_bricks_count_);
+    Profiler::UpdateCurrentBrickCounts(bricks_count_, 0, 0);
+}
+
 // Read back the count of surface cells
 void Computer::ReadBackCellCount()
 {
@@ -216,7 +387,9 @@ void Computer::ReadBackCellCount()
     GridSurfaceCounts* mapped_data = nullptr;
     ThrowIfFailed(surface_counts_readback_buffer_->Map(0, nullptr, reinterpret_cast<void**>(&mapped_data)));
 
+    // Cells at a coarser level of detail still take BRICKS_PER_CELL of the brick indices, leaving those they don't use empty
     bricks_count_ = mapped_data->surface_cells * BRICKS_PER_CELL;
+    std::copy(mapped_data->lod_surface_cells, mapped_data->lod_surface_cells + MAX_BRICK_LODS, lod_cells_count_);
 
     surface_counts_readback_buffer_->Unmap(0, nullptr);
 }
@@ -250,11 +423,80 @@ void Computer::ReadBackBlocksCount()
     surface_counts_readback_buffer_->Unmap(0, nullptr);
 }
 
+// Pick each surface cell's level of detail from its distance to the camera, see CSSelectCellLods
+void Computer::SelectCellLods()
+{
+    auto command_list = device_resources_->GetCommandList();
+
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(surface_cell_indices_buffer_.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_GENERIC_READ));
+
+    // The free slots are allocated with the brick pool, so may not exist yet, but aren't used here
+    command_list->SetPipelineState(compute_select_cell_lods_state_object_.Get());
+    command_list->SetComputeRootSignature(compute_brick_slots_root_signature_.Get());
+    command_list->SetComputeRootUnorderedAccessView(ComputeBrickSlotsRootSignatureParams::CellBrickSlotsSlot, cell_brick_slots_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeBrickSlotsRootSignatureParams::FreeBrickSlotsSlot, free_brick_slots_buffer_ ? free_brick_slots_buffer_->GetGPUVirtualAddress() : 0);
+    command_list->SetComputeRootUnorderedAccessView(ComputeBrickSlotsRootSignatureParams::FreeBrickSlotsCountSlot, free_brick_slots_count_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeBrickSlotsRootSignatureParams::SurfaceCountsSlot, surface_counts_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootShaderResourceView(ComputeBrickSlotsRootSignatureParams::SurfaceCellIndicesSlot, surface_cell_indices_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootConstantBufferView(ComputeBrickSlotsRootSignatureParams::ConstantBufferSlot, compute_cb_->Resource()->GetGPUVirtualAddress());
+    command_list->SetComputeRootConstantBufferView(ComputeBrickSlotsRootSignatureParams::TestValuesSlot, test_vals_cb_->Resource()->GetGPUVirtualAddress());
+
+    // The count of surface cells is only read back after, so a thread is dispatched for every cell
+    command_list->Dispatch(clear_counts_threadgroups_, 1, 1);
+
+    D3D12_RESOURCE_BARRIER lods_uav_barriers[] = { CD3DX12_RESOURCE_BARRIER::UAV(cell_brick_slots_buffer_.Get()), CD3DX12_RESOURCE_BARRIER::UAV(surface_counts_buffer_.Get()) };
+    command_list->ResourceBarrier(ARRAYSIZE(lods_uav_barriers), lods_uav_barriers);
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(surface_cell_indices_buffer_.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+}
+
+// Give surface cells their slots in the brick pool
+void Computer::UpdateBrickSlots()
+{
+    auto command_list = device_resources_->GetCommandList();
+    UINT surface_cells_count = bricks_count_ / BRICKS_PER_CELL;
+
+    command_list->SetComputeRootSignature(compute_brick_slots_root_signature_.Get());
+    command_list->SetComputeRootUnorderedAccessView(ComputeBrickSlotsRootSignatureParams::CellBrickSlotsSlot, cell_brick_slots_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeBrickSlotsRootSignatureParams::FreeBrickSlotsSlot, free_brick_slots_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeBrickSlotsRootSignatureParams::FreeBrickSlotsCountSlot, free_brick_slots_count_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeBrickSlotsRootSignatureParams::SurfaceCountsSlot, surface_counts_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootShaderResourceView(ComputeBrickSlotsRootSignatureParams::SurfaceCellIndicesSlot, surface_cell_indices_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootConstantBufferView(ComputeBrickSlotsRootSignatureParams::ConstantBufferSlot, compute_cb_->Resource()->GetGPUVirtualAddress());
+    command_list->SetComputeRootConstantBufferView(ComputeBrickSlotsRootSignatureParams::TestValuesSlot, test_vals_cb_->Resource()->GetGPUVirtualAddress());
+
+    D3D12_RESOURCE_BARRIER slots_uav_barriers[2];
+    slots_uav_barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(cell_brick_slots_buffer_.Get());
+    slots_uav_barriers[1] = CD3DX12_RESOURCE_BARRIER::UAV(free_brick_slots_count_buffer_.Get());
+
+    // Free every slot if the brick pool's contents can't be kept
+    if (!brick_slots_valid_) {
+        command_list->SetPipelineState(compute_reset_brick_slots_state_object_.Get());
+        command_list->Dispatch(std::ceil(max((UINT)NUM_CELLS, compute_cb_->Values().brick_slot_capacity_) / 1024.f), 1, 1);
+        command_list->ResourceBarrier(ARRAYSIZE(slots_uav_barriers), slots_uav_barriers);
+        brick_slots_valid_ = true;
+    }
+
+    command_list->SetPipelineState(compute_mark_surface_cells_state_object_.Get());
+    command_list->Dispatch(std::ceil(surface_cells_count / 1024.f), 1, 1);
+    command_list->ResourceBarrier(ARRAYSIZE(slots_uav_barriers), slots_uav_barriers);
+
+    command_list->SetPipelineState(compute_release_brick_slots_state_object_.Get());
+    command_list->Dispatch(std::ceil(NUM_CELLS / 1024.f), 1, 1);
+    command_list->ResourceBarrier(ARRAYSIZE(slots_uav_barriers), slots_uav_barriers);
+
+    command_list->SetPipelineState(compute_allocate_brick_slots_state_object_.Get());
+    command_list->Dispatch(std::ceil(surface_cells_count / 1024.f), 1, 1);
+    command_list->ResourceBarrier(ARRAYSIZE(slots_uav_barriers), slots_uav_barriers);
+}
+
 // Fill the brick pool
 void Computer::ComputeBrickPoolTexture()
 {
     auto command_list = device_resources_->GetCommandList();
 
+    // Surface cells keep their slots from the last frame where possible, so only bricks around moved particles are filled
+    UpdateBrickSlots();
+
     ID3D12DescriptorHeap* heap = application_->GetDescriptorHeap();
     command_list->SetDescriptorHeaps(1, &heap);
 
@@ -263,18 +505,54 @@ void Computer::ComputeBrickPoolTexture()
 
     command_list->SetComputeRootDescriptorTable(ComputeBrickPoolRootSignatureParams::TextureSlot, brick_pool_3d_texture_gpu_handle_);
     command_list->SetComputeRootShaderResourceView(ComputeBrickPoolRootSignatureParams::ParticlePositionsBufferSlot, particle_buffer_ordered_->GetGPUVirtualAddress());
-    command_list->SetComputeRootShaderResourceView(ComputeBrickPoolRootSignatureParams::AABBBufferSlot, ray_tracer_->GetAccelerationStructure()->GetAABBBuffer()->GetGPUVirtualAddress());
+    command_list->SetComputeRootShaderResourceView(ComputeBrickPoolRootSignatureParams::AABBBufferSlot, brick_aabbs_buffer_->GetGPUVirtualAddress());
     command_list->SetComputeRootShaderResourceView(ComputeBrickPoolRootSignatureParams::CellCountsSlot, scan_shader_->GetScanInBuffer()->GetGPUVirtualAddress());
     command_list->SetComputeRootShaderResourceView(ComputeBrickPoolRootSignatureParams::CellGlobalIndicexOffsetsSlot, scan_shader_->GetScanOutBuffer()->GetGPUVirtualAddress());
     command_list->SetComputeRootShaderResourceView(ComputeBrickPoolRootSignatureParams::SurfaceCellIndicesSlot, surface_cell_indices_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeBrickPoolRootSignatureParams::SurfaceAABBsSlot, ray_tracer_->GetAccelerationStructure()->GetAABBBuffer()->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeBrickPoolRootSignatureParams::SurfaceBrickIndicesSlot, surface_brick_indices_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeBrickPoolRootSignatureParams::SurfaceCountsSlot, surface_counts_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootShaderResourceView(ComputeBrickPoolRootSignatureParams::CellBrickSlotsSlot, cell_brick_slots_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeBrickPoolRootSignatureParams::BrickSlotOnSurfaceSlot, brick_slot_on_surface_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeBrickPoolRootSignatureParams::BrickRangesSlot, brick_ranges_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootDescriptorTable(ComputeBrickPoolRootSignatureParams::NormalTextureSlot, brick_normal_texture_gpu_handle_);
     command_list->SetComputeRootConstantBufferView(ComputeBrickPoolRootSignatureParams::ConstantBufferSlot, compute_cb_->Resource()->GetGPUVirtualAddress());
     command_list->SetComputeRootConstantBufferView(ComputeBrickPoolRootSignatureParams::TestValuesSlot, test_vals_cb_->Resource()->GetGPUVirtualAddress());
 
     command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(brick_pool_3d_texture_.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(brick_normal_texture_.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(ray_tracer_->GetAccelerationStructure()->GetAABBBuffer(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(surface_brick_indices_buffer_.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(cell_brick_slots_buffer_.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_GENERIC_READ));
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(brick_ranges_buffer_.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
 
+    // Fills the bricks, and appends those that can be hit to the AABB buffer the BLAS is built from
     command_list->Dispatch(bricks_count_, 1, 1);
 
+    // Apron-free bricks copy their aprons from the neighbouring bricks' cores once they're all filled, then get culled
+    if (compute_cb_->Values().apron_free_bricks_) {
+        D3D12_RESOURCE_BARRIER filled_barriers[] = { CD3DX12_RESOURCE_BARRIER::UAV(brick_pool_3d_texture_.Get()), CD3DX12_RESOURCE_BARRIER::UAV(brick_ranges_buffer_.Get()),
+            CD3DX12_RESOURCE_BARRIER::UAV(brick_normal_texture_.Get()) };
+        command_list->ResourceBarrier(ARRAYSIZE(filled_barriers), filled_barriers);
+        command_list->SetPipelineState(compute_brick_apron_state_object_.Get());
+        command_list->Dispatch(bricks_count_, 1, 1);
+    }
+
+    // With camera LOD, the aprons facing coarser cells are matched to them once every brick is filled, then the bricks get culled
+    if (compute_cb_->Values().lod_bricks_) {
+        D3D12_RESOURCE_BARRIER filled_barriers[] = { CD3DX12_RESOURCE_BARRIER::UAV(brick_pool_3d_texture_.Get()), CD3DX12_RESOURCE_BARRIER::UAV(brick_ranges_buffer_.Get()),
+            CD3DX12_RESOURCE_BARRIER::UAV(brick_normal_texture_.Get()) };
+        command_list->ResourceBarrier(ARRAYSIZE(filled_barriers), filled_barriers);
+        command_list->SetPipelineState(compute_brick_lod_seam_state_object_.Get());
+        command_list->Dispatch(bricks_count_, 1, 1);
+    }
+
     command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(brick_pool_3d_texture_.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_GENERIC_READ));
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(brick_normal_texture_.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_GENERIC_READ));
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(ray_tracer_->GetAccelerationStructure()->GetAABBBuffer(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_GENERIC_READ));
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(surface_brick_indices_buffer_.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_GENERIC_READ));
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(cell_brick_slots_buffer_.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(brick_ranges_buffer_.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_GENERIC_READ));
     command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(surface_cell_indices_buffer_.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
 }
 
@@ -305,31 +583,113 @@ void Computer::SortParticleData()
     command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(scan_shader_->GetScanOutBuffer(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
 }
 
-// Fill the simple SDF 3D texture
-void Computer::ComputeSimpleSDFTexture()
+// Fill the simple SDF 3D texture, either from every particle or from the particles around each voxel's cell.
+// From the grid, the particles must have been counted with BuildGrid and sorted with SortParticleData, and with a narrow
+// band set in the constant buffer only the voxels near the surface are filled from them, see ComputeNarrowBandSDFTexture.
+void Computer::ComputeSimpleSDFTexture(bool from_grid)
 {
     auto command_list = device_resources_->GetCommandList();
 
     ID3D12DescriptorHeap* heap = application_->GetDescriptorHeap();
     command_list->SetDescriptorHeaps(1, &heap);
 
-    command_list->SetPipelineState(compute_simple_tex_state_object_.Get());
+    command_list->SetPipelineState(from_grid ? compute_simple_tex_grid_state_object_.Get() : compute_simple_tex_state_object_.Get());
     command_list->SetComputeRootSignature(compute_simple_tex_root_signature_.Get());
 
-    command_list->SetComputeRootShaderResourceView(ComputeTextureRootSignatureParams::ParticlePositionsBufferSlot, particle_buffer_unordered_->GetGPUVirtualAddress());
+    ID3D12Resource* particles = from_grid ? particle_buffer_ordered_.Get() : particle_buffer_unordered_.Get();
+    command_list->SetComputeRootShaderResourceView(ComputeTextureRootSignatureParams::ParticlePositionsBufferSlot, particles->GetGPUVirtualAddress());
     command_list->SetComputeRootDescriptorTable(ComputeTextureRootSignatureParams::TextureSlot, simple_sdf_3d_texture_gpu_handle_);
     command_list->SetComputeRootConstantBufferView(ComputeTextureRootSignatureParams::TestValuesSlot, test_vals_cb_->Resource()->GetGPUVirtualAddress());
+    command_list->SetComputeRootShaderResourceView(ComputeTextureRootSignatureParams::CellCountsSlot, scan_shader_->GetScanInBuffer()->GetGPUVirtualAddress());
+    command_list->SetComputeRootShaderResourceView(ComputeTextureRootSignatureParams::CellGlobalIndicexOffsetsSlot, scan_shader_->GetScanOutBuffer()->GetGPUVirtualAddress());
 
-    command_list->Dispatch(tex_creation_threadgroups_.x, tex_creation_threadgroups_.y, tex_creation_threadgroups_.z);
+    if (from_grid && compute_cb_->Values().narrow_band_voxels_ > 0) {
+        ComputeNarrowBandSDFTexture();
+    }
+    else {
+        command_list->Dispatch(tex_creation_threadgroups_.x, tex_creation_threadgroups_.y, tex_creation_threadgroups_.z);
+    }
+
+    if (compute_cb_->Values().distance_pyramid_) {
+        BuildDistancePyramid();
+    }
 
     command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(simple_sdf_3d_texture_.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_GENERIC_READ));
 }
 
+// Fill only the voxels within a band around the cells the surface can be in from the grid, then flood their distances out
+// over a coarser grid with jump flooding for the rest, which is never further than the surface. See CPUBackend/NarrowBand.h.
+// Expects the texture's root signature and the grid's buffers to be bound by ComputeSimpleSDFTexture.
+void Computer::ComputeNarrowBandSDFTexture()
+{
+    auto command_list = device_resources_->GetCommandList();
+
+    command_list->SetComputeRootConstantBufferView(ComputeTextureRootSignatureParams::ConstantBufferSlot, compute_cb_->Resource()->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeTextureRootSignatureParams::BandCellsSlot, band_cells_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeTextureRootSignatureParams::SeedDistancesSlot, seed_distances_buffer_->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeTextureRootSignatureParams::FloodInSlot, flood_buffers_[0]->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(ComputeTextureRootSignatureParams::FloodOutSlot, flood_buffers_[1]->GetGPUVirtualAddress());
+
+    // Flag the band cells and clear the seeds
+    command_list->SetPipelineState(compute_narrow_band_cells_state_object_.Get());
+    command_list->Dispatch(narrow_band_cells_threadgroups_, 1, 1);
+    D3D12_RESOURCE_BARRIER cells_barriers[] = { CD3DX12_RESOURCE_BARRIER::UAV(band_cells_buffer_.Get()), CD3DX12_RESOURCE_BARRIER::UAV(seed_distances_buffer_.Get()) };
+    command_list->ResourceBarrier(ARRAYSIZE(cells_barriers), cells_barriers);
+
+    // Fill the band, keeping the seeds
+    command_list->SetPipelineState(compute_simple_tex_narrow_band_state_object_.Get());
+    command_list->Dispatch(tex_creation_threadgroups_.x, tex_creation_threadgroups_.y, tex_creation_threadgroups_.z);
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(seed_distances_buffer_.Get()));
+
+    // Jump flood, halving the step from half the flood grid down to 1, then one more step of 1
+    UINT flood_res = (TEXTURE_RESOLUTION + NARROW_BAND_FLOOD_SCALE - 1) / NARROW_BAND_FLOOD_SCALE;
+    std::vector<UINT> steps;
+    for (UINT step = max(flood_res / 2, 1u); step >= 1; step /= 2) {
+        steps.push_back(step);
+    }
+    steps.push_back(1);
+
+    command_list->SetPipelineState(compute_jump_flood_state_object_.Get());
+    for (size_t pass = 0; pass < steps.size(); pass++) {
+        UINT flood_constants[] = { steps[pass], pass == 0 };
+        command_list->SetComputeRoot32BitConstants(ComputeTextureRootSignatureParams::PassConstantsSlot, ARRAYSIZE(flood_constants), flood_constants, 0);
+        command_list->SetComputeRootUnorderedAccessView(ComputeTextureRootSignatureParams::FloodInSlot, flood_buffers_[pass % 2]->GetGPUVirtualAddress());
+        command_list->SetComputeRootUnorderedAccessView(ComputeTextureRootSignatureParams::FloodOutSlot, flood_buffers_[(pass + 1) % 2]->GetGPUVirtualAddress());
+        command_list->Dispatch(flood_threadgroups_, flood_threadgroups_, flood_threadgroups_);
+        command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(flood_buffers_[(pass + 1) % 2].Get()));
+    }
+
+    // Fill the rest from the flood's result
+    command_list->SetComputeRootUnorderedAccessView(ComputeTextureRootSignatureParams::FloodInSlot, flood_buffers_[steps.size() % 2]->GetGPUVirtualAddress());
+    command_list->SetPipelineState(compute_simple_tex_far_field_state_object_.Get());
+    command_list->Dispatch(tex_creation_threadgroups_.x, tex_creation_threadgroups_.y, tex_creation_threadgroups_.z);
+}
+
+// Build each level of the distance pyramid from the one below it, the first reading the texture back, so rays can skip
+// the empty space it shows. See CPUBackend/DistancePyramid.h.
+// Expects the texture's root signature and the texture to be bound by ComputeSimpleSDFTexture.
+void Computer::BuildDistancePyramid()
+{
+    auto command_list = device_resources_->GetCommandList();
+
+    command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(simple_sdf_3d_texture_.Get()));
+    command_list->SetComputeRootUnorderedAccessView(ComputeTextureRootSignatureParams::DistancePyramidSlot, distance_pyramid_buffer_->GetGPUVirtualAddress());
+    command_list->SetPipelineState(compute_distance_pyramid_state_object_.Get());
+    for (UINT level = 1; level <= DISTANCE_PYRAMID_LEVELS; level++) {
+        UINT pass_constants[] = { level, 0 };
+        command_list->SetComputeRoot32BitConstants(ComputeTextureRootSignatureParams::PassConstantsSlot, ARRAYSIZE(pass_constants), pass_constants, 0);
+        UINT level_threadgroups = std::ceil(((TEXTURE_RESOLUTION + (1 << level) - 1) >> level) / 4.f);
+        command_list->Dispatch(level_threadgroups, level_threadgroups, level_threadgroups);
+        command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(distance_pyramid_buffer_.Get()));
+    }
+}
+
 void Computer::CreateRootSignatures()
 {
     // Root signature used for shader which computes particle positions
     CD3DX12_ROOT_PARAMETER pos_root_params[ComputePositionsRootSignatureParams::Count];
     pos_root_params[ComputePositionsRootSignatureParams::ParticlePositionsBufferSlot].InitAsUnorderedAccessView(0);
+    pos_root_params[ComputePositionsRootSignatureParams::CellBrickSlotsSlot].InitAsUnorderedAccessView(1);
     pos_root_params[ComputePositionsRootSignatureParams::ConstantBufferSlot].InitAsConstantBufferView(1);
     pos_root_params[ComputePositionsRootSignatureParams::TestValuesSlot].InitAsConstantBufferView(0);
     CD3DX12_ROOT_SIGNATURE_DESC pos_root_signature_desc(ARRAYSIZE(pos_root_params), pos_root_params);
@@ -343,6 +703,11 @@ void Computer::CreateRootSignatures()
     grid_root_params[ComputeGridRootSignatureParams::SurfaceBlocksSlot].InitAsUnorderedAccessView(3);
     grid_root_params[ComputeGridRootSignatureParams::SurfaceCellsSlot].InitAsUnorderedAccessView(4);
     grid_root_params[ComputeGridRootSignatureParams::SurfaceCountsSlot].InitAsUnorderedAccessView(5);
+    grid_root_params[ComputeGridRootSignatureParams::SurfaceBlockFlagsSlot].InitAsUnorderedAccessView(6);
+    grid_root_params[ComputeGridRootSignatureParams::SurfaceBlockOffsetsSlot].InitAsUnorderedAccessView(7);
+    grid_root_params[ComputeGridRootSignatureParams::SurfaceCellFlagsSlot].InitAsUnorderedAccessView(8);
+    grid_root_params[ComputeGridRootSignatureParams::SurfaceCellOffsetsSlot].InitAsUnorderedAccessView(9);
+    grid_root_params[ComputeGridRootSignatureParams::ConstantBufferSlot].InitAsConstantBufferView(1);
     grid_root_params[ComputeGridRootSignatureParams::TestValuesSlot].InitAsConstantBufferView(0);
     CD3DX12_ROOT_SIGNATURE_DESC grid_root_signature_desc(ARRAYSIZE(grid_root_params), grid_root_params);
     SerializeAndCreateComputeRootSignature(grid_root_signature_desc, &compute_grid_root_signature_);
@@ -351,6 +716,7 @@ void Computer::CreateRootSignatures()
     CD3DX12_ROOT_PARAMETER build_AABBs_root_params[ComputeAABBsRootSignatureParams::Count];
     build_AABBs_root_params[ComputeAABBsRootSignatureParams::SurfaceCellIndicesSlot].InitAsShaderResourceView(0);
     build_AABBs_root_params[ComputeAABBsRootSignatureParams::SurfaceCountsSlot].InitAsShaderResourceView(1);
+    build_AABBs_root_params[ComputeAABBsRootSignatureParams::CellBrickSlotsSlot].InitAsShaderResourceView(2);
     build_AABBs_root_params[ComputeAABBsRootSignatureParams::AABBBufferSlot].InitAsUnorderedAccessView(0);
     build_AABBs_root_params[ComputeAABBsRootSignatureParams::TestValuesSlot].InitAsConstantBufferView(0);
     CD3DX12_ROOT_SIGNATURE_DESC build_AABBs_signature_desc(ARRAYSIZE(build_AABBs_root_params), build_AABBs_root_params);
@@ -363,6 +729,15 @@ void Computer::CreateRootSignatures()
     tex_root_params[ComputeTextureRootSignatureParams::ParticlePositionsBufferSlot].InitAsShaderResourceView(0);
     tex_root_params[ComputeTextureRootSignatureParams::TestValuesSlot].InitAsConstantBufferView(0);
     tex_root_params[ComputeTextureRootSignatureParams::TextureSlot].InitAsDescriptorTable(1, &tex_uav_descriptor);
+    tex_root_params[ComputeTextureRootSignatureParams::CellCountsSlot].InitAsShaderResourceView(1);
+    tex_root_params[ComputeTextureRootSignatureParams::CellGlobalIndicexOffsetsSlot].InitAsShaderResourceView(2);
+    tex_root_params[ComputeTextureRootSignatureParams::ConstantBufferSlot].InitAsConstantBufferView(1);
+    tex_root_params[ComputeTextureRootSignatureParams::BandCellsSlot].InitAsUnorderedAccessView(1);
+    tex_root_params[ComputeTextureRootSignatureParams::SeedDistancesSlot].InitAsUnorderedAccessView(2);
+    tex_root_params[ComputeTextureRootSignatureParams::FloodInSlot].InitAsUnorderedAccessView(3);
+    tex_root_params[ComputeTextureRootSignatureParams::FloodOutSlot].InitAsUnorderedAccessView(4);
+    tex_root_params[ComputeTextureRootSignatureParams::PassConstantsSlot].InitAsConstants(2, 2); // Step and if it's the first pass per jump flood pass, or the pyramid level
+    tex_root_params[ComputeTextureRootSignatureParams::DistancePyramidSlot].InitAsUnorderedAccessView(5);
     CD3DX12_ROOT_SIGNATURE_DESC tex_root_signature_desc(ARRAYSIZE(tex_root_params), tex_root_params);
     SerializeAndCreateComputeRootSignature(tex_root_signature_desc, &compute_simple_tex_root_signature_);
 
@@ -376,6 +751,15 @@ void Computer::CreateRootSignatures()
     brickpool_root_params[ComputeBrickPoolRootSignatureParams::CellCountsSlot].InitAsShaderResourceView(2);
     brickpool_root_params[ComputeBrickPoolRootSignatureParams::CellGlobalIndicexOffsetsSlot].InitAsShaderResourceView(3);
     brickpool_root_params[ComputeBrickPoolRootSignatureParams::SurfaceCellIndicesSlot].InitAsShaderResourceView(4);
+    brickpool_root_params[ComputeBrickPoolRootSignatureParams::SurfaceAABBsSlot].InitAsUnorderedAccessView(1);
+    brickpool_root_params[ComputeBrickPoolRootSignatureParams::SurfaceBrickIndicesSlot].InitAsUnorderedAccessView(2);
+    brickpool_root_params[ComputeBrickPoolRootSignatureParams::SurfaceCountsSlot].InitAsUnorderedAccessView(3);
+    brickpool_root_params[ComputeBrickPoolRootSignatureParams::CellBrickSlotsSlot].InitAsShaderResourceView(5);
+    brickpool_root_params[ComputeBrickPoolRootSignatureParams::BrickSlotOnSurfaceSlot].InitAsUnorderedAccessView(4);
+    brickpool_root_params[ComputeBrickPoolRootSignatureParams::BrickRangesSlot].InitAsUnorderedAccessView(5);
+    CD3DX12_DESCRIPTOR_RANGE brickpool_normal_uav_descriptor;
+    brickpool_normal_uav_descriptor.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 6);
+    brickpool_root_params[ComputeBrickPoolRootSignatureParams::NormalTextureSlot].InitAsDescriptorTable(1, &brickpool_normal_uav_descriptor);
     brickpool_root_params[ComputeBrickPoolRootSignatureParams::ConstantBufferSlot].InitAsConstantBufferView(1);
     brickpool_root_params[ComputeBrickPoolRootSignatureParams::TestValuesSlot].InitAsConstantBufferView(0);
     CD3DX12_ROOT_SIGNATURE_DESC brickpool_root_signature_desc(ARRAYSIZE(brickpool_root_params), brickpool_root_params);
@@ -390,6 +774,18 @@ void Computer::CreateRootSignatures()
     CD3DX12_ROOT_SIGNATURE_DESC build_reorder_signature_desc(ARRAYSIZE(build_reorder_root_params), build_reorder_root_params);
     SerializeAndCreateComputeRootSignature(build_reorder_signature_desc, &compute_reorder_root_signature_);
 
+    // Root signature used for shaders which allocate brick pool slots
+    CD3DX12_ROOT_PARAMETER brick_slots_root_params[ComputeBrickSlotsRootSignatureParams::Count];
+    brick_slots_root_params[ComputeBrickSlotsRootSignatureParams::CellBrickSlotsSlot].InitAsUnorderedAccessView(0);
+    brick_slots_root_params[ComputeBrickSlotsRootSignatureParams::FreeBrickSlotsSlot].InitAsUnorderedAccessView(1);
+    brick_slots_root_params[ComputeBrickSlotsRootSignatureParams::FreeBrickSlotsCountSlot].InitAsUnorderedAccessView(2);
+    brick_slots_root_params[ComputeBrickSlotsRootSignatureParams::SurfaceCountsSlot].InitAsUnorderedAccessView(3);
+    brick_slots_root_params[ComputeBrickSlotsRootSignatureParams::SurfaceCellIndicesSlot].InitAsShaderResourceView(0);
+    brick_slots_root_params[ComputeBrickSlotsRootSignatureParams::ConstantBufferSlot].InitAsConstantBufferView(1);
+    brick_slots_root_params[ComputeBrickSlotsRootSignatureParams::TestValuesSlot].InitAsConstantBufferView(0);
+    CD3DX12_ROOT_SIGNATURE_DESC brick_slots_signature_desc(ARRAYSIZE(brick_slots_root_params), brick_slots_root_params);
+    SerializeAndCreateComputeRootSignature(brick_slots_signature_desc, &compute_brick_slots_root_signature_);
+
 
 }
 
@@ -466,6 +862,22 @@ void Computer::CreateComputePipelineStateObjects()
     compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
     ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_surface_cells_state_object_)));
 
+    // Scatter flagged surface blocks shader, for sorted surface lists
+    if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeGrid.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSScatterSurfaceBlocksMain", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
+        std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
+        throw std::exception(errMsg.c_str());
+    }
+    compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
+    ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_scatter_surface_blocks_state_object_)));
+
+    // Scatter flagged surface cells shader
+    if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeGrid.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSScatterSurfaceCellsMain", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
+        std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
+        throw std::exception(errMsg.c_str());
+    }
+    compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
+    ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_scatter_surface_cells_state_object_)));
+
     // Build AABB buffer
     if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeBuildAABBs.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSBuildAABBs", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
         std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
@@ -484,6 +896,50 @@ void Computer::CreateComputePipelineStateObjects()
     compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
     ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_simple_tex_state_object_)));
 
+    // Compute texture from the grid shader
+    if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeTexture.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSTexGridMain", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
+        std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
+        throw std::exception(errMsg.c_str());
+    }
+    compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
+    ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_simple_tex_grid_state_object_)));
+
+    // Narrow band texture shaders
+    if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeTexture.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSNarrowBandCellsMain", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
+        std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
+        throw std::exception(errMsg.c_str());
+    }
+    compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
+    ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_narrow_band_cells_state_object_)));
+
+    if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeTexture.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSTexNarrowBandMain", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
+        std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
+        throw std::exception(errMsg.c_str());
+    }
+    compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
+    ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_simple_tex_narrow_band_state_object_)));
+
+    if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeTexture.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSJumpFloodMain", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
+        std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
+        throw std::exception(errMsg.c_str());
+    }
+    compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
+    ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_jump_flood_state_object_)));
+
+    if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeTexture.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSTexFarFieldMain", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
+        std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
+        throw std::exception(errMsg.c_str());
+    }
+    compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
+    ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_simple_tex_far_field_state_object_)));
+
+    if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeTexture.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSDistancePyramidMain", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
+        std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
+        throw std::exception(errMsg.c_str());
+    }
+    compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
+    ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_distance_pyramid_state_object_)));
+
     // Compute brick pool shader
     if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeBrickPool.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSBrickPoolMain", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
         std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
@@ -493,6 +949,22 @@ void Computer::CreateComputePipelineStateObjects()
     compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
     ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_brickpool_state_object_)));
 
+    // Apron copy shader for apron-free bricks
+    if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeBrickPool.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSBrickApronMain", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
+        std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
+        throw std::exception(errMsg.c_str());
+    }
+    compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
+    ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_brick_apron_state_object_)));
+
+    // Seam shader for camera LOD
+    if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeBrickPool.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSBrickLodSeamMain", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
+        std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
+        throw std::exception(errMsg.c_str());
+    }
+    compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
+    ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_brick_lod_seam_state_object_)));
+
     // Reorder particle data shader
     if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeReorderParticles.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSReorderParticlesMain", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
         std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
@@ -502,6 +974,43 @@ void Computer::CreateComputePipelineStateObjects()
     compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
     ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_reorder_state_object_)));
 
+    // Brick slot shaders
+    if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeBrickSlots.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSResetBrickSlots", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
+        std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
+        throw std::exception(errMsg.c_str());
+    }
+    compute_pso.pRootSignature = compute_brick_slots_root_signature_.Get();
+    compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
+    ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_reset_brick_slots_state_object_)));
+
+    if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeBrickSlots.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSMarkSurfaceCells", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
+        std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
+        throw std::exception(errMsg.c_str());
+    }
+    compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
+    ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_mark_surface_cells_state_object_)));
+
+    if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeBrickSlots.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSReleaseBrickSlots", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
+        std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
+        throw std::exception(errMsg.c_str());
+    }
+    compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
+    ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_release_brick_slots_state_object_)));
+
+    if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeBrickSlots.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSAllocateBrickSlots", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
+        std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
+        throw std::exception(errMsg.c_str());
+    }
+    compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
+    ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_allocate_brick_slots_state_object_)));
+
+    if (FAILED(D3DCompileFromFile(application_->GetAssetFullPath(L"ComputeBrickSlots.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "CSSelectCellLods", "cs_5_1", flags, 0, &compute_shader, &error_blob))) {
+        std::string errMsg((char*)error_blob->GetBufferPointer(), error_blob->GetBufferSize());
+        throw std::exception(errMsg.c_str());
+    }
+    compute_pso.CS = CD3DX12_SHADER_BYTECODE(compute_shader.Get());
+    ThrowIfFailed(device_resources_->GetD3DDevice()->CreateComputePipelineState(&compute_pso, IID_PPV_ARGS(&compute_select_cell_lods_state_object_)));
+
 }
 
 void Computer::CreateBuffers()
@@ -515,6 +1024,10 @@ void Computer::CreateBuffers()
     blocks_threadgroups_ = std::ceil(NUM_BLOCKS / 1024.f);
     clear_counts_threadgroups_ = std::ceil(NUM_CELLS / 1024.f);
     tex_creation_threadgroups_ = XMUINT3(std::ceil(TEXTURE_RESOLUTION / 32.f), std::ceil(TEXTURE_RESOLUTION / 32.f), TEXTURE_RESOLUTION);
+    UINT flood_res = (TEXTURE_RESOLUTION + NARROW_BAND_FLOOD_SCALE - 1) / NARROW_BAND_FLOOD_SCALE;
+    UINT flood_voxels = flood_res * flood_res * flood_res;
+    narrow_band_cells_threadgroups_ = std::ceil(max((UINT)NUM_CELLS, flood_voxels) / 1024.f);
+    flood_threadgroups_ = std::ceil(flood_res / 8.f);
 
     // Particle buffers
     UINT64 byte_size = NUM_PARTICLES * sizeof(ParticleData);
@@ -525,24 +1038,59 @@ void Computer::CreateBuffers()
 
     Profiler::RegisterResource("OrderedParticles", byte_size);
 
-    // Grid buffers
+    // Grid buffers. The surface scans are made first, as each scan registers its buffers under the same names as scan_shader_'s.
+    surface_blocks_scan_ = std::make_unique<ChainedScanDecoupledLookback>(device_resources_);
+    surface_blocks_scan_->UpdateSize(NUM_BLOCKS);
+    surface_cells_scan_ = std::make_unique<ChainedScanDecoupledLookback>(device_resources_);
+    surface_cells_scan_->UpdateSize(NUM_CELLS);
     scan_shader_ = std::make_unique<ChainedScanDecoupledLookback>(device_resources_);
     scan_shader_->UpdateSize(NUM_CELLS);
     Utilities::AllocateDefaultBuffer(device, NUM_BLOCKS * sizeof(Block), blocks_buffer_.GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
     Utilities::AllocateDefaultBuffer(device, NUM_CELLS * sizeof(unsigned int), surface_cell_indices_buffer_.GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
     Utilities::AllocateDefaultBuffer(device, NUM_BLOCKS * sizeof(unsigned int), surface_block_indices_buffer_.GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
     Utilities::AllocateDefaultBuffer(device, sizeof(GridSurfaceCounts), surface_counts_buffer_.GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    Utilities::AllocateDefaultBuffer(device, NUM_CELLS * sizeof(CellBrickSlot), cell_brick_slots_buffer_.GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    Utilities::AllocateDefaultBuffer(device, MAX_BRICK_LODS * sizeof(unsigned int), free_brick_slots_count_buffer_.GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 
     blocks_buffer_->SetName(L"Blocks");
     surface_cell_indices_buffer_->SetName(L"SurfaceCellIndices");
     surface_block_indices_buffer_->SetName(L"SurfaceBlockIndices");
     surface_counts_buffer_->SetName(L"SurfaceCounts");
+    cell_brick_slots_buffer_->SetName(L"CellBrickSlots");
+    free_brick_slots_count_buffer_->SetName(L"FreeBrickSlotsCount");
 
     Profiler::RegisterResource("BlocksBuffer", NUM_BLOCKS * sizeof(Block));
     Profiler::RegisterResource("SurfaceCellIndicesBuffer", NUM_CELLS * sizeof(unsigned int));
     Profiler::RegisterResource("SurfaceBlockIndicesBuffer", NUM_BLOCKS * sizeof(unsigned int));
+    Profiler::RegisterResource("SurfaceBlockFlagsBuffer", 2 * NUM_BLOCKS * sizeof(unsigned int)); // Flags and their scan
+    Profiler::RegisterResource("SurfaceCellFlagsBuffer", 2 * NUM_CELLS * sizeof(unsigned int));
     Profiler::RegisterResource("SurfaceCountsBuffer", sizeof(GridSurfaceCounts));
     Profiler::RegisterResource("SurfaceCountsReadbackBuffer", sizeof(GridSurfaceCounts));
+    Profiler::RegisterResource("CellBrickSlotsBuffer", NUM_CELLS * sizeof(CellBrickSlot));
+    Profiler::RegisterResource("FreeBrickSlotsCountBuffer", MAX_BRICK_LODS * sizeof(unsigned int));
+
+    // Narrow band texture buffers, per cell and per voxel of the flood grid
+    Utilities::AllocateDefaultBuffer(device, NUM_CELLS * sizeof(unsigned int), band_cells_buffer_.GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    Utilities::AllocateDefaultBuffer(device, flood_voxels * sizeof(unsigned int), seed_distances_buffer_.GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    Utilities::AllocateDefaultBuffer(device, flood_voxels * sizeof(unsigned int), flood_buffers_[0].GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    Utilities::AllocateDefaultBuffer(device, flood_voxels * sizeof(unsigned int), flood_buffers_[1].GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    band_cells_buffer_->SetName(L"BandCells");
+    seed_distances_buffer_->SetName(L"SeedDistances");
+    flood_buffers_[0]->SetName(L"Flood0");
+    flood_buffers_[1]->SetName(L"Flood1");
+    Profiler::RegisterResource("BandCellsBuffer", NUM_CELLS * sizeof(unsigned int));
+    Profiler::RegisterResource("SeedDistancesBuffer", flood_voxels * sizeof(unsigned int));
+    Profiler::RegisterResource("FloodBuffers", 2 * flood_voxels * sizeof(unsigned int));
+
+    // Distance pyramid, every level one after another
+    UINT pyramid_texels = 0;
+    for (UINT level = 1; level <= DISTANCE_PYRAMID_LEVELS; level++) {
+        UINT level_res = (TEXTURE_RESOLUTION + (1 << level) - 1) >> level;
+        pyramid_texels += level_res * level_res * level_res;
+    }
+    Utilities::AllocateDefaultBuffer(device, pyramid_texels * sizeof(float), distance_pyramid_buffer_.GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    distance_pyramid_buffer_->SetName(L"DistancePyramid");
+    Profiler::RegisterResource("DistancePyramidBuffer", pyramid_texels * sizeof(float));
 
     // Allocate buffer for reading back surface cell count
     ThrowIfFailed(device->CreateCommittedResource(
@@ -554,18 +1102,64 @@ void Computer::CreateBuffers()
         IID_PPV_ARGS(&surface_counts_readback_buffer_)));
 }
 
+void Computer::AllocateBrickBuffers()
+{
+    // If count of bricks is larger than the buffers can store, or has stayed well below it
+    if (brick_buffers_capacity_.Update(bricks_count_)) {
+        max_brick_buffers_count_ = brick_buffers_capacity_.GetCapacity();
+        auto device = device_resources_->GetD3DDevice();
+
+        // Release and reallocate the buffers
+        brick_aabbs_buffer_.Reset();
+        surface_brick_indices_buffer_.Reset();
+        Utilities::AllocateDefaultBuffer(device, max_brick_buffers_count_ * sizeof(D3D12_RAYTRACING_AABB), brick_aabbs_buffer_.GetAddressOf(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        Utilities::AllocateDefaultBuffer(device, max_brick_buffers_count_ * sizeof(unsigned int), surface_brick_indices_buffer_.GetAddressOf(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        brick_aabbs_buffer_->SetName(L"BrickAABBs");
+        surface_brick_indices_buffer_->SetName(L"SurfaceBrickIndices");
+
+        Profiler::RegisterResource("BrickAABBBuffer", max_brick_buffers_count_ * sizeof(D3D12_RAYTRACING_AABB));
+        Profiler::RegisterResource("SurfaceBrickIndicesBuffer", max_brick_buffers_count_ * sizeof(unsigned int));
+    }
+}
+
 void Computer::AllocateBrickPoolTexture()
 {
-    // If count of surface cells is larger than max bricks the pool can store
-    if (bricks_count_ > max_bricks_count_) {
-        XMUINT3 dimensions;
-        max_bricks_count_ = FindOptimalBrickPoolDimensions(dimensions); 
+    // If count of surface cells at any level of detail is larger than the pool's slots for that level, or has stayed well
+    // below it, or the format changed
+    bool reallocate = false;
+    for (int lod = 0; lod < MAX_BRICK_LODS; lod++) {
+        reallocate |= brick_pool_capacities_[lod].Update(lod_cells_count_[lod]);
+    }
+    if (reallocate || quantised_bricks_ != (bool)compute_cb_->Values().quantised_bricks_ || brick_normals_ != (bool)compute_cb_->Values().brick_normals_) {
+        brick_pool_reallocations_ += reallocate;
+
+        // The levels' slots are laid out coarsest first (see ComputeBrickSlots.hlsl), so only level 0 is at the end
+        UINT64 coarse_bricks = 0;
+        for (int lod = 1; lod < MAX_BRICK_LODS; lod++) {
+            coarse_bricks += brick_pool_capacities_[lod].GetCapacity() * BricksPerCellAtLod(lod);
+        }
+
+        // Pack the bricks into the fewest 64KB tiles of the textures sharing the dimensions, see BrickPoolPacking.h
+        BrickPoolPackingSettings packing_settings;
+        packing_settings.voxels_per_axis_per_brick_ = VOXELS_PER_AXIS_PER_BRICK;
+        packing_settings.texel_bytes_[0] = quantised_bricks_ ? sizeof(INT8) : sizeof(INT16);
+        packing_settings.texel_bytes_[1] = brick_normals_ ? 4 * sizeof(INT8) : 0;
+        BrickPoolPacking packing = PackBrickPool(coarse_bricks + brick_pool_capacities_[0].GetCapacity() * BricksPerCellAtLod(0), packing_settings);
+
+        // The ray tracer samples a single texture. A second page is only needed past 204^3 bricks, 17GB of 16-bit voxels.
+        if (packing.pages_ > 1) {
+            throw std::exception("Brick pool needs more than one texture");
+        }
+        XMUINT3 dimensions = { packing.dimensions_[0], packing.dimensions_[1], packing.dimensions_[2] };
+        max_bricks_count_ = (UINT)packing.slots_;
+        brick_pool_capacities_[0].SetCapacity((max_bricks_count_ - coarse_bricks) / BricksPerCellAtLod(0));
 
         // Release the texture
         brick_pool_3d_texture_.Reset();
 
-        // Create the 3D texture 
-        auto uavDesc = CD3DX12_RESOURCE_DESC::Tex3D(DXGI_FORMAT_R16_SNORM, dimensions.x * VOXELS_PER_AXIS_PER_BRICK, dimensions.y * VOXELS_PER_AXIS_PER_BRICK, dimensions.z * VOXELS_PER_AXIS_PER_BRICK, 1, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        // Create the 3D texture, 8-bit bricks halving its size
+        DXGI_FORMAT format = quantised_bricks_ ? DXGI_FORMAT_R8_SNORM : DXGI_FORMAT_R16_SNORM;
+        auto uavDesc = CD3DX12_RESOURCE_DESC::Tex3D(format, dimensions.x * VOXELS_PER_AXIS_PER_BRICK, dimensions.y * VOXELS_PER_AXIS_PER_BRICK, dimensions.z * VOXELS_PER_AXIS_PER_BRICK, 1, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
 
         auto defaultHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
         ThrowIfFailed(device_resources_->GetD3DDevice()->CreateCommittedResource(
@@ -580,40 +1174,62 @@ void Computer::AllocateBrickPoolTexture()
         // Add the size in bytes of the texture for csv
         UINT64 texture_size;
         device_resources_->GetD3DDevice()->GetCopyableFootprints(&brick_pool_3d_texture_->GetDesc(), 0, 1, 0, nullptr, nullptr, nullptr, &texture_size);
-        Profiler::UpdateCurrentBrickPoolSize(texture_size);
+
+        // The normal channel, an 8-bit normal per voxel. Without normals it's a single voxel, so there's always a texture to bind.
+        brick_normal_texture_.Reset();
+        auto normal_desc = CD3DX12_RESOURCE_DESC::Tex3D(DXGI_FORMAT_R8G8B8A8_SNORM, brick_normals_ ? uavDesc.Width : 1, brick_normals_ ? uavDesc.Height : 1, brick_normals_ ? uavDesc.DepthOrArraySize : 1, 1, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        ThrowIfFailed(device_resources_->GetD3DDevice()->CreateCommittedResource(
+            &defaultHeapProperties,
+            D3D12_HEAP_FLAG_NONE,
+            &normal_desc,
+            D3D12_RESOURCE_STATE_GENERIC_READ,
+            nullptr, IID_PPV_ARGS(&brick_normal_texture_)));
+        device_resources_->GetD3DDevice()->CreateUnorderedAccessView(brick_normal_texture_.Get(), nullptr, nullptr, brick_normal_texture_cpu_handle_);
+
+        UINT64 normal_texture_size;
+        device_resources_->GetD3DDevice()->GetCopyableFootprints(&brick_normal_texture_->GetDesc(), 0, 1, 0, nullptr, nullptr, nullptr, &normal_texture_size);
+        Profiler::UpdateCurrentBrickPoolSize(texture_size + normal_texture_size);
+
+        // The pool holds a slot for every surface cell at each level. Its bricks have moved, so every slot is freed.
+        UINT lod_slot_capacities[4] = {};
+        UINT slot_capacity = 0;
+        for (int lod = 0; lod < MAX_BRICK_LODS; lod++) {
+            lod_slot_capacities[lod] = (UINT)brick_pool_capacities_[lod].GetCapacity();
+            slot_capacity += lod_slot_capacities[lod];
+        }
+        free_brick_slots_buffer_.Reset();
+        brick_slot_on_surface_buffer_.Reset();
+        brick_ranges_buffer_.Reset();
+        Utilities::AllocateDefaultBuffer(device_resources_->GetD3DDevice(), slot_capacity * sizeof(unsigned int), free_brick_slots_buffer_.GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        Utilities::AllocateDefaultBuffer(device_resources_->GetD3DDevice(), max_bricks_count_ * sizeof(unsigned int), brick_slot_on_surface_buffer_.GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        Profiler::RegisterResource("FreeBrickSlotsBuffer", slot_capacity * sizeof(unsigned int));
+        Profiler::RegisterResource("BrickSlotOnSurfaceBuffer", max_bricks_count_ * sizeof(unsigned int));
+        InvalidateBrickSlots();
+
+        // Only read for 8-bit bricks, but always allocated so there's a buffer to bind
+        Utilities::AllocateDefaultBuffer(device_resources_->GetD3DDevice(), max_bricks_count_ * sizeof(BrickRange), brick_ranges_buffer_.GetAddressOf(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+        Profiler::RegisterResource("BrickRangesBuffer", max_bricks_count_ * sizeof(BrickRange));
 
         // Upload dimensions for use in texture creation
         compute_cb_->Values().brick_pool_dimensions_ = std::move(dimensions);
+        compute_cb_->Values().brick_slot_capacity_ = slot_capacity;
+        compute_cb_->Values().lod_slot_capacities_ = XMUINT4(lod_slot_capacities);
+        compute_cb_->Values().quantised_bricks_ = quantised_bricks_;
+        compute_cb_->Values().brick_normals_ = brick_normals_;
         compute_cb_->CopyData(0);
     }
 }
 
-// Approximates optimal dimensions for the brick pool
-unsigned int Computer::FindOptimalBrickPoolDimensions(XMUINT3& dimensions)
+// Reallocations and unused space of the resources sized by the brick count
+CapacityStats Computer::GetCapacityStats()
 {
-    // Greedily assign the smallest possible value, >= the cube root, to the x dimension
-    int cube_root = std::ceil(std::cbrt(bricks_count_)); 
-    dimensions.x = cube_root;
-
-    // Iteratively adjust dimensions till a suitable solution is found
-    while (dimensions.x > 0) {
-        int remaining = std::ceil((double)bricks_count_ / dimensions.x);
-        int y_approx = std::sqrt(remaining);
-        int z_approx = std::ceil((double)remaining / y_approx);
-
-        if (dimensions.x * y_approx * z_approx >= bricks_count_) {
-            dimensions.y = y_approx;
-            dimensions.z = z_approx;
-            return dimensions.x * dimensions.y * dimensions.z;
-        }
-
-        dimensions.x--;
+    CapacityStats stats;
+    for (const CapacityPolicy& capacity : brick_pool_capacities_) {
+        stats += capacity.GetStats();
     }
-
-    // No solution found, allocate according to cube root
-    dimensions.x = dimensions.y = dimensions.z = cube_root;
-
-    return dimensions.x * dimensions.y * dimensions.z;
+    stats.reallocations_ = brick_pool_reallocations_; // The levels are reallocated together, as the one brick pool
+    stats += brick_buffers_capacity_.GetStats();
+    return stats;
 }
 
 void Computer::AllocateSimpleSDFTexture()
@@ -645,5 +1261,7 @@ void Computer::AllocateSimpleSDFTexture()
     // Also allocate descriptors for the brick pool
     heap_index = application_->AllocateDescriptor(&brick_pool_3d_texture_cpu_handle_);
     brick_pool_3d_texture_gpu_handle_ = CD3DX12_GPU_DESCRIPTOR_HANDLE(application_->GetDescriptorHeap()->GetGPUDescriptorHandleForHeapStart(), heap_index, descriptor_size);
+    heap_index = application_->AllocateDescriptor(&brick_normal_texture_cpu_handle_);
+    brick_normal_texture_gpu_handle_ = CD3DX12_GPU_DESCRIPTOR_HANDLE(application_->GetDescriptorHeap()->GetGPUDescriptorHandleForHeapStart(), heap_index, descriptor_size);
 }
 
@@ -2,11 +2,23 @@
 #include "DeviceResources.h"
 #include "ComputeStructs.h"
 #include "UploadBuffer.h"
+#include "CapacityPolicy.h"
+#include "BrickPoolPacking.h"
 #include "ChainedScanDecoupledLookback.h"
 
+// Size of a brick in the brick pool, of R16_SNORM voxels (8-bit bricks use half of it)
+#define BRICK_POOL_BYTES_PER_BRICK (VOXELS_PER_AXIS_PER_BRICK * VOXELS_PER_AXIS_PER_BRICK * VOXELS_PER_AXIS_PER_BRICK * sizeof(INT16))
+
+// Texture voxels per axis per voxel of the narrow band texture's flood grid, as in ComputeTexture.hlsl
+#define NARROW_BAND_FLOOD_SCALE 8
+
+// Levels of the distance pyramid over the Simple method's texture, as in ComputeCommon.hlsli
+#define DISTANCE_PYRAMID_LEVELS 6
+
 namespace ComputePositionsRootSignatureParams {
     enum Value {
         ParticlePositionsBufferSlot = 0,
+        CellBrickSlotsSlot,
         ConstantBufferSlot,
         TestValuesSlot,
         Count
@@ -17,6 +29,15 @@ namespace ComputeTextureRootSignatureParams {
         ParticlePositionsBufferSlot = 0,
         TextureSlot,
         TestValuesSlot,
+        CellCountsSlot,
+        CellGlobalIndicexOffsetsSlot,
+        ConstantBufferSlot,
+        BandCellsSlot,
+        SeedDistancesSlot,
+        FloodInSlot,
+        FloodOutSlot,
+        PassConstantsSlot,
+        DistancePyramidSlot,
         Count
     };
 }
@@ -28,6 +49,25 @@ namespace ComputeBrickPoolRootSignatureParams {
         CellCountsSlot,
         CellGlobalIndicexOffsetsSlot,
         SurfaceCellIndicesSlot,
+        SurfaceAABBsSlot,
+        SurfaceBrickIndicesSlot,
+        SurfaceCountsSlot,
+        CellBrickSlotsSlot,
+        BrickSlotOnSurfaceSlot,
+        BrickRangesSlot,
+        NormalTextureSlot,
+        ConstantBufferSlot,
+        TestValuesSlot,
+        Count
+    };
+}
+namespace ComputeBrickSlotsRootSignatureParams {
+    enum Value {
+        CellBrickSlotsSlot = 0,
+        FreeBrickSlotsSlot,
+        FreeBrickSlotsCountSlot,
+        SurfaceCountsSlot,
+        SurfaceCellIndicesSlot,
         ConstantBufferSlot,
         TestValuesSlot,
         Count
@@ -41,6 +81,11 @@ namespace ComputeGridRootSignatureParams {
         SurfaceBlocksSlot,
         SurfaceCellsSlot,
         SurfaceCountsSlot,
+        SurfaceBlockFlagsSlot,
+        SurfaceBlockOffsetsSlot,
+        SurfaceCellFlagsSlot,
+        SurfaceCellOffsetsSlot,
+        ConstantBufferSlot,
         TestValuesSlot,
         Count
     };
@@ -49,6 +94,7 @@ namespace ComputeAABBsRootSignatureParams {
     enum Value {
         SurfaceCellIndicesSlot = 0,
         SurfaceCountsSlot,
+        CellBrickSlotsSlot,
         AABBBufferSlot,
         TestValuesSlot,
         Count
@@ -76,12 +122,19 @@ public:
     Computer(DX::DeviceResources* device_resources, HonoursApplication* app);
     void SetRayTracer(RayTracer* ray_tracer) { ray_tracer_ = ray_tracer; }
     void GenerateParticles();
+    void AdvanceFrame();
     void ComputePostitions();
     void ComputeGrid(Profiler* profiler);
-    void ComputeSimpleSDFTexture();
+    void BuildGrid(Profiler* profiler);
+    void ComputeSimpleSDFTexture(bool from_grid);
     void ReadBackCellCount();
     void ComputeAABBs(Profiler* profiler);
     void ComputeBrickPoolTexture();
+    void ReadBackSurfaceBrickCount();
+    void CopyAllBrickAABBs();
+    inline void InvalidateBrickSlots() { brick_slots_valid_ = false; }
+    inline void SetQuantisedBricks(bool quantised) { quantised_bricks_ = quantised; } // Takes effect when the brick pool is next allocated
+    inline void SetBrickNormals(bool normals) { brick_normals_ = normals; } // As above
     void SortParticleData();
 
 
@@ -93,6 +146,15 @@ public:
     inline D3D12_GPU_DESCRIPTOR_HANDLE GetSimpleSDFTextureHandle() { return simple_sdf_3d_texture_gpu_handle_; }
     inline ID3D12Resource* GetBrickPoolTexture() { return brick_pool_3d_texture_.Get(); }
     inline D3D12_GPU_DESCRIPTOR_HANDLE GetBrickPoolTextureHandle() { return brick_pool_3d_texture_gpu_handle_; }
+    inline D3D12_GPU_DESCRIPTOR_HANDLE GetBrickNormalTextureHandle() { return brick_normal_texture_gpu_handle_; }
+    inline ID3D12Resource* GetSurfaceBrickIndicesBuffer() { return surface_brick_indices_buffer_.Get(); }
+    inline ID3D12Resource* GetBrickRangesBuffer() { return brick_ranges_buffer_.Get(); }
+    inline ID3D12Resource* GetDistancePyramidBuffer() { return distance_pyramid_buffer_.Get(); }
+    inline UINT GetBricksCount() { return bricks_count_; }
+    inline UINT GetSurfaceBricksCount() { return surface_bricks_count_; }
+    inline UINT GetRecomputedBricksCount() { return recomputed_bricks_count_; }
+    inline bool IsTypedUAVLoadSupported() { return typed_uav_load_supported_; }
+    CapacityStats GetCapacityStats();
 
     inline void ReleaseUploaders() {
         particle_buffer_uploader_.Reset();
@@ -106,12 +168,21 @@ private:
     void CreateBuffers();
 
     void AllocateSimpleSDFTexture();
+    void ComputeNarrowBandSDFTexture();
+    void BuildDistancePyramid();
     void ReadBackBlocksCount();
+    void BindGridResources();
+    void CompactSurfaceList(ChainedScanDecoupledLookback* scan, ID3D12PipelineState* scatter_state_object, UINT threadgroups);
     void AllocateBrickPoolTexture();
-    UINT FindOptimalBrickPoolDimensions(XMUINT3& dimensions);
+    void AllocateBrickBuffers();
+    void UpdateBrickSlots();
+    void SelectCellLods();
 
     // Implementation of chained scan with decoupled lookback from https://github.com/b0nes164/GPUPrefixSums
     std::unique_ptr<ChainedScanDecoupledLookback> scan_shader_;
+    // Scans of the surface block and cell flags, for sorted surface lists. Their scan-in buffers hold the flags.
+    std::unique_ptr<ChainedScanDecoupledLookback> surface_blocks_scan_;
+    std::unique_ptr<ChainedScanDecoupledLookback> surface_cells_scan_;
 
     // State Objects
     ComPtr<ID3D12PipelineState> compute_pos_state_object_;
@@ -120,10 +191,25 @@ private:
     ComPtr<ID3D12PipelineState> compute_clear_counts_state_object_;
     ComPtr<ID3D12PipelineState> compute_surface_blocks_state_object_;
     ComPtr<ID3D12PipelineState> compute_surface_cells_state_object_;
+    ComPtr<ID3D12PipelineState> compute_scatter_surface_blocks_state_object_;
+    ComPtr<ID3D12PipelineState> compute_scatter_surface_cells_state_object_;
     ComPtr<ID3D12PipelineState> compute_AABBs_state_object_;
     ComPtr<ID3D12PipelineState> compute_simple_tex_state_object_;
+    ComPtr<ID3D12PipelineState> compute_simple_tex_grid_state_object_;
+    ComPtr<ID3D12PipelineState> compute_narrow_band_cells_state_object_;
+    ComPtr<ID3D12PipelineState> compute_simple_tex_narrow_band_state_object_;
+    ComPtr<ID3D12PipelineState> compute_jump_flood_state_object_;
+    ComPtr<ID3D12PipelineState> compute_simple_tex_far_field_state_object_;
+    ComPtr<ID3D12PipelineState> compute_distance_pyramid_state_object_;
     ComPtr<ID3D12PipelineState> compute_brickpool_state_object_;
+    ComPtr<ID3D12PipelineState> compute_brick_apron_state_object_;
+    ComPtr<ID3D12PipelineState> compute_brick_lod_seam_state_object_;
     ComPtr<ID3D12PipelineState> compute_reorder_state_object_;
+    ComPtr<ID3D12PipelineState> compute_reset_brick_slots_state_object_;
+    ComPtr<ID3D12PipelineState> compute_mark_surface_cells_state_object_;
+    ComPtr<ID3D12PipelineState> compute_release_brick_slots_state_object_;
+    ComPtr<ID3D12PipelineState> compute_allocate_brick_slots_state_object_;
+    ComPtr<ID3D12PipelineState> compute_select_cell_lods_state_object_;
 
     // Root signatures
     ComPtr<ID3D12RootSignature> compute_pos_root_signature_;
@@ -132,6 +218,7 @@ private:
     ComPtr<ID3D12RootSignature> compute_simple_tex_root_signature_;
     ComPtr<ID3D12RootSignature> compute_brickpool_root_signature_;
     ComPtr<ID3D12RootSignature> compute_reorder_root_signature_;
+    ComPtr<ID3D12RootSignature> compute_brick_slots_root_signature_;
 
     // Buffers
     ComPtr<ID3D12Resource> particle_buffer_uploader_;
@@ -142,6 +229,21 @@ private:
     ComPtr<ID3D12Resource> surface_cell_indices_buffer_;
     ComPtr<ID3D12Resource> surface_counts_buffer_;
     ComPtr<ID3D12Resource> surface_counts_readback_buffer_;
+    ComPtr<ID3D12Resource> brick_aabbs_buffer_; // AABBs of every brick, before culling
+    ComPtr<ID3D12Resource> surface_brick_indices_buffer_; // Brick pool index of each AABB the BLAS is built from
+
+    // Persistent brick pool slots, see ComputeBrickSlots.hlsl
+    ComPtr<ID3D12Resource> cell_brick_slots_buffer_;
+    ComPtr<ID3D12Resource> free_brick_slots_buffer_;
+    ComPtr<ID3D12Resource> free_brick_slots_count_buffer_;
+    ComPtr<ID3D12Resource> brick_slot_on_surface_buffer_; // Per brick in the pool, if it was kept by the culling when filled
+    ComPtr<ID3D12Resource> brick_ranges_buffer_; // Per brick in the pool, the BrickRange its 8-bit distances are stored in
+
+    // Narrow band texture, see ComputeTexture.hlsl
+    ComPtr<ID3D12Resource> band_cells_buffer_;
+    ComPtr<ID3D12Resource> seed_distances_buffer_;
+    ComPtr<ID3D12Resource> flood_buffers_[2]; // Ping-ponged between the jump flood passes
+    ComPtr<ID3D12Resource> distance_pyramid_buffer_; // Over the Simple method's texture, every level one after another
 
     std::unique_ptr<UploadBuffer<ComputeCB>> compute_cb_ = nullptr;
     std::unique_ptr<UploadBuffer<TestVariables>> test_vals_cb_ = nullptr;
@@ -150,19 +252,39 @@ private:
     UINT surface_blocks_count_ = 0;
     UINT bricks_count_ = 0;
     UINT max_bricks_count_ = 0;
+    UINT surface_bricks_count_ = 0; // Bricks left after culling those the ray tracer can't hit
+    UINT max_brick_buffers_count_ = 0;
+    UINT recomputed_bricks_count_ = 0;
+    UINT lod_cells_count_[MAX_BRICK_LODS] = {}; // Surface cells at each level of detail, see CSSelectCellLods
+    UINT brick_pool_reallocations_ = 0;
+    bool brick_slots_valid_ = false; // Cleared when the brick pool's contents can't be kept, so every slot is freed
+    bool typed_uav_load_supported_ = false; // If the SDF textures' formats can be read back from a UAV, for apron-free bricks, camera LOD seams and the distance pyramid
+    bool quantised_bricks_ = false; // If the brick pool should be 8-bit, the constant buffer has the format it was allocated with
+    bool brick_normals_ = false; // If the brick pool should have a normal channel, likewise
+
+    // When the resources sized by the brick count are reallocated, see CapacityPolicy.h.
+    // The brick pool's slots are in cells, with a policy per level of detail as each level's cells hold a different
+    // number of bricks.
+    CapacityPolicy brick_pool_capacities_[MAX_BRICK_LODS];
+    CapacityPolicy brick_buffers_capacity_;
 
     // 3D texture
     ComPtr<ID3D12Resource> simple_sdf_3d_texture_;
     D3D12_GPU_DESCRIPTOR_HANDLE simple_sdf_3d_texture_gpu_handle_;
     ComPtr<ID3D12Resource> brick_pool_3d_texture_;
     D3D12_GPU_DESCRIPTOR_HANDLE brick_pool_3d_texture_gpu_handle_;
+    ComPtr<ID3D12Resource> brick_normal_texture_; // Same dimensions as the brick pool, or a single voxel without normals
+    D3D12_GPU_DESCRIPTOR_HANDLE brick_normal_texture_gpu_handle_;
     D3D12_CPU_DESCRIPTOR_HANDLE brick_pool_3d_texture_cpu_handle_;
+    D3D12_CPU_DESCRIPTOR_HANDLE brick_normal_texture_cpu_handle_;
 
     // threadgroup sizes
     UINT particle_threadgroups_; // for particle position manipulation shader
     UINT blocks_threadgroups_; // for surface block detection
     UINT clear_counts_threadgroups_; // for clearing counters
     XMUINT3 tex_creation_threadgroups_; // for simple texture creation shader
+    UINT narrow_band_cells_threadgroups_; // for flagging band cells and clearing the flood grid's seeds
+    UINT flood_threadgroups_; // per axis, for the jump flood passes
     XMUINT3 brickpool_creation_threadgroups_; // for brick pool texture creation shader
 
     DX::DeviceResources* device_resources_;
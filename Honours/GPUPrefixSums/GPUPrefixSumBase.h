@@ -17,7 +17,7 @@ class GPUPrefixSumBase {
     const char* k_scanName;
     const uint32_t k_partitionSize;
     const uint32_t k_maxReadBack;
-    const uint32_t k_maxRandSize = 1 << 20;
+    const uint32_t k_maxRandSize = 1 << 21; // Raised from 1 << 20 to fit a 128 x 128 x 128 cell grid
 
     uint32_t m_alignedSize;
     uint32_t m_vectorizedSize;
@@ -8,37 +8,52 @@
 #define SceneWave 2
 #define SceneNormals 3
 
+#define CellIndexingLinear 0
+#define CellIndexingMorton 1
+
 struct TestVariables
 {
     int num_particles_;
     int texture_res_;
     int scene_;
+    float particle_radius_;
+    
+    // Grid layout, derived on the CPU by DeriveGridValues in TestValues.h
+    int cells_per_axis_;
+    int blocks_per_axis_;
+    int num_cells_;
+    int num_blocks_;
+    
+    int cell_indexing_;
 };
 ConstantBuffer<TestVariables> test_values_ : register(b0);
 
 #define NUM_PARTICLES test_values_.num_particles_
 #define TEXTURE_RESOLUTION test_values_.texture_res_
 #define SCENE test_values_.scene_
+#define CELL_INDEXING test_values_.cell_indexing_
 
 #define WORLD_MIN float3(0, 0, 0)
 #define WORLD_MAX float3(1, 1, 1)
 
-// Blocks: 4 x 4 x 4 total
-// Cells: 16 x 16 x 16 total, 4 x 4 x 4 per block
-#define NUM_CELLS 4096 
-#define NUM_CELLS_PER_AXIS 16, 16, 16
+// Blocks: (cells per axis / 4) cubed total
+// NUM_CELLS is padded up to the enclosing power of 2 cube with Morton indexing
+// Cells: set at run time from the particle radius (16 x 16 x 16 by default), 4 x 4 x 4 per block
+#define NUM_CELLS test_values_.num_cells_
+#define NUM_CELLS_PER_AXIS test_values_.cells_per_axis_, test_values_.cells_per_axis_, test_values_.cells_per_axis_
 
-#define NUM_BLOCKS 64 
-#define NUM_BLOCKS_PER_AXIS 4, 4, 4
+#define NUM_BLOCKS test_values_.num_blocks_
+#define NUM_BLOCKS_PER_AXIS test_values_.blocks_per_axis_, test_values_.blocks_per_axis_, test_values_.blocks_per_axis_
 
+// Fixed, as it is the thread group size of CSDetectSurfaceCellsMain
 #define NUM_CELLS_PER_AXIS_PER_BLOCK 4, 4, 4
 #define NUM_CELLS_PER_BLOCK 64
 
 // cell size >= influence radius
 // influence radius = 2 * particle radius
 #define CELL_SIZE WORLD_MAX / float3(NUM_CELLS_PER_AXIS)
-#define PARTICLE_INFLUENCE_RADIUS 0.0625
-#define PARTICLE_RADIUS 0.03125
+#define PARTICLE_INFLUENCE_RADIUS (test_values_.particle_radius_ * 2)
+#define PARTICLE_RADIUS test_values_.particle_radius_
 
 // Including voxels for adjacency data is 10, without is 8
 #define VOXELS_PER_AXIS_PER_BRICK 10
@@ -47,11 +62,18 @@ ConstantBuffer<TestVariables> test_values_ : register(b0);
 #define VOXEL_SIZE 1.f / TEXTURE_RESOLUTION
 
 // Currently assumes cells are perfect cubes
-// 2 x 2 x 2 = 8
-#define BRICKS_PER_AXIS_PER_CELL (TEXTURE_RESOLUTION / 128)
+// 2 x 2 x 2 = 8 for the default 16 cells per axis at 256 resolution
+#define BRICKS_PER_AXIS_PER_CELL max(TEXTURE_RESOLUTION / (test_values_.cells_per_axis_ * CORE_VOXELS_PER_AXIS_PER_BRICK), 1)
 #define BRICKS_PER_CELL (BRICKS_PER_AXIS_PER_CELL * BRICKS_PER_AXIS_PER_CELL * BRICKS_PER_AXIS_PER_CELL)
 #define BRICK_SIZE CELL_SIZE / float3(BRICKS_PER_AXIS_PER_CELL, BRICKS_PER_AXIS_PER_CELL, BRICKS_PER_AXIS_PER_CELL)
 
+// Brick voxels only match VOXEL_SIZE when the texture resolution divides evenly between the cells
+#define BRICK_VOXEL_SIZE BRICK_SIZE / CORE_VOXELS_PER_AXIS_PER_BRICK
+
+// Camera-distance level of detail, see CSSelectCellLods. Each level halves the bricks along each axis of a cell, down to
+// one, so BRICK_SIZE and BRICK_VOXEL_SIZE are those of level 0.
+#define MAX_BRICK_LODS 3
+
 
 
 
@@ -63,6 +63,14 @@ void HonoursApplication::OnInit()
     if (cpu_test_vars_.test_mode_) {
         debug_.render_normals_ = true;
     }
+    debug_.quantised_bricks_ = cpu_test_vars_.quantised_bricks_;
+    debug_.gradient_normals_ = cpu_test_vars_.gradient_normals_;
+    debug_.grid_simple_texture_ = cpu_test_vars_.grid_simple_texture_;
+    debug_.narrow_band_voxels_ = cpu_test_vars_.narrow_band_voxels_;
+    if (cpu_test_vars_.lod_pixels_per_voxel_ > 0) {
+        debug_.camera_lod_ = true;
+        debug_.lod_pixels_per_voxel_ = cpu_test_vars_.lod_pixels_per_voxel_;
+    }
     switch (cpu_test_vars_.implementation_) {
     case Naive:
         SetNaiveImplementation();
@@ -124,6 +132,9 @@ void HonoursApplication::OnUpdate()
 
     timer_.Update(!profiler_->IsCapturing());
 
+    // Bricks whose particles haven't moved since the last frame are kept in the brick pool
+    computer_->AdvanceFrame();
+
     if (!profiler_->IsCapturing()) { // Don't update while profiler is capturing
 
         profiler_->Update(timer_.GetDeltaTime());
@@ -137,6 +148,7 @@ void HonoursApplication::OnUpdate()
         buffer.view_proj_ = XMMatrixMultiply(cameras_array_[camera_]->getViewMatrix(), projection_matrix_);
         buffer.inv_view_proj_ = XMMatrixTranspose(XMMatrixInverse(nullptr, buffer.view_proj_));
         buffer.view_proj_ = XMMatrixTranspose(buffer.view_proj_);
+        buffer.pixel_radius_ = std::tan((float)XM_PI / 8.0f) / m_height; // Of the projection's field of view
 
         buffer.rendering_flags_ = RENDERING_FLAG_NONE;
         if (debug_.visualize_particles_) buffer.rendering_flags_ |= RENDERING_FLAG_VISUALIZE_PARTICLES;
@@ -144,6 +156,11 @@ void HonoursApplication::OnUpdate()
         if (debug_.render_normals_) buffer.rendering_flags_ |= RENDERING_FLAG_NORMALS;
         if (debug_.visualize_aabbs_) buffer.rendering_flags_ |= RENDERING_FLAG_VISUALIZE_AABBS;
         if (debug_.use_simple_aabb_) buffer.rendering_flags_ |= RENDERING_FLAG_SIMPLE_AABB;
+        if (debug_.gradient_normals_) buffer.rendering_flags_ |= RENDERING_FLAG_GRADIENT_NORMALS;
+        if (debug_.marching_mode_ == MarchingOverRelaxed) buffer.rendering_flags_ |= RENDERING_FLAG_OVER_RELAXED;
+        if (debug_.marching_mode_ == MarchingRelaxedCone) buffer.rendering_flags_ |= RENDERING_FLAG_RELAXED_CONE;
+        if (debug_.adaptive_threshold_) buffer.rendering_flags_ |= RENDERING_FLAG_ADAPTIVE_THRESHOLD;
+        if (debug_.step_counts_) buffer.rendering_flags_ |= RENDERING_FLAG_STEP_COUNTS;
 
         ray_tracer_->GetRaytracingCB()->CopyData(0);
 
@@ -156,12 +173,25 @@ void HonoursApplication::OnUpdate()
     }
     profiler_->FrameStart(device_resources_->GetCommandQueue());
 
-    // Grid construction, AABB creation and BVH update - ranges to profile specified in the functions
+    // Grid construction and AABB creation - ranges to profile specified in the functions
     if (!(debug_.use_simple_aabb_)) {    
+        computer_->SetQuantisedBricks(debug_.quantised_bricks_); // Applied when the brick pool is allocated in ComputeAABBs
+        computer_->SetBrickNormals(debug_.gradient_normals_);
+
+        // Cells' levels of detail are picked in ComputeAABBs. Matching the seams between levels reads the brick pool back,
+        // which needs typed UAV loads, and there's only a brick pool to coarsen when it's rendered.
+        ComputeCB& compute_values = computer_->GetConstantBuffer()->Values();
+        compute_values.lod_bricks_ = debug_.camera_lod_ && computer_->IsTypedUAVLoadSupported() && !(debug_.render_analytical_ || debug_.visualize_particles_);
+        compute_values.lod_pixels_per_voxel_ = debug_.lod_pixels_per_voxel_;
+        compute_values.camera_position_ = cameras_array_[camera_]->getPosition();
+        compute_values.lod_pixel_scale_ = m_height / (2.f * std::tan((float)XM_PI / 8.0f)); // Of the projection's field of view
+        compute_values.sorted_surface_lists_ = debug_.sorted_surface_lists_;
+        compute_values.flag_block_neighbours_ = debug_.flag_block_neighbours_;
+        computer_->GetConstantBuffer()->CopyData(0);
+
         computer_->ComputeGrid(profiler_.get()); 
 
         computer_->ComputeAABBs(profiler_.get());
-        ray_tracer_->GetAccelerationStructure()->UpdateStructure(profiler_.get());
     }
     else {
         // Execute and wait for work to finish need this when not calling ComputeAABBs and UpdateStructure
@@ -174,17 +204,34 @@ void HonoursApplication::OnUpdate()
         device_resources_->ResetCommandList();
 
         if (debug_.use_simple_aabb_) { // Simple method
+            computer_->InvalidateBrickSlots(); // The brick pool isn't kept up to date
+            if (debug_.grid_simple_texture_) {
+                computer_->BuildGrid(profiler_.get());
+
+                profiler_->PushRange(device_resources_->GetCommandList(), "Particle Reordering");
+                computer_->SortParticleData();
+                profiler_->PopRange(device_resources_->GetCommandList());
+            }
+            // The band can't reach past the cells around a voxel's cell
+            computer_->GetConstantBuffer()->Values().narrow_band_voxels_ = debug_.grid_simple_texture_ ? min(debug_.narrow_band_voxels_, max(TEXTURE_RESOLUTION / NUM_CELLS_PER_AXIS, 1)) : 0;
+            computer_->GetConstantBuffer()->Values().distance_pyramid_ = debug_.distance_pyramid_ && computer_->IsTypedUAVLoadSupported(); // Reads the texture back
+            computer_->GetConstantBuffer()->CopyData(0);
+
             profiler_->PushRange(device_resources_->GetCommandList(), "Simple Texture");
-            computer_->ComputeSimpleSDFTexture();
+            computer_->ComputeSimpleSDFTexture(debug_.grid_simple_texture_);
             profiler_->PopRange(device_resources_->GetCommandList());
         }
         else { // Complex method
+            computer_->GetConstantBuffer()->Values().cull_empty_bricks_ = debug_.cull_empty_bricks_;
+            computer_->GetConstantBuffer()->Values().apron_free_bricks_ = debug_.apron_free_bricks_ && computer_->IsTypedUAVLoadSupported();
+            computer_->GetConstantBuffer()->CopyData(0);
+
             profiler_->PushRange(device_resources_->GetCommandList(), "Particle Reordering");
             computer_->SortParticleData(); // Particle sorting 
             profiler_->PopRange(device_resources_->GetCommandList());
 
             profiler_->PushRange(device_resources_->GetCommandList(), "Brick Pool");
-            computer_->ComputeBrickPoolTexture(); // Create brick pool
+            computer_->ComputeBrickPoolTexture(); // Create brick pool, culling bricks that can't be hit
             profiler_->PopRange(device_resources_->GetCommandList());
         }
 
@@ -192,12 +239,33 @@ void HonoursApplication::OnUpdate()
         device_resources_->WaitForGpu();
     }
 
+    // BVH update, from the bricks left after culling - range to profile specified in the function
+    if (!(debug_.use_simple_aabb_)) {
+        if (debug_.render_analytical_ || debug_.visualize_particles_) {
+            computer_->InvalidateBrickSlots(); // The brick pool isn't kept up to date
+            computer_->CopyAllBrickAABBs();
+        }
+        else {
+            computer_->ReadBackSurfaceBrickCount();
+        }
+        ray_tracer_->GetAccelerationStructure()->UpdateStructure(profiler_.get());
+    }
+
+    // How often the resources sized by the brick count have been reallocated, and how much of them is unused
+    CapacityStats capacity_stats = computer_->GetCapacityStats();
+    capacity_stats += ray_tracer_->GetAccelerationStructure()->GetCapacityStats();
+    Profiler::UpdateCurrentCapacityStats(capacity_stats.reallocations_, capacity_stats.wasted_bytes_);
+
     // Perform ray tracing 
     if (debug_.use_simple_aabb_ || ray_tracer_->GetAccelerationStructure()->IsStructureBuilt()) {
         device_resources_->ResetCommandList();
         ray_tracer_->RayTracing(profiler_.get());
         device_resources_->ExecuteCommandList();
         device_resources_->WaitForGpu();
+
+        if (debug_.step_counts_) {
+            ray_tracer_->ReadBackStepCounts();
+        }
     }
 
 }
@@ -289,6 +357,8 @@ void HonoursApplication::DrawGUI()
     
     ImGui::SetNextItemOpen(true, ImGuiCond_Once);
     if (ImGui::CollapsingHeader("Scene")) {
+        ImGui::Text("Particle radius: %.4f", PARTICLE_RADIUS);
+        ImGui::Text("Grid: %d^3 cells, %d^3 blocks, %s indexing", NUM_CELLS_PER_AXIS, NUM_BLOCKS_PER_AXIS, CELL_INDEXING == CellIndexingMorton ? "Morton" : "linear");
         ImGui::Text("Select scene:");
         if (ImGui::Button("Grid")) {
             SCENE = SceneGrid;
@@ -330,6 +400,45 @@ void HonoursApplication::DrawGUI()
     ImGui::SetNextItemOpen(true, ImGuiCond_Once);
     if (ImGui::CollapsingHeader("Debug")) {
         ImGui::Checkbox("Debug normals", &debug_.render_normals_);
+        ImGui::Checkbox("Cull empty bricks", &debug_.cull_empty_bricks_);
+        ImGui::Checkbox("Sorted surface lists", &debug_.sorted_surface_lists_);
+        ImGui::Checkbox("Flag block neighbours", &debug_.flag_block_neighbours_);
+        ImGui::Checkbox("Simple texture from grid", &debug_.grid_simple_texture_);
+        if (debug_.grid_simple_texture_) {
+            ImGui::SliderInt("Narrow band voxels", &debug_.narrow_band_voxels_, 0, 8);
+        }
+        if (computer_->IsTypedUAVLoadSupported()) {
+            ImGui::Checkbox("Distance pyramid", &debug_.distance_pyramid_);
+        }
+        if (computer_->IsTypedUAVLoadSupported()) {
+            ImGui::Checkbox("Apron-free bricks", &debug_.apron_free_bricks_);
+        }
+        ImGui::Checkbox("8-bit bricks", &debug_.quantised_bricks_);
+        ImGui::Checkbox("Gradient normals", &debug_.gradient_normals_);
+        if (computer_->IsTypedUAVLoadSupported()) {
+            ImGui::Checkbox("Camera LOD", &debug_.camera_lod_);
+            if (debug_.camera_lod_) {
+                ImGui::SliderFloat("LOD pixels per voxel", &debug_.lod_pixels_per_voxel_, 0.5f, 8.f);
+            }
+        }
+        ImGui::Text("Marching:");
+        ImGui::RadioButton("Sphere", &debug_.marching_mode_, MarchingSphere); ImGui::SameLine();
+        ImGui::RadioButton("Over-relaxed", &debug_.marching_mode_, MarchingOverRelaxed); ImGui::SameLine();
+        ImGui::RadioButton("Relaxed cone", &debug_.marching_mode_, MarchingRelaxedCone);
+        ImGui::Checkbox("Adaptive threshold", &debug_.adaptive_threshold_);
+        ImGui::Checkbox("Step counts", &debug_.step_counts_);
+        if (debug_.step_counts_) {
+            const StepCountStats& step_stats = ray_tracer_->GetStepCountStats();
+            ImGui::Text("Steps: %.2f mean, %u p99, %u max", step_stats.mean_, step_stats.p99_, step_stats.max_);
+            ImGui::PlotHistogram("1, 2-3, 4-7, ...", step_stats.bins_, STEP_HISTOGRAM_BINS, 0, nullptr, 0.f, 1.f, ImVec2(0, 60));
+        }
+        if (!debug_.use_simple_aabb_) {
+            ImGui::Text("Bricks: %u traced, %u culled, %u recomputed", computer_->GetSurfaceBricksCount(), computer_->GetBricksCount() - computer_->GetSurfaceBricksCount(), computer_->GetRecomputedBricksCount());
+
+            CapacityStats capacity_stats = computer_->GetCapacityStats();
+            capacity_stats += ray_tracer_->GetAccelerationStructure()->GetCapacityStats();
+            ImGui::Text("Reallocations: %u, unused %.1f of %.1f MB", capacity_stats.reallocations_, capacity_stats.wasted_bytes_ / 1048576.f, capacity_stats.allocated_bytes_ / 1048576.f);
+        }
     }
 
     ImGui::Render();
@@ -35,6 +35,20 @@ struct DebugValues {
     bool render_normals_ = false;
     bool visualize_aabbs_ = false;
     bool use_simple_aabb_ = false;
+    bool cull_empty_bricks_ = true; // If bricks the ray tracer can't hit are left out of the BLAS
+    bool sorted_surface_lists_ = false; // If surface blocks and cells are compacted in index order rather than appended, for the same lists every run
+    bool flag_block_neighbours_ = false; // If blocks are marked by their neighbouring cells rather than counting them, for the same surface every run
+    bool apron_free_bricks_ = true; // If bricks only calculate their core voxels, copying the apron from neighbouring bricks
+    bool quantised_bricks_ = false; // If the brick pool stores 8-bit distances, relative to each brick's range
+    bool gradient_normals_ = false; // If normals come from the SDF's gradient, stored in the brick pool, rather than finite differences
+    bool camera_lod_ = false; // If cells further from the camera get fewer bricks
+    float lod_pixels_per_voxel_ = 2.f; // Cells are coarsened while their voxels cover fewer pixels than this
+    bool grid_simple_texture_ = true; // If the Simple method's texture only visits the particles around each voxel's cell
+    int narrow_band_voxels_ = 0; // Voxels past the surface cells the grid texture is exact within, flooded beyond, 0 for everywhere
+    bool distance_pyramid_ = true; // If rays skip the empty space a pyramid of the Simple method's texture's lowest distances shows
+    int marching_mode_ = MarchingSphere; // How rays step through the SDF, see CPUBackend/SphereTracing.h
+    bool adaptive_threshold_ = false; // If rays hit once the surface is within a pixel's footprint, rather than a fixed distance
+    bool step_counts_ = false; // If each pixel shows the SDF samples its ray took, read back for a histogram
 };
 
 class HonoursApplication : public DXSample
@@ -25,7 +25,14 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow)
         int num_args;
         LPWSTR* args = CommandLineToArgvW(GetCommandLineW(), &num_args);
         
-        // Command line arguments: (Test name), (particle no.), (texture res), (screen res x), (screen res y), (view distance), (scene), (implementation)
+        // Command line arguments: (Test name), (particle no.), (texture res), (screen res x), (screen res y), (view distance), (scene), (implementation), [particle radius], [cell indexing], [brick bits], [gradient normals], [LOD pixels per voxel], [simple grid], [narrow band]
+        // The particle radius is optional, if left out it's derived from the particle count along with the grid layout
+        // Cell indexing defaults to linear, 1 selects Morton order
+        // Brick bits defaults to 16, 8 selects the quantised brick pool
+        // Gradient normals defaults to 0, finite differences, 1 reads normals from the brick pool's normal channel
+        // LOD pixels per voxel defaults to 0, every cell at full resolution, otherwise cells further from the camera get fewer bricks
+        // Simple grid defaults to 1, the Simple method's texture built from the particles sorted by cell, 0 visits every particle per voxel
+        // Narrow band defaults to 0, every voxel of the Simple method's grid texture exact, otherwise only those within that many voxels of the surface cells
 
         if (num_args > 1) {
             cpu_test_vars_.test_mode_ = true;
@@ -37,6 +44,13 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow)
             cpu_test_vars_.view_dist_ = std::atof(CW2A(args[6]));
             SCENE = (SceneType)_wtoi(args[7]);
             cpu_test_vars_.implementation_ = (ImplementationType)_wtoi(args[8]);
+            PARTICLE_RADIUS = num_args > 9 ? std::atof(CW2A(args[9])) : 0;
+            CELL_INDEXING = num_args > 10 ? (CellIndexing)_wtoi(args[10]) : CellIndexingLinear;
+            cpu_test_vars_.quantised_bricks_ = num_args > 11 && _wtoi(args[11]) == 8;
+            cpu_test_vars_.gradient_normals_ = num_args > 12 && _wtoi(args[12]) == 1;
+            cpu_test_vars_.lod_pixels_per_voxel_ = num_args > 13 ? std::atof(CW2A(args[13])) : 0;
+            cpu_test_vars_.grid_simple_texture_ = num_args > 14 ? _wtoi(args[14]) != 0 : true;
+            cpu_test_vars_.narrow_band_voxels_ = num_args > 15 ? _wtoi(args[15]) : 0;
         }
         else {
             cpu_test_vars_.test_mode_ = false;
@@ -45,11 +59,20 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow)
             cpu_test_vars_.screen_res_[1] = 1080;
             cpu_test_vars_.view_dist_ = 1.5;
             cpu_test_vars_.implementation_ = Complex;
+            cpu_test_vars_.quantised_bricks_ = false;
+            cpu_test_vars_.gradient_normals_ = false;
+            cpu_test_vars_.lod_pixels_per_voxel_ = 0;
+            cpu_test_vars_.grid_simple_texture_ = true;
+            cpu_test_vars_.narrow_band_voxels_ = 0;
             SCENE = SceneWave;
             NUM_PARTICLES = 343;
             TEXTURE_RESOLUTION = 256;
+            PARTICLE_RADIUS = 0;
+            CELL_INDEXING = CellIndexingLinear;
         }
 
+        DeriveGridValues(test_vars_);
+
         HonoursApplication sample(cpu_test_vars_.screen_res_[0], cpu_test_vars_.screen_res_[1], L"Honours");
         return Win32Application::Run(&sample, hInstance, nCmdShow);
     }
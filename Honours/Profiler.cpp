@@ -107,6 +107,19 @@ void Profiler::UpdateCurrentAABBsSize(UINT64 size)
     ProfilerGlobal::current_aabbs_size_ = size;
 }
 
+void Profiler::UpdateCurrentCapacityStats(UINT reallocations, UINT64 wasted_size)
+{
+    ProfilerGlobal::current_reallocations_count_ = reallocations;
+    ProfilerGlobal::current_wasted_capacity_size_ = wasted_size;
+}
+
+void Profiler::UpdateCurrentBrickCounts(UINT bricks, UINT culled_bricks, UINT recomputed_bricks)
+{
+    ProfilerGlobal::current_bricks_count_ = bricks;
+    ProfilerGlobal::current_culled_bricks_count_ = culled_bricks;
+    ProfilerGlobal::current_recomputed_bricks_count_ = recomputed_bricks;
+}
+
 nv::perf::ReportDefinition Profiler::GetCustomReportDefinition()
 {
     static const char* const RequiredCounters[] = {
@@ -20,6 +20,14 @@ namespace ProfilerGlobal {
 	static UINT64 current_brickpool_size_;
 	static UINT64 current_blas_size_;
 	static UINT64 current_aabbs_size_;
+	static UINT64 current_wasted_capacity_size_;
+	static UINT64 current_reallocations_count_;
+
+	// count name -> per frame count, for the brick culling
+	static std::map<std::string, double> brick_count_results_;
+	static UINT current_bricks_count_;
+	static UINT current_culled_bricks_count_;
+	static UINT current_recomputed_bricks_count_;
 	
 	static int remaining_captures_;
 }
@@ -46,6 +54,8 @@ public:
 	static void UpdateCurrentBrickPoolSize(UINT64 size);
 	static void UpdateCurrentBLASSize(UINT64 size);
 	static void UpdateCurrentAABBsSize(UINT64 size);
+	static void UpdateCurrentCapacityStats(UINT reallocations, UINT64 wasted_size);
+	static void UpdateCurrentBrickCounts(UINT bricks, UINT culled_bricks, UINT recomputed_bricks);
 
 
 	static nv::perf::ReportDefinition GetCustomReportDefinition();
@@ -80,6 +80,101 @@ bool RayAABBIntersectionTest(Ray ray, float3 aabb[2], out float tmin, out float
     return tmax > tmin && tmax >= RayTMin() && tmin <= RayTCurrent();
 }
 
+// Works out the coords of the voxel within the brick pool from the brick index
+uint3 BrickIndexToVoxelPosition(uint brick_index)
+{
+    // Convert brick index to its (bx, by, bz) brick coordinates
+    uint3 brick_pool_dimensions = comp_constant_buffer_.brick_pool_dimensions_;
+    
+    uint bricks_per_z = brick_pool_dimensions.x * brick_pool_dimensions.y;
+    uint bz = brick_index / bricks_per_z;
+    uint by = (brick_index % bricks_per_z) / brick_pool_dimensions.x;
+    uint bx = brick_index % brick_pool_dimensions.x;
+    
+    // Compute the voxel position
+    uint x = bx;
+    uint y = by;
+    uint z = bz;
+    
+    // Turn this into an index
+    return uint3(x, y, z);
+}
+
+// Work out the uvw within the brick pool using the current brick index (looked up from the primitive index) 
+// and the coords of the voxel within the brick
+float3 BrickIndexToBrickPoolUVW(float3 voxel_offset)
+{
+    float3 uvw = (voxel_offset / VOXELS_PER_AXIS_PER_BRICK) + BrickIndexToVoxelPosition(brick_indices_[PrimitiveIndex()]);
+                    
+    uvw /= (float3) comp_constant_buffer_.brick_pool_dimensions_;
+    
+    return uvw;
+}
+
+// Where the SDF is sampled a distance t along the ray: the uvw within the brick pool through a brick's AABB, the uvw within
+// the Simple method's texture through its AABB, or the world position for the analytical SDF
+float3 GetSamplePosition(Ray ray, float t, float3 brick_size)
+{
+    float3 position = clamp(ray.origin_ + max(t, 0) * ray.direction_, WORLD_MIN, WORLD_MAX);
+
+    // If we are using the complex AABBs and brick pool
+    if (!(rt_constant_buffer_.rendering_flags_ & RENDERING_FLAG_SIMPLE_AABB) &&
+        !(rt_constant_buffer_.rendering_flags_ & RENDERING_FLAG_ANALYTICAL))
+    {
+        // Find voxel offset from position within the brick
+        float3 voxel_offset = (position / brick_size) * CORE_VOXELS_PER_AXIS_PER_BRICK;
+
+        // voxel offset is offset by (1,1,1) to account for adjacency voxels
+        return BrickIndexToBrickPoolUVW(voxel_offset + 1.f);
+    }
+    else if (!(rt_constant_buffer_.rendering_flags_ & RENDERING_FLAG_ANALYTICAL))
+    {
+        // We are using the simple SDF 3D texture
+        return position / WORLD_MAX;
+    }
+    return position;
+}
+
+// How near the surface a sample at t along the ray counts as a hit. With the adaptive threshold, that's the pixel's
+// footprint there, as CPUBackend/SphereTracing.h's GetMarchingThreshold.
+float GetMarchingThreshold(float t)
+{
+    if ((rt_constant_buffer_.rendering_flags_ & RENDERING_FLAG_ADAPTIVE_THRESHOLD) && rt_constant_buffer_.pixel_radius_ > 0)
+    {
+        return t * rt_constant_buffer_.pixel_radius_;
+    }
+    return SPHERE_TRACING_THRESHOLD;
+}
+
+// How much further than the distance sampled the next step goes, as CPUBackend/SphereTracing.h's GetRelaxation. Relaxed
+// cone stepping goes to where the slope between the last two samples reaches the surface, up to 2x the distance.
+float GetRelaxation(float distance, float previous_distance, float step)
+{
+    if (rt_constant_buffer_.rendering_flags_ & RENDERING_FLAG_OVER_RELAXED)
+    {
+        return OVER_RELAXATION;
+    }
+    float slope = step > 0 ? (distance - previous_distance) / step : -1;
+    return slope < -1.f / RELAXED_CONE_MAX_RELAXATION ? max(-1.f / slope, 1.f) : RELAXED_CONE_MAX_RELAXATION;
+}
+
+// Adds the SDF samples taken through an AABB to the pixel's count, which ray generation zeroes
+void AddStepCount(uint steps)
+{
+    if (rt_constant_buffer_.rendering_flags_ & RENDERING_FLAG_STEP_COUNTS)
+    {
+        uint2 pixel = DispatchRaysIndex().xy;
+        InterlockedAdd(step_counts_[(pixel.y * DispatchRaysDimensions().x) + pixel.x], steps);
+    }
+}
+
+// Heat map of a pixel's step count, on a log2 scale from blue at 1 step through green to red at MAX_SPHERE_TRACING_STEPS
+float4 GetStepCountColour(uint steps)
+{
+    float heat = saturate(log2((float) max(steps, 1u)) / log2((float) MAX_SPHERE_TRACING_STEPS));
+    return float4(saturate((2 * heat) - 1), 1 - abs((2 * heat) - 1), saturate(1 - (2 * heat)), 1);
+}
+
 bool RenderParticlesVisualized()
 {
     float aspect_ratio = (float)DispatchRaysDimensions().x / (float)DispatchRaysDimensions().y;    
@@ -3,6 +3,7 @@
 #include "HonoursApplication.h"
 #include "Utilities.h"
 #include "UploadBuffer.h"
+#include <algorithm>
 #include <dxcapi.h>
 #include <fstream>
 #include <sstream>
@@ -52,17 +53,25 @@ void RayTracer::RayTracing(Profiler* profiler)
     commandList->SetComputeRootConstantBufferView(GlobalRTRootSignatureParams::RTConstantBufferSlot, ray_tracing_cb_->Resource()->GetGPUVirtualAddress());
     commandList->SetComputeRootConstantBufferView(GlobalRTRootSignatureParams::TestValuesSlot, computer_->GetTestValsBuffer()->Resource()->GetGPUVirtualAddress());
     commandList->SetComputeRootConstantBufferView(GlobalRTRootSignatureParams::CompConstantBufferSlot, computer_->GetConstantBuffer()->Resource()->GetGPUVirtualAddress());
+    commandList->SetComputeRootShaderResourceView(GlobalRTRootSignatureParams::DistancePyramidSlot, computer_->GetDistancePyramidBuffer()->GetGPUVirtualAddress()); // Only read through the Simple method's texture
+    commandList->SetComputeRootUnorderedAccessView(GlobalRTRootSignatureParams::StepCountsSlot, step_counts_buffer_->GetGPUVirtualAddress());
 
     auto& debug_values = application_->GetDebugValues();
     if ((debug_values.use_simple_aabb_ || debug_values.visualize_particles_) && !(debug_values.visualize_particles_ && debug_values.visualize_aabbs_)) {
         // Naive and simple methods use the simple AABB and acceleration structure, and simple texture (naive doesnt access this)
         commandList->SetComputeRootShaderResourceView(GlobalRTRootSignatureParams::AccelerationStructureSlot, top_simple_acceleration_structure->GetGPUVirtualAddress());
         commandList->SetComputeRootShaderResourceView(GlobalRTRootSignatureParams::AABBBufferSlot, simple_aabb_buffer_->GetGPUVirtualAddress());
+        commandList->SetComputeRootShaderResourceView(GlobalRTRootSignatureParams::BrickIndicesSlot, simple_aabb_buffer_->GetGPUVirtualAddress()); // Not read without the brick pool
+        commandList->SetComputeRootShaderResourceView(GlobalRTRootSignatureParams::BrickRangesSlot, simple_aabb_buffer_->GetGPUVirtualAddress());
+        commandList->SetComputeRootDescriptorTable(GlobalRTRootSignatureParams::NormalTextureSlot, computer_->GetBrickNormalTextureHandle());
         commandList->SetComputeRootDescriptorTable(GlobalRTRootSignatureParams::SDFTextureSlot, computer_->GetSimpleSDFTextureHandle());
     }
     else { // Complex method uses the calculated AABBs and acceleration structure, and brick pool
         commandList->SetComputeRootShaderResourceView(GlobalRTRootSignatureParams::AccelerationStructureSlot, acceleration_structure_->GetTLAS()->GetGPUVirtualAddress());
         commandList->SetComputeRootShaderResourceView(GlobalRTRootSignatureParams::AABBBufferSlot, acceleration_structure_->GetAABBBuffer()->GetGPUVirtualAddress());
+        commandList->SetComputeRootShaderResourceView(GlobalRTRootSignatureParams::BrickIndicesSlot, computer_->GetSurfaceBrickIndicesBuffer()->GetGPUVirtualAddress());
+        commandList->SetComputeRootShaderResourceView(GlobalRTRootSignatureParams::BrickRangesSlot, computer_->GetBrickRangesBuffer()->GetGPUVirtualAddress());
+        commandList->SetComputeRootDescriptorTable(GlobalRTRootSignatureParams::NormalTextureSlot, computer_->GetBrickNormalTextureHandle());
         commandList->SetComputeRootDescriptorTable(GlobalRTRootSignatureParams::SDFTextureSlot, computer_->GetBrickPoolTextureHandle());
     }
 
@@ -91,6 +100,11 @@ void RayTracer::RayTracing(Profiler* profiler)
 
     // Resource barriers
     auto& debug = application_->GetDebugValues();
+    if (debug.step_counts_) { // Read back in ReadBackStepCounts, once the frame's work has finished
+        commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(step_counts_buffer_.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE));
+        commandList->CopyResource(step_counts_readback_buffer_.Get(), step_counts_buffer_.Get());
+        commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(step_counts_buffer_.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+    }
     commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(computer_->GetUnorderedParticlesBuffer(),D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
     if (!(debug.render_analytical_ || debug.visualize_particles_)) {
         if (debug.use_simple_aabb_) {
@@ -117,6 +131,7 @@ void RayTracer::CreateRootSignatures()
     UAVDescriptor.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
     CD3DX12_ROOT_PARAMETER rootParameters[GlobalRTRootSignatureParams::Count];
     rootParameters[GlobalRTRootSignatureParams::OutputViewSlot].InitAsDescriptorTable(1, &UAVDescriptor);
+    rootParameters[GlobalRTRootSignatureParams::StepCountsSlot].InitAsUnorderedAccessView(1);
 
     // (t)
     rootParameters[GlobalRTRootSignatureParams::AccelerationStructureSlot].InitAsShaderResourceView(0);
@@ -125,6 +140,12 @@ void RayTracer::CreateRootSignatures()
     tex_descriptor.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 2);
     rootParameters[GlobalRTRootSignatureParams::SDFTextureSlot].InitAsDescriptorTable(1, &tex_descriptor);
     rootParameters[GlobalRTRootSignatureParams::AABBBufferSlot].InitAsShaderResourceView(3);
+    rootParameters[GlobalRTRootSignatureParams::BrickIndicesSlot].InitAsShaderResourceView(4);
+    rootParameters[GlobalRTRootSignatureParams::BrickRangesSlot].InitAsShaderResourceView(5);
+    CD3DX12_DESCRIPTOR_RANGE normal_tex_descriptor;
+    normal_tex_descriptor.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 6);
+    rootParameters[GlobalRTRootSignatureParams::NormalTextureSlot].InitAsDescriptorTable(1, &normal_tex_descriptor);
+    rootParameters[GlobalRTRootSignatureParams::DistancePyramidSlot].InitAsShaderResourceView(7);
 
     // (b)
     rootParameters[GlobalRTRootSignatureParams::TestValuesSlot].InitAsConstantBufferView(0);
@@ -377,6 +398,58 @@ void RayTracer::CreateRaytracingOutputResource()
     device->CreateUnorderedAccessView(m_raytracingOutput.Get(), nullptr, &UAVDesc, uavDescriptorHandle);
 
     m_raytracingOutputResourceUAVGpuDescriptor = CD3DX12_GPU_DESCRIPTOR_HANDLE(application_->GetDescriptorHeap()->GetGPUDescriptorHandleForHeapStart(), m_raytracingOutputResourceUAVDescriptorHeapIndex, descriptor_size);
+
+    // Step counts, a uint per pixel
+    UINT64 step_counts_size = (UINT64)window_size_.x * (UINT64)window_size_.y * sizeof(UINT);
+    step_counts_buffer_.Reset();
+    step_counts_readback_buffer_.Reset();
+    Utilities::AllocateDefaultBuffer(device, step_counts_size, step_counts_buffer_.GetAddressOf(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    ThrowIfFailed(device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(step_counts_size),
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(&step_counts_readback_buffer_)));
+    step_counts_buffer_->SetName(L"StepCounts");
+    step_counts_readback_buffer_->SetName(L"StepCountsReadback");
+    Profiler::RegisterResource("StepCountsBuffer", step_counts_size);
+    Profiler::RegisterResource("StepCountsReadbackBuffer", step_counts_size);
+}
+
+// Summarises the step counts copied back by the last RayTracing, which must have finished. The histogram bins rays by
+// the power of 2 of their steps, as CPUBackend/SphereTracing.h's GetStepHistogram does.
+void RayTracer::ReadBackStepCounts()
+{
+    const size_t pixels = (size_t)window_size_.x * (size_t)window_size_.y;
+    UINT* mapped_data = nullptr;
+    ThrowIfFailed(step_counts_readback_buffer_->Map(0, nullptr, reinterpret_cast<void**>(&mapped_data)));
+    std::vector<UINT> steps(mapped_data, mapped_data + pixels);
+    step_counts_readback_buffer_->Unmap(0, nullptr);
+
+    StepCountStats stats;
+    UINT64 sum = 0, traced = 0, bins[STEP_HISTOGRAM_BINS] = {};
+    for (UINT pixel_steps : steps) {
+        sum += pixel_steps;
+        if (pixel_steps > 0) {
+            traced++;
+            int bin = 0;
+            while (bin < STEP_HISTOGRAM_BINS - 1 && (pixel_steps >> (bin + 1)) > 0) {
+                bin++;
+            }
+            bins[bin]++;
+        }
+    }
+    if (!steps.empty()) {
+        stats.mean_ = (float)((double)sum / steps.size());
+        stats.max_ = *std::max_element(steps.begin(), steps.end());
+        std::nth_element(steps.begin(), steps.begin() + steps.size() * 99 / 100, steps.end());
+        stats.p99_ = steps[steps.size() * 99 / 100];
+    }
+    for (int bin = 0; bin < STEP_HISTOGRAM_BINS; bin++) {
+        stats.bins_[bin] = traced ? (float)bins[bin] / traced : 0.f;
+    }
+    step_count_stats_ = stats;
 }
 
 // Compile a HLSL file into a DXIL library - from NVIDIA
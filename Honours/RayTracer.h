@@ -15,6 +15,11 @@ namespace GlobalRTRootSignatureParams {
         ParticlePositionsBufferSlot,
         SDFTextureSlot,
         AABBBufferSlot,
+        BrickIndicesSlot,
+        BrickRangesSlot,
+        NormalTextureSlot,
+        DistancePyramidSlot,
+        StepCountsSlot,
         TestValuesSlot,
         Count
     };
@@ -24,6 +29,14 @@ using Microsoft::WRL::ComPtr;
 
 class HonoursApplication;
 
+// SDF samples the last frame's rays took, read back when RENDERING_FLAG_STEP_COUNTS is set
+struct StepCountStats {
+    float mean_ = 0;
+    UINT p99_ = 0;
+    UINT max_ = 0;
+    float bins_[STEP_HISTOGRAM_BINS] = {}; // Fraction of the rays that took any taking 1, 2-3, 4-7, ... steps
+};
+
 class RayTracer
 {
 public:
@@ -32,10 +45,12 @@ public:
     void RayTracing(Profiler* profiler);
 
     void CreateRaytracingOutputResource();
+    void ReadBackStepCounts();
 
     inline AccelerationStructureManager* GetAccelerationStructure() { return acceleration_structure_.get(); }
     inline UploadBuffer<RayTracingCB>* GetRaytracingCB() { return ray_tracing_cb_.get(); }
     inline ID3D12Resource* GetRaytracingOutput() { return m_raytracingOutput.Get(); }
+    inline const StepCountStats& GetStepCountStats() { return step_count_stats_; }
     inline void ReleaseUploaders() { aabb_buffer_uploader_.Reset(); }
 
 	static void CheckRayTracingSupport(ID3D12Device5* device);
@@ -68,6 +83,11 @@ private:
     UINT m_raytracingOutputResourceUAVDescriptorHeapIndex = -1;
     XMFLOAT2 window_size_;
 
+    // Per pixel step counts
+    ComPtr<ID3D12Resource> step_counts_buffer_;
+    ComPtr<ID3D12Resource> step_counts_readback_buffer_;
+    StepCountStats step_count_stats_;
+
     // Shader tables
     static const wchar_t* hit_group_name_;
     static const wchar_t* ray_gen_shader_name_;
@@ -4,35 +4,23 @@
 #include "RayHelpers.hlsli"
 #include "SdfHelpers.hlsli"
 
-// Works out the coords of the voxel within the brick pool from the brick index
-uint3 BrickIndexToVoxelPosition(uint brick_index)
+// Where the ray leaves the coarsest texel of the distance pyramid around the uvw with no hit in it, or 0 if even the finest
+// could have one. Texels are never below the ones within them, so it descends from the coarsest. See CPUBackend/DistancePyramid.h.
+float GetDistancePyramidSkip(Ray ray, float3 uvw)
 {
-    // Convert brick index to its (bx, by, bz) brick coordinates
-    uint3 brick_pool_dimensions = comp_constant_buffer_.brick_pool_dimensions_;
-    
-    uint bricks_per_z = brick_pool_dimensions.x * brick_pool_dimensions.y;
-    uint bz = brick_index / bricks_per_z;
-    uint by = (brick_index % bricks_per_z) / brick_pool_dimensions.x;
-    uint bx = brick_index % brick_pool_dimensions.x;
-    
-    // Compute the voxel position
-    uint x = bx;
-    uint y = by;
-    uint z = bz;
-    
-    // Turn this into an index
-    return uint3(x, y, z);
-}
-
-// Work out the uvw within the brick pool using the current brick index (primitive index) 
-// and the coords of the voxel within the brick
-float3 BrickIndexToBrickPoolUVW(float3 voxel_offset)
-{
-    float3 uvw = (voxel_offset / VOXELS_PER_AXIS_PER_BRICK) + BrickIndexToVoxelPosition(PrimitiveIndex());
-                    
-    uvw /= (float3) comp_constant_buffer_.brick_pool_dimensions_;
-    
-    return uvw;
+    for (uint level = DISTANCE_PYRAMID_LEVELS; level >= 1; level--)
+    {
+        float texel_size = (float)(1u << level) / TEXTURE_RESOLUTION;
+        uint3 texel = min(uint3(uvw / texel_size), DistancePyramidResolution(level) - 1);
+        if (distance_pyramid_[DistancePyramidIndex(level, texel)] > SPHERE_TRACING_THRESHOLD)
+        {
+            // The faces of the texel the ray leaves through
+            float3 faces = min((texel + uint3(ray.direction_ > 0)) * texel_size, 1.f) * WORLD_MAX;
+            float3 t_faces = select(ray.direction_ != 0, (faces - ray.origin_) / ray.direction_, 1e30f);
+            return min(t_faces.x, min(t_faces.y, t_faces.z));
+        }
+    }
+    return 0;
 }
 
 
@@ -45,10 +33,19 @@ void RayGenerationShader()
 
     // Generate ray from camera into the scene
 	GenerateCameraRay(DispatchRaysIndex().xy, ray.origin_, ray.direction_);
+
+    // The intersection shader adds to the pixel's step count for each AABB it traces
+    uint2 pixel = DispatchRaysIndex().xy;
+    uint pixel_index = (pixel.y * DispatchRaysDimensions().x) + pixel.x;
+    bool step_counts = (rt_constant_buffer_.rendering_flags_ & RENDERING_FLAG_STEP_COUNTS) != 0;
+    if (step_counts)
+    {
+        step_counts_[pixel_index] = 0;
+    }
 	RayPayload payload = TracePrimaryRay(ray, 0);
 
-    // Write the raytraced color to the output texture.
-	render_target_[DispatchRaysIndex().xy] = payload.colour_;
+    // Write the raytraced color, or the step count heat map, to the output texture.
+	render_target_[pixel] = step_counts ? GetStepCountColour(step_counts_[pixel_index]) : payload.colour_;
 }
 
 
@@ -70,6 +67,7 @@ void IntersectionShader()
     else
     {
         float3 aabb[2] = { AABBs_[PrimitiveIndex()].min_, AABBs_[PrimitiveIndex()].max_ };
+        float3 brick_size = aabb[1] - aabb[0]; // Bricks of cells further from the camera cover more, see CSSelectCellLods
         
         // Construct ray, translated to origin
         Ray ray;
@@ -85,7 +83,7 @@ void IntersectionShader()
             {
                 ray.origin_ -= aabb[0];                   
                 float3 aabb_uvw = ray.origin_ + max(t_min, 0) * ray.direction_;
-                aabb_uvw /= BRICK_SIZE;
+                aabb_uvw /= brick_size;
                 
                 RayIntersectionAttributes attributes;
                 attributes.float_3_ = aabb_uvw;
@@ -102,51 +100,93 @@ void IntersectionShader()
                 ray.origin_ -= aabb[0];
             }
             
-            // Perform sphere tracing through the AABB.
+            // Perform sphere tracing through the AABB. Relaxed marching steps further than the distance sampled, which is
+            // only safe while the spheres either side of a step overlap, see CPUBackend/SphereTracing.h.
+            uint flags = rt_constant_buffer_.rendering_flags_;
+            bool relaxed = (flags & (RENDERING_FLAG_OVER_RELAXED | RENDERING_FLAG_RELAXED_CONE)) != 0; // Over-relaxed steps stop once one passes the surface
+            float previous_distance = 0;
+            float step = 0;
             float3 position;
-            float3 voxel_offset = float3(0,0,0);
+            bool hit = false;
             uint i = 0;
-            while (i++ < MAX_SPHERE_TRACING_STEPS && t_min <= t_max)
+            while (i < MAX_SPHERE_TRACING_STEPS && t_min <= t_max)
             {
-                position = clamp(ray.origin_ + max(t_min, 0) * ray.direction_, WORLD_MIN, WORLD_MAX);
-                
-                // If we are using the complex AABBs and brick pool
-                if (!(rt_constant_buffer_.rendering_flags_ & RENDERING_FLAG_SIMPLE_AABB) &&
-                    !(rt_constant_buffer_.rendering_flags_ & RENDERING_FLAG_ANALYTICAL))
-                {
-                    // Find voxel offset from position within the brick
-                    position /= BRICK_SIZE;
-                    voxel_offset = position * CORE_VOXELS_PER_AXIS_PER_BRICK;
-                    
-                    // position variable is now the uvw to sample the brick pool
-                    position = BrickIndexToBrickPoolUVW(voxel_offset + 1.f); // voxel offset is offset by (1,1,1) to account for adjacency voxels
-
-                }
-                else if (!(rt_constant_buffer_.rendering_flags_ & RENDERING_FLAG_ANALYTICAL))
-                {
-                    // We are using the simple SDF 3D texture
-                    
-                    // position variable is now the uvw to sample the texture
-                    position /= WORLD_MAX;               
-                }
+                i++;
+                position = GetSamplePosition(ray, t_min, brick_size);
                
                 // Get the SDF value for the current position
                 float distance = GetDistance(position);
+                float threshold = GetMarchingThreshold(t_min);
 
-                // Has the ray intersected the isosurface? 
-                if (distance <= SPHERE_TRACING_THRESHOLD)
+                // Only a step further than the distance before it can have passed the surface
+                if (step > previous_distance)
                 {
-                    // Store the normal and report hit                    
-                    RayIntersectionAttributes attributes;
-                    attributes.float_3_ = CalculateNormal(position);     
+                    if ((flags & RENDERING_FLAG_RELAXED_CONE) && distance < -threshold)
+                    {
+                        // Inside, so the surface was passed. Halve the step towards it, as relaxed cone stepping's binary search.
+                        float outside = t_min - step;
+                        for (uint j = 0; j < RELAXED_CONE_SEARCH_STEPS && i < MAX_SPHERE_TRACING_STEPS; j++)
+                        {
+                            i++;
+                            float middle = 0.5f * (outside + t_min);
+                            if (GetDistance(GetSamplePosition(ray, middle, brick_size)) > GetMarchingThreshold(middle))
+                            {
+                                outside = middle;
+                            }
+                            else
+                            {
+                                t_min = middle;
+                            }
+                        }
+                        position = GetSamplePosition(ray, t_min, brick_size);
+                        hit = true;
+                        break;
+                    }
+                    if ((flags & RENDERING_FLAG_OVER_RELAXED) && distance + previous_distance < step)
+                    {
+                        // The spheres either side don't overlap, so the surface could be between them. Take the plain step
+                        // instead, which over-relaxed rays keep to from then on.
+                        t_min += previous_distance - step;
+                        step = previous_distance;
+                        relaxed = false;
+                        continue;
+                    }
+                }
 
-                    ReportHit(max(t_min, RayTMin()), 0, attributes);
-                    return;
+                // Has the ray intersected the isosurface? 
+                if (distance <= threshold)
+                {
+                    hit = true;
+                    break;
                 }
 
                 // Since distance is the minimum distance to the primitive, 
                 // we can safely jump by that amount without intersecting the primitive.
-                t_min += distance;
+                step = relaxed ? distance * GetRelaxation(distance, previous_distance, step) : distance;
+                previous_distance = distance;
+                t_min += step;
+                
+                // Through the simple texture, the distance pyramid can show there's nothing to hit for further than that.
+                // The skip is never past the surface, so the next step isn't checked for passing it.
+                if (comp_constant_buffer_.distance_pyramid_ && (flags & RENDERING_FLAG_SIMPLE_AABB) && !(flags & RENDERING_FLAG_ANALYTICAL))
+                {
+                    float skip = GetDistancePyramidSkip(ray, position);
+                    if (skip > t_min)
+                    {
+                        t_min = skip;
+                        step = 0;
+                    }
+                }
+            }
+            AddStepCount(i);
+
+            if (hit)
+            {
+                // Store the normal and report hit                    
+                RayIntersectionAttributes attributes;
+                attributes.float_3_ = CalculateNormal(position);     
+
+                ReportHit(max(t_min, RayTMin()), 0, attributes);
             }
         }
     }
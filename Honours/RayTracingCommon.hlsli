@@ -5,7 +5,9 @@
 
 #define MAX_RECURSION_DEPTH 1 // Primary rays
 #define MAX_SPHERE_TRACING_STEPS 512
-#define SPHERE_TRACING_THRESHOLD 0.001f
+#define OVER_RELAXATION 1.6f
+#define RELAXED_CONE_MAX_RELAXATION 2.f
+#define RELAXED_CONE_SEARCH_STEPS 6
 
 // Rendering flags
 #define RENDERING_FLAG_NONE                     0
@@ -14,6 +16,11 @@
 #define RENDERING_FLAG_NORMALS                  1 << 2
 #define RENDERING_FLAG_VISUALIZE_AABBS          1 << 3
 #define RENDERING_FLAG_SIMPLE_AABB              1 << 4
+#define RENDERING_FLAG_GRADIENT_NORMALS         1 << 5
+#define RENDERING_FLAG_OVER_RELAXED             1 << 6
+#define RENDERING_FLAG_RELAXED_CONE             1 << 7
+#define RENDERING_FLAG_ADAPTIVE_THRESHOLD       1 << 8
+#define RENDERING_FLAG_STEP_COUNTS              1 << 9
 
 struct Ray
 {
@@ -36,7 +43,7 @@ struct RayTracingCB
     float4x4 view_proj_;
     float4x4 inv_view_proj_;
     float3 camera_pos_;
-    float padding_;
+    float pixel_radius_; // Of a pixel's footprint a unit from the camera, for the adaptive threshold
     float3 camera_lookat_;    
     uint rendering_flags_;
 };
@@ -47,7 +54,12 @@ RaytracingAccelerationStructure scene_ : register(t0);
 StructuredBuffer<ParticleData> particles_ : register(t1);
 Texture3D<snorm float> sdf_texture_ : register(t2);
 StructuredBuffer<AABB> AABBs_ : register(t3);
+StructuredBuffer<uint> brick_indices_ : register(t4); // Brick pool index of each AABB, as empty bricks are culled
+StructuredBuffer<BrickRange> brick_ranges_ : register(t5); // Range of each brick pool slot, when bricks are 8-bit
+Texture3D<snorm float4> normal_texture_ : register(t6); // The brick pool's normal channel, when the fill stores normals
+StructuredBuffer<float> distance_pyramid_ : register(t7); // Over the Simple method's texture, when it's built
 RWTexture2D<float4> render_target_ : register(u0);
+RWStructuredBuffer<uint> step_counts_ : register(u1); // Per pixel, SDF samples its ray took, when RENDERING_FLAG_STEP_COUNTS
 ConstantBuffer<RayTracingCB> rt_constant_buffer_ : register(b1);
 ConstantBuffer<ComputeCB> comp_constant_buffer_ : register(b2);
 SamplerState linear_sampler_ : register(s0);
@@ -11,6 +11,20 @@
 #define RENDERING_FLAG_NORMALS                  1 << 2
 #define RENDERING_FLAG_VISUALIZE_AABBS          1 << 3
 #define RENDERING_FLAG_SIMPLE_AABB              1 << 4
+#define RENDERING_FLAG_GRADIENT_NORMALS         1 << 5
+#define RENDERING_FLAG_OVER_RELAXED             1 << 6
+#define RENDERING_FLAG_RELAXED_CONE             1 << 7
+#define RENDERING_FLAG_ADAPTIVE_THRESHOLD       1 << 8
+#define RENDERING_FLAG_STEP_COUNTS              1 << 9
+
+#define STEP_HISTOGRAM_BINS 10 // Of rays taking 1, 2-3, 4-7, ... steps
+
+// Ways the intersection shader can step along rays, see CPUBackend/SphereTracing.h
+enum MarchingMode {
+    MarchingSphere,
+    MarchingOverRelaxed,
+    MarchingRelaxedCone
+};
 
 using namespace DirectX;
 
@@ -28,7 +42,7 @@ struct RayTracingCB {
     XMMATRIX view_proj_;
     XMMATRIX inv_view_proj_;
 	XMFLOAT3 camera_pos_;
-    float padding_;
+    float pixel_radius_; // Of a pixel's footprint a unit from the camera, for the adaptive threshold
 	XMFLOAT3 camera_lookat_;
     UINT rendering_flags_ = 0;
 };
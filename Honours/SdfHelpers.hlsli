@@ -21,11 +21,26 @@ float SmoothMin(float a, float b, float r)
     return min(a, b) - e * e * 0.25f / r;
 }
 
+// SmoothMin, also blending the gradients of a and b by how much each contributes, so normals don't need finite differences
+float SmoothMinGradient(float a, float3 gradient_a, float b, float3 gradient_b, float r, out float3 gradient)
+{
+    float e = max(r - abs(a - b), 0.0f);
+    float h = e * 0.5f / r; // Weight of the larger of the two
+    gradient = (a < b) ? lerp(gradient_a, gradient_b, h) : lerp(gradient_b, gradient_a, h);
+    return min(a, b) - e * e * 0.25f / r;
+}
+
 float GetDistanceToSphere(float3 displacement, float radius)
 {
     return length(displacement) - radius;
 }
 
+// Gradient of GetDistanceToSphere at the position, pointing away from the sphere's centre
+float3 GetSphereGradient(float3 displacement)
+{
+    return -displacement / max(length(displacement), 1e-8f);
+}
+
 // Naively calculate SDF value using every particle
 float GetAnalyticalSignedDistance(float3 position)
 {
@@ -41,6 +56,22 @@ float GetAnalyticalSignedDistance(float3 position)
     return distance;
 }
 
+// As GetAnalyticalSignedDistance, along with the gradient, in one pass over the particles
+float GetAnalyticalSignedDistanceGradient(float3 position, out float3 gradient)
+{
+    float distance = 1000;
+    gradient = float3(0, 0, 0);
+    
+    for (int x = 0; x < NUM_PARTICLES; x++)
+    {
+        float3 displacement = particles_[x].position_ - position;
+        float distance1 = GetDistanceToSphere(displacement, PARTICLE_RADIUS);
+        distance = SmoothMinGradient(distance, gradient, distance1, GetSphereGradient(displacement), PARTICLE_RADIUS, gradient);
+    }
+    
+    return distance;
+}
+
 #ifndef COMPUTE_TEX_HLSL
 
 // Get the SDF value for current position. Either samples a texture or calculates naively
@@ -54,13 +85,36 @@ float GetDistance(float3 position)
     else
     {
         // Sample the distance from the SDF texture
-        return sdf_texture_.SampleLevel(linear_sampler_, position, 0);
+        float distance = sdf_texture_.SampleLevel(linear_sampler_, position, 0);
+
+        // 8-bit bricks are stored relative to the brick's range
+        if (comp_constant_buffer_.quantised_bricks_ && !(rt_constant_buffer_.rendering_flags_ & RENDERING_FLAG_SIMPLE_AABB))
+        {
+            BrickRange range = brick_ranges_[brick_indices_[PrimitiveIndex()]];
+            distance = range.offset_ + (range.scale_ * distance);
+        }
+        return distance;
     }
 }
 
 // https://iquilezles.org/articles/normalsSDF/
 float3 CalculateNormal(float3 position)
 {
+    // The SDF's gradient, from the brick pool's normal channel or alongside the distance analytically, rather than six more distances
+    if (rt_constant_buffer_.rendering_flags_ & RENDERING_FLAG_GRADIENT_NORMALS)
+    {
+        if (rt_constant_buffer_.rendering_flags_ & RENDERING_FLAG_ANALYTICAL)
+        {
+            float3 gradient;
+            GetAnalyticalSignedDistanceGradient(position, gradient);
+            return normalize(gradient);
+        }
+        else if (!(rt_constant_buffer_.rendering_flags_ & RENDERING_FLAG_SIMPLE_AABB))
+        {
+            return normalize(normal_texture_.SampleLevel(linear_sampler_, position, 0).xyz);
+        }
+    }
+
     if (rt_constant_buffer_.rendering_flags_ & RENDERING_FLAG_ANALYTICAL)
     {
         // Using analytical method
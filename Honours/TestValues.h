@@ -1,10 +1,22 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
 #include <string>
 
 // Fixed values
 #define VOXELS_PER_AXIS_PER_BRICK 10
-#define NUM_CELLS 4096 
-#define NUM_BLOCKS 64
+#define CORE_VOXELS_PER_AXIS_PER_BRICK 8
+
+// Two-level grid layout, mirrors GlobalValues.hlsli
+// Blocks stay 4 x 4 x 4 cells as they match the surface cell thread group size, the number of cells scales with the particle radius
+#define NUM_CELLS_PER_AXIS_PER_BLOCK 4
+#define NUM_CELLS_PER_BLOCK 64
+#define CELL_MAX_PARTICLE_COUNT 8
+
+// Largest particle radius used, and the grid resolution limits it's derived against
+#define MAX_PARTICLE_RADIUS 0.03125f
+#define MIN_CELLS_PER_AXIS NUM_CELLS_PER_AXIS_PER_BLOCK
+#define MAX_CELLS_PER_AXIS 128
 
 // Custom values
 enum SceneType {
@@ -14,17 +26,95 @@ enum SceneType {
 	SceneNormals
 };
 
+// Order of cells in the cell count, offset and surface buffers
+enum CellIndexing {
+	CellIndexingLinear = 0, // Row-major, x then y then z
+	CellIndexingMorton      // Z-order, so the 27 neighbouring cells are mostly close in memory
+};
+
+// Uploaded as a constant buffer, so keep to 4 byte scalars to match HLSL packing
 struct TestVariables {
 	int num_particles_;
 	int texture_res_;
 	SceneType scene_;
+	float particle_radius_;
+
+	// Derived from the above by DeriveGridValues
+	int cells_per_axis_;
+	int blocks_per_axis_;
+	int num_cells_;
+	int num_blocks_;
+
+	CellIndexing cell_indexing_;
 };
 extern TestVariables test_vars_;
 
 #define NUM_PARTICLES test_vars_.num_particles_
 #define TEXTURE_RESOLUTION test_vars_.texture_res_
 #define SCENE test_vars_.scene_
-#define BRICKS_PER_CELL ((TEXTURE_RESOLUTION / 128) * (TEXTURE_RESOLUTION / 128) * (TEXTURE_RESOLUTION / 128))
+#define PARTICLE_RADIUS test_vars_.particle_radius_
+#define PARTICLE_INFLUENCE_RADIUS (PARTICLE_RADIUS * 2)
+#define NUM_CELLS_PER_AXIS test_vars_.cells_per_axis_
+#define NUM_BLOCKS_PER_AXIS test_vars_.blocks_per_axis_
+#define NUM_CELLS test_vars_.num_cells_
+#define NUM_BLOCKS test_vars_.num_blocks_
+#define CELL_INDEXING test_vars_.cell_indexing_
+
+// Bricks are 8 core voxels wide, so as many fit along a cell as keeps roughly the requested texture resolution
+// (std::min/max are parenthesised throughout to dodge the windows.h macros)
+inline int BricksPerAxisPerCell(const TestVariables& vars)
+{
+	return (std::max)(vars.texture_res_ / (vars.cells_per_axis_ * CORE_VOXELS_PER_AXIS_PER_BRICK), 1);
+}
+#define BRICKS_PER_AXIS_PER_CELL BricksPerAxisPerCell(test_vars_)
+#define BRICKS_PER_CELL (BRICKS_PER_AXIS_PER_CELL * BRICKS_PER_AXIS_PER_CELL * BRICKS_PER_AXIS_PER_CELL)
+
+// Camera-distance level of detail, mirrors GlobalValues.hlsli. Each level halves the bricks along each axis of a cell,
+// doubling their voxels' spacing, so levels 0 to 2 give cells of 64, 8 or 1 bricks at 4 bricks per axis.
+#define MAX_BRICK_LODS 3
+inline int BricksPerAxisAtLod(const TestVariables& vars, int lod)
+{
+	return (std::max)(BricksPerAxisPerCell(vars) >> lod, 1);
+}
+
+// Coarsest level that still halves the bricks per axis
+inline int MaxBrickLod(const TestVariables& vars)
+{
+	int lod = 0;
+	while (lod < MAX_BRICK_LODS - 1 && (BricksPerAxisPerCell(vars) >> (lod + 1)) > 0) {
+		lod++;
+	}
+	return lod;
+}
+
+// Works out the particle radius (if not already set) and grid layout from the particle count.
+// Particles shrink once the Grid scene could no longer fit them side by side within the 0.1 - 0.9 clamp of CSPosMain,
+// so cells don't overflow CELL_MAX_PARTICLE_COUNT.
+// Cells must be at least as wide as the influence radius for the 3 x 3 x 3 neighbour search to find every contributing particle,
+// and there must be a whole number of blocks along each axis.
+// Morton indices span the enclosing power of 2 cube, so with Morton indexing num_cells_ is padded to that.
+inline void DeriveGridValues(TestVariables& vars)
+{
+	if (vars.particle_radius_ <= 0) {
+		vars.particle_radius_ = (std::min)(MAX_PARTICLE_RADIUS, 0.4f / std::cbrt((float)(std::max)(vars.num_particles_, 1)));
+	}
+
+	int cells_per_axis = (int)(1.f / (vars.particle_radius_ * 2));
+	cells_per_axis -= cells_per_axis % NUM_CELLS_PER_AXIS_PER_BLOCK;
+	cells_per_axis = std::clamp(cells_per_axis, MIN_CELLS_PER_AXIS, MAX_CELLS_PER_AXIS);
+
+	vars.cells_per_axis_ = cells_per_axis;
+	vars.blocks_per_axis_ = cells_per_axis / NUM_CELLS_PER_AXIS_PER_BLOCK;
+	vars.num_cells_ = cells_per_axis * cells_per_axis * cells_per_axis;
+	if (vars.cell_indexing_ == CellIndexingMorton) {
+		int padded_cells_per_axis = 1;
+		while (padded_cells_per_axis < cells_per_axis) {
+			padded_cells_per_axis *= 2;
+		}
+		vars.num_cells_ = padded_cells_per_axis * padded_cells_per_axis * padded_cells_per_axis;
+	}
+	vars.num_blocks_ = vars.blocks_per_axis_ * vars.blocks_per_axis_ * vars.blocks_per_axis_;
+}
 
 enum ImplementationType {
 	Naive = 0, 
@@ -38,6 +128,11 @@ struct TestVariablesCPUOnly {
 	bool test_mode_;
 	std::string test_name_;
 	ImplementationType implementation_;
+	bool quantised_bricks_;	// If the brick pool is 8-bit
+	bool gradient_normals_;	// If normals come from the SDF's gradient rather than finite differences
+	float lod_pixels_per_voxel_;	// Cells are coarsened while their voxels cover fewer pixels than this, 0 for no camera LOD
+	bool grid_simple_texture_;	// If the Simple method's texture only visits the particles around each voxel's cell
+	int narrow_band_voxels_;	// Voxels past the surface cells the Simple method's grid texture is exact within, 0 for everywhere
 };
 extern TestVariablesCPUOnly cpu_test_vars_;
 
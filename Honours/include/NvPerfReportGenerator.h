@@ -540,6 +540,16 @@ namespace nv { namespace perf {
             ProfilerGlobal::memory_usage_results_["BrickPool"] += ProfilerGlobal::current_brickpool_size_;
             ProfilerGlobal::memory_usage_results_["ComplexBLAS"] += ProfilerGlobal::current_blas_size_;
             ProfilerGlobal::memory_usage_results_["ComplexAABBBuffer"] += ProfilerGlobal::current_aabbs_size_;
+            ProfilerGlobal::memory_usage_results_["WastedCapacity"] += ProfilerGlobal::current_wasted_capacity_size_;
+
+            // Reallocations so far, the last capture's is written out
+            ProfilerGlobal::memory_usage_results_["Reallocations"] = ProfilerGlobal::current_reallocations_count_;
+
+            // Add the brick counts of this frame, averaged at the end
+            ProfilerGlobal::brick_count_results_["Bricks"] += ProfilerGlobal::current_bricks_count_;
+            ProfilerGlobal::brick_count_results_["CulledBricks"] += ProfilerGlobal::current_culled_bricks_count_;
+            ProfilerGlobal::brick_count_results_["TracedBricks"] += ProfilerGlobal::current_bricks_count_ - ProfilerGlobal::current_culled_bricks_count_;
+            ProfilerGlobal::brick_count_results_["RecomputedBricks"] += ProfilerGlobal::current_recomputed_bricks_count_;
         }
 
         inline void WriteCustomCsvReportFiles(NVPW_MetricsEvaluator* pMetricsEvaluator, const ReportLayout& reportLayout, const ReportData& reportData)
@@ -591,6 +601,7 @@ namespace nv { namespace perf {
             ProfilerGlobal::memory_usage_results_["BrickPool"] /= Profiler::GetTotalCaptures();
             ProfilerGlobal::memory_usage_results_["ComplexBLAS"] /= Profiler::GetTotalCaptures();
             ProfilerGlobal::memory_usage_results_["ComplexAABBBuffer"] /= Profiler::GetTotalCaptures();
+            ProfilerGlobal::memory_usage_results_["WastedCapacity"] /= Profiler::GetTotalCaptures();
 
             const std::string mem_filename = nv::perf::utilities::JoinDriectoryAndFileName(reportData.reportDirectoryName, cpu_test_vars_.test_name_ + "_memory.csv");
             FILE* mfp = OpenFile(mem_filename.c_str(), "wt");
@@ -615,6 +626,31 @@ namespace nv { namespace perf {
             fclose(mfp);
 
 
+            // --------- print brick culling csv ------------
+
+            const std::string bricks_filename = nv::perf::utilities::JoinDriectoryAndFileName(reportData.reportDirectoryName, cpu_test_vars_.test_name_ + "_bricks.csv");
+            FILE* bfp = OpenFile(bricks_filename.c_str(), "wt");
+            if (!bfp)
+            {
+                NV_PERF_LOG_ERR(20, "OpenFile failed for file: %s\n", bricks_filename.c_str());
+                return;
+            }
+
+            // print header
+            for (const auto& count : ProfilerGlobal::brick_count_results_)
+            {
+                fprintf(bfp, "\"%s\",", count.first.c_str());
+            }
+            fprintf(bfp, "\n");
+
+            // print per frame averages
+            for (const auto& count : ProfilerGlobal::brick_count_results_)
+            {
+                fprintf(bfp, "%f, ", count.second / Profiler::GetTotalCaptures());
+            }
+            fclose(bfp);
+
+
         }
 
         inline void WriteCsvReportFile(NVPW_MetricsEvaluator* pMetricsEvaluator, const ReportLayout& reportLayout, const ReportData& reportData)